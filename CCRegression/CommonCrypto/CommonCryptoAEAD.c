@@ -0,0 +1,213 @@
+//
+//  CommonCryptoAEAD.c
+//  CommonCrypto
+//
+
+#include "capabilities.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <CommonCrypto/CommonCryptor.h>
+#include <CommonCrypto/CommonCryptorSPI.h>
+#include "CCCryptorTestFuncs.h"
+#include "testbyteBuffer.h"
+#include "testmore.h"
+
+#if (CCAEAD == 0)
+entryPoint(CommonCryptoAEAD,"CommonCrypto ChaCha20-Poly1305 and AES-GCM-SIV Testing")
+#else
+
+static int kTestTestCount = 19;
+
+#define AEAD_LEN (64 * 1024 + 29)
+
+static char *chachaKey = "808182838485868788898a8b8c8d8e8f909192939495969798999a9b9c9d9e9f";
+static char *chachaIV = "070000004041424344454647";
+static char *chachaAData = "50515253c0c1c2c3c4c5c6c7";
+static char *chachaPlain =
+    "4c616469657320616e642047656e746c656d656e206f662074686520636c6173"
+    "73206f66202739393a204966204920636f756c64206f6666657220796f75206f"
+    "6e6c79206f6e652074697020666f7220746865206675747572652c2073756e73"
+    "637265656e20776f756c642062652069742e";
+static char *chachaCipher =
+    "d31a8d34648e60db7b86afbc53ef7ec2a4aded51296e08fea9e2b5a736ee62d6"
+    "3dbea45e8ca9671282fafb69da92728b1a71de0a9e060b2905d6a5b67ecd3b36"
+    "92ddbd7f2d778b8c9803aee328091b58fab324e4fad675945585808b4831d7bc"
+    "3ff4def08e4b7a9de576d26586cec64b6116";
+static char *chachaTag = "1ae10b594f09e26a7e902ecbd0600691";
+
+/* Pieces that split the ChaCha20 blocks and the POLYVAL blocks */
+static const size_t pieces[] = { 1, 63, 4097, 15, 640, 17 };
+
+/*
+ * Encrypt or decrypt through the GCM calls, optionally setting the
+ * GCM-SIV tag first and feeding the text in pieces.  Returns the status
+ * of the final.
+ */
+
+static CCCryptorStatus
+aeadCrypt(CCOperation op, CCMode mode, CCAlgorithm alg, byteBuffer key, byteBuffer iv, byteBuffer adata,
+          const uint8_t *in, size_t len, uint8_t *out, uint8_t *tag, int streamed)
+{
+    CCCryptorRef cref;
+    CCCryptorStatus retval;
+    size_t pos = 0, tagLength = 16;
+    int i = 0;
+
+    if((retval = CCCryptorCreateWithMode(op, mode, alg, ccNoPadding, NULL, key->bytes, key->len, NULL, 0, 0, 0, &cref)) != kCCSuccess) return retval;
+    CCCryptorGCMAddIV(cref, iv->bytes, iv->len);
+    if(mode == kCCModeGCMSIV && op == kCCDecrypt && (retval = CCCryptorGCMSIVSetTag(cref, tag, 16)) != kCCSuccess) goto out;
+    CCCryptorGCMAddAAD(cref, adata->bytes, adata->len);
+    while(pos < len) {
+        size_t n = (streamed) ? pieces[i++ % (sizeof(pieces) / sizeof(pieces[0]))]: len;
+        if(n > len - pos) n = len - pos;
+        if(op == kCCEncrypt) retval = CCCryptorGCMEncrypt(cref, in + pos, n, out + pos);
+        else retval = CCCryptorGCMDecrypt(cref, in + pos, n, out + pos);
+        if(retval != kCCSuccess) goto out;
+        pos += n;
+    }
+    retval = CCCryptorGCMFinal(cref, tag, &tagLength);
+out:
+    CCCryptorRelease(cref);
+    return retval;
+}
+
+/*
+ * A known answer test in both directions.
+ */
+
+static int
+aeadKAT(CCMode mode, CCAlgorithm alg, char *keyStr, char *ivStr, char *aDataStr, char *plainStr, char *cipherStr, char *tagStr)
+{
+    byteBuffer key = hexStringToBytes(keyStr), iv = hexStringToBytes(ivStr), adata = hexStringToBytes(aDataStr);
+    byteBuffer pt = hexStringToBytes(plainStr), ct = hexStringToBytes(cipherStr), expectedTag = hexStringToBytes(tagStr);
+    uint8_t out[256], tag[16];
+    int succeeded = 0;
+
+    if(aeadCrypt(kCCEncrypt, mode, alg, key, iv, adata, pt->bytes, pt->len, out, tag, 0) != kCCSuccess) goto out;
+    if(memcmp(out, ct->bytes, ct->len) || memcmp(tag, expectedTag->bytes, 16)) {
+        diag("FAIL Encrypt Output %s\n", bytesToHexString(bytesToBytes(out, ct->len)));
+        goto out;
+    }
+    memcpy(tag, expectedTag->bytes, 16);
+    if(aeadCrypt(kCCDecrypt, mode, alg, key, iv, adata, ct->bytes, ct->len, out, tag, 0) != kCCSuccess) goto out;
+    succeeded = memcmp(out, pt->bytes, pt->len) == 0 && memcmp(tag, expectedTag->bytes, 16) == 0;
+out:
+    free(key); free(iv); free(adata); free(pt); free(ct); free(expectedTag);
+    return succeeded;
+}
+
+/*
+ * A long message encrypted in one go and in pieces must give the same
+ * ciphertext and tag, and decrypt back in pieces.
+ */
+
+static int
+aeadStreamed(CCMode mode, CCAlgorithm alg, char *keyStr)
+{
+    byteBuffer key = hexStringToBytes(keyStr), iv = hexStringToBytes("000102030405060708090a0b"), adata = hexStringToBytes("feedfacedeadbeef");
+    uint8_t *plain = malloc(AEAD_LEN), *cipher = malloc(AEAD_LEN), *out = malloc(AEAD_LEN);
+    uint8_t tag[16], streamedTag[16];
+    size_t i;
+    int succeeded = 0;
+
+    for(i = 0; i < AEAD_LEN; i++) plain[i] = (uint8_t) (i * 13);
+    if(aeadCrypt(kCCEncrypt, mode, alg, key, iv, adata, plain, AEAD_LEN, cipher, tag, 0) != kCCSuccess) goto out;
+    if(aeadCrypt(kCCEncrypt, mode, alg, key, iv, adata, plain, AEAD_LEN, out, streamedTag, 1) != kCCSuccess) goto out;
+    if(memcmp(cipher, out, AEAD_LEN) || memcmp(tag, streamedTag, 16)) goto out;
+    if(aeadCrypt(kCCDecrypt, mode, alg, key, iv, adata, cipher, AEAD_LEN, out, streamedTag, 1) != kCCSuccess) goto out;
+    succeeded = memcmp(plain, out, AEAD_LEN) == 0 && memcmp(tag, streamedTag, 16) == 0;
+out:
+    free(key); free(iv); free(adata);
+    free(plain); free(cipher); free(out);
+    return succeeded;
+}
+
+int CommonCryptoAEAD(int argc, char *const *argv)
+{
+    byteBuffer key, iv, adata;
+    uint8_t buf[64], tag[16];
+    CCCryptorRef cref;
+    size_t tagLength = 16;
+
+	plan_tests(kTestTestCount);
+
+    /* RFC 8439 2.8.2 */
+    ok(aeadKAT(kCCModeChaCha20Poly1305, kCCAlgorithmChaCha20, chachaKey, chachaIV, chachaAData, chachaPlain, chachaCipher, chachaTag),
+       "ChaCha20-Poly1305 RFC 8439 vector");
+    ok(CCCryptorGCMTestCase(chachaKey, chachaIV, chachaAData, chachaTag, kCCAlgorithmChaCha20, chachaCipher, chachaPlain) == 0,
+       "ChaCha20-Poly1305 through CCCryptorGCM");
+    ok(aeadStreamed(kCCModeGCM, kCCAlgorithmChaCha20, chachaKey),
+       "ChaCha20-Poly1305 streamed, any mode selector");
+    ok(CCCryptorCreateWithMode(kCCEncrypt, kCCModeChaCha20Poly1305, kCCAlgorithmChaCha20, ccNoPadding, NULL, buf, 16, NULL, 0, 0, 0, &cref) == kCCParamError,
+       "ChaCha20 with a 16 byte key");
+
+    /* RFC 8452 C.1 and C.2 */
+    ok(aeadKAT(kCCModeGCMSIV, kCCAlgorithmAES128, "01000000000000000000000000000000", "030000000000000000000000", "",
+               "", "", "dc20e2d83f25705bb49e439eca56de25"), "AES-128-GCM-SIV RFC 8452 empty message");
+    ok(aeadKAT(kCCModeGCMSIV, kCCAlgorithmAES128, "01000000000000000000000000000000", "030000000000000000000000", "",
+               "0100000000000000", "b5d839330ac7b786", "578782fff6013b815b287c22493a364c"), "AES-128-GCM-SIV RFC 8452 vector");
+    ok(aeadKAT(kCCModeGCMSIV, kCCAlgorithmAES128, "0100000000000000000000000000000000000000000000000000000000000000", "030000000000000000000000", "",
+               "0100000000000000", "c2ef328e5c71c83b", "843122130f7364b761e0b97427e3df28"), "AES-256-GCM-SIV RFC 8452 vector");
+    ok(aeadStreamed(kCCModeGCMSIV, kCCAlgorithmAES128, "000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f"), "AES-256-GCM-SIV streamed");
+
+    key = hexStringToBytes("01000000000000000000000000000000");
+    iv = hexStringToBytes("030000000000000000000000");
+    adata = hexStringToBytes("");
+    memcpy(buf, "\xb5\xd8\x39\x33\x0a\xc7\xb7\x86", 8);
+    memcpy(tag, "\x57\x87\x82\xff\xf6\x01\x3b\x81\x5b\x28\x7c\x22\x49\x3a\x36\x4d", 16);
+    ok(aeadCrypt(kCCDecrypt, kCCModeGCMSIV, kCCAlgorithmAES128, key, iv, adata, buf, 8, buf + 16, tag, 0) == kCCDecodeError, "GCM-SIV tag mismatch");
+
+    /* No plaintext before the tag checks out, and none left after it fails */
+    memset(buf + 16, 0xa5, 8);
+    memcpy(tag, "\x57\x87\x82\xff\xf6\x01\x3b\x81\x5b\x28\x7c\x22\x49\x3a\x36\x4d", 16);
+    CCCryptorCreateWithMode(kCCDecrypt, kCCModeGCMSIV, kCCAlgorithmAES128, ccNoPadding, NULL, key->bytes, key->len, NULL, 0, 0, 0, &cref);
+    CCCryptorGCMAddIV(cref, iv->bytes, iv->len);
+    CCCryptorGCMSIVSetTag(cref, tag, 16);
+    CCCryptorGCMDecrypt(cref, buf, 3, buf + 16);
+    CCCryptorGCMDecrypt(cref, buf + 3, 5, buf + 19);
+    ok(memcmp(buf + 16, "\x01\x00\x00\x00\x00\x00\x00\x00", 8) != 0 &&
+       CCCryptorGCMFinal(cref, tag, &tagLength) == kCCDecodeError &&
+       memcmp(buf + 16, "\x00\x00\x00\x00\x00\x00\x00\x00", 8) == 0, "GCM-SIV output wiped on a bad tag");
+    CCCryptorRelease(cref);
+
+    CCCryptorCreateWithMode(kCCDecrypt, kCCModeGCMSIV, kCCAlgorithmAES128, ccNoPadding, NULL, key->bytes, key->len, NULL, 0, 0, 0, &cref);
+    CCCryptorGCMAddIV(cref, iv->bytes, iv->len);
+    ok(CCCryptorGCMDecrypt(cref, buf, 8, buf + 16) == kCCParamError, "GCM-SIV decrypt before the tag");
+    CCCryptorRelease(cref);
+
+    CCCryptorCreateWithMode(kCCEncrypt, kCCModeGCMSIV, kCCAlgorithmAES128, ccNoPadding, NULL, key->bytes, key->len, NULL, 0, 0, 0, &cref);
+    CCCryptorGCMAddIV(cref, iv->bytes, iv->len);
+    ok(CCCryptorGCMSIVSetTag(cref, tag, 16) == kCCParamError, "GCM-SIV tag on an encryptor");
+    ok(CCCryptorGCMEncrypt(cref, buf, 8, buf + 16) == kCCSuccess &&
+       CCCryptorGCMEncrypt(cref, buf, 8, buf + 32) == kCCParamError, "GCM-SIV output has to be contiguous");
+    ok(CCCryptorGCMFinal(cref, tag, &tagLength) == kCCSuccess, "GCM-SIV final after refused output");
+    CCCryptorRelease(cref);
+
+    ok(CCCryptorCreateWithMode(kCCEncrypt, kCCModeGCMSIV, kCCAlgorithmAES128, ccNoPadding, NULL, buf, 24, NULL, 0, 0, 0, &cref) == kCCParamError,
+       "GCM-SIV with a 24 byte key");
+
+    /* The nonce is exactly 12 bytes, once, before anything else */
+    memset(buf, 0x5a, sizeof(buf));
+    CCCryptorCreateWithMode(kCCEncrypt, kCCModeChaCha20Poly1305, kCCAlgorithmChaCha20, ccNoPadding, NULL, buf, 32, NULL, 0, 0, 0, &cref);
+    ok(CCCryptorGCMAddIV(cref, iv->bytes, 8) == kCCParamError &&
+       CCCryptorGCMAddIV(cref, buf, 16) == kCCParamError, "ChaCha20-Poly1305 short and long nonces");
+    ok(CCCryptorGCMAddAAD(cref, buf, 4) == kCCParamError &&
+       CCCryptorGCMEncrypt(cref, buf, 8, buf + 16) == kCCParamError &&
+       CCCryptorGCMFinal(cref, tag, &tagLength) == kCCParamError, "ChaCha20-Poly1305 without a nonce");
+    ok(CCCryptorGCMAddIV(cref, iv->bytes, 12) == kCCSuccess &&
+       CCCryptorGCMAddIV(cref, iv->bytes, 12) == kCCParamError, "ChaCha20-Poly1305 second nonce");
+    CCCryptorRelease(cref);
+
+    CCCryptorCreateWithMode(kCCDecrypt, kCCModeGCMSIV, kCCAlgorithmAES128, ccNoPadding, NULL, key->bytes, key->len, NULL, 0, 0, 0, &cref);
+    ok(CCCryptorGCMAddIV(cref, buf, 16) == kCCParamError &&
+       CCCryptorGCMSIVSetTag(cref, tag, 16) == kCCSuccess &&
+       CCCryptorGCMDecrypt(cref, buf, 8, buf + 16) == kCCParamError &&
+       CCCryptorGCMFinal(cref, tag, &tagLength) == kCCParamError, "GCM-SIV without a nonce");
+    CCCryptorRelease(cref);
+
+    free(key); free(iv); free(adata);
+    return 0;
+}
+
+#endif
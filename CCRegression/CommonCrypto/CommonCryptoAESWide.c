@@ -0,0 +1,215 @@
+//
+//  CommonCryptoAESWide.c
+//  CommonCrypto
+//
+//  Known answers for the AES tier's own CTR and XTS modes - counters that
+//  carry out of the low 64 bits, XTS ciphertext stealing and key lengths
+//  the key schedule has to refuse.
+//
+
+#include "capabilities.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <CommonCrypto/CommonCryptor.h>
+#include <CommonCrypto/CommonCryptorSPI.h>
+#include "testbyteBuffer.h"
+#include "testmore.h"
+
+#if (CCAESWIDE == 0)
+entryPoint(CommonCryptoAESWide,"CommonCrypto AES Wide Mode Known Answers")
+#else
+
+static int kTestTestCount = 14;
+
+/* IEEE 1619-2007 Annex B; the data unit sequence number is the tweak, little endian */
+typedef struct xtsVector_t {
+    const char *name;
+    const char *key1, *key2, *tweak, *ptx, *ctx;
+} xtsVector;
+
+static const char ptx512[] =
+    "000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f"
+    "202122232425262728292a2b2c2d2e2f303132333435363738393a3b3c3d3e3f"
+    "404142434445464748494a4b4c4d4e4f505152535455565758595a5b5c5d5e5f"
+    "606162636465666768696a6b6c6d6e6f707172737475767778797a7b7c7d7e7f"
+    "808182838485868788898a8b8c8d8e8f909192939495969798999a9b9c9d9e9f"
+    "a0a1a2a3a4a5a6a7a8a9aaabacadaeafb0b1b2b3b4b5b6b7b8b9babbbcbdbebf"
+    "c0c1c2c3c4c5c6c7c8c9cacbcccdcecfd0d1d2d3d4d5d6d7d8d9dadbdcdddedf"
+    "e0e1e2e3e4e5e6e7e8e9eaebecedeeeff0f1f2f3f4f5f6f7f8f9fafbfcfdfeff"
+    "000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f"
+    "202122232425262728292a2b2c2d2e2f303132333435363738393a3b3c3d3e3f"
+    "404142434445464748494a4b4c4d4e4f505152535455565758595a5b5c5d5e5f"
+    "606162636465666768696a6b6c6d6e6f707172737475767778797a7b7c7d7e7f"
+    "808182838485868788898a8b8c8d8e8f909192939495969798999a9b9c9d9e9f"
+    "a0a1a2a3a4a5a6a7a8a9aaabacadaeafb0b1b2b3b4b5b6b7b8b9babbbcbdbebf"
+    "c0c1c2c3c4c5c6c7c8c9cacbcccdcecfd0d1d2d3d4d5d6d7d8d9dadbdcdddedf"
+    "e0e1e2e3e4e5e6e7e8e9eaebecedeeeff0f1f2f3f4f5f6f7f8f9fafbfcfdfeff";;
+
+static const xtsVector xtsVectors[] = {
+    { "vector 2",
+      "11111111111111111111111111111111", "22222222222222222222222222222222", "33333333330000000000000000000000",
+      "4444444444444444444444444444444444444444444444444444444444444444",
+      "c454185e6a16936e39334038acef838bfb186fff7480adc4289382ecd6d394f0" },
+    { "vector 3",
+      "fffefdfcfbfaf9f8f7f6f5f4f3f2f1f0", "22222222222222222222222222222222", "33333333330000000000000000000000",
+      "4444444444444444444444444444444444444444444444444444444444444444",
+      "af85336b597afc1a900b2eb21ec949d292df4c047e0b21532186a5971a227a89" },
+    { "vector 4, 512 bytes",
+      "27182818284590452353602874713526", "31415926535897932384626433832795", "00000000000000000000000000000000",
+      ptx512,
+      "27a7479befa1d476489f308cd4cfa6e2a96e4bbe3208ff25287dd3819616e89c"
+      "c78cf7f5e543445f8333d8fa7f56000005279fa5d8b5e4ad40e736ddb4d35412"
+      "328063fd2aab53e5ea1e0a9f332500a5df9487d07a5c92cc512c8866c7e860ce"
+      "93fdf166a24912b422976146ae20ce846bb7dc9ba94a767aaef20c0d61ad0265"
+      "5ea92dc4c4e41a8952c651d33174be51a10c421110e6d81588ede82103a252d8"
+      "a750e8768defffed9122810aaeb99f9172af82b604dc4b8e51bcb08235a6f434"
+      "1332e4ca60482a4ba1a03b3e65008fc5da76b70bf1690db4eae29c5f1badd03c"
+      "5ccf2a55d705ddcd86d449511ceb7ec30bf12b1fa35b913f9f747a8afd1b130e"
+      "94bff94effd01a91735ca1726acd0b197c4e5b03393697e126826fb6bbde8ecc"
+      "1e08298516e2c9ed03ff3c1b7860f6de76d4cecd94c8119855ef5297ca67e9f3"
+      "e7ff72b1e99785ca0a7e7720c5b36dc6d72cac9574c8cbbc2f801e23e56fd344"
+      "b07f22154beba0f08ce8891e643ed995c94d9a69c9f1b5f499027a78572aeebd"
+      "74d20cc39881c213ee770b1010e4bea718846977ae119f7a023ab58cca0ad752"
+      "afe656bb3c17256a9f6e9bf19fdd5a38fc82bbe872c5539edb609ef4f79c203e"
+      "bb140f2e583cb2ad15b4aa5b655016a8449277dbd477ef2c8d6c017db738b18d"
+      "eb4a427d1923ce3ff262735779a418f20a282df920147beabe421ee5319d0568" },
+    { "vector 10, AES-256",
+      "2718281828459045235360287471352662497757247093699959574966967627",
+      "3141592653589793238462643383279502884197169399375105820974944592", "ff000000000000000000000000000000",
+      ptx512,
+      "1c3b3a102f770386e4836c99e370cf9bea00803f5e482357a4ae12d414a3e63b"
+      "5d31e276f8fe4a8d66b317f9ac683f44680a86ac35adfc3345befecb4bb188fd"
+      "5776926c49a3095eb108fd1098baec70aaa66999a72a82f27d848b21d4a741b0"
+      "c5cd4d5fff9dac89aeba122961d03a757123e9870f8acf1000020887891429ca"
+      "2a3e7a7d7df7b10355165c8b9a6d0a7de8b062c4500dc4cd120c0f7418dae3d0"
+      "b5781c34803fa75421c790dfe1de1834f280d7667b327f6c8cd7557e12ac3a0f"
+      "93ec05c52e0493ef31a12d3d9260f79a289d6a379bc70c50841473d1a8cc81ec"
+      "583e9645e07b8d9670655ba5bbcfecc6dc3966380ad8fecb17b6ba02469a020a"
+      "84e18e8f84252070c13e9f1f289be54fbc481457778f616015e1327a02b140f1"
+      "505eb309326d68378f8374595c849d84f4c333ec4423885143cb47bd71c5edae"
+      "9be69a2ffeceb1bec9de244fbe15992b11b77c040f12bd8f6a975a44a0f90c29"
+      "a9abc3d4d893927284c58754cce294529f8614dcd2aba991925fedc4ae74ffac"
+      "6e333b93eb4aff0479da9a410e4450e0dd7ae4c6e2910900575da401fc07059f"
+      "645e8b7e9bfdef33943054ff84011493c27b3429eaedb4ed5376441a77ed4385"
+      "1ad77f16f541dfd269d50d6a5f14fb0aab1cbb4c1550be97f7ab4066193c4caa"
+      "773dad38014bd2092fa755c824bb5e54c4f36ffda9fcea70b9c6e693e148c151" },
+    { "vector 15, 17 bytes stolen",
+      "fffefdfcfbfaf9f8f7f6f5f4f3f2f1f0", "bfbebdbcbbbab9b8b7b6b5b4b3b2b1b0", "9a785634120000000000000000000000",
+      "000102030405060708090a0b0c0d0e0f10", "6c1625db4671522d3d7599601de7ca09ed" },
+    { "vector 16, 18 bytes stolen",
+      "fffefdfcfbfaf9f8f7f6f5f4f3f2f1f0", "bfbebdbcbbbab9b8b7b6b5b4b3b2b1b0", "9a785634120000000000000000000000",
+      "000102030405060708090a0b0c0d0e0f1011", "d069444b7a7e0cab09e24447d24deb1fedbf" },
+    { "vector 17, 19 bytes stolen",
+      "fffefdfcfbfaf9f8f7f6f5f4f3f2f1f0", "bfbebdbcbbbab9b8b7b6b5b4b3b2b1b0", "9a785634120000000000000000000000",
+      "000102030405060708090a0b0c0d0e0f101112", "e5df1351c0544ba1350b3363cd8ef4beedbf9d" },
+    { "vector 18, 20 bytes stolen",
+      "fffefdfcfbfaf9f8f7f6f5f4f3f2f1f0", "bfbebdbcbbbab9b8b7b6b5b4b3b2b1b0", "9a785634120000000000000000000000",
+      "000102030405060708090a0b0c0d0e0f10111213", "9d84c813f719aa2c7be3f66171c7c5c2edbf9dac" },
+};
+
+/* Both directions, in place for decrypt */
+static int
+xtsMatches(const xtsVector *v)
+{
+    byteBuffer key1 = hexStringToBytes((char *) v->key1), key2 = hexStringToBytes((char *) v->key2);
+    byteBuffer tweak = hexStringToBytes((char *) v->tweak);
+    byteBuffer ptx = hexStringToBytes((char *) v->ptx), ctx = hexStringToBytes((char *) v->ctx);
+    CCCryptorRef encryptor = NULL, decryptor = NULL;
+    uint8_t out[512];
+    int good = 0;
+
+    if(CCCryptorCreateWithMode(kCCEncrypt, kCCModeXTS, kCCAlgorithmAES128, ccNoPadding, NULL, key1->bytes, key1->len,
+                               key2->bytes, key2->len, 0, 0, &encryptor) == kCCSuccess &&
+       CCCryptorCreateWithMode(kCCDecrypt, kCCModeXTS, kCCAlgorithmAES128, ccNoPadding, NULL, key1->bytes, key1->len,
+                               key2->bytes, key2->len, 0, 0, &decryptor) == kCCSuccess &&
+       CCCryptorEncryptDataBlock(encryptor, tweak->bytes, ptx->bytes, ptx->len, out) == kCCSuccess &&
+       memcmp(out, ctx->bytes, ctx->len) == 0 &&
+       CCCryptorDecryptDataBlock(decryptor, tweak->bytes, out, ctx->len, out) == kCCSuccess)
+        good = memcmp(out, ptx->bytes, ptx->len) == 0;
+    if(!good) diag("XTS %s failed", v->name);
+    if(encryptor) CCCryptorRelease(encryptor);
+    if(decryptor) CCCryptorRelease(decryptor);
+    free(key1); free(key2); free(tweak); free(ptx); free(ctx);
+    return good;
+}
+
+/*
+ * The low 64 bits of the counter run out four blocks in, so a wide batch
+ * has to carry into the high half.  Checked against OpenSSL.
+ */
+
+#define CTR_CARRY_LEN 200
+
+static const uint8_t ctrKey[16] = {
+    0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6, 0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c };
+static const uint8_t ctrCounter[16] = {
+    0xf0, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xfc };
+static const char ctrCarryCiphertext[] =
+    "6b33eb30202e11f9d032a21e3febd0b0f3f4701ca9333a92753078deb5c3dea0"
+    "dda08782b867725367a5ceed2109493a2179cf76667dbc5924f2240aa44a9420"
+    "0f3cde4908105983111361e5e97bf9b0f73b3602c1ee9c864cb4e30869943393"
+    "f99195bb93b2d1e1af0b55f94f81bacf67eb0a2b1ee84200e48475fd02ba7cdd"
+    "9df6080fc776369a536297cb15bd8d7ed6b2c1769051143f61061da675c05100"
+    "5785215bb93355ab32dd1e949e67e7a1875c2be1f185221f7a708984989c6923"
+    "aae2ad520a8cee30";
+
+/* The whole message at once, or in pieces that straddle block boundaries */
+static int
+ctrCarryMatches(size_t piece)
+{
+    byteBuffer expected = hexStringToBytes((char *) ctrCarryCiphertext);
+    uint8_t plain[CTR_CARRY_LEN], out[CTR_CARRY_LEN];
+    CCCryptorRef cref;
+    size_t done, n, moved;
+    int good = 1;
+
+    for(size_t i = 0; i < CTR_CARRY_LEN; i++) plain[i] = (uint8_t) (i * 7);
+    if(CCCryptorCreateWithMode(kCCEncrypt, kCCModeCTR, kCCAlgorithmAES128, ccNoPadding, ctrCounter, ctrKey, sizeof(ctrKey),
+                               NULL, 0, 0, kCCModeOptionCTR_BE, &cref)) {
+        free(expected);
+        return 0;
+    }
+    for(done = 0; good && done < CTR_CARRY_LEN; done += n) {
+        n = CTR_CARRY_LEN - done;
+        if(piece && n > piece) n = piece;
+        good = CCCryptorUpdate(cref, plain + done, n, out + done, n, &moved) == kCCSuccess && moved == n;
+    }
+    good = good && memcmp(out, expected->bytes, CTR_CARRY_LEN) == 0;
+    CCCryptorRelease(cref);
+    free(expected);
+    return good;
+}
+
+static CCCryptorStatus
+createWithKeyLength(CCMode mode, size_t keyLength)
+{
+    uint8_t key[64] = { 0 }, iv[16] = { 0 };
+    CCCryptorRef cref = NULL;
+    CCCryptorStatus status;
+
+    status = CCCryptorCreateWithMode(kCCEncrypt, mode, kCCAlgorithmAES128, ccNoPadding, iv, key, keyLength,
+                                     (mode == kCCModeXTS) ? key: NULL, (mode == kCCModeXTS) ? keyLength: 0, 0,
+                                     (mode == kCCModeCTR) ? kCCModeOptionCTR_BE: 0, &cref);
+    if(cref) CCCryptorRelease(cref);
+    return status;
+}
+
+int CommonCryptoAESWide(int argc, char *const *argv)
+{
+	plan_tests(kTestTestCount);
+
+    for(size_t i = 0; i < sizeof(xtsVectors) / sizeof(xtsVectors[0]); i++)
+        ok(xtsMatches(&xtsVectors[i]), "XTS IEEE 1619 vector");
+
+    ok(ctrCarryMatches(0), "CTR counter carries past 64 bits");
+    ok(ctrCarryMatches(37), "CTR carry in odd pieces");
+
+    ok(createWithKeyLength(kCCModeCTR, 20) == kCCKeySizeError, "20 byte AES key refused");
+    ok(createWithKeyLength(kCCModeCTR, 3) == kCCKeySizeError, "3 byte AES key refused");
+    ok(createWithKeyLength(kCCModeXTS, 64) == kCCKeySizeError, "64 byte XTS half key refused");
+    ok(createWithKeyLength(kCCModeECB, 36) == kCCKeySizeError, "36 byte AES key refused");
+    return 0;
+}
+
+#endif
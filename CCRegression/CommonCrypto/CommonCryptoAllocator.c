@@ -0,0 +1,96 @@
+//
+//  CommonCryptoAllocator.c
+//  CommonCrypto
+//
+
+#include "capabilities.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <CommonCrypto/CommonCryptor.h>
+#include <CommonCrypto/CommonCryptoAllocator.h>
+#include "CommonDH.h"
+#include "testmore.h"
+
+#if (CCALLOCATOR == 0)
+entryPoint(CommonCryptoAllocator,"CommonCrypto Allocator Testing")
+#else
+
+static int kTestTestCount = 8;
+
+static void *
+testAllocate(void *context, size_t size, size_t alignment)
+{
+    return malloc(size);
+}
+
+static void
+testDeallocate(void *context, void *block, size_t size)
+{
+    free(block);
+}
+
+/* Every block freed, and freed at the size it was allocated at */
+static int
+balanced(CCAllocatorStatistics *statistics)
+{
+    return statistics->allocations != 0 && statistics->allocations == statistics->deallocations &&
+           statistics->bytesAllocated == statistics->bytesDeallocated;
+}
+
+/*
+ * The allocator can only go in before CommonCrypto's first allocation, and
+ * the tests before this one have long since made that - so all that can be
+ * checked here is that a bad allocator is turned away and a good one is
+ * refused for being too late.
+ */
+
+int CommonCryptoAllocator(int argc, char *const *argv)
+{
+    CCAllocator allocator;
+    CCAllocatorStatistics statistics;
+    CCCryptorRef cref;
+    CCDHParameters parms;
+    CCDHRef dh;
+    uint8_t key[16], buf[16], out[16], prime[16], generator = 2;
+    size_t moved;
+
+	plan_tests(kTestTestCount);
+    memset(key, 0x11, sizeof(key));
+    memset(buf, 0x22, sizeof(buf));
+
+    ok(CCSetAllocator(NULL) == kCCParamError, "NULL allocator");
+
+    memset(&allocator, 0, sizeof(allocator));
+    allocator.allocate = testAllocate;
+    ok(CCSetAllocator(&allocator) == kCCParamError, "allocate without deallocate");
+
+    allocator.deallocate = testDeallocate;
+    allocator.alignment = 24;
+    ok(CCSetAllocator(&allocator) == kCCParamError, "alignment not a power of two");
+
+    allocator.alignment = 16;
+    ok(CCCryptorCreate(kCCEncrypt, kCCAlgorithmAES128, kCCOptionECBMode, key, sizeof(key), NULL, &cref) == kCCSuccess, "create a cryptor");
+    ok(CCSetAllocator(&allocator) == kCCUnimplemented, "allocator refused after the first allocation");
+
+    CCAllocatorSetThreadContext(key);
+    ok(CCCryptorUpdate(cref, buf, sizeof(buf), out, sizeof(out), &moved) == kCCSuccess && moved == sizeof(out), "cryptor works with a thread context set");
+    CCAllocatorSetThreadContext(NULL);
+    CCCryptorRelease(cref);
+
+    /* 2^127 - 1 */
+    memset(prime, 0xff, sizeof(prime));
+    prime[0] = 0x7f;
+    memset(&statistics, 0, sizeof(statistics));
+    CCAllocatorCountThread(&statistics);
+    if((parms = CCDHParametersCreateFromData(prime, sizeof(prime), &generator, 1, 0)) != NULL) {
+        if((dh = CCDHCreate(parms)) != NULL) CCDHRelease(dh);
+        CCDHParametersRelease(parms);
+    }
+    CCAllocatorCountThread(NULL);
+    ok(parms != NULL, "DH parameters from data");
+    ok(balanced(&statistics), "DH create and release free what they allocate");
+    return 0;
+}
+
+#endif
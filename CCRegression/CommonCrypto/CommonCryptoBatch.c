@@ -0,0 +1,148 @@
+//
+//  CommonCryptoBatch.c
+//  CommonCrypto
+//
+
+#include "capabilities.h"
+#include <stdio.h>
+#include <string.h>
+#include <CommonCrypto/CommonCryptor.h>
+#include <CommonCrypto/CommonCryptorSPI.h>
+#include "CCCryptorTestFuncs.h"
+#include "testbyteBuffer.h"
+#include "testmore.h"
+
+#if (CCBATCH == 0)
+entryPoint(CommonCryptoBatch,"CommonCrypto Batch One-Shot Testing")
+#else
+
+static int kTestTestCount = 10;
+
+#define BATCH_COUNT 21
+#define BATCH_MAXLEN 512
+
+static uint8_t keys[3][16];
+static uint8_t ivs[BATCH_COUNT][16];
+static uint8_t cipher[BATCH_COUNT][BATCH_MAXLEN + 16];
+static uint8_t expected[BATCH_COUNT][BATCH_MAXLEN + 16];
+static size_t lengths[BATCH_COUNT];
+static size_t expectedLengths[BATCH_COUNT];
+
+/*
+ * Fill the batch - lengths from 64 to 512 bytes (some unaligned), keys in
+ * runs long enough to need more than one set of lanes.
+ */
+
+static void
+setupEntries(CCCryptBatchEntry *entries, uint8_t (*in)[BATCH_MAXLEN + 16], size_t *inLengths, uint8_t (*out)[BATCH_MAXLEN + 16])
+{
+    int i;
+
+    for(i = 0; i < BATCH_COUNT; i++) {
+        entries[i].key = keys[(i < 12) ? 0: (i < 13) ? 1: 2];
+        entries[i].keyLength = 16;
+        entries[i].iv = (i % 5) ? ivs[i]: NULL;
+        entries[i].dataIn = in[i];
+        entries[i].dataInLength = inLengths[i];
+        entries[i].dataOut = out[i];
+        entries[i].dataOutAvailable = BATCH_MAXLEN + 16;
+    }
+}
+
+static int
+batchMatches(CCOperation op, CCAlgorithm alg, CCOptions options, CCMode mode, CCPadding padding, uint8_t (*in)[BATCH_MAXLEN + 16], size_t *inLengths)
+{
+    CCCryptBatchEntry entries[BATCH_COUNT];
+    size_t moved;
+    int i;
+
+    for(i = 0; i < BATCH_COUNT; i++) {
+        CCCryptorRef cref;
+        size_t finalMoved;
+
+        if(mode == kCCModeCTR) {
+            /* CCCrypt() has no CTR selector */
+            if(CCCryptorCreateWithMode(op, mode, alg, padding, (i % 5) ? ivs[i]: NULL, keys[(i < 12) ? 0: (i < 13) ? 1: 2], 16, NULL, 0, 0, kCCModeOptionCTR_BE, &cref)) return 0;
+            if(CCCryptorUpdate(cref, in[i], inLengths[i], expected[i], sizeof(expected[i]), &moved)) return 0;
+            if(CCCryptorFinal(cref, expected[i] + moved, sizeof(expected[i]) - moved, &finalMoved)) return 0;
+            CCCryptorRelease(cref);
+            moved += finalMoved;
+        } else if(CCCrypt(op, alg, options, keys[(i < 12) ? 0: (i < 13) ? 1: 2], 16, (i % 5) ? ivs[i]: NULL, in[i], inLengths[i], expected[i], sizeof(expected[i]), &moved)) return 0;
+        expectedLengths[i] = moved;
+    }
+
+    setupEntries(entries, in, inLengths, cipher);
+    if(CCCryptBatch(op, mode, alg, padding, entries, BATCH_COUNT) != kCCSuccess) return 0;
+    for(i = 0; i < BATCH_COUNT; i++) {
+        if(entries[i].status != kCCSuccess || entries[i].dataOutMoved != expectedLengths[i]) return 0;
+        if(memcmp(entries[i].dataOut, expected[i], entries[i].dataOutMoved)) return 0;
+    }
+    return 1;
+}
+
+int CommonCryptoBatch(int argc, char *const *argv)
+{
+    static uint8_t input[BATCH_COUNT][BATCH_MAXLEN + 16], ciphertext[BATCH_COUNT][BATCH_MAXLEN + 16];
+    static size_t cipherLengths[BATCH_COUNT], alignedLengths[BATCH_COUNT];
+    CCCryptBatchEntry entries[BATCH_COUNT];
+    int i;
+
+	plan_tests(kTestTestCount);
+    memset(keys[0], 0x10, 16);
+    memset(keys[1], 0x20, 16);
+    memset(keys[2], 0x30, 16);
+    for(i = 0; i < BATCH_COUNT; i++) {
+        lengths[i] = 64 + (i * 97) % (BATCH_MAXLEN - 63);
+        alignedLengths[i] = lengths[i] & ~(size_t) 15;
+        memset(ivs[i], i, 16);
+        memset(input[i], 0xa0 + i, BATCH_MAXLEN);
+    }
+
+    ok(batchMatches(kCCEncrypt, kCCAlgorithmAES128, kCCOptionPKCS7Padding, kCCModeCBC, ccPKCS7Padding, input, lengths), "interleaved CBC PKCS7 encrypt matches CCCrypt");
+    ok(batchMatches(kCCEncrypt, kCCAlgorithmAES128, 0, kCCModeCBC, ccNoPadding, input, alignedLengths), "interleaved CBC encrypt matches CCCrypt");
+    ok(batchMatches(kCCEncrypt, kCCAlgorithmBlowfish, kCCOptionPKCS7Padding, kCCModeCBC, ccPKCS7Padding, input, lengths), "interleaved Blowfish CBC encrypt matches CCCrypt");
+
+    /* Decrypt what the interleaved path produced */
+    setupEntries(entries, input, lengths, ciphertext);
+    CCCryptBatch(kCCEncrypt, kCCModeCBC, kCCAlgorithmAES128, ccPKCS7Padding, entries, BATCH_COUNT);
+    for(i = 0; i < BATCH_COUNT; i++) cipherLengths[i] = entries[i].dataOutMoved;
+    ok(batchMatches(kCCDecrypt, kCCAlgorithmAES128, kCCOptionPKCS7Padding, kCCModeCBC, ccPKCS7Padding, ciphertext, cipherLengths), "CBC PKCS7 decrypt matches CCCrypt");
+
+    ok(batchMatches(kCCEncrypt, kCCAlgorithmAES128, 0, kCCModeCTR, ccNoPadding, input, lengths), "CTR matches CCCryptor");
+
+    setupEntries(entries, input, lengths, cipher);
+    ok(CCCryptBatch(kCCEncrypt, kCCModeCBC, kCCAlgorithmAES128, ccNoPadding, entries, BATCH_COUNT) == kCCAlignmentError &&
+       entries[1].status == kCCAlignmentError, "unaligned input without padding");
+
+    setupEntries(entries, input, lengths, cipher);
+    entries[3].dataOutAvailable = 16;
+    ok(CCCryptBatch(kCCEncrypt, kCCModeCBC, kCCAlgorithmAES128, ccPKCS7Padding, entries, BATCH_COUNT) == kCCBufferTooSmall &&
+       entries[3].status == kCCBufferTooSmall && entries[3].dataOutMoved == (lengths[3] / 16 + 1) * 16 && entries[4].status == kCCSuccess, "short output buffer");
+
+    /* Bad entries are refused up front and don't disturb the runs around them */
+    setupEntries(entries, input, lengths, cipher);
+    entries[5].key = NULL;
+    entries[7].dataIn = NULL;
+    ok(CCCryptBatch(kCCEncrypt, kCCModeCBC, kCCAlgorithmAES128, ccPKCS7Padding, entries, BATCH_COUNT) == kCCParamError &&
+       entries[5].status == kCCParamError && entries[7].status == kCCParamError && entries[5].dataOutMoved == 0 &&
+       entries[6].status == kCCSuccess && entries[8].status == kCCSuccess, "NULL key and input in a CBC run");
+
+    setupEntries(entries, input, lengths, cipher);
+    entries[2].keyLength = 15;
+    ok(CCCryptBatch(kCCEncrypt, kCCModeCBC, kCCAlgorithmAES128, ccPKCS7Padding, entries, BATCH_COUNT) == kCCKeySizeError &&
+       entries[2].status == kCCKeySizeError && entries[2].dataOutMoved == 0 && entries[1].status == kCCSuccess &&
+       entries[3].status == kCCSuccess, "bad AES key length in a CBC run");
+
+    setupEntries(entries, input, lengths, ciphertext);
+    CCCryptBatch(kCCEncrypt, kCCModeCTR, kCCAlgorithmAES128, ccNoPadding, entries, BATCH_COUNT);
+    setupEntries(entries, input, lengths, cipher);
+    entries[2].key = NULL;
+    entries[3].dataOut = NULL;
+    ok(CCCryptBatch(kCCEncrypt, kCCModeCTR, kCCAlgorithmAES128, ccNoPadding, entries, BATCH_COUNT) == kCCParamError &&
+       entries[2].status == kCCParamError && entries[3].status == kCCParamError && entries[4].status == kCCSuccess &&
+       memcmp(cipher[4], ciphertext[4], lengths[4]) == 0, "NULL key and output in a CTR run");
+
+    return 0;
+}
+
+#endif
@@ -0,0 +1,146 @@
+//
+//  CommonCryptoCBCHmac.c
+//  CommonCrypto
+//
+
+#include "capabilities.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <CommonCrypto/CommonCryptor.h>
+#include <CommonCrypto/CommonCryptorSPI.h>
+#include <CommonCrypto/CommonHMAC.h>
+#include "CCCryptorTestFuncs.h"
+#include "testbyteBuffer.h"
+#include "testmore.h"
+
+#if (CCCBCHMAC == 0)
+entryPoint(CommonCryptoCBCHmac,"CommonCrypto CBC-HMAC Composite Testing")
+#else
+
+static int kTestTestCount = 11;
+
+#define CBCHMAC_LEN (1024 * 1024 + 5)
+#define CBCHMAC_SPACE (CBCHMAC_LEN + 32)
+#define CBCHMAC_LOOPS 8
+
+/* Record sized pieces, none of them a block multiple */
+static const size_t pieces[] = { 1, 16383, 13, 4093, 1447, 65533 };
+
+static double
+elapsed(struct timeval *start)
+{
+    struct timeval stop;
+    
+    gettimeofday(&stop, NULL);
+    return (stop.tv_sec - start->tv_sec) * 1000000.0 + (stop.tv_usec - start->tv_usec);
+}
+
+/*
+ * Run len bytes through the composite in odd-sized updates.  Returns the
+ * status of the final.
+ */
+
+static CCCryptorStatus
+cbcHmacCrypt(CCOperation op, CCHmacAlgorithm macAlg, uint8_t *key, uint8_t *iv, const uint8_t *in, size_t len, uint8_t *out, size_t *outLen, uint8_t *tag, size_t tagLength)
+{
+    CCCBCHmacRef ref;
+    CCCryptorStatus retval;
+    size_t pos = 0, total = 0, moved;
+    int i = 0;
+    
+    if((retval = CCCBCHmacCreate(op, ccPKCS7Padding, key, 16, iv, macAlg, key, 16, &ref)) != kCCSuccess) return retval;
+    while(pos < len) {
+        size_t n = pieces[i++ % (sizeof(pieces) / sizeof(pieces[0]))];
+        if(n > len - pos) n = len - pos;
+        if((retval = CCCBCHmacUpdate(ref, in + pos, n, out + total, CBCHMAC_SPACE - total, &moved)) != kCCSuccess) goto out;
+        pos += n; total += moved;
+    }
+    retval = CCCBCHmacFinal(ref, out + total, CBCHMAC_SPACE - total, &moved, tag, tagLength);
+    *outLen = total + moved;
+out:
+    CCCBCHmacRelease(ref);
+    return retval;
+}
+
+/*
+ * The composite against CCCrypt() followed by CCHmac() over the ciphertext.
+ */
+
+static int
+cbcHmacMatches(CCHmacAlgorithm macAlg, size_t macLength, uint8_t *key, uint8_t *iv, const uint8_t *plain, size_t len, uint8_t *expected, uint8_t *out)
+{
+    uint8_t expectedTag[CC_SHA512_DIGEST_LENGTH], tag[CC_SHA512_DIGEST_LENGTH];
+    size_t expectedLen, outLen;
+    
+    if(CCCrypt(kCCEncrypt, kCCAlgorithmAES128, kCCOptionPKCS7Padding, key, 16, iv, plain, len, expected, CBCHMAC_SPACE, &expectedLen)) return 0;
+    CCHmac(macAlg, key, 16, expected, expectedLen, expectedTag);
+    if(cbcHmacCrypt(kCCEncrypt, macAlg, key, iv, plain, len, out, &outLen, tag, macLength) != kCCSuccess) return 0;
+    return outLen == expectedLen && memcmp(out, expected, outLen) == 0 && memcmp(tag, expectedTag, macLength) == 0;
+}
+
+int CommonCryptoCBCHmac(int argc, char *const *argv)
+{
+    uint8_t key[16], iv[16], tag[CC_SHA256_DIGEST_LENGTH];
+    uint8_t *plain, *cipher, *out;
+    size_t cipherLen, outLen, moved;
+    struct timeval start;
+    double stitched = 0, separate = 0;
+    CCCBCHmacRef ref;
+    CCHmacContext hmac;
+    int i;
+    
+	plan_tests(kTestTestCount);
+    memset(key, 0x3c, sizeof(key));
+    memset(iv, 0xa5, sizeof(iv));
+    plain = malloc(CBCHMAC_SPACE);
+    cipher = malloc(CBCHMAC_SPACE);
+    out = malloc(CBCHMAC_SPACE);
+    for(i = 0; i < CBCHMAC_LEN; i++) plain[i] = (uint8_t) (i * 11);
+    
+    ok(cbcHmacMatches(kCCHmacAlgSHA256, CC_SHA256_DIGEST_LENGTH, key, iv, plain, CBCHMAC_LEN, cipher, out), "CBC + HMAC-SHA256 matches the two passes");
+    ok(cbcHmacMatches(kCCHmacAlgSHA1, CC_SHA1_DIGEST_LENGTH, key, iv, plain, CBCHMAC_LEN, cipher, out), "CBC + HMAC-SHA1 matches the two passes");
+    ok(cbcHmacMatches(kCCHmacAlgSHA256, CC_SHA256_DIGEST_LENGTH, key, iv, plain, 77, cipher, out), "short record");
+    
+    ok(cbcHmacCrypt(kCCEncrypt, kCCHmacAlgSHA256, key, iv, plain, CBCHMAC_LEN, cipher, &cipherLen, tag, CC_SHA256_DIGEST_LENGTH) == kCCSuccess &&
+       cbcHmacCrypt(kCCDecrypt, kCCHmacAlgSHA256, key, iv, cipher, cipherLen, out, &outLen, tag, CC_SHA256_DIGEST_LENGTH) == kCCSuccess &&
+       outLen == CBCHMAC_LEN && memcmp(out, plain, outLen) == 0, "decrypt and verify");
+    ok(cbcHmacCrypt(kCCDecrypt, kCCHmacAlgSHA256, key, iv, cipher, cipherLen, out, &outLen, tag, 16) == kCCSuccess, "truncated tag verifies");
+    tag[3] ^= 1;
+    ok(cbcHmacCrypt(kCCDecrypt, kCCHmacAlgSHA256, key, iv, cipher, cipherLen, out, &outLen, tag, CC_SHA256_DIGEST_LENGTH) == kCCDecodeError, "bad tag");
+    tag[3] ^= 1;
+    cipher[cipherLen - 1] ^= 0x80;
+    ok(cbcHmacCrypt(kCCDecrypt, kCCHmacAlgSHA256, key, iv, cipher, cipherLen, out, &outLen, tag, CC_SHA256_DIGEST_LENGTH) == kCCDecodeError, "tampered padding block fails the MAC");
+    cipher[cipherLen - 1] ^= 0x80;
+    
+    CCCBCHmacCreate(kCCEncrypt, ccPKCS7Padding, key, 16, iv, kCCHmacAlgSHA256, key, 16, &ref);
+    ok(CCCBCHmacUpdate(ref, plain, 64, out, 48, &moved) == kCCBufferTooSmall, "output too small");
+    ok(CCCBCHmacFinal(ref, out, 32, &moved, tag, 0) == kCCParamError, "zero length tag");
+    ok(CCCBCHmacFinal(ref, out, 32, &moved, tag, CC_SHA256_DIGEST_LENGTH / 2 - 1) == kCCParamError, "tag under half the MAC");
+    CCCBCHmacRelease(ref);
+    
+    /* Throughput against the two separate passes */
+    for(i = 0; i < CBCHMAC_LOOPS; i++) {
+        gettimeofday(&start, NULL);
+        cbcHmacCrypt(kCCEncrypt, kCCHmacAlgSHA256, key, iv, plain, CBCHMAC_LEN, out, &outLen, tag, CC_SHA256_DIGEST_LENGTH);
+        stitched += elapsed(&start);
+        gettimeofday(&start, NULL);
+        CCCrypt(kCCEncrypt, kCCAlgorithmAES128, kCCOptionPKCS7Padding, key, 16, iv, plain, CBCHMAC_LEN, cipher, CBCHMAC_SPACE, &cipherLen);
+        CCHmacInit(&hmac, kCCHmacAlgSHA256, key, 16);
+        CCHmacUpdate(&hmac, cipher, cipherLen);
+        CCHmacFinal(&hmac, tag);
+        separate += elapsed(&start);
+    }
+    if(stitched > 0 && separate > 0)
+        diag("CBC + HMAC-SHA256: %.1f MB/s one pass, %.1f MB/s two passes",
+             (double) CBCHMAC_LEN * CBCHMAC_LOOPS / stitched, (double) CBCHMAC_LEN * CBCHMAC_LOOPS / separate);
+    ok(outLen == cipherLen && memcmp(out, cipher, outLen) == 0, "timed runs agree");
+    
+    free(plain);
+    free(cipher);
+    free(out);
+    return 0;
+}
+
+#endif
@@ -0,0 +1,194 @@
+//
+//  CommonCryptoCPUTiers.c
+//  CommonCrypto
+//
+//  The symmetric known answer tests again under each CC_CPU_TIER.  The tier
+//  is picked once per process, so each one runs this binary afresh; the
+//  child also hashes the ciphertext of every AES mode, and the hashes have
+//  to agree across the tiers.
+//
+
+#include "capabilities.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <spawn.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <mach-o/dyld.h>
+#include <CommonCrypto/CommonCryptor.h>
+#include <CommonCrypto/CommonCryptorSPI.h>
+#include <CommonCrypto/CommonDigest.h>
+#include "testmore.h"
+
+#if (CCCPUTIERS == 0)
+entryPoint(CommonCryptoCPUTiers,"CommonCrypto CPU Tiers")
+#else
+
+static int kTestTestCount = 4;
+
+#define TIER_CHILD  "CC_TIER_TEST_CHILD"
+#define TIER_DIGEST "[DIGEST] "
+#define TIER_LEN    (4096 + 13)
+#define TIER_COUNT  3
+
+extern char **environ;
+
+static const char *tiers[TIER_COUNT] = { "portable", "vector", "aes" };
+
+/* Run in the child; this test last, in digest mode */
+static const char *katTests[] = {
+    "CommonCryptoSymCBC", "CommonCryptoSymOFB", "CommonCryptoSymCFB", "CommonCryptoSymCTR",
+    "CommonCryptoSymXTS", "CommonCryptoSymGCM", "CommonCryptoSymRegression", "CommonCryptoAESWide",
+    "CommonCryptoCPUTiers"
+};
+#define KAT_TESTS (sizeof(katTests) / sizeof(katTests[0]))
+
+/*
+ * Child side: every AES mode at every key length over the same message,
+ * all of it into one SHA-256.
+ */
+
+static int
+tierDigest(uint8_t *digest)
+{
+    static const CCMode modes[] = { kCCModeECB, kCCModeCBC, kCCModeCFB, kCCModeCFB8, kCCModeOFB, kCCModeCTR };
+    static const size_t keyLengths[] = { 16, 24, 32 };
+    uint8_t key[64], iv[16], in[TIER_LEN], out[TIER_LEN], tag[16];
+    size_t tagLength, moved;
+    CC_SHA256_CTX sha;
+    CCCryptorRef cref;
+    int good = 1;
+
+    for(size_t i = 0; i < sizeof(key); i++) key[i] = (uint8_t) (i * 29 + 1);
+    for(size_t i = 0; i < sizeof(iv); i++) iv[i] = (uint8_t) (0xf0 + i);
+    for(size_t i = 0; i < TIER_LEN; i++) in[i] = (uint8_t) (i * 7 + (i >> 8));
+    CC_SHA256_Init(&sha);
+
+    for(size_t k = 0; k < sizeof(keyLengths) / sizeof(keyLengths[0]); k++) {
+        size_t keyLength = keyLengths[k];
+
+        for(size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+            /* ECB takes whole blocks */
+            size_t len = (modes[m] == kCCModeECB) ? TIER_LEN & ~(size_t) 15: TIER_LEN;
+
+            if(CCCryptorCreateWithMode(kCCEncrypt, modes[m], kCCAlgorithmAES128, ccNoPadding, iv, key, keyLength, NULL, 0, 0,
+                                       (modes[m] == kCCModeCTR) ? kCCModeOptionCTR_BE: 0, &cref)) return 0;
+            good &= CCCryptorUpdate(cref, in, len, out, len, &moved) == kCCSuccess && moved == len;
+            CC_SHA256_Update(&sha, out, (CC_LONG) moved);
+            CCCryptorRelease(cref);
+        }
+
+        tagLength = sizeof(tag);
+        good &= CCCryptorGCM(kCCEncrypt, kCCAlgorithmAES128, key, keyLength, iv, 12, in, 20, in, TIER_LEN, out, tag, &tagLength) == kCCSuccess;
+        CC_SHA256_Update(&sha, out, TIER_LEN);
+        CC_SHA256_Update(&sha, tag, (CC_LONG) tagLength);
+
+        if(keyLength == 24) continue;
+        if(CCCryptorCreateWithMode(kCCEncrypt, kCCModeXTS, kCCAlgorithmAES128, ccNoPadding, NULL, key, keyLength,
+                                   key + 32, keyLength, 0, 0, &cref)) return 0;
+        good &= CCCryptorEncryptDataBlock(cref, iv, in, TIER_LEN, out) == kCCSuccess;
+        CC_SHA256_Update(&sha, out, TIER_LEN);
+        CCCryptorRelease(cref);
+    }
+    CC_SHA256_Final(digest, &sha);
+    return good;
+}
+
+/*
+ * Parent side: run the tests under one tier with stderr on a pipe, and keep
+ * the [PASS]/[FAIL] lines and the digest line.
+ */
+
+static int
+runTier(const char *path, const char *tier, char *results, size_t resultsSize, char *digest, size_t digestSize)
+{
+    char *argv[KAT_TESTS + 2], **envp, tierVar[64], line[256];
+    posix_spawn_file_actions_t actions;
+    size_t nenv = 0, e = 0, used = 0;
+    int pipefd[2], status, good = 0;
+    pid_t pid;
+    FILE *childErr;
+
+    argv[0] = (char *) path;
+    for(size_t i = 0; i < KAT_TESTS; i++) argv[i + 1] = (char *) katTests[i];
+    argv[KAT_TESTS + 1] = NULL;
+
+    while(environ[nenv]) nenv++;
+    if((envp = calloc(nenv + 3, sizeof(char *))) == NULL) return 0;
+    for(size_t i = 0; i < nenv; i++)
+        if(strncmp(environ[i], "CC_CPU_TIER=", 12) && strncmp(environ[i], TIER_CHILD "=", sizeof(TIER_CHILD))) envp[e++] = environ[i];
+    snprintf(tierVar, sizeof(tierVar), "CC_CPU_TIER=%s", tier);
+    envp[e++] = tierVar;
+    envp[e++] = TIER_CHILD "=1";
+
+    results[0] = digest[0] = 0;
+    if(pipe(pipefd)) {
+        free(envp);
+        return 0;
+    }
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, pipefd[1], STDERR_FILENO);
+    posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+    posix_spawn_file_actions_addclose(&actions, pipefd[0]);
+    status = posix_spawn(&pid, path, &actions, NULL, argv, envp);
+    posix_spawn_file_actions_destroy(&actions);
+    close(pipefd[1]);
+    free(envp);
+    if(status) {
+        close(pipefd[0]);
+        return 0;
+    }
+
+    childErr = fdopen(pipefd[0], "r");
+    while(childErr && fgets(line, sizeof(line), childErr)) {
+        if(strncmp(line, "[PASS] ", 7) == 0 || strncmp(line, "[FAIL] ", 7) == 0) {
+            size_t n = strlen(line);
+
+            if(used + n < resultsSize) {
+                memcpy(results + used, line, n + 1);
+                used += n;
+            }
+        } else if(strncmp(line, TIER_DIGEST, sizeof(TIER_DIGEST) - 1) == 0) {
+            snprintf(digest, digestSize, "%s", line + sizeof(TIER_DIGEST) - 1);
+        }
+    }
+    if(childErr) fclose(childErr);
+    else close(pipefd[0]);
+    if(waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0)
+        good = strstr(results, "[FAIL] ") == NULL && digest[0] != 0;
+    if(!good) diag("CC_CPU_TIER=%s:\n%s", tier, results);
+    return good;
+}
+
+int CommonCryptoCPUTiers(int argc, char *const *argv)
+{
+    char path[1024], results[TIER_COUNT][2048], digests[TIER_COUNT][2 * CC_SHA256_DIGEST_LENGTH + 2];
+    uint32_t pathSize = sizeof(path);
+    uint8_t digest[CC_SHA256_DIGEST_LENGTH];
+    int same = 1;
+
+    if(getenv(TIER_CHILD)) {
+        /* Spawned by the parent below: hand back the digest */
+        plan_tests(1);
+        ok(tierDigest(digest), "tier digest");
+        fputs(TIER_DIGEST, stderr);
+        for(int i = 0; i < CC_SHA256_DIGEST_LENGTH; i++) fprintf(stderr, "%02x", digest[i]);
+        fprintf(stderr, "\n");
+        return 0;
+    }
+
+	plan_tests(kTestTestCount);
+    if(_NSGetExecutablePath(path, &pathSize)) path[0] = 0;
+
+    ok(runTier(path, tiers[0], results[0], sizeof(results[0]), digests[0], sizeof(digests[0])), "KATs under the portable tier");
+    ok(runTier(path, tiers[1], results[1], sizeof(results[1]), digests[1], sizeof(digests[1])), "KATs under the vector tier");
+    ok(runTier(path, tiers[2], results[2], sizeof(results[2]), digests[2], sizeof(digests[2])), "KATs under the AES tier");
+    for(int i = 1; i < TIER_COUNT; i++)
+        same &= strcmp(digests[0], digests[i]) == 0 && strcmp(results[0], results[i]) == 0;
+    ok(same && digests[0][0], "every tier gives the same ciphertext");
+    return 0;
+}
+
+#endif
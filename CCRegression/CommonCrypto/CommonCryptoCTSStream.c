@@ -0,0 +1,135 @@
+//
+//  CommonCryptoCTSStream.c
+//  CommonCrypto
+//
+
+#include "capabilities.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <CommonCrypto/CommonCryptor.h>
+#include <CommonCrypto/CommonCryptorSPI.h>
+#include "CCCryptorTestFuncs.h"
+#include "testbyteBuffer.h"
+#include "testmore.h"
+
+#if (CCCTSSTREAM == 0)
+entryPoint(CommonCryptoCTSStream,"CommonCrypto Streaming CTS Benchmark")
+#else
+
+static int kTestTestCount = 10;
+
+#define CTS_LEN (2 * 1024 * 1024 + 11)
+#define CTS_SPACE (CTS_LEN + 32)
+#define CTS_SHORT 203
+#define CTS_MAX_PIECE 4096
+
+/*
+ * Run len bytes through a fresh cryptor in updates of piece bytes, or of
+ * every size from 1 to CTS_MAX_PIECE in turn when piece is 0.  Returns the
+ * elapsed time in microseconds or -1 on failure.
+ */
+
+static double
+ctsCrypt(CCOperation op, CCAlgorithm alg, CCPadding padding, size_t piece, uint8_t *key, size_t keyLength, uint8_t *iv,
+         const uint8_t *in, size_t len, uint8_t *out, size_t outSpace, size_t *outLen)
+{
+    CCCryptorRef cref;
+    struct timeval start, stop;
+    size_t pos = 0, total = 0, moved, n, next = 1;
+
+    gettimeofday(&start, NULL);
+    if(CCCryptorCreateWithMode(op, kCCModeCBC, alg, padding, iv, key, keyLength, NULL, 0, 0, 0, &cref)) return -1;
+    while(pos < len) {
+        if(piece) n = piece;
+        else {
+            n = next;
+            next = (next == CTS_MAX_PIECE) ? 1: next + 1;
+        }
+        if(n > len - pos) n = len - pos;
+        if(CCCryptorUpdate(cref, in + pos, n, out + total, outSpace - total, &moved)) { CCCryptorRelease(cref); return -1; }
+        pos += n; total += moved;
+    }
+    if(CCCryptorFinal(cref, out + total, outSpace - total, &moved)) { CCCryptorRelease(cref); return -1; }
+    CCCryptorRelease(cref);
+    gettimeofday(&stop, NULL);
+    *outLen = total + moved;
+    return (stop.tv_sec - start.tv_sec) * 1000000.0 + (stop.tv_usec - start.tv_usec);
+}
+
+/*
+ * A short message in fixed pieces of every size from 1 to 64 bytes, both
+ * ways, against the same message in one update.
+ */
+
+static int
+ctsPieces(CCAlgorithm alg, CCPadding padding, uint8_t *key, size_t keyLength, uint8_t *iv, const uint8_t *plain)
+{
+    uint8_t expected[CTS_SHORT + 32], out[CTS_SHORT + 32], back[CTS_SHORT + 32];
+    size_t expectedLen, outLen, backLen, piece;
+
+    if(ctsCrypt(kCCEncrypt, alg, padding, CTS_SHORT, key, keyLength, iv, plain, CTS_SHORT, expected, sizeof(expected), &expectedLen) < 0) return 0;
+    for(piece = 1; piece <= 64; piece++) {
+        if(ctsCrypt(kCCEncrypt, alg, padding, piece, key, keyLength, iv, plain, CTS_SHORT, out, sizeof(out), &outLen) < 0) return 0;
+        if(outLen != expectedLen || memcmp(out, expected, outLen)) return 0;
+        if(ctsCrypt(kCCDecrypt, alg, padding, piece, key, keyLength, iv, out, outLen, back, sizeof(back), &backLen) < 0) return 0;
+        if(backLen != CTS_SHORT || memcmp(back, plain, CTS_SHORT)) return 0;
+    }
+    return 1;
+}
+
+/*
+ * The long message with every update size from 1 to 4096 bytes, timed,
+ * against the same message in one update.
+ */
+
+static int
+ctsThroughput(CCOperation op, CCAlgorithm alg, CCPadding padding, const char *name, uint8_t *key, size_t keyLength, uint8_t *iv,
+              const uint8_t *in, size_t len, const uint8_t *expected, size_t expectedLen, uint8_t *out)
+{
+    double usecs;
+    size_t outLen;
+
+    if((usecs = ctsCrypt(op, alg, padding, 0, key, keyLength, iv, in, len, out, CTS_SPACE, &outLen)) < 0) return 0;
+    if(usecs > 0) diag("%s, updates of 1-4096 bytes: %.1f MB/s", name, (double) len / usecs);
+    return outLen == expectedLen && memcmp(out, expected, outLen) == 0;
+}
+
+int CommonCryptoCTSStream(int argc, char *const *argv)
+{
+    static const CCPadding paddings[] = { ccCBCCTS1, ccCBCCTS2, ccCBCCTS3 };
+    static const char *encryptNames[] = { "AES CTS1 encrypt", "AES CTS2 encrypt", "AES CTS3 encrypt" };
+    static const char *decryptNames[] = { "AES CTS1 decrypt", "AES CTS2 decrypt", "AES CTS3 decrypt" };
+    uint8_t key[24], iv[16];
+    uint8_t *plain, *cipher, *out;
+    size_t cipherLen, i;
+    int p;
+
+	plan_tests(kTestTestCount);
+    memset(key, 0x3c, sizeof(key));
+    memset(iv, 0x5a, sizeof(iv));
+    plain = malloc(CTS_SPACE);
+    cipher = malloc(CTS_SPACE);
+    out = malloc(CTS_SPACE);
+    for(i = 0; i < CTS_LEN; i++) plain[i] = (uint8_t) (i * 11);
+
+    for(p = 0; p < 3; p++) {
+        ok(ctsPieces(kCCAlgorithmAES128, paddings[p], key, 16, iv, plain), "AES CTS fixed pieces of 1-64 bytes");
+        ctsCrypt(kCCEncrypt, kCCAlgorithmAES128, paddings[p], CTS_LEN, key, 16, iv, plain, CTS_LEN, cipher, CTS_SPACE, &cipherLen);
+        ok(ctsThroughput(kCCEncrypt, kCCAlgorithmAES128, paddings[p], encryptNames[p], key, 16, iv, plain, CTS_LEN, cipher, cipherLen, out),
+           "AES CTS encrypt, updates of 1-4096 bytes");
+        ok(ctsThroughput(kCCDecrypt, kCCAlgorithmAES128, paddings[p], decryptNames[p], key, 16, iv, cipher, cipherLen, plain, CTS_LEN, out),
+           "AES CTS decrypt, updates of 1-4096 bytes");
+    }
+
+    /* 8 byte blocks: four to the ring */
+    ok(ctsPieces(kCCAlgorithm3DES, ccCBCCTS3, key, 24, iv, plain), "3DES CTS3 fixed pieces of 1-64 bytes");
+
+    free(plain);
+    free(cipher);
+    free(out);
+    return 0;
+}
+
+#endif
@@ -0,0 +1,163 @@
+//
+//  CommonCryptoClone.c
+//  CommonCrypto
+//
+
+#include "capabilities.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <CommonCrypto/CommonCryptor.h>
+#include <CommonCrypto/CommonCryptorSPI.h>
+#include "testmore.h"
+
+#if (CCCRYPTORCLONE == 0)
+entryPoint(CommonCryptoClone,"CommonCrypto Cryptor Cloning")
+#else
+
+static int kTestTestCount = 8;
+
+#define CLONE_LEN 1000
+#define CLONE_PREFIX 333
+
+/*
+ * Run a prefix through one cryptor, clone it, and finish the message on
+ * both.  Each has to produce what a fresh cryptor does over the whole
+ * message, and the two have to stay independent - the original is
+ * finished first, so a clone sharing its state would come out wrong.
+ */
+
+static int
+cloneMatches(CCCryptorRef cref, const uint8_t *in, const uint8_t *expected, size_t expectedLen)
+{
+    CCCryptorRef clone = NULL;
+    uint8_t out[2][CLONE_LEN + 32];
+    size_t prefixLen, moved, total;
+    int succeeded = 0;
+
+    if(CCCryptorUpdate(cref, in, CLONE_PREFIX, out[0], sizeof(out[0]), &prefixLen)) goto out;
+    if(CCCryptorClone(cref, &clone)) goto out;
+    memcpy(out[1], out[0], prefixLen);
+
+    for(int i = 0; i < 2; i++) {
+        CCCryptorRef c = (i == 0) ? cref: clone;
+        total = prefixLen;
+        if(CCCryptorUpdate(c, in + CLONE_PREFIX, CLONE_LEN - CLONE_PREFIX, out[i] + total, sizeof(out[i]) - total, &moved)) goto out;
+        total += moved;
+        if(CCCryptorFinal(c, out[i] + total, sizeof(out[i]) - total, &moved)) goto out;
+        total += moved;
+        if(total != expectedLen || memcmp(out[i], expected, expectedLen)) goto out;
+    }
+    succeeded = 1;
+out:
+    CCCryptorRelease(clone);
+    return succeeded;
+}
+
+static int
+cloneMode(CCMode mode, CCPadding padding, const uint8_t *key, const uint8_t *iv, const uint8_t *plain)
+{
+    CCCryptorRef cref;
+    uint8_t expected[CLONE_LEN + 32];
+    size_t expectedLen, moved;
+    int succeeded;
+
+    if(CCCryptorCreateWithMode(kCCEncrypt, mode, kCCAlgorithmAES128, padding, iv, key, 16, NULL, 0, 0, kCCModeOptionCTR_BE, &cref)) return 0;
+    if(CCCryptorUpdate(cref, plain, CLONE_LEN, expected, sizeof(expected), &expectedLen) ||
+       CCCryptorFinal(cref, expected + expectedLen, sizeof(expected) - expectedLen, &moved)) {
+        CCCryptorRelease(cref);
+        return 0;
+    }
+    expectedLen += moved;
+    CCCryptorRelease(cref);
+
+    if(CCCryptorCreateWithMode(kCCEncrypt, mode, kCCAlgorithmAES128, padding, iv, key, 16, NULL, 0, 0, kCCModeOptionCTR_BE, &cref)) return 0;
+    succeeded = cloneMatches(cref, plain, expected, expectedLen);
+    CCCryptorRelease(cref);
+    return succeeded;
+}
+
+/*
+ * GCM cloned after the AAD and part of the text: the same ciphertext and
+ * tag from both.
+ */
+
+static int
+cloneGCM(const uint8_t *key, const uint8_t *iv, const uint8_t *plain)
+{
+    CCCryptorRef cref = NULL, clone = NULL;
+    uint8_t out[3][CLONE_LEN], tag[3][16];
+    size_t tagLen;
+    int succeeded = 0;
+
+    for(int i = 0; i < 2; i++) {
+        if(CCCryptorCreateWithMode(kCCEncrypt, kCCModeGCM, kCCAlgorithmAES128, ccNoPadding, NULL, key, 16, NULL, 0, 0, 0, &cref)) return 0;
+        if(CCCryptorGCMAddIV(cref, iv, 12) || CCCryptorGCMAddAAD(cref, plain + 500, 20)) goto out;
+        if(CCCryptorGCMEncrypt(cref, plain, CLONE_PREFIX, out[i])) goto out;
+        if(i == 0) {
+            if(CCCryptorGCMEncrypt(cref, plain + CLONE_PREFIX, CLONE_LEN - CLONE_PREFIX, out[0] + CLONE_PREFIX)) goto out;
+        } else {
+            if(CCCryptorClone(cref, &clone)) goto out;
+            memcpy(out[2], out[1], CLONE_PREFIX);
+            if(CCCryptorGCMEncrypt(cref, plain + CLONE_PREFIX, CLONE_LEN - CLONE_PREFIX, out[1] + CLONE_PREFIX)) goto out;
+            if(CCCryptorGCMEncrypt(clone, plain + CLONE_PREFIX, CLONE_LEN - CLONE_PREFIX, out[2] + CLONE_PREFIX)) goto out;
+            tagLen = 16;
+            if(CCCryptorGCMFinal(clone, tag[2], &tagLen)) goto out;
+        }
+        tagLen = 16;
+        if(CCCryptorGCMFinal(cref, tag[i], &tagLen)) goto out;
+        CCCryptorRelease(cref);
+        cref = NULL;
+    }
+    succeeded = !memcmp(out[0], out[1], CLONE_LEN) && !memcmp(out[0], out[2], CLONE_LEN) &&
+                !memcmp(tag[0], tag[1], 16) && !memcmp(tag[0], tag[2], 16);
+out:
+    CCCryptorRelease(cref);
+    CCCryptorRelease(clone);
+    return succeeded;
+}
+
+static int
+cloneFromKeySchedule(const uint8_t *key, const uint8_t *iv, const uint8_t *plain)
+{
+    CCKeyScheduleRef schedule;
+    CCCryptorRef cref;
+    uint8_t expected[CLONE_LEN + 32];
+    size_t expectedLen;
+    int succeeded = 0;
+
+    if(CCCrypt(kCCEncrypt, kCCAlgorithmAES128, kCCOptionPKCS7Padding, key, 16, iv, plain, CLONE_LEN, expected, sizeof(expected), &expectedLen)) return 0;
+    if(CCKeyScheduleCreate(kCCEncrypt, kCCModeCBC, kCCAlgorithmAES128, key, 16, NULL, 0, &schedule)) return 0;
+    if(CCCryptorCreateWithKeySchedule(schedule, ccPKCS7Padding, iv, &cref) == kCCSuccess) {
+        succeeded = cloneMatches(cref, plain, expected, expectedLen);
+        CCCryptorRelease(cref);
+    }
+    CCKeyScheduleRelease(schedule);
+    return succeeded;
+}
+
+int CommonCryptoClone(int argc, char *const *argv)
+{
+    uint8_t key[32], iv[16], plain[CLONE_LEN];
+    CCCryptorRef cref, clone;
+
+	plan_tests(kTestTestCount);
+    for(int i = 0; i < 32; i++) key[i] = (uint8_t) (i * 3 + 1);
+    for(int i = 0; i < 16; i++) iv[i] = (uint8_t) (0xf0 + i);
+    for(int i = 0; i < CLONE_LEN; i++) plain[i] = (uint8_t) (i * 13);
+
+    ok(cloneMode(kCCModeCBC, ccPKCS7Padding, key, iv, plain), "CBC clone with a partial block buffered");
+    ok(cloneMode(kCCModeCTR, ccNoPadding, key, iv, plain), "CTR clone mid-block");
+    ok(cloneMode(kCCModeCFB8, ccNoPadding, key, iv, plain), "CFB8 clone");
+    ok(cloneMode(kCCModeOFB, ccNoPadding, key, iv, plain), "OFB clone");
+    ok(cloneGCM(key, iv, plain), "GCM clone after AAD and part of the text");
+    ok(cloneFromKeySchedule(key, iv, plain), "clone of a cryptor from a key schedule");
+
+    ok(CCCryptorClone(NULL, &clone) == kCCParamError, "NULL cryptor");
+    CCCryptorCreateWithMode(kCCEncrypt, kCCModeGCMSIV, kCCAlgorithmAES128, ccNoPadding, NULL, key, 16, NULL, 0, 0, 0, &cref);
+    ok(CCCryptorClone(cref, &clone) == kCCUnimplemented, "GCM-SIV can't be cloned");
+    CCCryptorRelease(cref);
+    return 0;
+}
+
+#endif
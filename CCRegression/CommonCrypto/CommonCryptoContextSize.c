@@ -0,0 +1,98 @@
+//
+//  CommonCryptoContextSize.c
+//  CommonCrypto
+//
+
+#include "capabilities.h"
+#include <stdio.h>
+#include <string.h>
+#include <CommonCrypto/CommonCryptor.h>
+#include <CommonCrypto/CommonCryptorSPI.h>
+#include "CCCryptorTestFuncs.h"
+#include "testbyteBuffer.h"
+#include "testmore.h"
+
+#if (CCCONTEXTSIZE == 0)
+entryPoint(CommonCryptoContextSize,"CommonCrypto Cryptor Context Size Testing")
+#else
+
+static int kTestTestCount = 12;
+
+/*
+ * Encrypt the same plaintext with a heap allocated cryptor and one built in
+ * caller-supplied memory of the size reported by CCCryptorGetContextSizeWithMode().
+ */
+
+static int
+contextSizeTest(CCOperation op, CCMode mode, CCAlgorithm alg, size_t keyLength, size_t offset)
+{
+    CCCryptorRef heapRef = NULL, dataRef = NULL;
+    CCCryptorStatus retval;
+    uint8_t key[32], iv[16], plain[64], cipher1[64], cipher2[64];
+    size_t contextSize, dataUsed, moved;
+    uint8_t *data;
+    CCModeOptions options = (mode == kCCModeCTR) ? kCCModeOptionCTR_BE: 0;
+    int status = 0;
+    
+    memset(key, 0x5a, sizeof(key));
+    memset(iv, 0xa5, sizeof(iv));
+    memset(plain, 0x3c, sizeof(plain));
+    
+    retval = CCCryptorGetContextSizeWithMode(op, mode, alg, &contextSize);
+    if(retval != kCCSuccess) return 1;
+    
+    /* Exercise an unaligned caller buffer as well */
+    if((data = malloc(contextSize + offset)) == NULL) return 1;
+    retval = CCCryptorCreateFromDataWithMode(op, mode, alg, ccNoPadding, iv, key, keyLength, NULL, 0, 0, options,
+                                             data + offset, contextSize, &dataRef, &dataUsed);
+    if(retval != kCCSuccess || dataUsed > contextSize) status = 1;
+    
+    retval = CCCryptorCreateWithMode(op, mode, alg, ccNoPadding, iv, key, keyLength, NULL, 0, 0, options, &heapRef);
+    if(retval != kCCSuccess) status = 1;
+    
+    if(status == 0) {
+        if(CCCryptorUpdate(heapRef, plain, sizeof(plain), cipher1, sizeof(cipher1), &moved) != kCCSuccess) status = 1;
+        if(CCCryptorUpdate(dataRef, plain, sizeof(plain), cipher2, sizeof(cipher2), &moved) != kCCSuccess) status = 1;
+        if(memcmp(cipher1, cipher2, sizeof(cipher1))) status = 1;
+    }
+    
+    CCCryptorRelease(heapRef);
+    CCCryptorRelease(dataRef);
+    free(data);
+    return status;
+}
+
+int CommonCryptoContextSize(int argc, char *const *argv)
+{
+    CCCryptorRef cref;
+	CCCryptorStatus retval;
+    uint8_t key[16], small[16];
+    size_t contextSize, dataUsed;
+    
+	plan_tests(kTestTestCount);
+    memset(key, 0, sizeof(key));
+    
+    retval = CCCryptorGetContextSizeWithMode(kCCEncrypt, kCCModeCBC, kCCAlgorithmAES128, NULL);
+    ok(retval == kCCParamError, "NULL size pointer rejected");
+    
+    retval = CCCryptorGetContextSizeWithMode(kCCEncrypt, kCCModeCBC, kCCAlgorithmAES128, &contextSize);
+    ok(retval == kCCSuccess && contextSize > 0, "AES-CBC context size reported");
+    
+    retval = CCCryptorCreateFromDataWithMode(kCCEncrypt, kCCModeCBC, kCCAlgorithmAES128, ccNoPadding, NULL, key, 16, NULL, 0, 0, 0,
+                                             small, sizeof(small), &cref, &dataUsed);
+    ok(retval == kCCBufferTooSmall && dataUsed == contextSize, "Too small buffer reports the full context size");
+    
+    ok(contextSizeTest(kCCEncrypt, kCCModeCBC, kCCAlgorithmAES128, 16, 0) == 0, "AES-CBC encrypt in caller memory");
+    ok(contextSizeTest(kCCDecrypt, kCCModeCBC, kCCAlgorithmAES128, 32, 3) == 0, "AES-CBC decrypt in unaligned caller memory");
+    ok(contextSizeTest(kCCEncrypt, kCCModeECB, kCCAlgorithmAES128, 16, 7) == 0, "AES-ECB encrypt in unaligned caller memory");
+    ok(contextSizeTest(kCCEncrypt, kCCModeCTR, kCCAlgorithmAES128, 16, 0) == 0, "AES-CTR encrypt in caller memory");
+    ok(contextSizeTest(kCCEncrypt, kCCModeOFB, kCCAlgorithmAES128, 24, 1) == 0, "AES-OFB encrypt in unaligned caller memory");
+    ok(contextSizeTest(kCCEncrypt, kCCModeCFB, kCCAlgorithmAES128, 16, 0) == 0, "AES-CFB encrypt in caller memory");
+    ok(contextSizeTest(kCCEncrypt, kCCModeCBC, kCCAlgorithm3DES, 24, 5) == 0, "3DES-CBC encrypt in unaligned caller memory");
+    ok(contextSizeTest(kCCEncrypt, kCCModeCBC, kCCAlgorithmBlowfish, 16, 0) == 0, "Blowfish-CBC encrypt in caller memory");
+    ok(contextSizeTest(kCCEncrypt, kCCModeRC4, kCCAlgorithmRC4, 16, 2) == 0, "RC4 in unaligned caller memory");
+    
+    return 0;
+}
+
+#endif
@@ -0,0 +1,88 @@
+//
+//  CommonCryptoCreatePerf.c
+//  CommonCrypto
+//
+
+#include "capabilities.h"
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+#include <CommonCrypto/CommonCryptor.h>
+#include <CommonCrypto/CommonCryptorSPI.h>
+#include "CCCryptorTestFuncs.h"
+#include "testbyteBuffer.h"
+#include "testmore.h"
+
+#if (CCCREATEPERF == 0)
+entryPoint(CommonCryptoCreatePerf,"CommonCrypto Create/Release Benchmark")
+#else
+
+static int kTestTestCount = 8;
+
+#define CREATE_LOOPS 10000
+
+/*
+ * Create and release CREATE_LOOPS cryptors, returning the elapsed time in
+ * microseconds or -1 on failure.
+ */
+
+static double
+createReleaseLoop(CCOperation op, CCMode mode, uint8_t *key, size_t keyLength)
+{
+    CCCryptorRef cref;
+    struct timeval start, stop;
+    int i;
+
+    gettimeofday(&start, NULL);
+    for(i = 0; i < CREATE_LOOPS; i++) {
+        if(CCCryptorCreateWithMode(op, mode, kCCAlgorithmAES128, ccNoPadding, NULL, key, keyLength, key, keyLength, 0, 0, &cref) != kCCSuccess) return -1;
+        CCCryptorRelease(cref);
+    }
+    gettimeofday(&stop, NULL);
+    return (stop.tv_sec - start.tv_sec) * 1000000.0 + (stop.tv_usec - start.tv_usec);
+}
+
+static int
+benchMode(CCMode mode, const char *name, uint8_t *key)
+{
+    double oneWay, both;
+
+    oneWay = createReleaseLoop(kCCEncrypt, mode, key, kCCKeySizeAES256);
+    both = createReleaseLoop(kCCBoth, mode, key, kCCKeySizeAES256);
+    if(oneWay < 0 || both < 0) return 0;
+    diag("%s create/release: one direction %.3f us, both directions %.3f us", name, oneWay / CREATE_LOOPS, both / CREATE_LOOPS);
+    return 1;
+}
+
+int CommonCryptoCreatePerf(int argc, char *const *argv)
+{
+    uint8_t key[kCCKeySizeAES256], plain[64], cipher[64], decrypted[64];
+    CCCryptorRef encRef, bothRef;
+
+	plan_tests(kTestTestCount);
+    memset(key, 0x42, sizeof(key));
+    memset(plain, 0x5a, sizeof(plain));
+
+    ok(benchMode(kCCModeECB, "AES-256-ECB", key), "ECB create/release loop");
+    ok(benchMode(kCCModeCBC, "AES-256-CBC", key), "CBC create/release loop");
+#if defined (__i386__) || defined(__x86_64__)
+    ok(benchMode(kCCModeXTS, "AES-256-XTS", key), "XTS create/release loop");
+#else
+    ok(1, "XTS not available");
+#endif
+
+    /* The decrypt schedule of an encrypt cryptor is expanded on first use */
+    ok(CCCryptorCreateWithMode(kCCEncrypt, kCCModeECB, kCCAlgorithmAES128, ccNoPadding, NULL, key, sizeof(key), NULL, 0, 0, 0, &encRef) == kCCSuccess, "create ECB encryptor");
+    ok(CCCryptorCreateWithMode(kCCBoth, kCCModeECB, kCCAlgorithmAES128, ccNoPadding, NULL, key, sizeof(key), NULL, 0, 0, 0, &bothRef) == kCCSuccess, "create ECB cryptor for both directions");
+    ok(CCCryptorEncryptDataBlock(encRef, NULL, plain, sizeof(plain), cipher) == kCCSuccess, "encrypt block");
+    ok(CCCryptorDecryptDataBlock(encRef, NULL, cipher, sizeof(cipher), decrypted) == kCCSuccess &&
+       memcmp(plain, decrypted, sizeof(plain)) == 0, "lazily expanded decrypt round trips");
+    ok(CCCryptorDecryptDataBlock(bothRef, NULL, cipher, sizeof(cipher), decrypted) == kCCSuccess &&
+       memcmp(plain, decrypted, sizeof(plain)) == 0, "matches eagerly expanded decrypt");
+    CCCryptorRelease(encRef);
+    CCCryptorRelease(bothRef);
+
+    return 0;
+}
+
+#endif
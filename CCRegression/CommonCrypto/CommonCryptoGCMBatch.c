@@ -0,0 +1,164 @@
+//
+//  CommonCryptoGCMBatch.c
+//  CommonCrypto
+//
+
+#include "capabilities.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <CommonCrypto/CommonCryptor.h>
+#include <CommonCrypto/CommonCryptorSPI.h>
+#include "testmore.h"
+
+#if (CCGCMBATCH == 0)
+entryPoint(CommonCryptoGCMBatch,"CommonCrypto GCM Seal/Open Batch")
+#else
+
+static int kTestTestCount = 8;
+
+#define GCMBATCH_COUNT 37
+#define GCMBATCH_MAXLEN 1500
+#define GCMBATCH_LOOPS 2000
+
+static uint8_t plain[GCMBATCH_COUNT][GCMBATCH_MAXLEN];
+static uint8_t sealed[GCMBATCH_COUNT][GCMBATCH_MAXLEN];
+static uint8_t expected[GCMBATCH_COUNT][GCMBATCH_MAXLEN];
+static uint8_t tags[GCMBATCH_COUNT][16];
+static uint8_t expectedTags[GCMBATCH_COUNT][16];
+static uint8_t ivs[GCMBATCH_COUNT][16];
+
+/*
+ * Lengths from empty to a full packet, some with a partial block or an
+ * odd IV, so the pooled tails and the 8 block batches both get used.
+ */
+
+static void
+setupEntries(CCGCMBatchEntry *entries, uint8_t (*in)[GCMBATCH_MAXLEN], uint8_t (*out)[GCMBATCH_MAXLEN])
+{
+    for(int i = 0; i < GCMBATCH_COUNT; i++) {
+        entries[i].iv = ivs[i];
+        entries[i].ivLen = (i % 7 == 3) ? 16: 12;
+        entries[i].aData = plain[(i + 1) % GCMBATCH_COUNT];
+        entries[i].aDataLen = (i * 5) % 41;
+        entries[i].dataIn = in[i];
+        entries[i].dataInLength = (i * 97 + (i & 1) * 1200) % (GCMBATCH_MAXLEN + 1);
+        entries[i].dataOut = out[i];
+        entries[i].tag = tags[i];
+        entries[i].tagLength = 16;
+    }
+}
+
+static int
+sealMatches(CCKeyScheduleRef schedule, const uint8_t *key)
+{
+    CCGCMBatchEntry entries[GCMBATCH_COUNT];
+    size_t tagLength;
+
+    setupEntries(entries, plain, sealed);
+    for(int i = 0; i < GCMBATCH_COUNT; i++) {
+        tagLength = 16;
+        if(CCCryptorGCM(kCCEncrypt, kCCAlgorithmAES128, key, 16, entries[i].iv, entries[i].ivLen, entries[i].aData, entries[i].aDataLen,
+                        plain[i], entries[i].dataInLength, expected[i], expectedTags[i], &tagLength)) return 0;
+    }
+    if(CCCryptorGCMSealBatch(schedule, entries, GCMBATCH_COUNT)) return 0;
+    for(int i = 0; i < GCMBATCH_COUNT; i++)
+        if(entries[i].status || memcmp(sealed[i], expected[i], entries[i].dataInLength) || memcmp(tags[i], expectedTags[i], 16)) return 0;
+    return 1;
+}
+
+/* Open what sealMatches() sealed, in place, with one tag spoiled */
+static int
+openInPlace(CCKeyScheduleRef schedule)
+{
+    CCGCMBatchEntry entries[GCMBATCH_COUNT];
+    int bad = 5;
+
+    setupEntries(entries, sealed, sealed);
+    memcpy(tags, expectedTags, sizeof(tags));
+    tags[bad][15] ^= 1;
+    if(CCCryptorGCMOpenBatch(schedule, entries, GCMBATCH_COUNT) != kCCDecodeError) return 0;
+    for(int i = 0; i < GCMBATCH_COUNT; i++) {
+        if(i == bad) {
+            if(entries[i].status != kCCDecodeError) return 0;
+            for(size_t j = 0; j < entries[i].dataInLength; j++) if(sealed[i][j]) return 0;
+        } else if(entries[i].status || memcmp(sealed[i], plain[i], entries[i].dataInLength)) return 0;
+    }
+    return 1;
+}
+
+/* 1200 byte packets, batched and one at a time */
+static int
+benchPackets(CCKeyScheduleRef schedule)
+{
+    CCGCMBatchEntry entries[GCMBATCH_COUNT];
+    struct timeval start, stop;
+    double elapsed[2];
+    size_t tagLength;
+
+    setupEntries(entries, plain, sealed);
+    for(int i = 0; i < GCMBATCH_COUNT; i++) {
+        entries[i].ivLen = 12;
+        entries[i].aDataLen = 16;
+        entries[i].dataInLength = 1200;
+    }
+    for(int how = 0; how < 2; how++) {
+        gettimeofday(&start, NULL);
+        for(int loop = 0; loop < GCMBATCH_LOOPS; loop++) {
+            if(how == 0) {
+                if(CCCryptorGCMSealBatch(schedule, entries, GCMBATCH_COUNT)) return 0;
+                continue;
+            }
+            for(int i = 0; i < GCMBATCH_COUNT; i++) {
+                tagLength = 16;
+                if(CCCryptorGCMOneShotWithKey(schedule, kCCEncrypt, entries[i].iv, 12, entries[i].aData, 16,
+                                              entries[i].dataIn, 1200, entries[i].dataOut, entries[i].tag, &tagLength)) return 0;
+            }
+        }
+        gettimeofday(&stop, NULL);
+        elapsed[how] = (stop.tv_sec - start.tv_sec) * 1000000.0 + (stop.tv_usec - start.tv_usec);
+    }
+    diag("1200 byte packets: batched %.3f us, one at a time %.3f us per packet",
+         elapsed[0] / (GCMBATCH_LOOPS * GCMBATCH_COUNT), elapsed[1] / (GCMBATCH_LOOPS * GCMBATCH_COUNT));
+    return 1;
+}
+
+int CommonCryptoGCMBatch(int argc, char *const *argv)
+{
+    uint8_t key[16];
+    CCKeyScheduleRef sealKey, openKey;
+    CCGCMBatchEntry entries[GCMBATCH_COUNT];
+
+	plan_tests(kTestTestCount);
+    for(int i = 0; i < 16; i++) key[i] = (uint8_t) (i * 17 + 9);
+    for(int i = 0; i < GCMBATCH_COUNT; i++) {
+        for(int j = 0; j < 16; j++) ivs[i][j] = (uint8_t) (i * 31 + j);
+        for(int j = 0; j < GCMBATCH_MAXLEN; j++) plain[i][j] = (uint8_t) (i + j * 3);
+    }
+    CCKeyScheduleCreate(kCCEncrypt, kCCModeGCM, kCCAlgorithmAES128, key, 16, NULL, 0, &sealKey);
+    CCKeyScheduleCreate(kCCDecrypt, kCCModeGCM, kCCAlgorithmAES128, key, 16, NULL, 0, &openKey);
+
+    ok(sealMatches(sealKey, key), "sealed batch matches CCCryptorGCM");
+    ok(openInPlace(openKey), "opened in place, bad tag refused and wiped");
+    ok(benchPackets(sealKey), "packet benchmark");
+
+    setupEntries(entries, plain, sealed);
+    entries[1].tag = NULL;
+    ok(CCCryptorGCMSealBatch(sealKey, entries, 2) == kCCParamError && entries[0].status == kCCSuccess &&
+       entries[1].status == kCCParamError, "bad entry refused, the rest run");
+    setupEntries(entries, plain, sealed);
+    entries[0].iv = NULL;
+    entries[1].aData = NULL;
+    ok(CCCryptorGCMSealBatch(sealKey, entries, 3) == kCCParamError && entries[0].status == kCCParamError &&
+       entries[1].status == kCCParamError && entries[2].status == kCCSuccess, "NULL IV and AAD with lengths refused");
+    ok(CCCryptorGCMSealBatch(openKey, entries, 1) == kCCParamError, "schedule for the other direction");
+    ok(CCCryptorGCMSealBatch(NULL, entries, 1) == kCCParamError, "NULL schedule");
+    ok(CCCryptorGCMOpenBatch(openKey, NULL, 0) == kCCSuccess, "empty batch");
+
+    CCKeyScheduleRelease(sealKey);
+    CCKeyScheduleRelease(openKey);
+    return 0;
+}
+
+#endif
@@ -0,0 +1,93 @@
+//
+//  CommonCryptoGCMKey.c
+//  CommonCrypto
+//
+
+#include "capabilities.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <CommonCrypto/CommonCryptor.h>
+#include <CommonCrypto/CommonCryptorSPI.h>
+#include "testmore.h"
+
+#if (CCGCMKEY == 0)
+entryPoint(CommonCryptoGCMKey,"CommonCrypto GCM One-Shot With Key")
+#else
+
+static int kTestTestCount = 7;
+
+#define GCMKEY_LEN 1000
+
+/*
+ * Messages of assorted lengths, AAD and IV lengths - some short of a
+ * block, some long enough for the wide batches - through one schedule,
+ * each checked against CCCryptorGCM() with the raw key.
+ */
+
+static int
+oneShotMatches(CCKeyScheduleRef schedule, CCOperation op, const uint8_t *key, size_t keyLength, const uint8_t *plain)
+{
+    static const size_t lengths[][3] = {    /* iv, aad, text */
+        { 12, 0, 0 }, { 12, 20, 100 }, { 12, 0, 128 }, { 16, 13, 1000 }, { 1, 300, 31 }, { 12, 16, 257 },
+    };
+    uint8_t cipher[GCMKEY_LEN], out[GCMKEY_LEN], tag[16], tag2[16];
+    size_t tagLength;
+
+    for(size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+        size_t ivLen = lengths[i][0], aadLen = lengths[i][1], len = lengths[i][2];
+        const uint8_t *iv = plain + 700, *aad = plain + 400;
+
+        tagLength = sizeof(tag);
+        if(CCCryptorGCM(kCCEncrypt, kCCAlgorithmAES128, key, keyLength, iv, ivLen, aad, aadLen, plain, len, cipher, tag, &tagLength)) return 0;
+        tagLength = sizeof(tag2);
+        if(op == kCCEncrypt) {
+            if(CCCryptorGCMOneShotWithKey(schedule, op, iv, ivLen, aad, aadLen, plain, len, out, tag2, &tagLength)) return 0;
+            if(memcmp(out, cipher, len)) return 0;
+        } else {
+            if(CCCryptorGCMOneShotWithKey(schedule, op, iv, ivLen, aad, aadLen, cipher, len, out, tag2, &tagLength)) return 0;
+            if(memcmp(out, plain, len)) return 0;
+        }
+        if(memcmp(tag, tag2, sizeof(tag))) return 0;
+    }
+    return 1;
+}
+
+int CommonCryptoGCMKey(int argc, char *const *argv)
+{
+    uint8_t key[32], plain[GCMKEY_LEN], out[16], tag[16];
+    CCKeyScheduleRef schedule;
+    size_t tagLength = sizeof(tag);
+
+	plan_tests(kTestTestCount);
+    for(int i = 0; i < 32; i++) key[i] = (uint8_t) (i * 7 + 2);
+    for(int i = 0; i < GCMKEY_LEN; i++) plain[i] = (uint8_t) (i * 11);
+
+    CCKeyScheduleCreate(kCCEncrypt, kCCModeGCM, kCCAlgorithmAES128, key, 16, NULL, 0, &schedule);
+    ok(oneShotMatches(schedule, kCCEncrypt, key, 16, plain), "AES-128 encrypt matches CCCryptorGCM");
+    ok(CCCryptorGCMOneShotWithKey(schedule, kCCDecrypt, plain, 12, NULL, 0, plain, 16, out, tag, &tagLength) == kCCParamError,
+       "direction the schedule wasn't created for");
+    CCKeyScheduleRelease(schedule);
+
+    CCKeyScheduleCreate(kCCDecrypt, kCCModeGCM, kCCAlgorithmAES128, key, 32, NULL, 0, &schedule);
+    ok(oneShotMatches(schedule, kCCDecrypt, key, 32, plain), "AES-256 decrypt matches CCCryptorGCM");
+    CCKeyScheduleRelease(schedule);
+
+    CCKeyScheduleCreate(kCCBoth, kCCModeGCM, kCCAlgorithmAES128, key, 24, NULL, 0, &schedule);
+    ok(oneShotMatches(schedule, kCCEncrypt, key, 24, plain) && oneShotMatches(schedule, kCCDecrypt, key, 24, plain),
+       "AES-192 both directions from one schedule");
+    CCKeyScheduleRelease(schedule);
+
+    CCKeyScheduleCreate(kCCEncrypt, kCCModeCBC, kCCAlgorithmAES128, key, 16, NULL, 0, &schedule);
+    ok(CCCryptorGCMOneShotWithKey(schedule, kCCEncrypt, plain, 12, NULL, 0, plain, 16, out, tag, &tagLength) == kCCParamError,
+       "CBC schedule refused");
+    CCKeyScheduleRelease(schedule);
+
+    ok(CCCryptorGCMOneShotWithKey(NULL, kCCEncrypt, plain, 12, NULL, 0, plain, 16, out, tag, &tagLength) == kCCParamError, "NULL schedule");
+    CCKeyScheduleCreate(kCCEncrypt, kCCModeGCM, kCCAlgorithmAES128, key, 16, NULL, 0, &schedule);
+    ok(CCCryptorGCMOneShotWithKey(schedule, kCCEncrypt, plain, 12, NULL, 0, plain, 16, out, NULL, &tagLength) == kCCParamError, "NULL tag");
+    CCKeyScheduleRelease(schedule);
+    return 0;
+}
+
+#endif
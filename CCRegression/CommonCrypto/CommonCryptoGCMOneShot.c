@@ -0,0 +1,131 @@
+//
+//  CommonCryptoGCMOneShot.c
+//  CommonCrypto
+//
+
+#include "capabilities.h"
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+#include <CommonCrypto/CommonCryptor.h>
+#include <CommonCrypto/CommonCryptorSPI.h>
+#include <CommonCrypto/CommonCryptoAllocator.h>
+#include "testmore.h"
+
+#if (CCGCMONESHOT == 0)
+entryPoint(CommonCryptoGCMOneShot,"CommonCrypto GCM One-Shot Allocation Benchmark")
+#else
+
+static int kTestTestCount = 8;
+
+#define ONESHOT_LOOPS 100000
+#define ONESHOT_LEN 100
+
+/*
+ * Each way of sealing a ONESHOT_LEN byte message, run ONESHOT_LOOPS times
+ * with this thread's allocations counted.  Streaming is what CCCryptorGCM()
+ * used to do: a cryptor created, driven and released per message.
+ */
+
+enum { streaming, oneShot, withKey };
+
+static int
+sealMessage(int how, CCKeyScheduleRef schedule, const uint8_t *key, const uint8_t *iv, const uint8_t *in, uint8_t *out, uint8_t *tag)
+{
+    CCCryptorRef cref;
+    size_t tagLength = 16;
+    int failed;
+
+    switch(how) {
+        case streaming:
+            if(CCCryptorCreateWithMode(kCCEncrypt, kCCModeGCM, kCCAlgorithmAES128, 0, NULL, key, 16, NULL, 0, 0, 0, &cref)) return 1;
+            failed = CCCryptorGCMAddIV(cref, iv, 12) || CCCryptorGCMAddAAD(cref, in, 16) ||
+                     CCCryptorGCMEncrypt(cref, in, ONESHOT_LEN, out) || CCCryptorGCMFinal(cref, tag, &tagLength);
+            CCCryptorRelease(cref);
+            return failed;
+        case oneShot:
+            return CCCryptorGCM(kCCEncrypt, kCCAlgorithmAES128, key, 16, iv, 12, in, 16, in, ONESHOT_LEN, out, tag, &tagLength);
+        default:
+            return CCCryptorGCMOneShotWithKey(schedule, kCCEncrypt, iv, 12, in, 16, in, ONESHOT_LEN, out, tag, &tagLength);
+    }
+}
+
+static int
+sealLoop(int how, const char *name, CCKeyScheduleRef schedule, const uint8_t *key, const uint8_t *iv, const uint8_t *in,
+         CCAllocatorStatistics *statistics)
+{
+    uint8_t out[ONESHOT_LEN], tag[16];
+    struct timeval start, stop;
+    double elapsed;
+
+    memset(statistics, 0, sizeof(*statistics));
+    gettimeofday(&start, NULL);
+    CCAllocatorCountThread(statistics);
+    for(int i = 0; i < ONESHOT_LOOPS; i++)
+        if(sealMessage(how, schedule, key, iv, in, out, tag)) break;
+    CCAllocatorCountThread(NULL);
+    gettimeofday(&stop, NULL);
+    elapsed = (stop.tv_sec - start.tv_sec) * 1000000.0 + (stop.tv_usec - start.tv_usec);
+    diag("%s: %.3f us, %.2f allocations (%llu bytes) per message", name, elapsed / ONESHOT_LOOPS,
+         (double) statistics->allocations / ONESHOT_LOOPS, (unsigned long long) (statistics->bytesAllocated / ONESHOT_LOOPS));
+    return 1;
+}
+
+/* Allocations made and left behind by one failing CCCryptorGCM() */
+static int
+errorPathBalanced(CCOperation op, const uint8_t *key, const uint8_t *iv, const void *in, uint8_t *out)
+{
+    CCAllocatorStatistics statistics;
+    uint8_t tag[16];
+    size_t tagLength = sizeof(tag);
+    CCCryptorStatus status;
+
+    memset(&statistics, 0, sizeof(statistics));
+    CCAllocatorCountThread(&statistics);
+    status = CCCryptorGCM(op, kCCAlgorithmAES128, key, 16, iv, 12, NULL, 0, in, ONESHOT_LEN, out, tag, &tagLength);
+    CCAllocatorCountThread(NULL);
+    return status == kCCParamError && statistics.allocations == statistics.deallocations;
+}
+
+int CommonCryptoGCMOneShot(int argc, char *const *argv)
+{
+    uint8_t keyBuf[17], iv[12], in[ONESHOT_LEN], out[2][ONESHOT_LEN], tag[2][16];
+    uint8_t *key = keyBuf, *unalignedKey = keyBuf + 1;
+    CCAllocatorStatistics statistics[3];
+    CCKeyScheduleRef schedule;
+    size_t contextSize = 0, tagLength = 16;
+
+	plan_tests(kTestTestCount);
+    for(int i = 0; i < (int) sizeof(keyBuf); i++) keyBuf[i] = (uint8_t) (i * 9 + 4);
+    memset(iv, 0x6c, sizeof(iv));
+    for(int i = 0; i < ONESHOT_LEN; i++) in[i] = (uint8_t) i;
+    CCKeyScheduleCreate(kCCEncrypt, kCCModeGCM, kCCAlgorithmAES128, key, 16, NULL, 0, &schedule);
+
+    CCCryptorGetContextSizeWithMode(kCCDecrypt, kCCModeGCM, kCCAlgorithmAES128, &contextSize);
+    ok(contextSize != 0 && contextSize <= kCCContextSizeGCM, "GCM cryptor fits kCCContextSizeGCM");
+
+    sealMessage(streaming, schedule, key, iv, in, out[0], tag[0]);
+    sealMessage(oneShot, schedule, key, iv, in, out[1], tag[1]);
+    ok(!memcmp(out[0], out[1], sizeof(out[0])) && !memcmp(tag[0], tag[1], sizeof(tag[0])), "CCCryptorGCM matches a streaming cryptor");
+
+    sealLoop(streaming, "create/release per message", schedule, key, iv, in, &statistics[streaming]);
+    sealLoop(oneShot, "CCCryptorGCM", schedule, key, iv, in, &statistics[oneShot]);
+    sealLoop(withKey, "CCCryptorGCMOneShotWithKey", schedule, key, iv, in, &statistics[withKey]);
+    ok(statistics[oneShot].allocations == 0, "CCCryptorGCM allocates nothing");
+    ok(statistics[withKey].allocations == 0, "CCCryptorGCMOneShotWithKey allocates nothing");
+    ok(statistics[streaming].allocations == statistics[streaming].deallocations, "streaming cryptors are all released");
+
+    memset(&statistics[0], 0, sizeof(statistics[0]));
+    CCAllocatorCountThread(&statistics[0]);
+    CCCryptorGCM(kCCEncrypt, kCCAlgorithmAES128, unalignedKey, 16, iv, 12, NULL, 0, in, ONESHOT_LEN, out[0], tag[0], &tagLength);
+    CCAllocatorCountThread(NULL);
+    ok(statistics[0].allocations == 0, "unaligned key allocates nothing");
+
+    ok(errorPathBalanced(kCCBoth, key, iv, in, out[0]), "kCCBoth refused without a leak");
+    ok(errorPathBalanced(kCCEncrypt, key, iv, NULL, out[0]), "NULL input refused without a leak");
+
+    CCKeyScheduleRelease(schedule);
+    return 0;
+}
+
+#endif
@@ -0,0 +1,127 @@
+//
+//  CommonCryptoGCMParallel.c
+//  CommonCrypto
+//
+
+#include "capabilities.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <CommonCrypto/CommonCryptor.h>
+#include <CommonCrypto/CommonCryptorSPI.h>
+#include "testmore.h"
+
+#if (CCGCMPARALLEL == 0)
+entryPoint(CommonCryptoGCMParallel,"CommonCrypto GCM Parallel Text")
+#else
+
+static int kTestTestCount = 7;
+
+#define GCMPAR_MAXLEN (4 * 1024 * 1024 + 37)
+#define GCMPAR_LOOPS 20
+
+static uint8_t plain[GCMPAR_MAXLEN];
+static uint8_t serialOut[GCMPAR_MAXLEN];
+static uint8_t parallelOut[GCMPAR_MAXLEN];
+
+static const uint8_t key[32] = {
+    0x60, 0x3d, 0xeb, 0x10, 0x15, 0xca, 0x71, 0xbe, 0x2b, 0x73, 0xae, 0xf0, 0x85, 0x7d, 0x77, 0x81,
+    0x1f, 0x35, 0x2c, 0x07, 0x3b, 0x61, 0x08, 0xd7, 0x2d, 0x98, 0x10, 0xa3, 0x09, 0x14, 0xdf, 0xf4 };
+static const uint8_t iv[12] = { 0xca, 0xfe, 0xba, 0xbe, 0xfa, 0xce, 0xdb, 0xad, 0xde, 0xca, 0xf8, 0x88 };
+
+/*
+ * Run a message through a cryptor set to nthreads, the text given in
+ * pieces of the lengths in splits (the rest in one go), and take its tag.
+ */
+
+static int
+gcmRun(CCOperation op, uint32_t nthreads, size_t aadLen, const uint8_t *in, size_t len,
+       const size_t *splits, uint8_t *out, uint8_t *tag)
+{
+    CCCryptorRef cref;
+    size_t tagLength = 16, done = 0, n;
+    int ok = 1;
+
+    if(CCCryptorCreateWithMode(op, kCCModeGCM, kCCAlgorithmAES128, ccNoPadding, NULL, key, 16, NULL, 0, 0, 0, &cref)) return 0;
+    if(CCCryptorSetParallelism(cref, nthreads)) ok = 0;
+    if(CCCryptorGCMAddIV(cref, iv, sizeof(iv))) ok = 0;
+    if(aadLen && CCCryptorGCMAddAAD(cref, plain + 1, aadLen)) ok = 0;
+    for(; ok && done < len; done += n) {
+        n = (splits && *splits) ? *splits++: len - done;
+        if(n > len - done) n = len - done;
+        if(op == kCCEncrypt) ok = CCCryptorGCMEncrypt(cref, in + done, n, out + done) == kCCSuccess;
+        else ok = CCCryptorGCMDecrypt(cref, in + done, n, out + done) == kCCSuccess;
+    }
+    if(ok && CCCryptorGCMFinal(cref, tag, &tagLength)) ok = 0;
+    CCCryptorRelease(cref);
+    return ok;
+}
+
+/* Parallel and serial give the same ciphertext and tag */
+static int
+sealMatches(size_t aadLen, size_t len, const size_t *splits)
+{
+    uint8_t serialTag[16], parallelTag[16];
+
+    if(!gcmRun(kCCEncrypt, 1, aadLen, plain, len, NULL, serialOut, serialTag)) return 0;
+    if(!gcmRun(kCCEncrypt, 8, aadLen, plain, len, splits, parallelOut, parallelTag)) return 0;
+    return memcmp(serialOut, parallelOut, len) == 0 && memcmp(serialTag, parallelTag, 16) == 0;
+}
+
+/* Decrypt sealMatches()' ciphertext in place, in parallel */
+static int
+openInPlace(size_t aadLen, size_t len)
+{
+    uint8_t serialTag[16], parallelTag[16];
+
+    if(!gcmRun(kCCEncrypt, 1, aadLen, plain, len, NULL, serialOut, serialTag)) return 0;
+    memcpy(parallelOut, serialOut, len);
+    if(!gcmRun(kCCDecrypt, 4, aadLen, parallelOut, len, NULL, parallelOut, parallelTag)) return 0;
+    return memcmp(parallelOut, plain, len) == 0 && memcmp(serialTag, parallelTag, 16) == 0;
+}
+
+static int
+benchText(void)
+{
+    struct timeval start, stop;
+    double elapsed[2];
+    uint8_t tag[16];
+    size_t len = 4 * 1024 * 1024;
+
+    for(int how = 0; how < 2; how++) {
+        gettimeofday(&start, NULL);
+        for(int loop = 0; loop < GCMPAR_LOOPS; loop++)
+            if(!gcmRun(kCCEncrypt, (how) ? 8: 1, 0, plain, len, NULL, parallelOut, tag)) return 0;
+        gettimeofday(&stop, NULL);
+        elapsed[how] = (stop.tv_sec - start.tv_sec) + (stop.tv_usec - start.tv_usec) / 1000000.0;
+    }
+    diag("4MB messages: serial %.0f MB/s, 8 threads %.0f MB/s", GCMPAR_LOOPS * 4 / elapsed[0], GCMPAR_LOOPS * 4 / elapsed[1]);
+    return 1;
+}
+
+int CommonCryptoGCMParallel(int argc, char *const *argv)
+{
+    /* A partial block ahead of the split, and a piece too short to split */
+    const size_t oddSplits[] = { 5, 300000, 1000, 2 * 1024 * 1024 + 3, 0 };
+    CCCryptorRef cref;
+
+	plan_tests(kTestTestCount);
+    for(size_t i = 0; i < GCMPAR_MAXLEN; i++) plain[i] = (uint8_t) (i * 7 + (i >> 13));
+
+    ok(sealMatches(0, 1024 * 1024, NULL), "1MB, no AAD");
+    ok(sealMatches(20, GCMPAR_MAXLEN, NULL), "4MB and a partial block, after AAD");
+    ok(sealMatches(33, GCMPAR_MAXLEN, oddSplits), "text in odd pieces");
+    ok(openInPlace(13, 3 * 1024 * 1024 + 5), "decrypted in place");
+    ok(benchText(), "throughput");
+
+    CCCryptorCreateWithMode(kCCEncrypt, kCCModeGCM, kCCAlgorithmAES128, ccNoPadding, NULL, key, 16, NULL, 0, 0, 0, &cref);
+    ok(CCCryptorSetParallelism(cref, 8) == kCCSuccess, "GCM accepts parallelism");
+    CCCryptorRelease(cref);
+    CCCryptorCreateWithMode(kCCEncrypt, kCCModeCBC, kCCAlgorithmAES128, ccNoPadding, NULL, key, 16, NULL, 0, 0, 0, &cref);
+    ok(CCCryptorSetParallelism(cref, 8) == kCCUnimplemented, "CBC encryption still refused");
+    CCCryptorRelease(cref);
+    return 0;
+}
+
+#endif
@@ -0,0 +1,142 @@
+//
+//  CommonCryptoInPlace.c
+//  CommonCrypto
+//
+
+#include "capabilities.h"
+#include <stdio.h>
+#include <string.h>
+#include <CommonCrypto/CommonCryptor.h>
+#include <CommonCrypto/CommonCryptorSPI.h>
+#include "CCCryptorTestFuncs.h"
+#include "testbyteBuffer.h"
+#include "testmore.h"
+
+#if (CCINPLACE == 0)
+entryPoint(CommonCryptoInPlace,"CommonCrypto In-Place Update Testing")
+#else
+
+static int kTestTestCount = 18;
+
+#define INPLACE_LEN 203
+#define INPLACE_ALIGNED 192
+#define INPLACE_SPACE (INPLACE_LEN + 32)
+
+/* Network-read sized pieces; the held back tail is carried into the next one */
+static const size_t pieces[] = { 1, 17, 5, 40, 16, 3, 64, 33 };
+
+static int
+copyCrypt(CCOperation op, CCMode mode, CCAlgorithm alg, CCPadding padding, uint8_t *key, uint8_t *iv, const uint8_t *in, size_t len, uint8_t *out, size_t *outLen)
+{
+    CCCryptorRef cref;
+    size_t moved, finalMoved;
+    CCModeOptions options = (mode == kCCModeCTR) ? kCCModeOptionCTR_BE: 0;
+
+    if(CCCryptorCreateWithMode(op, mode, alg, padding, iv, key, 16, NULL, 0, 0, options, &cref)) return 0;
+    if(CCCryptorUpdate(cref, in, len, out, INPLACE_SPACE, &moved) ||
+       CCCryptorFinal(cref, out + moved, INPLACE_SPACE - moved, &finalMoved)) {
+        CCCryptorRelease(cref);
+        return 0;
+    }
+    CCCryptorRelease(cref);
+    *outLen = moved + finalMoved;
+    return 1;
+}
+
+/*
+ * Walk one buffer with in-place updates, the way a caller decrypting
+ * network reads would, then finish in place.
+ */
+
+static int
+inPlaceCrypt(CCOperation op, CCMode mode, CCAlgorithm alg, CCPadding padding, uint8_t *key, uint8_t *iv, uint8_t *buf, size_t len, size_t *outLen)
+{
+    CCCryptorRef cref;
+    size_t pos = 0, pending = 0, moved;
+    CCModeOptions options = (mode == kCCModeCTR) ? kCCModeOptionCTR_BE: 0;
+    int i = 0, succeeded = 0;
+
+    if(CCCryptorCreateWithMode(op, mode, alg, padding, iv, key, 16, NULL, 0, 0, options, &cref)) return 0;
+    while(pos + pending < len) {
+        size_t n = pieces[i++ % (sizeof(pieces) / sizeof(pieces[0]))];
+        if(n > len - pos - pending) n = len - pos - pending;
+        pending += n;
+        if(CCCryptorUpdateInPlace(cref, buf + pos, pending, &moved)) goto out;
+        pos += moved; pending -= moved;
+    }
+    if(CCCryptorFinalInPlace(cref, buf + pos, pending, INPLACE_SPACE - pos, &moved)) goto out;
+    *outLen = pos + moved;
+    succeeded = 1;
+out:
+    CCCryptorRelease(cref);
+    return succeeded;
+}
+
+/*
+ * Encrypt and decrypt in place and check both against the copying path.
+ */
+
+static int
+inPlaceMatches(CCMode mode, CCAlgorithm alg, CCPadding padding, uint8_t *key, uint8_t *iv, const uint8_t *plain, size_t len)
+{
+    uint8_t expected[INPLACE_SPACE], buf[INPLACE_SPACE];
+    size_t expectedLen, cipherLen, plainLen;
+
+    if(!copyCrypt(kCCEncrypt, mode, alg, padding, key, iv, plain, len, expected, &expectedLen)) return 0;
+    memcpy(buf, plain, len);
+    if(!inPlaceCrypt(kCCEncrypt, mode, alg, padding, key, iv, buf, len, &cipherLen)) return 0;
+    if(cipherLen != expectedLen || memcmp(buf, expected, cipherLen)) return 0;
+    if(!inPlaceCrypt(kCCDecrypt, mode, alg, padding, key, iv, buf, cipherLen, &plainLen)) return 0;
+    return plainLen == len && memcmp(buf, plain, len) == 0;
+}
+
+int CommonCryptoInPlace(int argc, char *const *argv)
+{
+    uint8_t key[16], iv[16], plain[INPLACE_LEN], expected[INPLACE_SPACE], buf[INPLACE_SPACE];
+    CCCryptorRef cref;
+    size_t moved, expectedLen;
+    int i;
+
+	plan_tests(kTestTestCount);
+    memset(key, 0x2b, sizeof(key));
+    memset(iv, 0x0f, sizeof(iv));
+    for(i = 0; i < INPLACE_LEN; i++) plain[i] = (uint8_t) (i * 3);
+
+    ok(inPlaceMatches(kCCModeECB, kCCAlgorithmAES128, ccNoPadding, key, iv, plain, INPLACE_ALIGNED), "ECB");
+    ok(inPlaceMatches(kCCModeECB, kCCAlgorithmAES128, ccPKCS7Padding, key, iv, plain, INPLACE_LEN), "ECB PKCS7");
+    ok(inPlaceMatches(kCCModeCBC, kCCAlgorithmAES128, ccNoPadding, key, iv, plain, INPLACE_ALIGNED), "CBC");
+    ok(inPlaceMatches(kCCModeCBC, kCCAlgorithmAES128, ccPKCS7Padding, key, iv, plain, INPLACE_LEN), "CBC PKCS7");
+    ok(inPlaceMatches(kCCModeCBC, kCCAlgorithmAES128, ccPKCS7Padding, key, iv, plain, INPLACE_ALIGNED), "CBC PKCS7, aligned input");
+    ok(inPlaceMatches(kCCModeCBC, kCCAlgorithmAES128, ccCBCCTS1, key, iv, plain, INPLACE_LEN), "CBC CTS1");
+    ok(inPlaceMatches(kCCModeCBC, kCCAlgorithmAES128, ccCBCCTS2, key, iv, plain, INPLACE_LEN), "CBC CTS2");
+    ok(inPlaceMatches(kCCModeCBC, kCCAlgorithmAES128, ccCBCCTS3, key, iv, plain, INPLACE_LEN), "CBC CTS3");
+    ok(inPlaceMatches(kCCModeCBC, kCCAlgorithmAES128, ccCBCCTS3, key, iv, plain, INPLACE_ALIGNED), "CBC CTS3, aligned input");
+    ok(inPlaceMatches(kCCModeCFB, kCCAlgorithmAES128, ccNoPadding, key, iv, plain, INPLACE_LEN), "CFB");
+    ok(inPlaceMatches(kCCModeCFB8, kCCAlgorithmAES128, ccNoPadding, key, iv, plain, INPLACE_LEN), "CFB8");
+    ok(inPlaceMatches(kCCModeCTR, kCCAlgorithmAES128, ccNoPadding, key, iv, plain, INPLACE_LEN), "CTR");
+    ok(inPlaceMatches(kCCModeOFB, kCCAlgorithmAES128, ccNoPadding, key, iv, plain, INPLACE_LEN), "OFB");
+    ok(inPlaceMatches(kCCModeRC4, kCCAlgorithmRC4, ccNoPadding, key, iv, plain, INPLACE_LEN), "RC4");
+
+    /* A whole message through final alone */
+    copyCrypt(kCCEncrypt, kCCModeCBC, kCCAlgorithmAES128, ccPKCS7Padding, key, iv, plain, INPLACE_LEN, expected, &expectedLen);
+    memcpy(buf, plain, INPLACE_LEN);
+    CCCryptorCreateWithMode(kCCEncrypt, kCCModeCBC, kCCAlgorithmAES128, ccPKCS7Padding, iv, key, 16, NULL, 0, 0, 0, &cref);
+    ok(CCCryptorFinalInPlace(cref, buf, INPLACE_LEN, INPLACE_LEN, &moved) == kCCBufferTooSmall &&
+       memcmp(buf, plain, INPLACE_LEN) == 0, "no headroom for the padding block, nothing written");
+    ok(CCCryptorFinalInPlace(cref, buf, INPLACE_LEN, sizeof(buf), &moved) == kCCSuccess &&
+       moved == expectedLen && memcmp(buf, expected, moved) == 0, "whole message through final");
+    CCCryptorRelease(cref);
+
+    CCCryptorCreateWithMode(kCCEncrypt, kCCModeCBC, kCCAlgorithmAES128, ccNoPadding, iv, key, 16, NULL, 0, 0, 0, &cref);
+    ok(CCCryptorFinalInPlace(cref, buf, INPLACE_LEN, sizeof(buf), &moved) == kCCAlignmentError, "partial block without padding");
+    CCCryptorRelease(cref);
+
+    CCCryptorCreateWithMode(kCCEncrypt, kCCModeCBC, kCCAlgorithmAES128, ccPKCS7Padding, iv, key, 16, NULL, 0, 0, 0, &cref);
+    CCCryptorUpdate(cref, plain, 5, expected, sizeof(expected), &moved);
+    ok(CCCryptorUpdateInPlace(cref, buf, 32, &moved) == kCCParamError, "bytes buffered by CCCryptorUpdate");
+    CCCryptorRelease(cref);
+
+    return 0;
+}
+
+#endif
@@ -0,0 +1,96 @@
+//
+//  CommonCryptoKeySchedule.c
+//  CommonCrypto
+//
+
+#include "capabilities.h"
+#include <stdio.h>
+#include <string.h>
+#include <CommonCrypto/CommonCryptor.h>
+#include <CommonCrypto/CommonCryptorSPI.h>
+#include "CCCryptorTestFuncs.h"
+#include "testbyteBuffer.h"
+#include "testmore.h"
+
+#if (CCKEYSCHEDULE == 0)
+entryPoint(CommonCryptoKeySchedule,"CommonCrypto Key Schedule Testing")
+#else
+
+static int kTestTestCount = 12;
+
+int CommonCryptoKeySchedule(int argc, char *const *argv)
+{
+    CCKeyScheduleRef schedule;
+    CCCryptorRef cref1, cref2;
+	CCCryptorStatus retval;
+    size_t moved;
+    uint8_t key[16] = { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f };
+    uint8_t iv1[16], iv2[16], plain[48], expected[48], cipher[48], decrypted[48];
+    
+	plan_tests(kTestTestCount);
+    memset(iv1, 0x01, sizeof(iv1));
+    memset(iv2, 0x02, sizeof(iv2));
+    memset(plain, 0x5a, sizeof(plain));
+    
+    retval = CCKeyScheduleCreate(kCCEncrypt, kCCModeCTR, kCCAlgorithmAES128, key, 16, NULL, 0, &schedule);
+    ok(retval == kCCUnimplemented, "CTR folds the IV into its context - no shared schedule");
+    
+    retval = CCKeyScheduleCreate(kCCEncrypt, kCCModeCBC, kCCAlgorithmAES128, key, 16, NULL, 0, &schedule);
+    ok(retval == kCCSuccess, "CBC key schedule created");
+    
+    /* Two cryptors with different IVs from one schedule */
+    retval = CCCryptorCreateWithKeySchedule(schedule, ccNoPadding, iv1, &cref1);
+    ok(retval == kCCSuccess, "first cryptor from schedule");
+    retval = CCCryptorCreateWithKeySchedule(schedule, ccNoPadding, iv2, &cref2);
+    ok(retval == kCCSuccess, "second cryptor from schedule");
+    
+    CCCrypt(kCCEncrypt, kCCAlgorithmAES128, 0, key, 16, iv1, plain, sizeof(plain), expected, sizeof(expected), &moved);
+    retval = CCCryptorUpdate(cref1, plain, sizeof(plain), cipher, sizeof(cipher), &moved);
+    ok(retval == kCCSuccess && memcmp(cipher, expected, sizeof(cipher)) == 0, "IV 1 matches CCCrypt");
+    
+    CCCrypt(kCCEncrypt, kCCAlgorithmAES128, 0, key, 16, iv2, plain, sizeof(plain), expected, sizeof(expected), &moved);
+    retval = CCCryptorUpdate(cref2, plain, sizeof(plain), cipher, sizeof(cipher), &moved);
+    ok(retval == kCCSuccess && memcmp(cipher, expected, sizeof(cipher)) == 0, "IV 2 matches CCCrypt");
+    
+    retval = CCCryptorReset(cref2, iv2);
+    ok(retval == kCCSuccess, "reset cryptor from schedule");
+    retval = CCCryptorUpdate(cref2, plain, sizeof(plain), cipher, sizeof(cipher), &moved);
+    ok(retval == kCCSuccess && memcmp(cipher, expected, sizeof(cipher)) == 0, "reset crypt should be the same as the start");
+    
+    CCCryptorRelease(cref1);
+    CCCryptorRelease(cref2);
+    CCKeyScheduleRelease(schedule);
+    
+    /* A decrypting schedule with PKCS7 padding on the cryptor */
+    CCCrypt(kCCEncrypt, kCCAlgorithmAES128, kCCOptionPKCS7Padding, key, 16, iv1, plain, 40, cipher, sizeof(cipher), &moved);
+    retval = CCKeyScheduleCreate(kCCDecrypt, kCCModeCBC, kCCAlgorithmAES128, key, 16, NULL, 0, &schedule);
+    ok(retval == kCCSuccess, "CBC decrypt key schedule created");
+    retval = CCCryptorCreateWithKeySchedule(schedule, ccPKCS7Padding, iv1, &cref1);
+    ok(retval == kCCSuccess, "padded cryptor from schedule");
+    {
+        size_t total;
+        retval = CCCryptorUpdate(cref1, cipher, 48, decrypted, sizeof(decrypted), &moved);
+        total = moved;
+        if(retval == kCCSuccess) retval = CCCryptorFinal(cref1, decrypted + total, sizeof(decrypted) - total, &moved);
+        total += moved;
+        ok(retval == kCCSuccess && total == 40 && memcmp(decrypted, plain, 40) == 0, "padded decrypt round trip");
+    }
+    CCCryptorRelease(cref1);
+    CCKeyScheduleRelease(schedule);
+    
+    /* The other direction of an ECB block call comes from the schedule's key */
+    CCCrypt(kCCEncrypt, kCCAlgorithmAES128, kCCOptionECBMode, key, 16, NULL, plain, 32, cipher, sizeof(cipher), &moved);
+    schedule = NULL;
+    retval = CCKeyScheduleCreate(kCCEncrypt, kCCModeECB, kCCAlgorithmAES128, key, 16, NULL, 0, &schedule);
+    if(retval == kCCSuccess) retval = CCCryptorCreateWithKeySchedule(schedule, ccNoPadding, NULL, &cref1);
+    if(retval == kCCSuccess) {
+        retval = CCCryptorDecryptDataBlock(cref1, NULL, cipher, 32, decrypted);
+        CCCryptorRelease(cref1);
+    }
+    ok(retval == kCCSuccess && memcmp(decrypted, plain, 32) == 0, "decrypt block from an encrypt schedule");
+    CCKeyScheduleRelease(schedule);
+    
+    return 0;
+}
+
+#endif
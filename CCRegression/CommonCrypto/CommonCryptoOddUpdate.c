@@ -0,0 +1,110 @@
+//
+//  CommonCryptoOddUpdate.c
+//  CommonCrypto
+//
+
+#include "capabilities.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <CommonCrypto/CommonCryptor.h>
+#include <CommonCrypto/CommonCryptorSPI.h>
+#include "CCCryptorTestFuncs.h"
+#include "testbyteBuffer.h"
+#include "testmore.h"
+
+#if (CCODDUPDATE == 0)
+entryPoint(CommonCryptoOddUpdate,"CommonCrypto Odd-Sized Update Benchmark")
+#else
+
+static int kTestTestCount = 6;
+
+#define ODD_LEN (4 * 1024 * 1024)
+#define ODD_LOOPS 4
+
+/* Socket-read sized pieces, none of them a block multiple */
+static const size_t oddSizes[] = { 1, 1447, 13, 4093, 7, 2896, 511, 1, 65533, 31, 999, 8191 };
+
+/*
+ * Run len bytes through a fresh cryptor in odd-sized updates and a final,
+ * returning the elapsed time in microseconds or -1 on failure.
+ */
+
+static double
+oddUpdate(CCOperation op, CCMode mode, CCPadding padding, uint8_t *key, uint8_t *in, size_t len, uint8_t *out, size_t *outLen)
+{
+    CCCryptorRef cref;
+    struct timeval start, stop;
+    size_t pos = 0, moved, total = 0;
+    int i = 0;
+
+    gettimeofday(&start, NULL);
+    if(CCCryptorCreateWithMode(op, mode, kCCAlgorithmAES128, padding, NULL, key, 16, NULL, 0, 0, 0, &cref)) return -1;
+    while(pos < len) {
+        size_t n = oddSizes[i++ % (sizeof(oddSizes) / sizeof(oddSizes[0]))];
+        if(n > len - pos) n = len - pos;
+        if(CCCryptorUpdate(cref, in + pos, n, out + total, len + 32 - total, &moved)) { CCCryptorRelease(cref); return -1; }
+        pos += n; total += moved;
+    }
+    if(CCCryptorFinal(cref, out + total, len + 32 - total, &moved)) { CCCryptorRelease(cref); return -1; }
+    total += moved;
+    CCCryptorRelease(cref);
+    gettimeofday(&stop, NULL);
+    *outLen = total;
+    return (stop.tv_sec - start.tv_sec) * 1000000.0 + (stop.tv_usec - start.tv_usec);
+}
+
+static int
+oddMatches(CCOperation op, CCMode mode, CCPadding padding, const char *name, uint8_t *key, uint8_t *in, size_t len, uint8_t *expected, size_t expectedLen, uint8_t *out)
+{
+    double usecs = 0, t;
+    size_t outLen = 0;
+    int i;
+
+    for(i = 0; i < ODD_LOOPS; i++) {
+        if((t = oddUpdate(op, mode, padding, key, in, len, out, &outLen)) < 0) return 0;
+        usecs += t;
+    }
+    if(usecs > 0) diag("%s odd-sized updates: %.1f MB/s", name, (double) len * ODD_LOOPS / usecs);
+    return outLen == expectedLen && memcmp(out, expected, outLen) == 0;
+}
+
+int CommonCryptoOddUpdate(int argc, char *const *argv)
+{
+    uint8_t key[16], iv[16];
+    uint8_t *plain, *cipher, *out;
+    size_t cipherLen, moved, moved2, i;
+    CCCryptorRef cref;
+
+	plan_tests(kTestTestCount);
+    memset(key, 0x77, sizeof(key));
+    memset(iv, 0, sizeof(iv));
+    plain = malloc(ODD_LEN + 32);
+    cipher = malloc(ODD_LEN + 32);
+    out = malloc(ODD_LEN + 32);
+    for(i = 0; i < ODD_LEN; i++) plain[i] = (uint8_t) (i * 7);
+
+    ok(CCCrypt(kCCEncrypt, kCCAlgorithmAES128, kCCOptionPKCS7Padding, key, 16, iv, plain, ODD_LEN - 5, cipher, ODD_LEN + 32, &cipherLen) == kCCSuccess, "one-shot CBC PKCS7");
+    ok(oddMatches(kCCEncrypt, kCCModeCBC, ccPKCS7Padding, "CBC PKCS7 encrypt", key, plain, ODD_LEN - 5, cipher, cipherLen, out), "CBC PKCS7 encrypt");
+    ok(oddMatches(kCCDecrypt, kCCModeCBC, ccPKCS7Padding, "CBC PKCS7 decrypt", key, cipher, cipherLen, plain, ODD_LEN - 5, out), "CBC PKCS7 decrypt");
+
+    ok(CCCryptorCreateWithMode(kCCEncrypt, kCCModeCBC, kCCAlgorithmAES128, ccCBCCTS3, NULL, key, 16, NULL, 0, 0, 0, &cref) == kCCSuccess &&
+       CCCryptorUpdate(cref, plain, ODD_LEN - 5, cipher, ODD_LEN + 32, &moved) == kCCSuccess &&
+       CCCryptorFinal(cref, cipher + moved, ODD_LEN + 32 - moved, &moved2) == kCCSuccess, "one-shot CBC CTS3");
+    CCCryptorRelease(cref);
+    ok(oddMatches(kCCEncrypt, kCCModeCBC, ccCBCCTS3, "CBC CTS3 encrypt", key, plain, ODD_LEN - 5, cipher, moved + moved2, out), "CBC CTS3 encrypt");
+
+    /* Two blocks held back for CTS, then one more block */
+    ok(CCCryptorCreateWithMode(kCCEncrypt, kCCModeCBC, kCCAlgorithmAES128, ccCBCCTS3, NULL, key, 16, NULL, 0, 0, 0, &cref) == kCCSuccess &&
+       CCCryptorUpdate(cref, plain, 32, out, 64, &moved) == kCCSuccess && moved == 0 &&
+       CCCryptorUpdate(cref, plain + 32, 16, out, 64, &moved) == kCCSuccess && moved == 16, "CTS buffer drains a block at a time");
+    CCCryptorRelease(cref);
+
+    free(plain);
+    free(cipher);
+    free(out);
+    return 0;
+}
+
+#endif
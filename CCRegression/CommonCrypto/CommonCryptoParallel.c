@@ -0,0 +1,118 @@
+//
+//  CommonCryptoParallel.c
+//  CommonCrypto
+//
+
+#include "capabilities.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <CommonCrypto/CommonCryptor.h>
+#include <CommonCrypto/CommonCryptorSPI.h>
+#include "CCCryptorTestFuncs.h"
+#include "testbyteBuffer.h"
+#include "testmore.h"
+
+#if (CCPARALLEL == 0)
+entryPoint(CommonCryptoParallel,"CommonCrypto Parallel Bulk Testing")
+#else
+
+static int kTestTestCount = 9;
+
+#define PARALLEL_LEN (1024 * 1024 + 48)
+#define PARALLEL_SKEW 13
+
+/*
+ * Encrypt len bytes: a short update first so CTR chunks can start mid-block,
+ * the bulk in one call, then a block to check the stream carries on from
+ * where the parallel run left it.
+ */
+
+static int
+parallelCrypt(CCMode mode, uint32_t nthreads, uint8_t *key, uint8_t *iv, uint8_t *in, uint8_t *out, size_t len, size_t skew)
+{
+    CCCryptorRef cref;
+    size_t moved;
+    CCModeOptions options = (mode == kCCModeCTR) ? kCCModeOptionCTR_BE: 0;
+    int succeeded = 0;
+
+    if(CCCryptorCreateWithMode(kCCEncrypt, mode, kCCAlgorithmAES128, ccNoPadding, iv, key, 16, NULL, 0, 0, options, &cref)) return 0;
+    if(CCCryptorSetParallelism(cref, nthreads) == kCCSuccess &&
+       CCCryptorUpdate(cref, in, skew, out, skew, &moved) == kCCSuccess &&
+       CCCryptorUpdate(cref, in + skew, len - skew - 16, out + skew, len - skew - 16, &moved) == kCCSuccess &&
+       CCCryptorUpdate(cref, in + len - 16, 16, out + len - 16, 16, &moved) == kCCSuccess) succeeded = 1;
+    CCCryptorRelease(cref);
+    return succeeded;
+}
+
+/*
+ * CBC decrypt in two updates, so the second chunked run starts from the IV
+ * the first one left behind.
+ */
+
+static int
+parallelCBCDecrypt(uint32_t nthreads, uint8_t *key, uint8_t *iv, uint8_t *in, uint8_t *out, size_t len)
+{
+    CCCryptorRef cref;
+    size_t moved, half = (len / 32) * 16;
+    int succeeded = 0;
+
+    if(CCCryptorCreateWithMode(kCCDecrypt, kCCModeCBC, kCCAlgorithmAES128, ccNoPadding, iv, key, 16, NULL, 0, 0, 0, &cref)) return 0;
+    if(CCCryptorSetParallelism(cref, nthreads) == kCCSuccess &&
+       CCCryptorUpdate(cref, in, half, out, half, &moved) == kCCSuccess &&
+       CCCryptorUpdate(cref, in + half, len - half, out + half, len - half, &moved) == kCCSuccess) succeeded = 1;
+    CCCryptorRelease(cref);
+    return succeeded;
+}
+
+int CommonCryptoParallel(int argc, char *const *argv)
+{
+    uint8_t key[16], iv[16];
+    uint8_t *plain, *serial, *parallel;
+    CCCryptorRef cref;
+    size_t i;
+
+	plan_tests(kTestTestCount);
+    memset(key, 0x5c, sizeof(key));
+    /* Counter near a byte carry so chunk counters must propagate it */
+    memset(iv, 0xff, sizeof(iv));
+    iv[0] = 0;
+    plain = malloc(PARALLEL_LEN);
+    serial = malloc(PARALLEL_LEN);
+    parallel = malloc(PARALLEL_LEN);
+    for(i = 0; i < PARALLEL_LEN; i++) plain[i] = (uint8_t) (i * 31);
+
+    ok(parallelCrypt(kCCModeCTR, 0, key, iv, plain, serial, PARALLEL_LEN, PARALLEL_SKEW) &&
+       parallelCrypt(kCCModeCTR, 8, key, iv, plain, parallel, PARALLEL_LEN, PARALLEL_SKEW) &&
+       memcmp(serial, parallel, PARALLEL_LEN) == 0, "CTR parallel output matches serial");
+    ok(parallelCrypt(kCCModeCTR, 8, key, iv, plain, parallel, PARALLEL_LEN - 7, 0) &&
+       memcmp(serial, parallel, PARALLEL_LEN - 7) == 0, "CTR parallel output matches serial, aligned start");
+    ok(parallelCrypt(kCCModeCTR, 3, key, iv, plain, parallel, PARALLEL_LEN, PARALLEL_SKEW) &&
+       memcmp(serial, parallel, PARALLEL_LEN) == 0, "CTR parallel output matches serial, odd chunk count");
+
+    ok(parallelCrypt(kCCModeECB, 0, key, iv, plain, serial, PARALLEL_LEN, 16) &&
+       parallelCrypt(kCCModeECB, 8, key, iv, plain, parallel, PARALLEL_LEN, 16) &&
+       memcmp(serial, parallel, PARALLEL_LEN) == 0, "ECB parallel output matches serial");
+
+    ok(CCCrypt(kCCEncrypt, kCCAlgorithmAES128, 0, key, 16, iv, plain, PARALLEL_LEN, serial, PARALLEL_LEN, &i) == kCCSuccess &&
+       parallelCBCDecrypt(8, key, iv, serial, parallel, PARALLEL_LEN) &&
+       memcmp(plain, parallel, PARALLEL_LEN) == 0, "CBC parallel decrypt");
+    memcpy(parallel, serial, PARALLEL_LEN);
+    ok(parallelCBCDecrypt(5, key, iv, parallel, parallel, PARALLEL_LEN) &&
+       memcmp(plain, parallel, PARALLEL_LEN) == 0, "CBC parallel decrypt in place");
+    ok(CCCryptorCreateWithMode(kCCDecrypt, kCCModeCBC, kCCAlgorithmAES128, ccNoPadding, iv, key, 16, NULL, 0, 0, 0, &cref) == kCCSuccess &&
+       CCCryptorDecryptDataBlock(cref, iv, serial, 64, parallel) == kCCParamError, "CBC block decrypt still refuses an IV");
+    CCCryptorRelease(cref);
+
+    ok(CCCryptorCreateWithMode(kCCEncrypt, kCCModeCBC, kCCAlgorithmAES128, ccNoPadding, iv, key, 16, NULL, 0, 0, 0, &cref) == kCCSuccess &&
+       CCCryptorSetParallelism(cref, 8) == kCCUnimplemented, "CBC encryption can't be split");
+    CCCryptorRelease(cref);
+    ok(CCCryptorSetParallelism(NULL, 8) == kCCParamError, "NULL cryptor");
+
+    free(plain);
+    free(serial);
+    free(parallel);
+    return 0;
+}
+
+#endif
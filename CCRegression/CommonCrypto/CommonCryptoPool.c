@@ -0,0 +1,92 @@
+//
+//  CommonCryptoPool.c
+//  CommonCrypto
+//
+
+#include "capabilities.h"
+#include <stdio.h>
+#include <string.h>
+#include <CommonCrypto/CommonCryptor.h>
+#include <CommonCrypto/CommonCryptorSPI.h>
+#include "CCCryptorTestFuncs.h"
+#include "testbyteBuffer.h"
+#include "testmore.h"
+
+#if (CCPOOL == 0)
+entryPoint(CommonCryptoPool,"CommonCrypto Cryptor Pool Testing")
+#else
+
+static int kTestTestCount = 8;
+
+#define POOL_LOOPS 64
+
+static CCCryptorStatus
+poolCrypt(CCOperation op, CCMode mode, uint8_t *key, uint8_t *iv, uint8_t *in, uint8_t *out, size_t len)
+{
+    CCCryptorRef cref;
+    CCCryptorStatus retval;
+    size_t moved;
+    CCModeOptions options = (mode == kCCModeCTR) ? kCCModeOptionCTR_BE: 0;
+    
+    retval = CCCryptorCreateWithMode(op, mode, kCCAlgorithmAES128, ccNoPadding, iv, key, 16, NULL, 0, 0, options, &cref);
+    if(retval) return retval;
+    retval = CCCryptorUpdate(cref, in, len, out, len, &moved);
+    CCCryptorRelease(cref);
+    return retval;
+}
+
+int CommonCryptoPool(int argc, char *const *argv)
+{
+    uint8_t key1[16], key2[16], iv[16], plain[64], cipher[64], expected1[64], expected2[64], decrypted[64];
+    CCCryptorRef held[4];
+    int i, failed;
+    
+	plan_tests(kTestTestCount);
+    memset(key1, 0x11, sizeof(key1));
+    memset(key2, 0x22, sizeof(key2));
+    memset(iv, 0, sizeof(iv));
+    memset(plain, 0x5a, sizeof(plain));
+    
+    ok(poolCrypt(kCCEncrypt, kCCModeCBC, key1, iv, plain, expected1, sizeof(plain)) == kCCSuccess, "unpooled CBC encrypt, key 1");
+    ok(poolCrypt(kCCEncrypt, kCCModeCBC, key2, iv, plain, expected2, sizeof(plain)) == kCCSuccess, "unpooled CBC encrypt, key 2");
+    
+    ok(CCCryptorSetPoolDepth(4) == kCCSuccess, "enable cryptor pool");
+    
+    /* Alternate keys so a recycled cryptor must never carry the old key schedule */
+    for(i = 0, failed = 0; i < POOL_LOOPS; i++) {
+        uint8_t *key = (i & 1) ? key2: key1;
+        uint8_t *expected = (i & 1) ? expected2: expected1;
+        if(poolCrypt(kCCEncrypt, kCCModeCBC, key, iv, plain, cipher, sizeof(plain)) != kCCSuccess) failed++;
+        else if(memcmp(cipher, expected, sizeof(cipher))) failed++;
+    }
+    ok(failed == 0, "pooled CBC encryptions match unpooled results");
+    
+    /* Interleave shapes so each key of the pool is exercised */
+    for(i = 0, failed = 0; i < POOL_LOOPS; i++) {
+        if(poolCrypt(kCCEncrypt, kCCModeCTR, key1, iv, plain, cipher, sizeof(plain)) != kCCSuccess) failed++;
+        if(poolCrypt(kCCDecrypt, kCCModeCTR, key1, iv, cipher, decrypted, sizeof(plain)) != kCCSuccess) failed++;
+        else if(memcmp(plain, decrypted, sizeof(plain))) failed++;
+    }
+    ok(failed == 0, "pooled CTR round trips");
+
+    for(i = 0, failed = 0; i < POOL_LOOPS; i++) {
+        if(poolCrypt(kCCDecrypt, kCCModeCBC, key1, iv, expected1, decrypted, sizeof(plain)) != kCCSuccess) failed++;
+        else if(memcmp(plain, decrypted, sizeof(plain))) failed++;
+    }
+    ok(failed == 0, "pooled CBC decryptions");
+    
+    /* Fill a list, then lower the depth: releases trim it and reuse still works */
+    for(i = 0; i < 4; i++) CCCryptorCreateWithMode(kCCEncrypt, kCCModeCBC, kCCAlgorithmAES128, ccNoPadding, iv, key1, 16, NULL, 0, 0, 0, &held[i]);
+    for(i = 0; i < 4; i++) CCCryptorRelease(held[i]);
+    CCCryptorSetPoolDepth(1);
+    for(i = 0; i < 2; i++) CCCryptorCreateWithMode(kCCEncrypt, kCCModeCBC, kCCAlgorithmAES128, ccNoPadding, iv, key2, 16, NULL, 0, 0, 0, &held[i]);
+    for(i = 0; i < 2; i++) CCCryptorRelease(held[i]);
+    ok(poolCrypt(kCCEncrypt, kCCModeCBC, key2, iv, plain, cipher, sizeof(plain)) == kCCSuccess &&
+       memcmp(cipher, expected2, sizeof(cipher)) == 0, "lowered depth trims the pool");
+    
+    ok(CCCryptorSetPoolDepth(0) == kCCSuccess, "disable cryptor pool");
+    
+    return 0;
+}
+
+#endif
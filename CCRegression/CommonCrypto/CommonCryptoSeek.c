@@ -0,0 +1,103 @@
+//
+//  CommonCryptoSeek.c
+//  CommonCrypto
+//
+
+#include "capabilities.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <CommonCrypto/CommonCryptor.h>
+#include <CommonCrypto/CommonCryptorSPI.h>
+#include "testmore.h"
+
+#if (CCCRYPTORSEEK == 0)
+entryPoint(CommonCryptoSeek,"CommonCrypto CTR Seek Testing")
+#else
+
+static int kTestTestCount = 8;
+
+#define SEEK_LEN (256 * 1024)
+
+/*
+ * Seek a cryptor to each offset in turn - out of order, mid-block and
+ * back again - and check a run from there against the same bytes of a
+ * straight pass over the whole buffer.
+ */
+
+static int
+seekMatches(CCAlgorithm alg, size_t keyLength, CCOperation op, const uint8_t *key, const uint8_t *iv,
+            const uint8_t *in, const uint8_t *expected, uint8_t *out, const size_t *offsets, int count, size_t runLength)
+{
+    CCCryptorRef cref;
+    size_t moved, len;
+    int succeeded = 0;
+
+    if(CCCryptorCreateWithMode(op, kCCModeCTR, alg, ccNoPadding, iv, key, keyLength, NULL, 0, 0, kCCModeOptionCTR_BE, &cref)) return 0;
+    for(int i = 0; i < count; i++) {
+        len = (offsets[i] + runLength > SEEK_LEN) ? SEEK_LEN - offsets[i]: runLength;
+        if(CCCryptorSeek(cref, offsets[i])) goto out;
+        if(CCCryptorUpdate(cref, in + offsets[i], len, out, len, &moved) || moved != len) goto out;
+        if(memcmp(out, expected + offsets[i], len)) goto out;
+    }
+    succeeded = 1;
+out:
+    CCCryptorRelease(cref);
+    return succeeded;
+}
+
+int CommonCryptoSeek(int argc, char *const *argv)
+{
+    static const size_t offsets[] = { 100000, 0, 17, 16, 65535, 1, SEEK_LEN - 5, 4097, 100000, 31 };
+    uint8_t key[32], iv[16];
+    uint8_t *plain, *cipher, *out;
+    CCCryptorRef cref;
+    CCKeyScheduleRef schedule;
+    size_t moved, i;
+    int count = sizeof(offsets) / sizeof(offsets[0]);
+
+	plan_tests(kTestTestCount);
+    for(i = 0; i < sizeof(key); i++) key[i] = (uint8_t) (i * 5 + 3);
+    /* Low counter bytes near the top so seeks carry into the higher ones */
+    memset(iv, 0xff, sizeof(iv));
+    iv[0] = 0x42;
+    plain = malloc(SEEK_LEN);
+    cipher = malloc(SEEK_LEN);
+    out = malloc(SEEK_LEN);
+    for(i = 0; i < SEEK_LEN; i++) plain[i] = (uint8_t) (i * 7);
+
+    CCCryptorCreateWithMode(kCCEncrypt, kCCModeCTR, kCCAlgorithmAES128, ccNoPadding, iv, key, 16, NULL, 0, 0, kCCModeOptionCTR_BE, &cref);
+    CCCryptorUpdate(cref, plain, SEEK_LEN, cipher, SEEK_LEN, &moved);
+    CCCryptorRelease(cref);
+    ok(seekMatches(kCCAlgorithmAES128, 16, kCCEncrypt, key, iv, plain, cipher, out, offsets, count, 1000), "AES-128 CTR encrypt after seeks");
+    ok(seekMatches(kCCAlgorithmAES128, 16, kCCDecrypt, key, iv, cipher, plain, out, offsets, count, 1000), "AES-128 CTR decrypt after seeks");
+    ok(seekMatches(kCCAlgorithmAES128, 16, kCCDecrypt, key, iv, cipher, plain, out, offsets, count, 3), "AES-128 CTR short runs after seeks");
+
+    CCCryptorCreateWithMode(kCCEncrypt, kCCModeCTR, kCCAlgorithmAES128, ccNoPadding, iv, key, 32, NULL, 0, 0, kCCModeOptionCTR_BE, &cref);
+    CCCryptorUpdate(cref, plain, SEEK_LEN, cipher, SEEK_LEN, &moved);
+    CCCryptorRelease(cref);
+    ok(seekMatches(kCCAlgorithmAES128, 32, kCCDecrypt, key, iv, cipher, plain, out, offsets, count, 1000), "AES-256 CTR decrypt after seeks");
+
+    /* 8 byte blocks */
+    CCCryptorCreateWithMode(kCCEncrypt, kCCModeCTR, kCCAlgorithm3DES, ccNoPadding, iv, key, 24, NULL, 0, 0, kCCModeOptionCTR_BE, &cref);
+    CCCryptorUpdate(cref, plain, SEEK_LEN, cipher, SEEK_LEN, &moved);
+    CCCryptorRelease(cref);
+    ok(seekMatches(kCCAlgorithm3DES, 24, kCCDecrypt, key, iv, cipher, plain, out, offsets, count, 1000), "3DES CTR decrypt after seeks");
+
+    ok(CCCryptorSeek(NULL, 0) == kCCParamError, "NULL cryptor");
+    CCCryptorCreateWithMode(kCCEncrypt, kCCModeOFB, kCCAlgorithmAES128, ccNoPadding, iv, key, 16, NULL, 0, 0, 0, &cref);
+    ok(CCCryptorSeek(cref, 16) == kCCUnimplemented, "OFB can't seek");
+    CCCryptorRelease(cref);
+    CCKeyScheduleCreate(kCCEncrypt, kCCModeCBC, kCCAlgorithmAES128, key, 16, NULL, 0, &schedule);
+    CCCryptorCreateWithKeySchedule(schedule, ccNoPadding, iv, &cref);
+    ok(CCCryptorSeek(cref, 16) == kCCUnimplemented, "no seeking a cryptor from a key schedule");
+    CCCryptorRelease(cref);
+    CCKeyScheduleRelease(schedule);
+
+    free(plain);
+    free(cipher);
+    free(out);
+    return 0;
+}
+
+#endif
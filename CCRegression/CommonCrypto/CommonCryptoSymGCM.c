@@ -41,7 +41,7 @@ entryPoint(CommonCryptoSymGCM,"CommonCrypto Symmetric GCM Testing")
 
 
 
-static int kTestTestCount = 7;
+static int kTestTestCount = 9;
 
 int CommonCryptoSymGCM(int argc, char *const *argv) {
 	char *keyStr;
@@ -155,7 +155,20 @@ int CommonCryptoSymGCM(int argc, char *const *argv) {
     ok(retval == 0, "AES-GCM Testcase 7");
     accum += retval;
 
-    /* testcase #8 - #1 with NULL IV and AAD */
+    /* testcase #8 - long enough for the 8 block CTR/GHASH batches, with a tail */
+    keyStr = "030a11181f262d343b424950575e656c";
+    adata =  "010e1b2835424f5c697683909daab7c4d1deebf8";
+    iv =     "05101b26313c47525d68737e";
+    plainText =  "0724415e7b98b5d2ef0c294663809dbad7f4112e4b6885a2bfdcf91633506d8aa7c4e1fe1b3855728facc9e603203d5a7794b1ceeb0825425f7c99b6d3f00d2a4764819ebbd8f5122f4c6986a3c0ddfa1734516e8ba8c5e2ff1c39567390adcae704213e5b7895b2cfec092643607d9ab7d4f10e2b4865829fbcd9f613304d6a87a4c1defb1835526f8ca9c6e3001d3a577491aecbe8";
+    cipherText = "e86c6398db3e159da3942f5c80bfd139cca3cbde88b718379e4a4f771450fe3dfeac1ecd8ca136e7b40a9b9fcc2cd1ed4a5e0f2a46a78c31e0d7f384519f9386551083220eab49d08c7219bdd441b2bf14eaab09184f69ad37ad0fdf2be1c907ed9765ffebe45ec7b6da0666caa4bd5f3e065063322bc53835d63d01e0ded798f449a8933bcb8e5c32d9b34b0ffe397064e820eef7df";
+    tag =    "dc17bfa50f4f5a4c0800753c28043676";
+
+    retval = CCCryptorGCMTestCase(keyStr, iv, adata, tag, alg, cipherText, plainText);
+    retval |= CCCryptorGCMDiscreetTestCase(keyStr, iv, adata, tag, alg, cipherText, plainText);
+    ok(retval == 0, "AES-GCM Testcase 8");
+    accum += retval;
+
+    /* testcase #9 - #1 with NULL IV and AAD */
     
     keyStr =     "00000000000000000000000000000000";
     adata =      "";
@@ -167,6 +180,23 @@ int CommonCryptoSymGCM(int argc, char *const *argv) {
     retval = CCCryptorGCMTestCase(keyStr, iv, adata, tag, alg, cipherText, plainText);
     retval = CCCryptorGCMDiscreetTestCase(keyStr, iv, adata, tag, alg, cipherText, plainText);
 
+    /* A 33 byte key is refused before any mode sees it */
+    {
+        uint8_t key[33] = { 0 }, iv12[12] = { 0 }, data[16] = { 0 }, out[16], tagOut[16];
+        size_t tagLength = sizeof(tagOut);
+        CCCryptorRef cref = NULL;
+        CCKeyScheduleRef schedule = NULL;
+
+        retval = CCCryptorGCM(kCCEncrypt, alg, key, sizeof(key), iv12, sizeof(iv12), NULL, 0, data, sizeof(data),
+                              out, tagOut, &tagLength) != kCCKeySizeError;
+        retval |= CCCryptorCreateWithMode(kCCEncrypt, kCCModeGCM, alg, ccNoPadding, NULL, key, sizeof(key),
+                                          NULL, 0, 0, 0, &cref) != kCCKeySizeError;
+        retval |= CCKeyScheduleCreate(kCCEncrypt, kCCModeGCM, alg, key, sizeof(key), NULL, 0, &schedule) != kCCKeySizeError;
+        if(cref) CCCryptorRelease(cref);
+        if(schedule) CCKeyScheduleRelease(schedule);
+        ok(retval == 0, "AES-GCM 33 byte key refused");
+        accum += retval;
+    }
 
     return accum != 0;
 }
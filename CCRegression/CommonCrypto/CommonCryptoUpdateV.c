@@ -0,0 +1,101 @@
+//
+//  CommonCryptoUpdateV.c
+//  CommonCrypto
+//
+
+#include "capabilities.h"
+#include <stdio.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <CommonCrypto/CommonCryptor.h>
+#include <CommonCrypto/CommonCryptorSPI.h>
+#include "CCCryptorTestFuncs.h"
+#include "testbyteBuffer.h"
+#include "testmore.h"
+
+#if (CCUPDATEV == 0)
+entryPoint(CommonCryptoUpdateV,"CommonCrypto Scatter/Gather Update Testing")
+#else
+
+static int kTestTestCount = 7;
+
+#define UPDATEV_LEN 203
+
+static const size_t inFrags[] = { 1, 7, 16, 33, 2, 64, 15, 17, 48 };
+static const size_t outFrags[] = { 5, 19, 3, 40, 1, 16, 71, 9, 80 };
+
+static int
+splitBuffer(uint8_t *buf, size_t len, const size_t *frags, int fragCount, struct iovec *iov)
+{
+    int i;
+
+    for(i = 0; i < fragCount && len; i++) {
+        size_t n = (frags[i] < len) ? frags[i]: len;
+        iov[i].iov_base = buf;
+        iov[i].iov_len = n;
+        buf += n; len -= n;
+    }
+    return i;
+}
+
+/*
+ * Run dataIn through a contiguous update and a fragmented one and compare.
+ */
+
+static int
+updateVMatches(CCOperation op, CCMode mode, CCPadding padding, uint8_t *key, uint8_t *iv, uint8_t *dataIn, size_t len)
+{
+    CCCryptorRef cref;
+    uint8_t expected[UPDATEV_LEN + 32], actual[UPDATEV_LEN + 32];
+    struct iovec in[9], out[9];
+    size_t moved, finalMoved, expectedLen;
+    int inCount, outCount;
+    CCModeOptions options = (mode == kCCModeCTR) ? kCCModeOptionCTR_BE: 0;
+
+    if(CCCryptorCreateWithMode(op, mode, kCCAlgorithmAES128, padding, iv, key, 16, NULL, 0, 0, options, &cref)) return 0;
+    if(CCCryptorUpdate(cref, dataIn, len, expected, sizeof(expected), &moved)) return 0;
+    if(CCCryptorFinal(cref, expected + moved, sizeof(expected) - moved, &finalMoved)) return 0;
+    expectedLen = moved + finalMoved;
+    CCCryptorRelease(cref);
+
+    memset(actual, 0, sizeof(actual));
+    inCount = splitBuffer(dataIn, len, inFrags, 9, in);
+    outCount = splitBuffer(actual, sizeof(actual), outFrags, 9, out);
+    if(CCCryptorCreateWithMode(op, mode, kCCAlgorithmAES128, padding, iv, key, 16, NULL, 0, 0, options, &cref)) return 0;
+    if(CCCryptorUpdateV(cref, in, inCount, out, outCount, &moved)) return 0;
+    if(CCCryptorFinal(cref, actual + moved, sizeof(actual) - moved, &finalMoved)) return 0;
+    CCCryptorRelease(cref);
+
+    return (moved + finalMoved == expectedLen) && memcmp(expected, actual, expectedLen) == 0;
+}
+
+int CommonCryptoUpdateV(int argc, char *const *argv)
+{
+    uint8_t key[16], iv[16], plain[UPDATEV_LEN], cipher[UPDATEV_LEN + 16], small[16];
+    struct iovec in, out;
+    CCCryptorRef cref;
+    size_t moved;
+    int i;
+
+	plan_tests(kTestTestCount);
+    memset(key, 0x33, sizeof(key));
+    memset(iv, 0x01, sizeof(iv));
+    for(i = 0; i < UPDATEV_LEN; i++) plain[i] = i;
+
+    ok(updateVMatches(kCCEncrypt, kCCModeCBC, ccPKCS7Padding, key, iv, plain, UPDATEV_LEN), "CBC PKCS7 encrypt");
+    ok(CCCrypt(kCCEncrypt, kCCAlgorithmAES128, kCCOptionPKCS7Padding, key, 16, iv, plain, UPDATEV_LEN, cipher, sizeof(cipher), &moved) == kCCSuccess, "contiguous CBC PKCS7 ciphertext");
+    ok(updateVMatches(kCCDecrypt, kCCModeCBC, ccPKCS7Padding, key, iv, cipher, moved), "CBC PKCS7 decrypt");
+    ok(updateVMatches(kCCEncrypt, kCCModeCTR, ccNoPadding, key, iv, plain, UPDATEV_LEN), "CTR");
+    ok(updateVMatches(kCCEncrypt, kCCModeCBC, ccCBCCTS3, key, iv, plain, UPDATEV_LEN), "CBC CTS3 encrypt");
+    ok(updateVMatches(kCCEncrypt, kCCModeECB, ccNoPadding, key, iv, plain, 192), "ECB");
+
+    in.iov_base = plain; in.iov_len = 64;
+    out.iov_base = small; out.iov_len = sizeof(small);
+    CCCryptorCreateWithMode(kCCEncrypt, kCCModeCBC, kCCAlgorithmAES128, ccNoPadding, iv, key, 16, NULL, 0, 0, 0, &cref);
+    ok(CCCryptorUpdateV(cref, &in, 1, &out, 1, &moved) == kCCBufferTooSmall, "short output fragments are reported");
+    CCCryptorRelease(cref);
+
+    return 0;
+}
+
+#endif
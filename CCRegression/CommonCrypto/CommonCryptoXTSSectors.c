@@ -0,0 +1,141 @@
+//
+//  CommonCryptoXTSSectors.c
+//  CommonCrypto
+//
+
+#include "capabilities.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <CommonCrypto/CommonCryptor.h>
+#include <CommonCrypto/CommonCryptorSPI.h>
+#include "CCCryptorTestFuncs.h"
+#include "testbyteBuffer.h"
+#include "testmore.h"
+
+#if (CCXTSSECTORS == 0)
+entryPoint(CommonCryptoXTSSectors,"CommonCrypto XTS Sector Batch Testing")
+#else
+
+static int kTestTestCount = 9;
+
+#define XTS_BATCH (1024 * 1024)
+
+static double
+elapsedUsecs(struct timeval *start)
+{
+    struct timeval stop;
+
+    gettimeofday(&stop, NULL);
+    return (stop.tv_sec - start->tv_sec) * 1000000.0 + (stop.tv_usec - start->tv_usec);
+}
+
+/*
+ * One DataBlock call per sector with the sector number as a little-endian
+ * tweak - what the sector calls have to match.
+ */
+
+static int
+xtsPerSector(CCCryptorRef cref, CCOperation op, uint64_t sector, size_t sectorSize, size_t nSectors, const uint8_t *in, uint8_t *out)
+{
+    uint8_t tweak[16];
+    size_t i;
+    int j;
+
+    memset(tweak, 0, sizeof(tweak));
+    for(i = 0; i < nSectors; i++, sector++) {
+        for(j = 0; j < 8; j++) tweak[j] = (uint8_t) (sector >> (8 * j));
+        if(op == kCCEncrypt && CCCryptorEncryptDataBlock(cref, tweak, in + i * sectorSize, sectorSize, out + i * sectorSize)) return 0;
+        if(op == kCCDecrypt && CCCryptorDecryptDataBlock(cref, tweak, in + i * sectorSize, sectorSize, out + i * sectorSize)) return 0;
+    }
+    return 1;
+}
+
+/*
+ * Encrypt a batch, check it against the per-sector calls and decrypt it
+ * back.
+ */
+
+static int
+xtsSectorsMatch(const uint8_t *key, size_t keyLength, uint32_t nthreads, uint64_t sector, size_t sectorSize, size_t nSectors,
+                const uint8_t *plain, uint8_t *expected, uint8_t *out)
+{
+    CCCryptorRef cref;
+    size_t len = sectorSize * nSectors;
+    int succeeded = 0;
+
+    if(CCCryptorCreateWithMode(kCCEncrypt, kCCModeXTS, kCCAlgorithmAES128, ccNoPadding, NULL, key, keyLength,
+                               key + keyLength, keyLength, 0, 0, &cref)) return 0;
+    if(CCCryptorSetParallelism(cref, nthreads)) goto out;
+    if(!xtsPerSector(cref, kCCEncrypt, sector, sectorSize, nSectors, plain, expected)) goto out;
+    if(CCCryptorXTSEncryptSectors(cref, sector, sectorSize, nSectors, plain, out) || memcmp(out, expected, len)) goto out;
+    if(CCCryptorXTSDecryptSectors(cref, sector, sectorSize, nSectors, expected, out) || memcmp(out, plain, len)) goto out;
+    succeeded = 1;
+out:
+    CCCryptorRelease(cref);
+    return succeeded;
+}
+
+/*
+ * A megabyte of 512 byte sectors, one call per sector and batched.
+ */
+
+static void
+xtsThroughput(const uint8_t *key, const uint8_t *plain, uint8_t *out)
+{
+    CCCryptorRef cref;
+    struct timeval start;
+    double perSector, batch;
+
+    if(CCCryptorCreateWithMode(kCCEncrypt, kCCModeXTS, kCCAlgorithmAES128, ccNoPadding, NULL, key, 16, key + 16, 16, 0, 0, &cref)) return;
+    gettimeofday(&start, NULL);
+    xtsPerSector(cref, kCCEncrypt, 0, 512, XTS_BATCH / 512, plain, out);
+    perSector = elapsedUsecs(&start);
+    gettimeofday(&start, NULL);
+    CCCryptorXTSEncryptSectors(cref, 0, 512, XTS_BATCH / 512, plain, out);
+    batch = elapsedUsecs(&start);
+    if(perSector > 0 && batch > 0)
+        diag("XTS 512 byte sectors: %.1f MB/s per sector, %.1f MB/s batched", XTS_BATCH / perSector, XTS_BATCH / batch);
+    CCCryptorRelease(cref);
+}
+
+int CommonCryptoXTSSectors(int argc, char *const *argv)
+{
+    uint8_t key[64], buf[64];
+    uint8_t *plain, *expected, *out;
+    CCCryptorRef cref;
+    size_t i;
+
+	plan_tests(kTestTestCount);
+    for(i = 0; i < sizeof(key); i++) key[i] = (uint8_t) (i * 7 + 1);
+    plain = malloc(XTS_BATCH);
+    expected = malloc(XTS_BATCH);
+    out = malloc(XTS_BATCH);
+    for(i = 0; i < XTS_BATCH; i++) plain[i] = (uint8_t) (i * 5);
+
+    ok(xtsSectorsMatch(key, 16, 0, 0, 512, 1, plain, expected, out), "one 512 byte sector");
+    ok(xtsSectorsMatch(key, 16, 0, 0x123456789ULL, 512, 61, plain, expected, out), "61 512 byte sectors, AES-128");
+    ok(xtsSectorsMatch(key, 32, 0, 0xfffffffbULL, 4096, 13, plain, expected, out), "13 4K sectors, AES-256, across 2^32");
+    ok(xtsSectorsMatch(key, 16, 0, 7, 528, 3, plain, expected, out), "528 byte sectors");
+    ok(xtsSectorsMatch(key, 32, 4, 1000, 4096, XTS_BATCH / 4096, plain, expected, out), "1MB of 4K sectors on 4 threads");
+    ok(xtsSectorsMatch(key, 16, 8, 1000, 512, XTS_BATCH / 512, plain, expected, out), "1MB of 512 byte sectors on 8 threads");
+
+    CCCryptorCreateWithMode(kCCEncrypt, kCCModeXTS, kCCAlgorithmAES128, ccNoPadding, NULL, key, 16, key + 16, 16, 0, 0, &cref);
+    ok(CCCryptorXTSEncryptSectors(cref, 0, 520, 1, plain, out) == kCCAlignmentError, "sector size not a multiple of the block size");
+    ok(CCCryptorXTSEncryptSectors(cref, 0, 512, 0, NULL, NULL) == kCCSuccess, "no sectors");
+    CCCryptorRelease(cref);
+
+    CCCryptorCreateWithMode(kCCEncrypt, kCCModeCBC, kCCAlgorithmAES128, ccNoPadding, key, key, 16, NULL, 0, 0, 0, &cref);
+    ok(CCCryptorXTSEncryptSectors(cref, 0, 16, 1, buf, buf) == kCCParamError, "not an XTS cryptor");
+    CCCryptorRelease(cref);
+
+    xtsThroughput(key, plain, out);
+
+    free(plain);
+    free(expected);
+    free(out);
+    return 0;
+}
+
+#endif
@@ -21,5 +21,27 @@ ONE_TEST(CommonDH)
 ONE_TEST(CommonDigest)
 ONE_TEST(CommonBaseEncoding)
 ONE_TEST(CommonCryptoReset)
+ONE_TEST(CommonCryptoContextSize)
+ONE_TEST(CommonCryptoPool)
+ONE_TEST(CommonCryptoKeySchedule)
+ONE_TEST(CommonCryptoCreatePerf)
+ONE_TEST(CommonCryptoUpdateV)
+ONE_TEST(CommonCryptoBatch)
+ONE_TEST(CommonCryptoParallel)
+ONE_TEST(CommonCryptoOddUpdate)
+ONE_TEST(CommonCryptoInPlace)
+ONE_TEST(CommonCryptoCBCHmac)
+ONE_TEST(CommonCryptoAEAD)
+ONE_TEST(CommonCryptoCTSStream)
+ONE_TEST(CommonCryptoXTSSectors)
+ONE_TEST(CommonCryptoAllocator)
+ONE_TEST(CommonCryptoClone)
+ONE_TEST(CommonCryptoSeek)
+ONE_TEST(CommonCryptoGCMKey)
+ONE_TEST(CommonCryptoGCMOneShot)
+ONE_TEST(CommonCryptoGCMBatch)
+ONE_TEST(CommonCryptoGCMParallel)
+ONE_TEST(CommonCryptoAESWide)
+ONE_TEST(CommonCryptoCPUTiers)
 ONE_TEST(CommonBigNum)
 ONE_TEST(CommonBigDigest)
@@ -61,5 +61,27 @@ return 0; \
 #define CNENCODER 0
 #define CCBIGDIGEST 0
 #define CCSYMCTR 1
+#define CCCONTEXTSIZE 1
+#define CCPOOL 1
+#define CCKEYSCHEDULE 1
+#define CCCREATEPERF 1
+#define CCUPDATEV 1
+#define CCBATCH 1
+#define CCPARALLEL 1
+#define CCODDUPDATE 1
+#define CCINPLACE 1
+#define CCCBCHMAC 1
+#define CCAEAD 1
+#define CCCTSSTREAM 1
+#define CCXTSSECTORS 1
+#define CCALLOCATOR 1
+#define CCCRYPTORCLONE 1
+#define CCCRYPTORSEEK 1
+#define CCGCMKEY 1
+#define CCGCMONESHOT 1
+#define CCGCMBATCH 1
+#define CCGCMPARALLEL 1
+#define CCAESWIDE 1
+#define CCCPUTIERS 1
 
 #endif /* __CAPABILITIES_H__ */
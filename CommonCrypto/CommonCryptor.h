@@ -109,6 +109,7 @@ typedef struct _CCCryptor *CCCryptorRef;
                                     properly.
     @constant   kCCUnimplemented    Function not implemented for the current 
                                     algorithm.
+    @constant   kCCKeySizeError     Key length not valid for the algorithm.
  */
 enum {
     kCCSuccess          = 0,
@@ -118,7 +119,8 @@ enum {
     kCCAlignmentError   = -4303,
     kCCDecodeError      = -4304,
     kCCUnimplemented    = -4305,
-    kCCOverflow         = -4306
+    kCCOverflow         = -4306,
+    kCCKeySizeError     = -4310
 };
 typedef int32_t CCCryptorStatus;
 
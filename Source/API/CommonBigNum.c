@@ -35,22 +35,23 @@
 
 static void *
 cc_alloc(void *ctx CC_UNUSED, size_t size) {
-    return malloc(size);
+    return CC_XMALLOC(size);
 }
 
 static void
 cc_free(void *ctx CC_UNUSED, size_t oldsize, void *p) {
     cc_zero(oldsize, p);
-    free(p);
+    CC_XFREE(p, oldsize);
 }
 
 static void *
 cc_realloc(void *ctx CC_UNUSED, size_t oldsize,
                  void *p, size_t newsize) {
-    void *r = malloc(newsize);
-    memcpy(r, p, oldsize);
+    void *r = CC_XMALLOC(newsize);
+    if(r == NULL) return NULL;
+    CC_XMEMCPY(r, p, CC_XMIN(oldsize, newsize));
     cc_zero(oldsize, p);
-    free(p);
+    CC_XFREE(p, oldsize);
     return r;
 }
 
@@ -65,7 +66,7 @@ CCBigNumRef
 CCCreateBigNum(CCStatus *status)
 {
     CC_DEBUG_LOG(ASL_LEVEL_ERR, "Entering\n");
-    ccz *r = malloc(ccz_size(&ccz_c));
+    ccz *r = CC_XMALLOC(ccz_size(&ccz_c));
     if (status)
         *status = r ? kCCSuccess : kCCMemoryFailure;
     if (r)
@@ -89,7 +90,7 @@ CCBigNumFree(CCBigNumRef bn)
     CC_DEBUG_LOG(ASL_LEVEL_ERR, "Entering\n");
     ccz *r = (ccz *)bn;
     ccz_free(r);
-    free(r);
+    CC_XFREE(r, ccz_size(&ccz_c));
 }
 
 CCBigNumRef
@@ -170,6 +171,7 @@ CCBigNumToHexString(CCStatus *status, const CCBigNumRef bn)
     CC_DEBUG_LOG(ASL_LEVEL_ERR, "Entering\n");
     const ccz *s = (ccz *)bn;
     size_t to_size = ccz_write_radix_size(s, 16);
+    /* The caller frees this with free(), so it can't come from the CommonCrypto allocator */
     char *to = malloc(to_size+1);
     ccz_write_radix(s, to_size, to, 16);
     to[to_size] = 0;
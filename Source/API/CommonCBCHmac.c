@@ -0,0 +1,173 @@
+/*
+ * Copyright (c) 2012 Apple Inc. All Rights Reserved.
+ * 
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ * 
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+/*
+ * AES-CBC with HMAC over the ciphertext in one pass.  The data is walked in
+ * stretches small enough that the bytes the cipher has just written (or is
+ * about to read) are still in L1 when the HMAC runs over them, so a record
+ * goes through memory once instead of once per primitive.
+ */
+
+#include "CommonCryptor.h"
+#include "CommonCryptorSPI.h"
+#include "CommonHMAC.h"
+#include "ccMemory.h"
+#include "ccdebug.h"
+
+#define CC_CBCHMAC_STRIDE   4096
+
+typedef struct _CCCBCHmac {
+    CCCryptorRef    cryptor;
+    CCHmacContext   hmac;
+    CCOperation     op;
+    size_t          macLength;
+} CCCBCHmac;
+
+static size_t
+ccHmacLength(CCHmacAlgorithm alg)
+{
+    switch(alg) {
+        case kCCHmacAlgSHA1: return CC_SHA1_DIGEST_LENGTH;
+        case kCCHmacAlgMD5: return CC_MD5_DIGEST_LENGTH;
+        case kCCHmacAlgSHA224: return CC_SHA224_DIGEST_LENGTH;
+        case kCCHmacAlgSHA256: return CC_SHA256_DIGEST_LENGTH;
+        case kCCHmacAlgSHA384: return CC_SHA384_DIGEST_LENGTH;
+        case kCCHmacAlgSHA512: return CC_SHA512_DIGEST_LENGTH;
+        default: return 0;
+    }
+}
+
+CCCryptorStatus CCCBCHmacCreate(
+	CCOperation 	op,
+	CCPadding		padding,
+	const void 		*key,
+	size_t 			keyLength,
+	const void 		*iv,
+	CCHmacAlgorithm	macAlgorithm,
+	const void		*macKey,
+	size_t			macKeyLength,
+	CCCBCHmacRef	*cbcHmacRef)
+{
+    CCCBCHmac *cbcHmac;
+    CCCryptorStatus retval;
+    size_t macLength = ccHmacLength(macAlgorithm);
+    
+    CC_DEBUG_LOG(ASL_LEVEL_ERR, "Entering Op: %d Padding: %d MAC: %d\n", op, padding, macAlgorithm);
+    if(cbcHmacRef == NULL || macKey == NULL || macLength == 0) return kCCParamError;
+    if((op != kCCEncrypt && op != kCCDecrypt) || (padding != ccNoPadding && padding != ccPKCS7Padding)) return kCCParamError;
+    if((cbcHmac = CC_XMALLOC(sizeof(CCCBCHmac))) == NULL) return kCCMemoryFailure;
+    
+    CC_XZEROMEM(cbcHmac, sizeof(CCCBCHmac));
+    if((retval = CCCryptorCreateWithMode(op, kCCModeCBC, kCCAlgorithmAES128, padding, iv, key, keyLength, NULL, 0, 0, 0, &cbcHmac->cryptor)) != kCCSuccess) {
+        CC_XFREE(cbcHmac, sizeof(CCCBCHmac));
+        return retval;
+    }
+    CCHmacInit(&cbcHmac->hmac, macAlgorithm, macKey, macKeyLength);
+    cbcHmac->op = op;
+    cbcHmac->macLength = macLength;
+    *cbcHmacRef = cbcHmac;
+    return kCCSuccess;
+}
+
+CCCryptorStatus CCCBCHmacUpdate(
+	CCCBCHmacRef	cbcHmacRef,
+	const void 		*dataIn,
+	size_t 			dataInLength,
+	void 			*dataOut,
+	size_t 			dataOutAvailable,
+	size_t 			*dataOutMoved)
+{
+    CCCBCHmac *cbcHmac = cbcHmacRef;
+    const uint8_t *in = dataIn;
+    uint8_t *out = dataOut;
+    size_t total = 0, n, moved;
+    CCCryptorStatus retval;
+    
+    CC_DEBUG_LOG(ASL_LEVEL_ERR, "Entering\n");
+    if(cbcHmac == NULL || dataOutMoved == NULL) return kCCParamError;
+    if(dataInLength && (dataIn == NULL || dataOut == NULL)) return kCCParamError;
+    if(CCCryptorGetOutputLength(cbcHmac->cryptor, dataInLength, false) > dataOutAvailable) return kCCBufferTooSmall;
+    
+    for(; dataInLength; dataInLength -= n, in += n) {
+        n = CC_XMIN(dataInLength, CC_CBCHMAC_STRIDE);
+        /* MAC the ciphertext: before decrypting it, after encrypting it */
+        if(cbcHmac->op == kCCDecrypt) CCHmacUpdate(&cbcHmac->hmac, in, n);
+        if((retval = CCCryptorUpdate(cbcHmac->cryptor, in, n, out + total, dataOutAvailable - total, &moved)) != kCCSuccess) return retval;
+        if(cbcHmac->op == kCCEncrypt) CCHmacUpdate(&cbcHmac->hmac, out + total, moved);
+        total += moved;
+    }
+    *dataOutMoved = total;
+    return kCCSuccess;
+}
+
+CCCryptorStatus CCCBCHmacFinal(
+	CCCBCHmacRef	cbcHmacRef,
+	void 			*dataOut,
+	size_t 			dataOutAvailable,
+	size_t 			*dataOutMoved,
+	void			*tag,
+	size_t			tagLength)
+{
+    CCCBCHmac *cbcHmac = cbcHmacRef;
+    uint8_t mac[CC_SHA512_DIGEST_LENGTH];
+    uint8_t diff = 0;
+    CCCryptorStatus retval;
+    size_t i;
+    
+    CC_DEBUG_LOG(ASL_LEVEL_ERR, "Entering\n");
+    if(cbcHmac == NULL || dataOutMoved == NULL || tag == NULL) return kCCParamError;
+    /* RFC 2104 truncation: no less than half the MAC, and no less than 80 bits */
+    if(tagLength < cbcHmac->macLength / 2 || tagLength < 10 || tagLength > cbcHmac->macLength) return kCCParamError;
+    
+    if(cbcHmac->op == kCCEncrypt) {
+        if((retval = CCCryptorFinal(cbcHmac->cryptor, dataOut, dataOutAvailable, dataOutMoved)) != kCCSuccess) return retval;
+        CCHmacUpdate(&cbcHmac->hmac, dataOut, *dataOutMoved);
+        CCHmacFinal(&cbcHmac->hmac, mac);
+        CC_XMEMCPY(tag, mac, tagLength);
+        CC_XZEROMEM(mac, sizeof(mac));
+        return kCCSuccess;
+    }
+    
+    /* Check the MAC before the padding is looked at, and in constant time */
+    CCHmacFinal(&cbcHmac->hmac, mac);
+    for(i = 0; i < tagLength; i++) diff |= mac[i] ^ ((const uint8_t *) tag)[i];
+    CC_XZEROMEM(mac, sizeof(mac));
+    if(diff) {
+        *dataOutMoved = 0;
+        return kCCDecodeError;
+    }
+    return CCCryptorFinal(cbcHmac->cryptor, dataOut, dataOutAvailable, dataOutMoved);
+}
+
+CCCryptorStatus CCCBCHmacRelease(
+	CCCBCHmacRef	cbcHmacRef)
+{
+    CCCBCHmac *cbcHmac = cbcHmacRef;
+    
+    CC_DEBUG_LOG(ASL_LEVEL_ERR, "Entering\n");
+    if(cbcHmac == NULL) return kCCParamError;
+    CCCryptorRelease(cbcHmac->cryptor);
+    CC_XZEROMEM(cbcHmac, sizeof(CCCBCHmac));
+    CC_XFREE(cbcHmac, sizeof(CCCBCHmac));
+    return kCCSuccess;
+}
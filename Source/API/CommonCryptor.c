@@ -35,6 +35,7 @@
 #include "CommonCryptorPriv.h"
 #include <dispatch/dispatch.h>
 #include <dispatch/queue.h>
+#include <pthread.h>
 
 /* 
  * CommonCryptor's portion of a CCCryptorRef. 
@@ -54,6 +55,7 @@ typedef struct cipherMode_t {
 } cipherMode;
 
 static cipherMode cipherModeTab[7][2];
+#define CC_TABLE_CIPHERS (sizeof(cipherModeTab) / sizeof(cipherModeTab[0]))
 
 static inline size_t ccGetCipherBlockSize(CCCryptor *ref)
 {
@@ -65,6 +67,7 @@ static inline size_t ccGetCipherBlockSize(CCCryptor *ref)
         case kCCAlgorithmRC4:       return 1;
         case kCCAlgorithmRC2:       return kCCBlockSizeRC2;
         case kCCAlgorithmBlowfish:  return kCCBlockSizeBlowfish;
+        case kCCAlgorithmChaCha20:  return 1;
         default: return kCCBlockSizeAES128;
     }
 }
@@ -74,18 +77,16 @@ corecryptoMode getCipherMode(CCAlgorithm cipher, CCMode mode, CCOperation direct
 {
     for(int i = 0; i<2; i++) {
         dispatch_once(&(cipherModeTab[cipher][i].init), ^{
-            cipherModeTab[cipher][i].ecb = ccmodeList[cipher][i].ecb();
-            cipherModeTab[cipher][i].cbc = ccmodeList[cipher][i].cbc();
-            cipherModeTab[cipher][i].cfb = ccmodeList[cipher][i].cfb();
-            cipherModeTab[cipher][i].cfb8 = ccmodeList[cipher][i].cfb8();
-            cipherModeTab[cipher][i].ctr = ccmodeList[cipher][i].ctr();
-            cipherModeTab[cipher][i].ofb = ccmodeList[cipher][i].ofb();
-#if defined(__i386__) || defined(__x86_64__)
-            cipherModeTab[cipher][i].xts = ccmodeList[cipher][i].xts();
-#else
-            cipherModeTab[cipher][i].xts = NULL;
-#endif
-            cipherModeTab[cipher][i].gcm = ccmodeList[cipher][i].gcm();
+            const modeList *list = ccmodeListSelect(cipher, i);
+            
+            cipherModeTab[cipher][i].ecb = list->ecb();
+            cipherModeTab[cipher][i].cbc = list->cbc();
+            cipherModeTab[cipher][i].cfb = list->cfb();
+            cipherModeTab[cipher][i].cfb8 = list->cfb8();
+            cipherModeTab[cipher][i].ctr = list->ctr();
+            cipherModeTab[cipher][i].ofb = list->ofb();
+            cipherModeTab[cipher][i].xts = list->xts();
+            cipherModeTab[cipher][i].gcm = list->gcm();
         });
     }
     // printf("%lu Size %lu Blocksize\n\n", cipherModeTab[cipher][direction].ecb->size, cipherModeTab[cipher][direction].ecb->block_size);
@@ -104,6 +105,18 @@ corecryptoMode getCipherMode(CCAlgorithm cipher, CCMode mode, CCOperation direct
 
 static CCCryptorStatus setCryptorCipherMode(CCCryptor *ref, CCAlgorithm cipher, CCMode mode, CCOperation direction)
 {
+    /* The AEAD modes come from aeadModes/, not the cipher tables, and run through the GCM calls */
+    if(mode == kCCModeChaCha20Poly1305 || mode == kCCModeGCMSIV) {
+        if(mode == kCCModeChaCha20Poly1305 && cipher == kCCAlgorithmChaCha20)
+            ref->symMode[direction].gcm = (direction == kCCEncrypt) ? ccchacha20poly1305_encrypt_mode(): ccchacha20poly1305_decrypt_mode();
+        else if(mode == kCCModeGCMSIV && cipher == kCCAlgorithmAES128)
+            ref->symMode[direction].gcm = ccaes_gcmsiv_mode(direction);
+        else return kCCParamError;
+        ref->modeDesc = &ccgcm_mode;
+        return kCCSuccess;
+    }
+    if(cipher == kCCAlgorithmChaCha20) return kCCParamError;
+
     switch(mode) {
         case kCCModeECB: if((ref->symMode[direction].ecb = getCipherMode(cipher, mode, direction).ecb) == NULL) return kCCUnimplemented;
             ref->modeDesc = &ccecb_mode; break;
@@ -128,33 +141,8 @@ static CCCryptorStatus setCryptorCipherMode(CCCryptor *ref, CCAlgorithm cipher,
 }
 
 
-static inline CCCryptorStatus ccSetupCryptor(CCCryptor *ref, CCAlgorithm cipher, CCMode mode, CCOperation direction, CCPadding padding)
+static inline void ccSetupPadding(CCCryptor *ref, CCMode mode, CCPadding padding)
 {
-    CCCryptorStatus retval;
-    
-    if(cipher > 6) return kCCParamError;
-    if(direction > kCCBoth) return kCCParamError;
-    if(cipher == kCCAlgorithmRC4) mode = kCCModeOFB;
-    
-    ref->mode = mode;
-    CCOperation op = direction;
-    if(ref->mode == kCCModeXTS || ref->mode == kCCModeECB || ref->mode == kCCModeCBC) op = kCCBoth;
-
-    // printf("Cryptor setup - cipher %d mode %d direction %d padding %d\n", cipher, mode, direction, padding);
-    switch(op) {
-        case kCCEncrypt:
-        case kCCDecrypt:
-            if((retval = setCryptorCipherMode(ref, cipher, mode, op)) != kCCSuccess) return retval;
-            if((ref->ctx[op].data = CC_XMALLOC(ref->modeDesc->mode_get_ctx_size(ref->symMode[op]))) == NULL) return kCCMemoryFailure;
-            break;
-        case kCCBoth:
-            if((retval = setCryptorCipherMode(ref, cipher, mode, kCCEncrypt)) != kCCSuccess) return retval;
-            if((ref->ctx[kCCEncrypt].data = CC_XMALLOC(ref->modeDesc->mode_get_ctx_size(ref->symMode[kCCEncrypt]))) == NULL) return kCCMemoryFailure;
-            if((retval = setCryptorCipherMode(ref, cipher, mode, kCCDecrypt)) != kCCSuccess) return retval;
-            if((ref->ctx[kCCDecrypt].data = CC_XMALLOC(ref->modeDesc->mode_get_ctx_size(ref->symMode[kCCDecrypt]))) == NULL) return kCCMemoryFailure;
-            break;
-    }
-    
     switch(padding) {
         case ccNoPadding:
             ref->padptr = &ccnopad_pad;
@@ -177,15 +165,101 @@ static inline CCCryptorStatus ccSetupCryptor(CCCryptor *ref, CCAlgorithm cipher,
         default:
             ref->padptr = &ccnopad_pad;
     }
+}
+
+/*
+ * Modes whose block I/O calls (CCCryptorEncryptDataBlock/DecryptDataBlock)
+ * can go either way regardless of the direction the cryptor was created for.
+ */
+
+static inline bool ccModeIsBidirectional(CCMode mode)
+{
+    return mode == kCCModeXTS || mode == kCCModeECB || mode == kCCModeCBC;
+}
+
+static inline CCCryptorStatus ccSetupCryptor(CCCryptor *ref, CCAlgorithm cipher, CCMode mode, CCOperation direction, CCPadding padding)
+{
+    CCCryptorStatus retval;
+    
+    if(cipher > kCCAlgorithmChaCha20) return kCCParamError;
+    if(direction > kCCBoth) return kCCParamError;
+    if(cipher == kCCAlgorithmRC4) mode = kCCModeOFB;
+    if(cipher == kCCAlgorithmChaCha20) mode = kCCModeChaCha20Poly1305;
+    
+    ref->mode = mode;
+    CCOperation op = direction;
+    if(ccModeIsBidirectional(ref->mode)) op = kCCBoth;  /* resolve both, ccInitCryptor() expands one */
+
+    // printf("Cryptor setup - cipher %d mode %d direction %d padding %d\n", cipher, mode, direction, padding);
+    /* Mode contexts are carved out of the cryptor block by ccLayoutCryptor() */
+    ref->ctx[kCCEncrypt].data = ref->ctx[kCCDecrypt].data = NULL;
+    switch(op) {
+        case kCCEncrypt:
+        case kCCDecrypt:
+            if((retval = setCryptorCipherMode(ref, cipher, mode, op)) != kCCSuccess) return retval;
+            break;
+        case kCCBoth:
+            if((retval = setCryptorCipherMode(ref, cipher, mode, kCCEncrypt)) != kCCSuccess) return retval;
+            if((retval = setCryptorCipherMode(ref, cipher, mode, kCCDecrypt)) != kCCSuccess) return retval;
+            break;
+    }
+    
+    ccSetupPadding(ref, mode, padding);
     ref->cipher = cipher;
     ref->cipherBlocksize = ccGetCipherBlockSize(ref);
     ref->op = direction;
-    ref->bufferPos = 0;
+    ref->bufferPos = ref->bufferStart = 0;
     ref->bytesProcessed = 0;
     return kCCSuccess;
 }
 
 #define OP4INFO(X) (((X)->op == 3) ? 0: (X)->op)
+#define FULLBLOCKSIZE(X,BLOCKSIZE) (((X)/(BLOCKSIZE))*BLOCKSIZE)
+#define FULLBLOCKREMAINDER(X,BLOCKSIZE) ((X)%(BLOCKSIZE))
+
+/*
+ * Size of the mode context for one direction, or 0 if that direction isn't
+ * scheduled for this cryptor.  The block modes only schedule the direction
+ * they were created for; the other one is expanded on demand by
+ * ccExpandDirection().
+ */
+
+static inline size_t ccGetModeCtxSize(CCCryptor *ref, CCOperation direction)
+{
+    if(ref->op != kCCBoth && ref->op != direction) return 0;
+    return ref->modeDesc->mode_get_ctx_size(ref->symMode[direction]);
+}
+
+/*
+ * Size of the cryptor block - the CCCryptor followed by its mode contexts,
+ * each rounded up to a cache line.
+ */
+
+static inline size_t ccCryptorBlockSize(CCCryptor *ref)
+{
+    return CC_CACHELINE_ROUNDUP(CCCRYPTOR_SIZE)
+         + CC_CACHELINE_ROUNDUP(ccGetModeCtxSize(ref, kCCEncrypt))
+         + CC_CACHELINE_ROUNDUP(ccGetModeCtxSize(ref, kCCDecrypt));
+}
+
+/*
+ * Move a set up cryptor into its (cache line aligned) block and point the
+ * mode contexts at the space following it.
+ */
+
+static inline CCCryptor *ccLayoutCryptor(CCCryptor *proto, uint8_t *block)
+{
+    CCCryptor *ref = (CCCryptor *) block;
+    uint8_t *ctxp = block + CC_CACHELINE_ROUNDUP(CCCRYPTOR_SIZE);
+    
+    CC_XMEMCPY(ref, proto, CCCRYPTOR_SIZE);
+    for(int i = 0; i<2; i++) {
+        size_t ctxsize = ccGetModeCtxSize(ref, i);
+        ref->ctx[i].data = (ctxsize) ? ctxp: NULL;
+        ctxp += CC_CACHELINE_ROUNDUP(ctxsize);
+    }
+    return ref;
+}
 
 static inline size_t ccGetBlockSize(CCCryptor *ref)
 {
@@ -206,17 +280,29 @@ static inline CCCryptorStatus ccInitCryptor(CCCryptor *ref, const void *key, uns
     if(!ref->modeDesc) return kCCParamError;
     uint8_t defaultIV[blocksize];
     
+    /* The AES modes expand whatever they're given */
+    if(ref->cipher == kCCAlgorithmAES128 && key_len != kCCKeySizeAES128 &&
+       key_len != kCCKeySizeAES192 && key_len != kCCKeySizeAES256) return kCCKeySizeError;
     if(iv == NULL) {
         CC_XZEROMEM(defaultIV, blocksize);
         iv = defaultIV;
     }
     
-    CCOperation op = ref->op;
-    
-    // This will create both sides of the context/mode pairs for now.
-    if(ref->mode == kCCModeXTS || ref->mode == kCCModeECB || ref->mode == kCCModeCBC) op = kCCBoth;
+    /*
+        Block I/O may want the other direction of a block mode later, and a
+        parallel CTR run keys a context per chunk - keep what's needed.
+    */
+    if((ccModeIsBidirectional(ref->mode) && ref->op != kCCBoth) || ref->mode == kCCModeCTR) {
+        if(key_len > sizeof(ref->deferredKey) || blocksize > sizeof(ref->deferredIV)) return kCCParamError;
+        if(tweak_key && key_len > sizeof(ref->deferredTweak)) return kCCParamError;
+        CC_XMEMCPY(ref->deferredKey, key, key_len);
+        if(tweak_key) CC_XMEMCPY(ref->deferredTweak, tweak_key, key_len);
+        CC_XMEMCPY(ref->deferredIV, iv, blocksize);
+        ref->deferredKeyLength = key_len;
+    }
+    ref->streamPos = 0;
     
-    switch(op) {
+    switch(ref->op) {
         case kCCEncrypt:
         case kCCDecrypt:
             ref->modeDesc->mode_setup(ref->symMode[ref->op], iv, key, key_len, tweak_key, 0, 0, ref->ctx[ref->op]);
@@ -229,17 +315,178 @@ static inline CCCryptorStatus ccInitCryptor(CCCryptor *ref, const void *key, uns
     return kCCSuccess;    
 }
 
+/*
+ * Expand the key schedule for a direction the cryptor wasn't created for.
+ * Only done for the block modes, whose DataBlock calls may go either way.
+ */
+
+static CCCryptorStatus ccExpandDirection(CCCryptor *ref, CCOperation direction)
+{
+    /* Cryptors made from a key schedule leave the raw key with the schedule */
+    CCCryptor *keyed = (ref->keySchedule) ? ref->keySchedule->cryptor: ref;
+    modeCtx ctx;
+    size_t ctxsize;
+    
+    if(ref->ctx[direction].data) return kCCSuccess;
+    if(keyed->deferredKeyLength == 0) return kCCParamError;
+    ctxsize = ref->modeDesc->mode_get_ctx_size(ref->symMode[direction]);
+    if((ref->lazyCtx = CC_XMALLOC(ctxsize)) == NULL) return kCCMemoryFailure;
+    ctx.data = ref->lazyCtx;
+    ref->modeDesc->mode_setup(ref->symMode[direction], keyed->deferredIV, keyed->deferredKey, keyed->deferredKeyLength,
+                              (ref->mode == kCCModeXTS) ? keyed->deferredTweak: NULL, 0, 0, ctx);
+    ref->ctx[direction] = ctx;
+    return kCCSuccess;
+}
+
+#pragma mark Parallel Bulk Crypt
+
+/*
+ * ECB, CTR and CBC decryption have no dependency between blocks beyond the
+ * ciphertext, so large runs can be split into chunks and handed to
+ * dispatch_apply().  ECB chunks share the key schedule; each CTR chunk gets
+ * a context keyed from the stashed key with the counter it would have
+ * reached serially; each CBC chunk decrypts from the ciphertext block ahead
+ * of it.  The output is identical to the serial path.
+ */
+
+typedef struct ccParallelJob {
+    CCCryptor       *ref;
+    CCOperation     direction;
+    const uint8_t   *dataIn;
+    uint8_t         *dataOut;
+    size_t          dataInLength;
+    size_t          head;           /* bytes before the first chunk boundary */
+    size_t          chunkSize;
+    size_t          nchunks;
+    uint8_t         *ctxMem;        /* CTR contexts for chunks 1..nchunks-1 */
+    size_t          ctxSize;
+    uint8_t         *ivs;           /* CBC IV for each chunk */
+} ccParallelJob;
+
+static inline bool ccModeIsParallel(CCCryptor *ref)
+{
+    return ref->mode == kCCModeECB || (ref->mode == kCCModeCTR && ref->deferredKeyLength) ||
+           (ref->mode == kCCModeCBC && ref->op == kCCDecrypt);
+}
+
+/* Big-endian add to a counter block */
+
+static inline void ccCounterAdd(uint8_t *ctr, size_t blocksize, uint64_t n)
+{
+    size_t i;
+    
+    for(i = blocksize; i > 0 && n; i--) {
+        n += ctr[i-1];
+        ctr[i-1] = (uint8_t) n;
+        n >>= 8;
+    }
+}
+
+static void ccParallelChunk(void *context, size_t chunk)
+{
+    ccParallelJob *job = context;
+    CCCryptor *ref = job->ref;
+    corecryptoMode symMode = ref->symMode[job->direction];
+    modeCtx ctx = ref->ctx[job->direction];
+    size_t start = (chunk == 0) ? 0: job->head + chunk * job->chunkSize;
+    size_t end = (chunk == job->nchunks - 1) ? job->dataInLength: job->head + (chunk + 1) * job->chunkSize;
+    
+    if(ref->mode == kCCModeCTR && chunk) {
+        size_t blocksize = ref->cipherBlocksize;
+        uint8_t counter[blocksize];
+        
+        ctx.data = job->ctxMem + (chunk - 1) * job->ctxSize;
+        CC_XMEMCPY(counter, ref->deferredIV, blocksize);
+        ccCounterAdd(counter, blocksize, (ref->streamPos + start) / blocksize);
+        ref->modeDesc->mode_setup(symMode, counter, ref->deferredKey, ref->deferredKeyLength, NULL, 0, 0, ctx);
+    }
+    if(ref->mode == kCCModeCBC) {
+        ref->modeDesc->mode_crypt_from_iv(symMode, job->dataIn + start, job->dataOut + start, end - start,
+                                            job->ivs + chunk * ref->cipherBlocksize, ctx);
+        return;
+    }
+    if(job->direction == kCCEncrypt) ref->modeDesc->mode_encrypt(symMode, job->dataIn + start, job->dataOut + start, end - start, ctx);
+    else ref->modeDesc->mode_decrypt(symMode, job->dataIn + start, job->dataOut + start, end - start, ctx);
+}
+
+/*
+ * Returns true if the run was done in parallel, false if it should be done
+ * serially.
+ */
+
+static bool ccParallelCrypt(CCCryptor *ref, CCOperation direction, const void *dataIn, size_t dataInLength, void *dataOut)
+{
+    ccParallelJob job;
+    size_t blocksize = ref->cipherBlocksize;
+    size_t nchunks, i;
+    uint32_t ivLen = (uint32_t) blocksize;
+    
+    if(ref->parallelism < 2 || dataInLength < 2 * CC_PARALLEL_MINCHUNK || !ccModeIsParallel(ref)) return false;
+    if(ref->mode == kCCModeCBC && (direction != kCCDecrypt || !ref->modeDesc->mode_crypt_from_iv)) return false;
+    nchunks = dataInLength / CC_PARALLEL_MINCHUNK;
+    if(nchunks > ref->parallelism) nchunks = ref->parallelism;
+    
+    job.ref = ref;
+    job.direction = direction;
+    job.dataIn = dataIn;
+    job.dataOut = dataOut;
+    job.dataInLength = dataInLength;
+    job.head = (ref->mode == kCCModeCTR) ? (blocksize - ref->streamPos % blocksize) % blocksize: 0;
+    job.chunkSize = FULLBLOCKSIZE((dataInLength - job.head) / nchunks, blocksize);
+    job.nchunks = nchunks;
+    job.ctxMem = NULL;
+    job.ctxSize = 0;
+    job.ivs = NULL;
+    if(ref->mode == kCCModeCTR) {
+        job.ctxSize = CC_CACHELINE_ROUNDUP(ref->modeDesc->mode_get_ctx_size(ref->symMode[direction]));
+        if((job.ctxMem = CC_XMALLOC(job.ctxSize * (nchunks - 1))) == NULL) return false;
+    } else if(ref->mode == kCCModeCBC) {
+        /*
+            The IVs are the ciphertext blocks ahead of each chunk plus the
+            last one, which becomes the cryptor's IV.  They're copied up
+            front since in-place decryption overwrites them.
+        */
+        if((job.ivs = CC_XMALLOC((nchunks + 1) * blocksize)) == NULL) return false;
+        if(ref->modeDesc->mode_getiv(ref->symMode[direction], job.ivs, &ivLen, ref->ctx[direction]) != 0) {
+            CC_XFREE(job.ivs, (nchunks + 1) * blocksize);
+            return false;
+        }
+        for(i = 1; i < nchunks; i++)
+            CC_XMEMCPY(job.ivs + i * blocksize, job.dataIn + i * job.chunkSize - blocksize, blocksize);
+        CC_XMEMCPY(job.ivs + nchunks * blocksize, job.dataIn + dataInLength - blocksize, blocksize);
+    }
+    
+    dispatch_apply_f(nchunks, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), &job, ccParallelChunk);
+    
+    if(job.ivs) {
+        ref->modeDesc->mode_setiv(ref->symMode[direction], job.ivs + nchunks * blocksize, (uint32_t) blocksize, ref->ctx[direction]);
+        CC_XZEROMEM(job.ivs, (nchunks + 1) * blocksize);
+        CC_XFREE(job.ivs, (nchunks + 1) * blocksize);
+    }
+    if(job.ctxMem) {
+        // The last chunk's context is where the serial path would have ended up.
+        CC_XMEMCPY(ref->ctx[direction].data, job.ctxMem + (nchunks - 2) * job.ctxSize, ref->modeDesc->mode_get_ctx_size(ref->symMode[direction]));
+        CC_XZEROMEM(job.ctxMem, job.ctxSize * (nchunks - 1));
+        CC_XFREE(job.ctxMem, job.ctxSize * (nchunks - 1));
+    }
+    return true;
+}
+
 static inline CCCryptorStatus ccDoEnCrypt(CCCryptor *ref, const void *dataIn, size_t dataInLength, void *dataOut)
 {
     if(!ref->modeDesc->mode_encrypt) return kCCParamError;
-    ref->modeDesc->mode_encrypt(ref->symMode[kCCEncrypt], dataIn, dataOut, dataInLength, ref->ctx[kCCEncrypt]);
+    if(!ccParallelCrypt(ref, kCCEncrypt, dataIn, dataInLength, dataOut))
+        ref->modeDesc->mode_encrypt(ref->symMode[kCCEncrypt], dataIn, dataOut, dataInLength, ref->ctx[kCCEncrypt]);
+    ref->streamPos += dataInLength;
     return kCCSuccess;
 }
 
 static inline CCCryptorStatus ccDoDeCrypt(CCCryptor *ref, const void *dataIn, size_t dataInLength, void *dataOut)
 {
     if(!ref->modeDesc->mode_decrypt) return kCCParamError;
-    ref->modeDesc->mode_decrypt(ref->symMode[kCCDecrypt], dataIn, dataOut, dataInLength, ref->ctx[kCCDecrypt]);
+    if(!ccParallelCrypt(ref, kCCDecrypt, dataIn, dataInLength, dataOut))
+        ref->modeDesc->mode_decrypt(ref->symMode[kCCDecrypt], dataIn, dataOut, dataInLength, ref->ctx[kCCDecrypt]);
+    ref->streamPos += dataInLength;
     return kCCSuccess;
 }
 
@@ -278,39 +525,39 @@ static inline CCCryptorStatus ccSetIV(CCCryptor *ref, void *iv, size_t ivLen)
 static inline void ccClearCryptor(CCCryptor *ref)
 {
     CC_XZEROMEM(ref->buffptr, sizeof(ref->buffptr));
-    CCOperation op = ref->op;
     
-    // This will clear both sides of the context/mode pairs for now.
-    if(ref->mode == kCCModeXTS || ref->mode == kCCModeECB || ref->mode == kCCModeCBC) op = kCCBoth;
-    switch(op) {
-        case kCCEncrypt:
-        case kCCDecrypt:
-            CC_XZEROMEM(ref->ctx[ref->op].data, ref->modeDesc->mode_get_ctx_size(ref->symMode[ref->op]));
-            CC_XFREE(ref->ctx[ref->op].data, ref->modeDesc->mode_get_ctx_size(ref->symMode[ref->op]));
-            break;
-        case kCCBoth:
-            for(int i = 0; i<2; i++) {
-                CC_XZEROMEM(ref->ctx[i].data, ref->modeDesc->mode_get_ctx_size(ref->symMode[i]));
-                CC_XFREE(ref->ctx[i].data, ref->modeDesc->mode_get_ctx_size(ref->symMode[i]));
-            }
-            break;
+    // The contexts live in the cryptor block - they're zeroed here and released with it.
+    for(int i = 0; i<2; i++) {
+        size_t ctxsize = ccGetModeCtxSize(ref, i);
+        if(ctxsize && ref->ctx[i].data) CC_XZEROMEM(ref->ctx[i].data, ctxsize);
+        else if(ref->ctx[i].data && ref->ctx[i].data == ref->lazyCtx) {
+            ctxsize = ref->modeDesc->mode_get_ctx_size(ref->symMode[i]);
+            CC_XZEROMEM(ref->lazyCtx, ctxsize);
+            CC_XFREE(ref->lazyCtx, ctxsize);
+        }
+        ref->ctx[i].data = NULL;
     }
+    ref->lazyCtx = NULL;
+    CC_XZEROMEM(ref->deferredKey, sizeof(ref->deferredKey));
+    CC_XZEROMEM(ref->deferredTweak, sizeof(ref->deferredTweak));
+    CC_XZEROMEM(ref->deferredIV, sizeof(ref->deferredIV));
+    ref->deferredKeyLength = 0;
     ref->cipher = 0;
     ref->mode = 0;
     ref->op = 0;
-    ref->bufferPos = 0;
+    ref->bufferPos = ref->bufferStart = 0;
     ref->bytesProcessed = 0;
 }
 
-static inline CCCryptorStatus ccEncryptPad(CCCryptor	*cryptor, void *buf, size_t *moved)
+static inline CCCryptorStatus ccEncryptPad(CCCryptor	*cryptor, void *in, size_t inLength, void *buf, size_t *moved)
 {
-    if(cryptor->padptr->encrypt_pad(cryptor->ctx[cryptor->op], cryptor->modeDesc, cryptor->symMode[cryptor->op], cryptor->buffptr, cryptor->bufferPos, buf, moved)) return kCCDecodeError;
+    if(cryptor->padptr->encrypt_pad(cryptor->ctx[cryptor->op], cryptor->modeDesc, cryptor->symMode[cryptor->op], in, (uint32_t) inLength, buf, moved)) return kCCDecodeError;
     return kCCSuccess;
 }
 
-static inline CCCryptorStatus ccDecryptPad(CCCryptor	*cryptor, void *buf, size_t *moved)
+static inline CCCryptorStatus ccDecryptPad(CCCryptor	*cryptor, void *in, size_t inLength, void *buf, size_t *moved)
 {
-    if(cryptor->padptr->decrypt_pad(cryptor->ctx[cryptor->op], cryptor->modeDesc, cryptor->symMode[cryptor->op], cryptor->buffptr, cryptor->bufferPos, buf, moved)) return kCCDecodeError;
+    if(cryptor->padptr->decrypt_pad(cryptor->ctx[cryptor->op], cryptor->modeDesc, cryptor->symMode[cryptor->op], in, (uint32_t) inLength, buf, moved)) return kCCDecodeError;
     return kCCSuccess;
 }
 
@@ -337,6 +584,13 @@ ccGetBytesAligned64(uint8_t *fromptr, uint32_t *bytesused)
 	return retval;
 }
 
+static uint8_t *
+ccGetBytesAlignedCacheline(uint8_t *fromptr)
+{
+	return (uint8_t *) CC_CACHELINE_ROUNDUP((uintptr_t) fromptr);
+}
+
+
 
 
 
@@ -349,15 +603,268 @@ ccGetBytesAligned64(uint8_t *fromptr, uint32_t *bytesused)
 
 
 
+/*
+ * buffptr holds bufferPos bytes as a ring starting at bufferStart.  Whole
+ * blocks leave from the front by advancing bufferStart, so the held back
+ * tail never gets shuffled down between updates.  bufferStart only moves a
+ * block at a time and the ring is a whole number of blocks, so a block in
+ * the ring never wraps.
+ */
 
 static int ccAddBuff(CCCryptor *cryptor, const void *dataIn, size_t dataInLength)
 {
-    CC_XMEMCPY((char *) cryptor->buffptr + cryptor->bufferPos, dataIn, dataInLength);
+    size_t end = (cryptor->bufferStart + cryptor->bufferPos) % sizeof(cryptor->buffptr);
+    size_t first = CC_XMIN(dataInLength, sizeof(cryptor->buffptr) - end);
+    
+    CC_XMEMCPY(cryptor->buffptr + end, dataIn, first);
+    if(dataInLength > first) CC_XMEMCPY(cryptor->buffptr, (const uint8_t *) dataIn + first, dataInLength - first);
     cryptor->bufferPos += dataInLength;
     return dataInLength;
 }
 
+/* Straighten the ring out for the padding code, which wants one run */
+static uint8_t *ccLinearBuff(CCCryptor *cryptor)
+{
+    uint8_t tmp[sizeof(cryptor->buffptr)];
+    size_t first;
+    
+    if(cryptor->bufferStart) {
+        first = CC_XMIN(cryptor->bufferPos, sizeof(cryptor->buffptr) - cryptor->bufferStart);
+        CC_XMEMCPY(tmp, cryptor->buffptr + cryptor->bufferStart, first);
+        CC_XMEMCPY(tmp + first, cryptor->buffptr, cryptor->bufferPos - first);
+        CC_XMEMCPY(cryptor->buffptr, tmp, cryptor->bufferPos);
+        CC_XZEROMEM(tmp, sizeof(tmp));
+        cryptor->bufferStart = 0;
+    }
+    return cryptor->buffptr;
+}
+
+
+
+/*
+ * Worst case space needed for the compat wrapper plus the cryptor block for
+ * any alignment of the caller's buffer.
+ */
+
+static inline size_t ccGetContextSize(CCCryptor *proto)
+{
+    return (sizeof(uint64_t) - 1) + sizeof(CCCompatCryptor) + (CC_CACHELINE_SIZE - 1) + ccCryptorBlockSize(proto);
+}
+
+static inline CCAlgorithm ccMapAlgorithm(CCAlgorithm alg)
+{
+    // For now we're mapping these two AES selectors to the stock one.
+    if(alg == kCCAlgorithmAES128NoHardware || alg == kCCAlgorithmAES128WithHardware) 
+        return kCCAlgorithmAES128;
+    return alg;
+}
+
+CCCryptorStatus CCCryptorGetContextSizeWithMode(
+	CCOperation 	op,
+	CCMode			mode,
+	CCAlgorithm		alg,
+	size_t			*contextSize)	/* RETURNED */
+{
+	CCCryptorStatus retval;
+    CCCryptor proto;
+    
+    CC_DEBUG_LOG(ASL_LEVEL_ERR, "Entering\n");
+    if(contextSize == NULL) return kCCParamError;
+    alg = ccMapAlgorithm(alg);
+    CC_XZEROMEM(&proto, CCCRYPTOR_SIZE);
+    if((retval = ccSetupCryptor(&proto, alg, mode, op, ccNoPadding)) != kCCSuccess) return retval;
+    *contextSize = ccGetContextSize(&proto);
+    return kCCSuccess;
+}
+
+CCCryptorStatus CCCryptorSetParallelism(
+	CCCryptorRef cryptorRef,
+	uint32_t nthreads)
+{
+    CCCompatCryptor *compat_cryptor = cryptorRef;
+    CCCryptor *cryptor;
+    
+    CC_DEBUG_LOG(ASL_LEVEL_ERR, "Entering\n");
+    if(compat_cryptor == NULL) return kCCParamError;
+    cryptor = compat_cryptor->cryptor;
+    if(nthreads > 1 && !ccModeIsParallel(cryptor) && cryptor->mode != kCCModeXTS && cryptor->mode != kCCModeGCM)
+        return kCCUnimplemented;
+    cryptor->parallelism = (nthreads > CC_MAXPARALLELISM) ? CC_MAXPARALLELISM: nthreads;
+    return kCCSuccess;
+}
+
+#pragma mark Cryptor Pool
+
+/*
+ * Opt-in per-thread cache of released cryptor blocks.  Blocks are keyed by
+ * (algorithm, mode, direction) so a pooled block always has the layout the
+ * next cryptor of that shape needs.  The key schedules and buffered data are
+ * zeroed by CCCryptorRelease() before a block is put on a free list.  The
+ * depth can change under any thread; a list over it is trimmed the next time
+ * a block is released to it.
+ */
+
+#define CCPOOL_ALGORITHMS   8
+#define CCPOOL_MODES        14
+#define CCPOOL_OPS          3
+
+typedef struct ccPoolEntry_t {
+    struct ccPoolEntry_t    *next;
+    size_t                  size;
+} ccPoolEntry;
+
+typedef struct ccPoolList_t {
+    ccPoolEntry     *head;
+    uint32_t        count;
+} ccPoolList;
+
+typedef struct ccThreadPool_t {
+    ccPoolList      list[CCPOOL_ALGORITHMS][CCPOOL_MODES][CCPOOL_OPS];
+} ccThreadPool;
+
+static volatile uint32_t ccPoolDepth = 0;
+static volatile uint32_t ccPoolUsed = 0;
+static pthread_key_t ccPoolKey;
+
+static inline uint32_t ccPoolGetDepth(void)
+{
+    return __sync_fetch_and_add(&ccPoolDepth, 0);
+}
+
+static void ccPoolDestroy(void *p)
+{
+    ccThreadPool *pool = p;
+    ccPoolList *list = &pool->list[0][0][0];
+    
+    for(size_t i = 0; i < CCPOOL_ALGORITHMS * CCPOOL_MODES * CCPOOL_OPS; i++) {
+        while(list[i].head) {
+            ccPoolEntry *entry = list[i].head;
+            list[i].head = entry->next;
+            CC_XFREE(entry, entry->size);
+        }
+    }
+    CC_XFREE(pool, sizeof(ccThreadPool));
+}
+
+static ccPoolList *ccPoolGetList(CCAlgorithm alg, CCMode mode, CCOperation op, bool create)
+{
+    static dispatch_once_t init;
+    ccThreadPool *pool;
+    
+    /* Released blocks still go to a list after the depth drops, to trim it */
+    if(!ccPoolUsed || (!create && ccPoolGetDepth() == 0)) return NULL;
+    if(alg == kCCAlgorithmRC4) mode = kCCModeOFB;
+    if(alg == kCCAlgorithmChaCha20) mode = kCCModeChaCha20Poly1305;
+    if(op == kCCBoth) op = CCPOOL_OPS - 1;
+    if(alg >= CCPOOL_ALGORITHMS || mode >= CCPOOL_MODES || op >= CCPOOL_OPS) return NULL;
+    
+    dispatch_once(&init, ^{
+        pthread_key_create(&ccPoolKey, ccPoolDestroy);
+    });
+    if((pool = pthread_getspecific(ccPoolKey)) == NULL) {
+        if(!create || ccPoolGetDepth() == 0 || (pool = CC_XCALLOC(1, sizeof(ccThreadPool))) == NULL) return NULL;
+        pthread_setspecific(ccPoolKey, pool);
+    }
+    return &pool->list[alg][mode][op];
+}
+
+static inline void *ccPoolGet(ccPoolList *list, size_t size)
+{
+    ccPoolEntry *entry;
+    
+    if(list == NULL || (entry = list->head) == NULL || entry->size != size) return NULL;
+    list->head = entry->next;
+    list->count--;
+    return entry;
+}
+
+static inline bool ccPoolPut(ccPoolList *list, void *block, size_t size)
+{
+    ccPoolEntry *entry = block;
+    uint32_t depth = ccPoolGetDepth();
+    
+    if(list == NULL) return false;
+    while(list->head && list->count >= depth) {
+        ccPoolEntry *extra = list->head;
+        
+        list->head = extra->next;
+        list->count--;
+        CC_XFREE(extra, extra->size);
+    }
+    if(list->count >= depth) return false;
+    entry->next = list->head;
+    entry->size = size;
+    list->head = entry;
+    list->count++;
+    return true;
+}
+
+CCCryptorStatus CCCryptorSetPoolDepth(
+	uint32_t		depth)
+{
+    uint32_t old;
+    
+    CC_DEBUG_LOG(ASL_LEVEL_ERR, "Entering\n");
+    if(depth) __sync_bool_compare_and_swap(&ccPoolUsed, 0, 1);
+    do {
+        old = ccPoolDepth;
+    } while(!__sync_bool_compare_and_swap(&ccPoolDepth, old, depth));
+    return kCCSuccess;
+}
+
+/* Get a wrapper + cryptor block of contextSize bytes - from this thread's pool if possible. */
+
+static inline CCCompatCryptor *ccAllocCompat(CCAlgorithm alg, CCMode mode, CCOperation op, size_t contextSize)
+{
+    CCCompatCryptor *compat_cryptor;
+    
+    if((compat_cryptor = ccPoolGet(ccPoolGetList(ccMapAlgorithm(alg), mode, op, false), contextSize)) == NULL)
+        compat_cryptor = (CCCompatCryptor *)CC_XMALLOC(contextSize);
+    return compat_cryptor;
+}
+
+/* This mallocs the CCCryptorRef - one allocation holding the wrapper, the cryptor and its contexts */
+
+static CCCryptorStatus ccCreateWithMalloc(
+	CCOperation 	op,
+	CCMode			mode,
+	CCAlgorithm		alg,
+	CCPadding		padding,		
+	const void 		*iv,
+	const void 		*key,
+	size_t 			keyLength,	
+	const void 		*tweak,
+	size_t 			tweakLength,	
+	int				numRounds,
+	CCModeOptions 	options,
+	CCCryptorRef	*cryptorRef)
+{
+	CCCryptorStatus err;
+	CCCompatCryptor *compat_cryptor = NULL;
+	size_t dataUsed = 0, contextSize;
+	
+    if((err = CCCryptorGetContextSizeWithMode(op, mode, alg, &contextSize)) != kCCSuccess) return err;
+    if((compat_cryptor = ccAllocCompat(alg, mode, op, contextSize)) == NULL) return kCCMemoryFailure;
+	err = CCCryptorCreateFromDataWithMode(op, mode, alg, padding, iv, key,  keyLength, tweak, tweakLength, numRounds, options, compat_cryptor, contextSize, cryptorRef, &dataUsed); 
+	if(err != kCCSuccess)  CC_XFREE(compat_cryptor, contextSize);
+	else compat_cryptor->weMallocd = true;
+	return err;
+}
 
+static inline void ccLegacyModeAndPadding(CCAlgorithm alg, CCOptions options, CCMode *mode, CCPadding *padding)
+{
+	/* Determine mode from options - old call only supported ECB and CBC 
+       we treat RC4 as a "mode" in that it's the only streaming cipher
+       currently supported 
+    */
+    if(alg == kCCAlgorithmRC4) *mode = kCCModeRC4;
+    else if(options & kCCOptionECBMode) *mode = kCCModeECB;
+	else *mode = kCCModeCBC;
+    
+	/* Determine padding from options - only PKCS7 was available */
+    *padding = ccNoPadding;
+	if(options & kCCOptionPKCS7Padding) *padding = ccPKCS7Padding;
+}
 
 CCCryptorStatus CCCryptorCreate(
 	CCOperation op,             /* kCCEncrypt, etc. */
@@ -368,16 +875,12 @@ CCCryptorStatus CCCryptorCreate(
 	const void *iv,             /* optional initialization vector */
 	CCCryptorRef *cryptorRef)  /* RETURNED */
 {
-	CCCryptorStatus err;
-	CCCompatCryptor *compat_cryptor = NULL;
-	size_t dataUsed = 0;
+	CCMode			mode;
+    CCPadding		padding;		
 	
     CC_DEBUG_LOG(ASL_LEVEL_ERR, "Entering\n");
-	if((compat_cryptor = (CCCompatCryptor *)CC_XMALLOC(sizeof(CCCompatCryptor))) == NULL) return kCCMemoryFailure;
-	err = CCCryptorCreateFromData( op, alg,  options, key,  keyLength, iv, compat_cryptor, sizeof(CCCompatCryptor), cryptorRef, &dataUsed); 
-	if(err != kCCSuccess)  CC_XFREE(compat_cryptor, sizeof(CCCompatCryptor));
-	else compat_cryptor->weMallocd = true;
-	return err;
+    ccLegacyModeAndPadding(alg, options, &mode, &padding);
+	return ccCreateWithMalloc(op, mode, alg, padding, iv, key, keyLength, NULL, 0, 0, 0, cryptorRef);
 }
 
 CCCryptorStatus CCCryptorCreateFromData(
@@ -400,17 +903,7 @@ CCCryptorStatus CCCryptorCreateFromData(
 	CCModeOptions 	modeOptions;
     
     CC_DEBUG_LOG(ASL_LEVEL_ERR, "Entering\n");
-	/* Determine mode from options - old call only supported ECB and CBC 
-       we treat RC4 as a "mode" in that it's the only streaming cipher
-       currently supported 
-    */
-    if(alg == kCCAlgorithmRC4) mode = kCCModeRC4;
-    else if(options & kCCOptionECBMode) mode = kCCModeECB;
-	else mode = kCCModeCBC;
-    
-	/* Determine padding from options - only PKCS7 was available */
-    padding = ccNoPadding;
-	if(options & kCCOptionPKCS7Padding) padding = ccPKCS7Padding;
+    ccLegacyModeAndPadding(alg, options, &mode, &padding);
    
 	/* No tweak was ever used */
    	tweak = NULL;
@@ -441,20 +934,29 @@ CCCryptorStatus CCCryptorCreateWithMode(
 	CCModeOptions 	options,
 	CCCryptorRef	*cryptorRef)	/* RETURNED */
 {
-	CCCryptorStatus err;
-	CCCompatCryptor *compat_cryptor = NULL;
-	size_t dataUsed = 0;
-	
     CC_DEBUG_LOG(ASL_LEVEL_ERR, "Entering\n");
-	if((compat_cryptor = (CCCompatCryptor *)CC_XMALLOC(sizeof(CCCompatCryptor))) == NULL) return kCCMemoryFailure;
-	err = CCCryptorCreateFromDataWithMode( op, mode, alg, padding, iv, key,  keyLength, tweak, tweakLength, numRounds, options, compat_cryptor, DEFAULT_CRYPTOR_MALLOC, cryptorRef, &dataUsed); 
-	if(err != kCCSuccess)  CC_XFREE(compat_cryptor, sizeof(CCCompatCryptor));
-	else compat_cryptor->weMallocd = true;
-	return err;
+	return ccCreateWithMalloc(op, mode, alg, padding, iv, key, keyLength, tweak, tweakLength, numRounds, options, cryptorRef);
 }
 
 #define KEYALIGNMENT (sizeof(int)-1)
 
+/*
+ * Some implementations are sensitive to keys not being 4 byte aligned.
+ * We'll move the key into an aligned buffer for the call to setup
+ * the key schedule.  The caller zeroes and frees *alignedKey.
+ */
+
+static inline CCCryptorStatus ccGetAlignedKey(const void **key, size_t keyLength, uint8_t **alignedKey)
+{
+    *alignedKey = NULL;
+    if((intptr_t) *key & KEYALIGNMENT) {
+        if((*alignedKey = CC_XMALLOC(keyLength)) == NULL) return kCCMemoryFailure;
+        CC_XMEMCPY(*alignedKey, *key, keyLength);
+        *key = *alignedKey;
+    }
+    return kCCSuccess;
+}
+
 CCCryptorStatus CCCryptorCreateFromDataWithMode(
 	CCOperation 	op,				/* kCCEncrypt, kCCEncrypt, kCCBoth (default for BlockMode) */
 	CCMode			mode,
@@ -474,72 +976,76 @@ CCCryptorStatus CCCryptorCreateFromDataWithMode(
 {
 	CCCryptorStatus retval = kCCSuccess;
 	CCCryptor *cryptor = NULL;
+    CCCryptor proto;
     CCCompatCryptor *compat_cryptor = NULL;
-	int	needed, needed2aligncryptor;
+	uint32_t needed2aligncryptor;
+    size_t needed, blockSize;
+    uint8_t *block = NULL, *cryptorMem = NULL;
     uint8_t *alignedKey = NULL;
 
     CC_DEBUG_LOG(ASL_LEVEL_ERR, "Entering Op: %d Mode: %d Cipher: %d Padding: %d\n", op, mode, alg, padding);
 
-    // For now we're mapping these two AES selectors to the stock one.
-    if(alg == kCCAlgorithmAES128NoHardware || alg == kCCAlgorithmAES128WithHardware) 
-        alg = kCCAlgorithmAES128;
+    alg = ccMapAlgorithm(alg);
     
     /* corecrypto only implements CTR_BE.  No use of CTR_LE was found so we're marking
        this as unimplemented for now.  Also in Lion this was defined in reverse order.
        See <rdar://problem/10306112> */
     
     if(mode == kCCModeCTR && options != kCCModeOptionCTR_BE) {
-        CC_DEBUG_LOG(ASL_LEVEL_ERR, "Mode is CTR, but options isn't BE\n", op, mode, alg, padding);
+        CC_DEBUG_LOG(ASL_LEVEL_ERR, "Mode is CTR, but options isn't BE\n");
         return kCCUnimplemented;
     }
 
     // validate pointers
 	if((data == NULL) || (cryptorRef == NULL) || (key == NULL)) {
-		CC_DEBUG_LOG(ASL_LEVEL_ERR, "bad arguments\n", 0);
+		CC_DEBUG_LOG(ASL_LEVEL_ERR, "bad arguments\n");
 		return kCCParamError;
 	}
     
-    /*
-     * Some implementations are sensitive to keys not being 4 byte aligned.
-     * We'll move the key into an aligned buffer for the call to setup
-     * the key schedule.
-     */
-    
-    if((intptr_t) key & KEYALIGNMENT) {
-        if((alignedKey = CC_XMALLOC(keyLength)) == NULL) {
-            return kCCMemoryFailure;
-        }
-        CC_XMEMCPY(alignedKey, key, keyLength);
-        key = alignedKey;
-    }
+    /* The AEAD modes take their key sizes on trust */
+    if((alg == kCCAlgorithmChaCha20 && keyLength != kCCKeySizeChaCha20) ||
+       (alg == kCCAlgorithmAES128 && mode == kCCModeGCMSIV && keyLength != kCCKeySizeAES128 && keyLength != kCCKeySizeAES256)) {
+		CC_DEBUG_LOG(ASL_LEVEL_ERR, "bad key length for AEAD mode\n");
+		return kCCParamError;
+	}
     
+    /* Resolve the modes first - the block size depends on them. */
+    CC_XZEROMEM(&proto, CCCRYPTOR_SIZE);
+    if((retval = ccSetupCryptor(&proto, alg, mode, op, padding)) != kCCSuccess) {
+        printf("Failed to setup Cryptor struct with alg/mode %d\n", retval);
+        return retval;
+    }
+    blockSize = ccCryptorBlockSize(&proto);
 
 	/* Get Space for Cryptor Structure */	
 	compat_cryptor = (CCCompatCryptor *) ccGetBytesAligned64((uint8_t *)data, &needed2aligncryptor);
     needed = needed2aligncryptor + sizeof(CCCompatCryptor);
-    if(dataUsed != NULL) *dataUsed = needed;
-
 	if (needed > dataLength) {
-		if(dataUsed != NULL) *dataUsed += 16; /* in case it's not on a doubleword boundary */
-		CC_DEBUG_LOG(ASL_LEVEL_ERR, "Needed %d Have %d\n", needed, dataLength);
-        retval = kCCBufferTooSmall;
-        goto out;
+		if(dataUsed != NULL) *dataUsed = ccGetContextSize(&proto);
+		CC_DEBUG_LOG(ASL_LEVEL_ERR, "Needed %zu Have %zu\n", needed, dataLength);
+        return kCCBufferTooSmall;
 	}
-    compat_cryptor->weMallocd = false;
     
-    if((cryptor = (CCCryptor *)CC_XMALLOC(DEFAULT_CRYPTOR_MALLOC)) == NULL) {
-        retval = kCCMemoryFailure;
-        goto out;
+    /* If the whole cryptor block fits behind the wrapper it goes there, otherwise it gets its own allocation. */
+    block = ccGetBytesAlignedCacheline((uint8_t *) data + needed);
+    if((size_t) (block - (uint8_t *) data) + blockSize <= dataLength) {
+        needed = (block - (uint8_t *) data) + blockSize;
+    } else {
+        if((cryptorMem = CC_XMALLOC(blockSize + CC_CACHELINE_SIZE - 1)) == NULL) return kCCMemoryFailure;
+        block = ccGetBytesAlignedCacheline(cryptorMem);
     }
+    if(dataUsed != NULL) *dataUsed = needed;
+    
+    if((retval = ccGetAlignedKey(&key, keyLength, &alignedKey)) != kCCSuccess) goto out;
+    
+    compat_cryptor->weMallocd = false;
+    compat_cryptor->cryptorMem = cryptorMem;
+    compat_cryptor->cryptorMemSize = (cryptorMem) ? blockSize + CC_CACHELINE_SIZE - 1: 0;
+    cryptor = ccLayoutCryptor(&proto, block);
 	compat_cryptor->cryptor = cryptor;
 		
 	*cryptorRef = compat_cryptor;
         
-    if((retval = ccSetupCryptor(cryptor, alg, mode, op, padding)) != kCCSuccess) {
-        printf("Failed to setup Cryptor struct with alg/mode %d\n", retval);
-        goto out;
-    }
-    
     if((retval = ccInitCryptor(cryptor, key, keyLength, tweak, iv)) != kCCSuccess) {
         printf("Failed to init Cryptor %d\n", retval);
         goto out;
@@ -550,11 +1056,12 @@ out:
     // Things to destroy if setup failed
     if(retval) {
         *cryptorRef = NULL;
-        if(compat_cryptor) compat_cryptor->cryptor = NULL;
-        if(cryptor) {
-            CC_XZEROMEM(cryptor, DEFAULT_CRYPTOR_MALLOC);
-            CC_XFREE(cryptor, DEFAULT_CRYPTOR_MALLOC);
+        if(compat_cryptor) {
+            compat_cryptor->cryptor = NULL;
+            compat_cryptor->cryptorMem = NULL;
         }
+        CC_XZEROMEM(block, blockSize);
+        if(cryptorMem) CC_XFREE(cryptorMem, blockSize + CC_CACHELINE_SIZE - 1);
     } else {
         // printf("Blocksize = %d mode = %d pad = %d\n", ccGetBlockSize(cryptor), cryptor->mode, padding);
     }
@@ -564,37 +1071,215 @@ out:
         CC_XZEROMEM(alignedKey, keyLength);
         CC_XFREE(alignedKey, keyLength);
     }
+    CC_XZEROMEM(&proto, CCCRYPTOR_SIZE);
+    
+    return retval;
+}
+
+
+
+
+
+CCCryptorStatus CCCryptorRelease(
+	CCCryptorRef cryptorRef)
+{
+	uint32_t err;
+    CCCompatCryptor *compat_cryptor = cryptorRef;
+    CCCryptor *cryptor;
+	uint32_t weMallocd;
+    ccPoolList *poolList = NULL;
+    size_t contextSize = 0;
+    
+    CC_DEBUG_LOG(ASL_LEVEL_ERR, "Entering\n");
+	if(cryptorRef == NULL) return kCCSuccess;
+    cryptor = compat_cryptor->cryptor;
+	weMallocd = compat_cryptor->weMallocd;
+    
+    // Only single allocation cryptors can be recycled.
+    if(weMallocd) {
+        contextSize = ccGetContextSize(cryptor);
+        if(compat_cryptor->cryptorMem == NULL) poolList = ccPoolGetList(cryptor->cipher, cryptor->mode, cryptor->op, true);
+    }
+    
+    ccClearCryptor(cryptor);
+    
+	CC_XMEMSET(cryptor, 0, CCCRYPTOR_SIZE);
+    if(compat_cryptor->cryptorMem) CC_XFREE(compat_cryptor->cryptorMem, compat_cryptor->cryptorMemSize);
+    compat_cryptor->cryptorMem = NULL;
+    compat_cryptor->cryptor = NULL;
+	if(weMallocd && !ccPoolPut(poolList, compat_cryptor, contextSize))  CC_XFREE(compat_cryptor, contextSize);
+	return kCCSuccess;
+}
+
+#pragma mark Key Schedules
+
+static inline void ccCopyModeContexts(CCCryptor *dst, CCCryptor *src)
+{
+    for(int i = 0; i<2; i++) {
+        size_t ctxsize = ccGetModeCtxSize(dst, i);
+        if(ctxsize) CC_XMEMCPY(dst->ctx[i].data, src->ctx[i].data, ctxsize);
+    }
+}
+
+/*
+ * Only modes whose IV isn't folded into the key schedule can share one.
+ */
+
+static inline bool ccModeHasSeparateIV(CCMode mode)
+{
+    return mode == kCCModeECB || mode == kCCModeCBC || mode == kCCModeXTS || mode == kCCModeGCM;
+}
+
+CCCryptorStatus CCKeyScheduleCreate(
+	CCOperation 	op,
+	CCMode			mode,
+	CCAlgorithm		alg,
+	const void 		*key,
+	size_t 			keyLength,
+	const void 		*tweak,
+	size_t 			tweakLength,
+	CCKeyScheduleRef *scheduleRef)
+{
+	CCCryptorStatus retval;
+    CCKeySchedule *schedule;
+    CCCryptor proto;
+    uint8_t *alignedKey = NULL;
+    
+    CC_DEBUG_LOG(ASL_LEVEL_ERR, "Entering Op: %d Mode: %d Cipher: %d\n", op, mode, alg);
+    if(key == NULL || scheduleRef == NULL) return kCCParamError;
+    alg = ccMapAlgorithm(alg);
+    if(alg == kCCAlgorithmRC4 || alg == kCCAlgorithmChaCha20 || !ccModeHasSeparateIV(mode)) return kCCUnimplemented;
+    
+    CC_XZEROMEM(&proto, CCCRYPTOR_SIZE);
+    if((retval = ccSetupCryptor(&proto, alg, mode, op, ccNoPadding)) != kCCSuccess) return retval;
+    
+    if((schedule = CC_XMALLOC(sizeof(CCKeySchedule))) == NULL) return kCCMemoryFailure;
+    schedule->cryptorMemSize = ccCryptorBlockSize(&proto) + CC_CACHELINE_SIZE - 1;
+    if((schedule->cryptorMem = CC_XMALLOC(schedule->cryptorMemSize)) == NULL) {
+        CC_XFREE(schedule, sizeof(CCKeySchedule));
+        return kCCMemoryFailure;
+    }
+    schedule->cryptor = ccLayoutCryptor(&proto, ccGetBytesAlignedCacheline(schedule->cryptorMem));
+    
+    if((retval = ccGetAlignedKey(&key, keyLength, &alignedKey)) == kCCSuccess)
+        retval = ccInitCryptor(schedule->cryptor, key, keyLength, tweak, NULL);
+    if(alignedKey) {
+        CC_XZEROMEM(alignedKey, keyLength);
+        CC_XFREE(alignedKey, keyLength);
+    }
+    if(retval != kCCSuccess) {
+        CCKeyScheduleRelease(schedule);
+        return retval;
+    }
+    *scheduleRef = schedule;
+    return kCCSuccess;
+}
+
+CCCryptorStatus CCKeyScheduleRelease(
+	CCKeyScheduleRef scheduleRef)
+{
+    CC_DEBUG_LOG(ASL_LEVEL_ERR, "Entering\n");
+    if(scheduleRef == NULL) return kCCSuccess;
+    ccClearCryptor(scheduleRef->cryptor);
+    CC_XZEROMEM(scheduleRef->cryptorMem, scheduleRef->cryptorMemSize);
+    CC_XFREE(scheduleRef->cryptorMem, scheduleRef->cryptorMemSize);
+    CC_XFREE(scheduleRef, sizeof(CCKeySchedule));
+    return kCCSuccess;
+}
+
+CCCryptorStatus CCCryptorCreateWithKeySchedule(
+	CCKeyScheduleRef scheduleRef,
+	CCPadding		padding,
+	const void 		*iv,			/* optional initialization vector */
+	CCCryptorRef	*cryptorRef)	/* RETURNED */
+{
+    CCCompatCryptor *compat_cryptor;
+    CCCryptor proto, *cryptor;
+    CCCryptorStatus retval;
+    size_t contextSize;
+    
+    CC_DEBUG_LOG(ASL_LEVEL_ERR, "Entering\n");
+    if(scheduleRef == NULL || cryptorRef == NULL) return kCCParamError;
     
-    return retval;
+    CC_XMEMCPY(&proto, scheduleRef->cryptor, CCCRYPTOR_SIZE);
+    proto.lazyCtx = NULL;
+    CC_XZEROMEM(proto.deferredKey, sizeof(proto.deferredKey));
+    CC_XZEROMEM(proto.deferredTweak, sizeof(proto.deferredTweak));
+    CC_XZEROMEM(proto.deferredIV, sizeof(proto.deferredIV));
+    proto.deferredKeyLength = 0;
+    ccSetupPadding(&proto, proto.mode, padding);
+    proto.keySchedule = scheduleRef;
+    contextSize = ccGetContextSize(&proto);
+    
+    if((compat_cryptor = ccAllocCompat(proto.cipher, proto.mode, proto.op, contextSize)) == NULL) return kCCMemoryFailure;
+    cryptor = ccLayoutCryptor(&proto, ccGetBytesAlignedCacheline((uint8_t *) (compat_cryptor + 1)));
+    CC_XZEROMEM(&proto, CCCRYPTOR_SIZE);
+    compat_cryptor->weMallocd = true;
+    compat_cryptor->cryptor = cryptor;
+    compat_cryptor->cryptorMem = NULL;
+    compat_cryptor->cryptorMemSize = 0;
+    
+    // Reset copies the keyed contexts in from the schedule and sets the IV.
+    if((retval = CCCryptorReset(compat_cryptor, iv)) != kCCSuccess) {
+        CCCryptorRelease(compat_cryptor);
+        return retval;
+    }
+    *cryptorRef = compat_cryptor;
+    return kCCSuccess;
 }
 
+#pragma mark Cloning
 
-
-
-
-CCCryptorStatus CCCryptorRelease(
-	CCCryptorRef cryptorRef)
+CCCryptorStatus CCCryptorClone(
+	CCCryptorRef	cryptorRef,
+	CCCryptorRef	*cloneRef)		/* RETURNED */
 {
-	uint32_t err;
     CCCompatCryptor *compat_cryptor = cryptorRef;
-    CCCryptor *cryptor;
-	uint32_t weMallocd;
-    
+    CCCryptor proto, *src, *cryptor;
+    size_t contextSize, ctxsize = 0;
+    void *lazyCtx = NULL;
+
     CC_DEBUG_LOG(ASL_LEVEL_ERR, "Entering\n");
-	if(cryptorRef == NULL) return kCCSuccess;
-    cryptor = compat_cryptor->cryptor;
-	weMallocd = compat_cryptor->weMallocd;
-    
-    ccClearCryptor(cryptor);
-    
-	CC_XMEMSET(cryptor, 0, CCCRYPTOR_SIZE);
-    CC_XFREE(cryptor, DEFAULT_CRYPTOR_MALLOC);
-	if(weMallocd)  CC_XFREE(compat_cryptor, sizeof(CCCompatCryptor));
-	return kCCSuccess;
+    if(compat_cryptor == NULL || cloneRef == NULL) return kCCParamError;
+    src = compat_cryptor->cryptor;
+    if(src == NULL) return kCCParamError;
+
+    // GCM-SIV holds back ciphertext in the caller's output buffer until final.
+    if(src->mode == kCCModeGCMSIV) return kCCUnimplemented;
+
+    CC_XMEMCPY(&proto, src, CCCRYPTOR_SIZE);
+    contextSize = ccGetContextSize(&proto);
+
+    // A direction expanded by a DataBlock call lives outside the block.
+    if(src->lazyCtx) {
+        for(int i = 0; i<2; i++)
+            if(src->ctx[i].data == src->lazyCtx) ctxsize = src->modeDesc->mode_get_ctx_size(src->symMode[i]);
+        if((lazyCtx = CC_XMALLOC(ctxsize)) == NULL) return kCCMemoryFailure;
+        CC_XMEMCPY(lazyCtx, src->lazyCtx, ctxsize);
+    }
+
+    if((compat_cryptor = ccAllocCompat(proto.cipher, proto.mode, proto.op, contextSize)) == NULL) {
+        if(lazyCtx) {
+            CC_XZEROMEM(lazyCtx, ctxsize);
+            CC_XFREE(lazyCtx, ctxsize);
+        }
+        return kCCMemoryFailure;
+    }
+    cryptor = ccLayoutCryptor(&proto, ccGetBytesAlignedCacheline((uint8_t *) (compat_cryptor + 1)));
+    CC_XZEROMEM(&proto, CCCRYPTOR_SIZE);
+    ccCopyModeContexts(cryptor, src);
+    for(int i = 0; i<2; i++)
+        if(src->lazyCtx && src->ctx[i].data == src->lazyCtx) cryptor->ctx[i].data = lazyCtx;
+    cryptor->lazyCtx = lazyCtx;
+
+    compat_cryptor->weMallocd = true;
+    compat_cryptor->cryptor = cryptor;
+    compat_cryptor->cryptorMem = NULL;
+    compat_cryptor->cryptorMemSize = 0;
+    *cloneRef = compat_cryptor;
+    return kCCSuccess;
 }
 
-#define FULLBLOCKSIZE(X,BLOCKSIZE) (((X)/(BLOCKSIZE))*BLOCKSIZE)
-#define FULLBLOCKREMAINDER(X,BLOCKSIZE) ((X)%(BLOCKSIZE))
 
 static CCCryptorStatus ccSimpleUpdate(CCCryptor *cryptor, const void *dataIn, size_t dataInLength, void **dataOut, size_t *dataOutAvailable, size_t *dataOutMoved)
 {		
@@ -615,10 +1300,17 @@ static CCCryptorStatus ccSimpleUpdate(CCCryptor *cryptor, const void *dataIn, si
 }
 
 
+/*
+ * Block mode update.  Whatever has to be held back (a partial block, or the
+ * blocks the padding needs at final) lives in buffptr; everything else is
+ * processed.  Only the bytes needed to complete a buffered partial block and
+ * the held back tail are copied - the whole blocks in the middle of the
+ * input always go straight to the mode in one call.
+ */
+
 static CCCryptorStatus ccBlockUpdate(CCCryptor *cryptor, const void *dataIn, size_t dataInLength, void *dataOut, size_t *dataOutAvailable, size_t *dataOutMoved)
 {
     CCCryptorStatus retval;
-	uint32_t encrypting = (cryptor->op == kCCEncrypt);
     size_t blocksize = ccGetCipherBlockSize(cryptor);
     size_t reserve = ccGetReserve(cryptor);
     size_t buffsize = (reserve) ? reserve: blocksize; /* minimum buffering is a block */
@@ -626,21 +1318,6 @@ static CCCryptorStatus ccBlockUpdate(CCCryptor *cryptor, const void *dataIn, siz
     size_t dataCountToHold, dataCountToProcess;
     size_t remainder, movecnt;
     
-    /* This is a simple optimization */
-    if(reserve == 0 && cryptor->bufferPos == 0 && (dataInLength % blocksize) == 0) { // No Padding, not buffering, even blocks
-        // printf("simple processing\n");
-    	return ccSimpleUpdate(cryptor, dataIn, dataInLength, &dataOut, &dataOutAvailable, dataOutMoved);
-    }
-    
-    /* From this point on we're dealing with a Block Cipher with Block oriented I/O
-     
-     We always fallback to buffering once we're processing non-block aligned data.
-     If the data inputs result in data becoming block aligned once again we can 
-     move back to block aligned I/O - even if it's only for partial processing
-     of the data supplied to this routine.
-     
-     */
-    
     if(dataCount <= reserve) {
     	dataCountToHold = dataCount;
     } else {
@@ -652,76 +1329,62 @@ static CCCryptorStatus ccBlockUpdate(CCCryptor *cryptor, const void *dataIn, siz
     dataCountToProcess = dataCount - dataCountToHold;
     // printf("DataCount %d Processing %d Holding %d\n", dataCount, dataCountToProcess, dataCountToHold);
     
-    if(dataCountToProcess > 0) {
-    	if(cryptor->bufferPos == 0) {
-        	// printf("CCCryptorUpdate checkpoint 0\n");
-        	/* nothing to do yet */
-    	} else if(cryptor->bufferPos < dataCountToProcess) {
-        	// printf("CCCryptorUpdate checkpoint 1\n");
-            movecnt = blocksize - (cryptor->bufferPos % blocksize);
-            ccAddBuff(cryptor, dataIn, movecnt);
-            dataIn += movecnt; dataInLength -= movecnt;
-            
-         	// printf("CCCryptorUpdate checkpoint 1.1 bufpos = %d\n", (int) cryptor->bufferPos);
-           	if((retval = ccSimpleUpdate(cryptor, cryptor->buffptr, cryptor->bufferPos, &dataOut, &dataOutAvailable, dataOutMoved)) != kCCSuccess) {
-                return retval;
-        	}
-			// printf("CCCryptorUpdate checkpoint 1.2\n");
-            
-			dataCountToProcess -= cryptor->bufferPos;
-        	cryptor->bufferPos = 0;
-        } else if(cryptor->bufferPos == dataCountToProcess) {
-        	// printf("CCCryptorUpdate checkpoint 2\n");
-			if((retval = ccSimpleUpdate(cryptor, cryptor->buffptr, cryptor->bufferPos, &dataOut, &dataOutAvailable, dataOutMoved)) != kCCSuccess) {
-                return retval;
-        	}
-			dataCountToProcess -= cryptor->bufferPos;
-        	cryptor->bufferPos = 0;
-        } else /* (cryptor->bufferPos > dataCountToProcess) */ {
-         	// printf("CCCryptorUpdate checkpoint 3\n");
-       		if(dataCountToHold) {
-            	// printf("CCCryptorUpdate bad calculation 1\n");
-                return kCCDecodeError;
-            }
-			if((retval = ccSimpleUpdate(cryptor, cryptor->buffptr, dataCountToProcess, &dataOut, &dataOutAvailable, dataOutMoved)) != kCCSuccess) {
-                return retval;
-        	}
-            cryptor->bufferPos = reserve - dataCountToProcess;
-            memmove(cryptor->buffptr, ((uint8_t *) cryptor->buffptr)+ dataCountToProcess, cryptor->bufferPos);
-            return kCCSuccess;
-        }
-        
-        if(dataCountToProcess > 0) {
-         	// printf("CCCryptorUpdate checkpoint 4\n");
-   			movecnt = FULLBLOCKREMAINDER(dataCountToProcess, blocksize);
-            if(movecnt) {
-            	// printf("CCCryptorUpdate bad calculation 2\n");
-                return kCCDecodeError;
-            }
-        	if((retval = ccSimpleUpdate(cryptor, dataIn, dataCountToProcess, &dataOut, &dataOutAvailable, dataOutMoved)) != kCCSuccess) return retval;
-        	dataIn += dataCountToProcess; dataInLength -= dataCountToProcess;
+    /* Head - whole blocks already buffered go first, off the front of the ring (at most two runs) */
+    if(dataCountToProcess && cryptor->bufferPos >= blocksize) {
+        movecnt = FULLBLOCKSIZE(cryptor->bufferPos, blocksize);
+        if(movecnt > dataCountToProcess) movecnt = dataCountToProcess;
+        dataCountToProcess -= movecnt;
+        while(movecnt) {
+            size_t run = CC_XMIN(movecnt, sizeof(cryptor->buffptr) - cryptor->bufferStart);
+            if((retval = ccSimpleUpdate(cryptor, cryptor->buffptr + cryptor->bufferStart, run, &dataOut, dataOutAvailable, dataOutMoved)) != kCCSuccess) return retval;
+            cryptor->bufferStart = (cryptor->bufferStart + run) % sizeof(cryptor->buffptr);
+            cryptor->bufferPos -= run;
+            movecnt -= run;
         }
+        if(cryptor->bufferPos == 0) cryptor->bufferStart = 0;
     }
     
-    if(dataCountToHold) {
-		// printf("CCCryptorUpdate checkpoint 1\n");
-    	movecnt = dataCountToHold - cryptor->bufferPos;
-        if(movecnt) {
-        	if(movecnt != dataInLength) {
-            	// printf("CCCryptorUpdate bad calculation 3\n");
-                return kCCDecodeError;
-            }
-            ccAddBuff(cryptor, dataIn, movecnt);
-        	dataIn += movecnt; dataInLength -= movecnt;
+    /* then a buffered partial block, completed from the input */
+    if(dataCountToProcess && cryptor->bufferPos) {
+        movecnt = blocksize - cryptor->bufferPos;
+        ccAddBuff(cryptor, dataIn, movecnt);
+        dataIn += movecnt; dataInLength -= movecnt;
+        if((retval = ccSimpleUpdate(cryptor, cryptor->buffptr + cryptor->bufferStart, blocksize, &dataOut, dataOutAvailable, dataOutMoved)) != kCCSuccess) return retval;
+        cryptor->bufferPos = cryptor->bufferStart = 0;
+        dataCountToProcess -= blocksize;
+    }
+    
+    /* Middle - straight from the caller's buffer */
+    if(dataCountToProcess) {
+        if(FULLBLOCKREMAINDER(dataCountToProcess, blocksize) || dataCountToProcess > dataInLength) {
+            // printf("CCCryptorUpdate bad calculation 2\n");
+            return kCCDecodeError;
         }
+        if((retval = ccSimpleUpdate(cryptor, dataIn, dataCountToProcess, &dataOut, dataOutAvailable, dataOutMoved)) != kCCSuccess) return retval;
+        dataIn += dataCountToProcess; dataInLength -= dataCountToProcess;
     }
     
+    /* Tail - held back for the next call or final */
     if(dataInLength) {
-        // printf("CCCryptorUpdate bad calculation 4\n");
-        return kCCDecodeError;
+        if(cryptor->bufferPos + dataInLength != dataCountToHold) {
+            // printf("CCCryptorUpdate bad calculation 3\n");
+            return kCCDecodeError;
+        }
+        ccAddBuff(cryptor, dataIn, dataInLength);
     }
     return kCCSuccess;
+}
+
+/*
+ * Run one contiguous stretch of input through the cryptor.
+ */
 
+static inline CCCryptorStatus ccUpdateRun(CCCryptor *cryptor, const void *dataIn, size_t dataInLength, void *dataOut, size_t dataOutAvailable, size_t *dataOutMoved)
+{
+	if(ccIsStreaming(cryptor)) {
+    	return ccSimpleUpdate(cryptor, dataIn, dataInLength, &dataOut, &dataOutAvailable, dataOutMoved);
+	}
+    return ccBlockUpdate(cryptor, dataIn, dataInLength, dataOut, &dataOutAvailable, dataOutMoved);
 }
 
 CCCryptorStatus CCCryptorUpdate(CCCryptorRef cryptorRef, const void *dataIn, size_t dataInLength, void *dataOut, size_t dataOutAvailable, size_t *dataOutMoved)
@@ -739,15 +1402,95 @@ CCCryptorStatus CCCryptorUpdate(CCCryptorRef cryptorRef, const void *dataIn, siz
     
 	if(dataInLength == 0) return kCCSuccess;
 
-	if(ccIsStreaming(cryptor)) {
-    	return ccSimpleUpdate(cryptor, dataIn, dataInLength, &dataOut, &dataOutAvailable, dataOutMoved);
-	}
-	
-    retval = ccBlockUpdate(cryptor, dataIn, dataInLength, dataOut, dataOutAvailable, dataOutMoved);
+    retval = ccUpdateRun(cryptor, dataIn, dataInLength, dataOut, dataOutAvailable, dataOutMoved);
         
 	return retval;
 }
 
+/*
+ * Largest amount of input the update path can take without producing more
+ * than dataOutAvailable bytes, given what's already buffered.  Output comes
+ * in whole blocks, less whatever the padding holds back.
+ */
+
+static inline size_t ccMaxInputForOutput(CCCryptor *cryptor, size_t dataOutAvailable)
+{
+    size_t blocksize, reserve, total;
+    
+    if(ccIsStreaming(cryptor)) return dataOutAvailable;
+    blocksize = ccGetCipherBlockSize(cryptor);
+    reserve = ccGetReserve(cryptor);
+    if(reserve == 0) total = FULLBLOCKSIZE(dataOutAvailable, blocksize) + blocksize - 1;
+    else total = FULLBLOCKSIZE(dataOutAvailable + reserve, blocksize);
+    return (total > cryptor->bufferPos) ? total - cryptor->bufferPos: 0;
+}
+
+static CCCryptorStatus ccScatter(const uint8_t *data, size_t dataLength, const struct iovec *dataOut, int dataOutCount, int *outIndex, size_t *outOffset)
+{
+    while(dataLength) {
+        size_t movecnt;
+        
+        if(*outIndex >= dataOutCount) return kCCBufferTooSmall;
+        movecnt = dataOut[*outIndex].iov_len - *outOffset;
+        if(movecnt > dataLength) movecnt = dataLength;
+        CC_XMEMCPY((uint8_t *) dataOut[*outIndex].iov_base + *outOffset, data, movecnt);
+        data += movecnt; dataLength -= movecnt; *outOffset += movecnt;
+        if(*outOffset == dataOut[*outIndex].iov_len) {
+            (*outIndex)++;
+            *outOffset = 0;
+        }
+    }
+    return kCCSuccess;
+}
+
+CCCryptorStatus CCCryptorUpdateV(CCCryptorRef cryptorRef, const struct iovec *dataIn, int dataInCount, const struct iovec *dataOut, int dataOutCount, size_t *dataOutMoved)
+{
+	CCCryptorStatus     retval;
+    CCCompatCryptor     *compat_cryptor = cryptorRef;
+    CCCryptor           *cryptor;
+    uint8_t             bounce[CC_MAXBLOCKSIZE];
+    size_t              outOffset = 0, blocksize, moved, movecnt, avail;
+    int                 i, outIndex = 0;
+    
+    CC_DEBUG_LOG(ASL_LEVEL_ERR, "Entering\n");
+	if(dataOutMoved) *dataOutMoved = 0;
+    if(compat_cryptor == NULL || dataInCount < 0 || dataOutCount < 0) return kCCParamError;
+    if((dataInCount && dataIn == NULL) || (dataOutCount && dataOut == NULL)) return kCCParamError;
+    cryptor = compat_cryptor->cryptor;
+    blocksize = (ccIsStreaming(cryptor)) ? 1: ccGetCipherBlockSize(cryptor);
+    
+    for(i = 0; i < dataInCount; i++) {
+        const uint8_t *in = dataIn[i].iov_base;
+        size_t inLength = dataIn[i].iov_len;
+        
+        while(inLength) {
+            while(outIndex < dataOutCount && outOffset == dataOut[outIndex].iov_len) {
+                outIndex++;
+                outOffset = 0;
+            }
+            avail = (outIndex < dataOutCount) ? dataOut[outIndex].iov_len - outOffset: 0;
+            moved = 0;
+            if((movecnt = ccMaxInputForOutput(cryptor, avail)) != 0) {
+                /* Everything this produces lands in the current output fragment */
+                if(movecnt > inLength) movecnt = inLength;
+                retval = ccUpdateRun(cryptor, in, movecnt, (avail) ? (uint8_t *) dataOut[outIndex].iov_base + outOffset: NULL, avail, &moved);
+                if(retval != kCCSuccess) return retval;
+                outOffset += moved;
+            } else {
+                /* The next block straddles output fragments - produce it here and scatter it */
+                if((movecnt = ccMaxInputForOutput(cryptor, blocksize)) > inLength) movecnt = inLength;
+                retval = ccUpdateRun(cryptor, in, movecnt, bounce, sizeof(bounce), &moved);
+                if(retval == kCCSuccess) retval = ccScatter(bounce, moved, dataOut, dataOutCount, &outIndex, &outOffset);
+                CC_XZEROMEM(bounce, sizeof(bounce));
+                if(retval != kCCSuccess) return retval;
+            }
+            in += movecnt; inLength -= movecnt;
+            if(dataOutMoved) *dataOutMoved += moved;
+        }
+    }
+    return kCCSuccess;
+}
+
 
 
 CCCryptorStatus CCCryptorFinal(
@@ -779,7 +1522,7 @@ CCCryptorStatus CCCryptorFinal(
     if(ccIsStreaming(cryptor)) return kCCSuccess;
 
 	if(encrypting) {
-        retval = ccEncryptPad(cryptor, tmpbuf, &moved);
+        retval = ccEncryptPad(cryptor, ccLinearBuff(cryptor), cryptor->bufferPos, tmpbuf, &moved);
         if(retval != kCCSuccess) return retval;
 		if(dataOutAvailable < moved) {
             return kCCBufferTooSmall;
@@ -791,7 +1534,7 @@ CCCryptorStatus CCCryptorFinal(
 		cryptor->bufferPos = 0;
 	} else {
 		if(ccGetReserve(cryptor) != 0) {
-            retval = ccDecryptPad(cryptor, tmpbuf, &moved);
+            retval = ccDecryptPad(cryptor, ccLinearBuff(cryptor), cryptor->bufferPos, tmpbuf, &moved);
             if(retval != kCCSuccess) return retval;
             if(dataOutAvailable < moved) {
                 return kCCBufferTooSmall;
@@ -807,6 +1550,98 @@ CCCryptorStatus CCCryptorFinal(
 	return kCCSuccess;
 }
 
+/*
+ * In-place processing.  data is both input and output and nothing is copied
+ * aside: whatever the padding has to hold back is left where it is, at the
+ * end of data, and the caller presents it again at the front of the next
+ * call.  Walking one buffer that just means advancing by *dataMoved.
+ */
+
+static inline size_t ccInPlaceHold(CCCryptor *cryptor, size_t dataLength)
+{
+    size_t blocksize, reserve, remainder;
+    
+    if(ccIsStreaming(cryptor)) return 0;
+    blocksize = ccGetCipherBlockSize(cryptor);
+    reserve = ccGetReserve(cryptor);
+    if(dataLength <= reserve) return dataLength;
+    if((remainder = FULLBLOCKREMAINDER(dataLength, blocksize)) == 0) return reserve;
+    return ((reserve) ? reserve - blocksize: 0) + remainder;
+}
+
+static inline CCCryptorStatus ccInPlaceRun(CCCryptor *cryptor, void *data, size_t dataInLength, size_t *dataMoved)
+{
+    size_t avail = dataInLength;
+    
+    *dataMoved = 0;
+    if(dataInLength == 0) return kCCSuccess;
+    return ccSimpleUpdate(cryptor, data, dataInLength, &data, &avail, dataMoved);
+}
+
+CCCryptorStatus CCCryptorUpdateInPlace(
+	CCCryptorRef cryptorRef,
+	void *data,
+	size_t dataLength,
+	size_t *dataMoved)
+{
+    CCCompatCryptor *compat_cryptor = cryptorRef;
+    CCCryptor	*cryptor;
+    
+    CC_DEBUG_LOG(ASL_LEVEL_ERR, "Entering\n");
+    if(dataMoved) *dataMoved = 0;
+    if(compat_cryptor == NULL || dataMoved == NULL || (data == NULL && dataLength)) return kCCParamError;
+    cryptor = compat_cryptor->cryptor;
+    /* Anything CCCryptorUpdate() buffered would have to be copied in front of data */
+    if(cryptor->bufferPos) return kCCParamError;
+    
+    return ccInPlaceRun(cryptor, data, dataLength - ccInPlaceHold(cryptor, dataLength), dataMoved);
+}
+
+CCCryptorStatus CCCryptorFinalInPlace(
+	CCCryptorRef cryptorRef,
+	void *data,
+	size_t dataLength,
+	size_t dataAvailable,
+	size_t *dataMoved)
+{
+    CCCompatCryptor *compat_cryptor = cryptorRef;
+    CCCryptor	*cryptor;
+	CCCryptorStatus	retval;
+    size_t hold, processed, moved, padlen, blocksize;
+    uint8_t *tail;
+    
+    CC_DEBUG_LOG(ASL_LEVEL_ERR, "Entering\n");
+    if(dataMoved) *dataMoved = 0;
+    if(compat_cryptor == NULL || dataMoved == NULL || (data == NULL && dataLength) || dataAvailable < dataLength) return kCCParamError;
+    cryptor = compat_cryptor->cryptor;
+    if(cryptor->bufferPos) return kCCParamError;
+    
+    if(ccIsStreaming(cryptor)) return ccInPlaceRun(cryptor, data, dataLength, dataMoved);
+    
+    /* Check the headroom before anything is overwritten */
+    hold = ccInPlaceHold(cryptor, dataLength);
+    blocksize = ccGetCipherBlockSize(cryptor);
+    padlen = (cryptor->op == kCCEncrypt) ? ccGetPadlen(cryptor): 0;
+    if(hold && padlen == 0 && ccGetReserve(cryptor) == 0) return kCCAlignmentError;
+    if(padlen && dataAvailable - (dataLength - hold) < FULLBLOCKSIZE(hold, blocksize) + padlen) return kCCBufferTooSmall;
+    
+    if((retval = ccInPlaceRun(cryptor, data, dataLength - hold, &processed)) != kCCSuccess) return retval;
+    *dataMoved = processed;
+    if(hold == 0 && padlen == 0) return kCCSuccess;
+    
+    /* The corecrypto pad routines take the same buffer for in and out */
+    tail = (uint8_t *) data + processed;
+    if(cryptor->op == kCCEncrypt) {
+        retval = ccEncryptPad(cryptor, tail, hold, tail, &moved);
+    } else {
+        retval = ccDecryptPad(cryptor, tail, hold, tail, &moved);
+        if(retval == kCCSuccess) cryptor->bytesProcessed += moved;
+    }
+    if(retval != kCCSuccess) return retval;
+    *dataMoved += moved;
+	return kCCSuccess;
+}
+
 size_t CCCryptorGetOutputLength(
 	CCCryptorRef cryptorRef,
 	size_t inputLength,
@@ -852,7 +1687,17 @@ CCCryptorStatus CCCryptorReset(
     	documented to throw away any in-flight buffer data.
     */
     
-    cryptor->bytesProcessed = cryptor->bufferPos = 0;
+    cryptor->bytesProcessed = cryptor->bufferPos = cryptor->bufferStart = 0;
+    
+    /*
+        Cryptors created from a key schedule get fresh contexts from it; the
+        GCM IV is supplied through CCCryptorGCMAddIV().
+    */
+    
+    if(cryptor->keySchedule) {
+        ccCopyModeContexts(cryptor, cryptor->keySchedule->cryptor);
+        if(cryptor->mode == kCCModeGCM) return kCCSuccess;
+    }
     
     /* 
     	Call the common routine to reset the IV - this will copy in the new 
@@ -886,6 +1731,41 @@ CCCryptorGetIV(CCCryptorRef cryptorRef, void *iv)
     return ccGetIV(cryptor, iv, ccGetCipherBlockSize(cryptor));
 }
 
+/*
+ * The counter for a position is the initial counter block (kept for the
+ * parallel path) plus the number of whole blocks before it.
+ */
+
+CCCryptorStatus CCCryptorSeek(
+	CCCryptorRef cryptorRef,
+	uint64_t byteOffset)
+{
+    CCCompatCryptor *compat_cryptor = cryptorRef;
+    CCCryptor	*cryptor;
+    size_t blocksize;
+
+    CC_DEBUG_LOG(ASL_LEVEL_ERR, "Entering\n");
+    if(compat_cryptor == NULL)  return kCCParamError;
+    cryptor = compat_cryptor->cryptor;
+    if(cryptor->mode != kCCModeCTR || cryptor->modeDesc->mode_seek == NULL) return kCCUnimplemented;
+    /* corecrypto's CTR is re-keyed from the raw key to move its counter */
+    if(cryptor->deferredKeyLength == 0) return kCCParamError;
+
+    blocksize = cryptor->cipherBlocksize;
+    uint8_t counter[blocksize];
+    CC_XMEMCPY(counter, cryptor->deferredIV, blocksize);
+    ccCounterAdd(counter, blocksize, byteOffset / blocksize);
+    for(int i = 0; i<2; i++) {
+        if(ccGetModeCtxSize(cryptor, i) == 0) continue;
+        cryptor->modeDesc->mode_seek(cryptor->symMode[i], cryptor->deferredKey, cryptor->deferredKeyLength,
+                                     counter, (size_t) (byteOffset % blocksize), cryptor->ctx[i]);
+    }
+    CC_XZEROMEM(counter, blocksize);
+    cryptor->streamPos = byteOffset;
+    cryptor->bytesProcessed = cryptor->bufferPos = cryptor->bufferStart = 0;
+    return kCCSuccess;
+}
+
 
 
 /* 
@@ -931,7 +1811,7 @@ CCCryptorStatus CCCrypt(
 	dataOutAvailable  -= moved;
 
 	if(retval = CCCryptorFinal(cryptor, dataOut, dataOutAvailable, &moved)) {
-		CC_DEBUG_LOG(ASL_LEVEL_ERR, "Final Error\n", 0);
+		CC_DEBUG_LOG(ASL_LEVEL_ERR, "Final Error\n");
         // printf("Failing on final\n");
 	} else {
 		used += moved;
@@ -942,6 +1822,228 @@ CCCryptorStatus CCCrypt(
 	return retval;
 }
 
+#pragma mark Batch One-Shot
+
+#define CC_BATCH_LANES 8
+
+static inline bool ccSameKey(const CCCryptBatchEntry *a, const CCCryptBatchEntry *b)
+{
+    if(a->key == NULL || b->key == NULL) return false;
+    return a->keyLength == b->keyLength && (a->key == b->key || memcmp(a->key, b->key, a->keyLength) == 0);
+}
+
+/* Sets every entry's status to kCCParamError or kCCSuccess before anything's grouped or run */
+static void ccBatchCheck(CCAlgorithm alg, CCCryptBatchEntry *entries, size_t count)
+{
+    size_t i;
+    
+    for(i = 0; i < count; i++) {
+        CCCryptBatchEntry *entry = &entries[i];
+        
+        entry->dataOutMoved = 0;
+        if(entry->key == NULL || entry->keyLength == 0 || (entry->dataIn == NULL && entry->dataInLength) ||
+           (entry->dataOut == NULL && entry->dataOutAvailable)) entry->status = kCCParamError;
+        /* The interleaved CBC path keys the cipher directly, so check here what ccInitCryptor would */
+        else if(alg == kCCAlgorithmAES128 && entry->keyLength != kCCKeySizeAES128 &&
+                entry->keyLength != kCCKeySizeAES192 && entry->keyLength != kCCKeySizeAES256) entry->status = kCCKeySizeError;
+        else entry->status = kCCSuccess;
+    }
+}
+
+/*
+ * CBC encryption is serial within a message, but the next blocks of
+ * independent messages under one key can go through the cipher together.
+ * Each round chains one block from every lane into a contiguous set and
+ * encrypts the set with a single ECB call, so the cipher can pipeline it.
+ */
+
+static void ccBatchCBCLanes(corecryptoMode ecb, modeCtx ctx, size_t blocksize, CCPadding padding, CCCryptBatchEntry **lane, int nlanes)
+{
+    static const uint8_t zeroIV[kCCBlockSizeAES128];
+    uint8_t blocks[CC_BATCH_LANES * kCCBlockSizeAES128];
+    const uint8_t *chain[CC_BATCH_LANES];
+    size_t total[CC_BATCH_LANES], offset, maxTotal = 0;
+    int i, n;
+    
+    for(i = 0; i < nlanes; i++) {
+        CCCryptBatchEntry *entry = lane[i];
+        
+        total[i] = 0;
+        entry->dataOutMoved = 0;
+        if(entry->status != kCCSuccess) continue;
+        if(padding == ccPKCS7Padding) total[i] = FULLBLOCKSIZE(entry->dataInLength, blocksize) + blocksize;
+        else if(FULLBLOCKREMAINDER(entry->dataInLength, blocksize)) {
+            entry->status = kCCAlignmentError;
+            continue;
+        } else total[i] = entry->dataInLength;
+        if(total[i] > entry->dataOutAvailable) {
+            entry->status = kCCBufferTooSmall;
+            entry->dataOutMoved = total[i];
+            total[i] = 0;
+            continue;
+        }
+        chain[i] = (entry->iv) ? entry->iv: zeroIV;
+        if(total[i] > maxTotal) maxTotal = total[i];
+    }
+    
+    for(offset = 0; offset < maxTotal; offset += blocksize) {
+        for(i = 0, n = 0; i < nlanes; i++) {
+            const uint8_t *in = (const uint8_t *) lane[i]->dataIn + offset;
+            uint8_t *block = blocks + n * blocksize;
+            size_t avail, j;
+            
+            if(offset >= total[i]) continue;
+            avail = (offset < lane[i]->dataInLength) ? lane[i]->dataInLength - offset: 0;
+            if(avail >= blocksize) CC_XMEMCPY(block, in, blocksize);
+            else {
+                /* final PKCS7 block */
+                if(avail) CC_XMEMCPY(block, in, avail);
+                CC_XMEMSET(block + avail, (int) (blocksize - avail), blocksize - avail);
+            }
+            for(j = 0; j < blocksize; j++) block[j] ^= chain[i][j];
+            n++;
+        }
+        ccecb_mode.mode_encrypt(ecb, blocks, blocks, n * blocksize, ctx);
+        for(i = 0, n = 0; i < nlanes; i++) {
+            uint8_t *out = (uint8_t *) lane[i]->dataOut + offset;
+            
+            if(offset >= total[i]) continue;
+            CC_XMEMCPY(out, blocks + n * blocksize, blocksize);
+            chain[i] = out;
+            n++;
+        }
+    }
+    CC_XZEROMEM(blocks, sizeof(blocks));
+    
+    for(i = 0; i < nlanes; i++) if(total[i]) lane[i]->dataOutMoved = total[i];
+}
+
+static CCCryptorStatus ccBatchCBCEncrypt(CCAlgorithm alg, CCPadding padding, CCCryptBatchEntry *entries, size_t count)
+{
+    CCCryptorStatus retval = kCCSuccess;
+    CCCryptBatchEntry *lane[CC_BATCH_LANES];
+    corecryptoMode ecb;
+    modeCtx ctx;
+    size_t ctxSize, blocksize, i, next;
+    int nlanes;
+    
+    alg = ccMapAlgorithm(alg);
+    if(alg >= CC_TABLE_CIPHERS) return kCCParamError;
+    if((ecb = getCipherMode(alg, kCCModeECB, kCCEncrypt)).ecb == NULL) return kCCUnimplemented;
+    blocksize = ccecb_mode.mode_get_block_size(ecb);
+    if(blocksize > kCCBlockSizeAES128) return kCCUnimplemented;
+    ctxSize = ccecb_mode.mode_get_ctx_size(ecb);
+    if((ctx.data = CC_XMALLOC(ctxSize)) == NULL) return kCCMemoryFailure;
+    
+    for(i = 0; i < count; i = next) {
+        const void *key = entries[i].key;
+        uint8_t *alignedKey = NULL;
+        
+        /* One key schedule for each run of entries sharing a key */
+        if(entries[i].status == kCCSuccess) entries[i].status = ccGetAlignedKey(&key, entries[i].keyLength, &alignedKey);
+        if(entries[i].status != kCCSuccess) {
+            entries[i].dataOutMoved = 0;
+            next = i + 1;
+            continue;
+        }
+        ccecb_mode.mode_setup(ecb, NULL, key, entries[i].keyLength, NULL, 0, 0, ctx);
+        if(alignedKey) {
+            CC_XZEROMEM(alignedKey, entries[i].keyLength);
+            CC_XFREE(alignedKey, entries[i].keyLength);
+        }
+        
+        for(next = i; next < count && ccSameKey(&entries[next], &entries[i]); ) {
+            for(nlanes = 0; nlanes < CC_BATCH_LANES && next < count && ccSameKey(&entries[next], &entries[i]); next++)
+                lane[nlanes++] = &entries[next];
+            ccBatchCBCLanes(ecb, ctx, blocksize, padding, lane, nlanes);
+        }
+    }
+    
+    CC_XZEROMEM(ctx.data, ctxSize);
+    CC_XFREE(ctx.data, ctxSize);
+    for(i = 0; i < count && retval == kCCSuccess; i++) retval = entries[i].status;
+    return retval;
+}
+
+static CCCryptorStatus ccBatchOne(CCCryptorRef cryptor, CCCryptBatchEntry *entry)
+{
+	CCCryptorStatus retval;
+    uint8_t *dataOut = entry->dataOut;
+    size_t dataOutAvailable = entry->dataOutAvailable;
+	size_t outputSize, moved;
+    
+    entry->dataOutMoved = 0;
+	if((outputSize = CCCryptorGetOutputLength(cryptor, entry->dataInLength, true)) > dataOutAvailable) {
+		entry->dataOutMoved = outputSize;
+		return kCCBufferTooSmall;
+	}
+	if((retval = CCCryptorUpdate(cryptor, entry->dataIn, entry->dataInLength, dataOut, dataOutAvailable, &moved)) != kCCSuccess) return retval;
+	dataOut += moved;
+	dataOutAvailable -= moved;
+	if((retval = CCCryptorFinal(cryptor, dataOut, dataOutAvailable, &outputSize)) != kCCSuccess) return retval;
+    entry->dataOutMoved = moved + outputSize;
+    return kCCSuccess;
+}
+
+CCCryptorStatus CCCryptBatch(
+	CCOperation 	op,
+	CCMode			mode,
+	CCAlgorithm		alg,
+	CCPadding		padding,
+	CCCryptBatchEntry *entries,
+	size_t			count)
+{
+	CCCryptorStatus retval = kCCSuccess;
+    CCCryptorRef cryptor = NULL;
+    const CCCryptBatchEntry *keyed = NULL;     /* the entry whose key the cryptor holds */
+    CCModeOptions options = (mode == kCCModeCTR) ? kCCModeOptionCTR_BE: 0;
+    uint8_t *ctxMem;
+    size_t ctxSize, i;
+    bool rekeyEach;
+    
+    CC_DEBUG_LOG(ASL_LEVEL_ERR, "Entering Op: %d Mode: %d Cipher: %d Padding: %d Count: %d\n", op, mode, alg, padding, (int) count);
+    if(entries == NULL && count) return kCCParamError;
+    if(op != kCCEncrypt && op != kCCDecrypt) return kCCParamError;
+    if(mode == kCCModeXTS || mode == kCCModeGCM || mode == kCCModeChaCha20Poly1305 || mode == kCCModeGCMSIV ||
+       alg == kCCAlgorithmChaCha20) return kCCUnimplemented;
+    if(count == 0) return kCCSuccess;
+    ccBatchCheck(alg, entries, count);
+    
+    if(op == kCCEncrypt && mode == kCCModeCBC && alg != kCCAlgorithmRC4 && (padding == ccNoPadding || padding == ccPKCS7Padding))
+        return ccBatchCBCEncrypt(alg, padding, entries, count);
+    
+    /* Everything else goes through one cryptor living in one buffer for the whole batch */
+    if((retval = CCCryptorGetContextSizeWithMode(op, mode, alg, &ctxSize)) != kCCSuccess) return retval;
+    if((ctxMem = CC_XMALLOC(ctxSize)) == NULL) return kCCMemoryFailure;
+    rekeyEach = alg == kCCAlgorithmRC4 || !ccModeHasSeparateIV(mode);
+    
+    for(i = 0; i < count; i++) {
+        CCCryptBatchEntry *entry = &entries[i];
+        
+        if(entry->status != kCCSuccess) {
+            if(retval == kCCSuccess) retval = entry->status;
+            continue;
+        }
+        if(cryptor && !rekeyEach && ccSameKey(entry, keyed)) {
+            entry->status = CCCryptorReset(cryptor, entry->iv);
+        } else {
+            if(cryptor) CCCryptorRelease(cryptor);
+            cryptor = NULL;
+            entry->status = CCCryptorCreateFromDataWithMode(op, mode, alg, padding, entry->iv, entry->key, entry->keyLength,
+                                                            NULL, 0, 0, options, ctxMem, ctxSize, &cryptor, NULL);
+            if(entry->status != kCCSuccess) cryptor = NULL;
+            keyed = entry;
+        }
+        if(entry->status == kCCSuccess) entry->status = ccBatchOne(cryptor, entry);
+        if(entry->status != kCCSuccess && retval == kCCSuccess) retval = entry->status;
+    }
+    
+    if(cryptor) CCCryptorRelease(cryptor);
+    CC_XZEROMEM(ctxMem, ctxSize);
+    CC_XFREE(ctxMem, ctxSize);
+    return retval;
+}
+
 CCCryptorStatus CCCryptorEncryptDataBlock(
 	CCCryptorRef cryptorRef,
 	const void *iv,
@@ -951,12 +2053,14 @@ CCCryptorStatus CCCryptorEncryptDataBlock(
 {
     CCCompatCryptor *compat_cryptor = cryptorRef;
     CCCryptor	*cryptor;
+    CCCryptorStatus retval;
     
     CC_DEBUG_LOG(ASL_LEVEL_ERR, "Entering\n");
     if(compat_cryptor == NULL)  return kCCParamError;
     cryptor = compat_cryptor->cryptor;
     
     if(ccIsStreaming(cryptor)) return kCCParamError;
+    if((retval = ccExpandDirection(cryptor, kCCEncrypt)) != kCCSuccess) return retval;
     if(!iv) return ccDoEnCrypt(cryptor, dataIn, dataInLength, dataOut);
     return ccDoEnCryptTweaked(cryptor, dataIn, dataInLength, dataOut, iv);    
 }
@@ -971,16 +2075,109 @@ CCCryptorStatus CCCryptorDecryptDataBlock(
 {
     CCCompatCryptor *compat_cryptor = cryptorRef;
     CCCryptor	*cryptor;
+    CCCryptorStatus retval;
     
     CC_DEBUG_LOG(ASL_LEVEL_ERR, "Entering\n");
     if(compat_cryptor == NULL)  return kCCParamError;
     cryptor = compat_cryptor->cryptor;
     
     if(ccIsStreaming(cryptor)) return kCCParamError;
+    if((retval = ccExpandDirection(cryptor, kCCDecrypt)) != kCCSuccess) return retval;
     if(!iv) return ccDoDeCrypt(cryptor, dataIn, dataInLength, dataOut);
     return ccDoDeCryptTweaked(cryptor, dataIn, dataInLength, dataOut, iv);    
 }
 
+#pragma mark XTS Sectors
+
+/*
+ * Sectors don't depend on one another, so a big batch is split on sector
+ * boundaries across dispatch_apply() like ccParallelCrypt() does.  The XTS
+ * context is only read; every chunk builds its own tweaks.
+ */
+
+typedef struct ccSectorJob {
+    CCCryptor       *ref;
+    CCOperation     direction;
+    uint64_t        sector;
+    size_t          sectorSize;
+    size_t          nSectors;
+    size_t          chunkSectors;
+    const uint8_t   *dataIn;
+    uint8_t         *dataOut;
+} ccSectorJob;
+
+static void ccSectorChunk(void *context, size_t chunk)
+{
+    ccSectorJob *job = context;
+    CCCryptor *ref = job->ref;
+    size_t first = chunk * job->chunkSectors;
+    size_t offset = first * job->sectorSize;
+    
+    ref->modeDesc->mode_crypt_sectors(ref->symMode[job->direction], job->sector + first, job->sectorSize,
+                                      CC_XMIN(job->chunkSectors, job->nSectors - first),
+                                      job->dataIn + offset, job->dataOut + offset, ref->ctx[job->direction]);
+}
+
+static CCCryptorStatus ccCryptSectors(CCCryptorRef cryptorRef, CCOperation direction, uint64_t startSector, size_t sectorSize,
+                                      size_t nSectors, const void *dataIn, void *dataOut)
+{
+    CCCompatCryptor *compat_cryptor = cryptorRef;
+    CCCryptor	*cryptor;
+    CCCryptorStatus retval;
+    ccSectorJob job;
+    size_t nchunks = 1;
+    
+    if(compat_cryptor == NULL)  return kCCParamError;
+    cryptor = compat_cryptor->cryptor;
+    
+    if(cryptor->mode != kCCModeXTS || !cryptor->modeDesc->mode_crypt_sectors) return kCCParamError;
+    if(sectorSize == 0 || (nSectors && (dataIn == NULL || dataOut == NULL))) return kCCParamError;
+    if(nSectors > SIZE_MAX / sectorSize) return kCCParamError;
+    if(sectorSize % cryptor->cipherBlocksize) return kCCAlignmentError;
+    if(nSectors == 0) return kCCSuccess;
+    if((retval = ccExpandDirection(cryptor, direction)) != kCCSuccess) return retval;
+    
+    if(cryptor->parallelism >= 2 && nSectors * sectorSize >= 2 * CC_PARALLEL_MINCHUNK)
+        nchunks = CC_XMIN(cryptor->parallelism, nSectors * sectorSize / CC_PARALLEL_MINCHUNK);
+    job.ref = cryptor;
+    job.direction = direction;
+    job.sector = startSector;
+    job.sectorSize = sectorSize;
+    job.nSectors = nSectors;
+    job.chunkSectors = (nSectors + nchunks - 1) / nchunks;
+    job.dataIn = dataIn;
+    job.dataOut = dataOut;
+    nchunks = (nSectors + job.chunkSectors - 1) / job.chunkSectors;
+    
+    if(nchunks > 1) dispatch_apply_f(nchunks, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), &job, ccSectorChunk);
+    else ccSectorChunk(&job, 0);
+    return kCCSuccess;
+}
+
+CCCryptorStatus CCCryptorXTSEncryptSectors(
+	CCCryptorRef cryptorRef,
+	uint64_t startSector,
+	size_t sectorSize,
+	size_t nSectors,
+	const void *dataIn,
+	void *dataOut)
+{
+    CC_DEBUG_LOG(ASL_LEVEL_ERR, "Entering\n");
+    return ccCryptSectors(cryptorRef, kCCEncrypt, startSector, sectorSize, nSectors, dataIn, dataOut);
+}
+
+CCCryptorStatus CCCryptorXTSDecryptSectors(
+	CCCryptorRef cryptorRef,
+	uint64_t startSector,
+	size_t sectorSize,
+	size_t nSectors,
+	const void *dataIn,
+	void *dataOut)
+{
+    CC_DEBUG_LOG(ASL_LEVEL_ERR, "Entering\n");
+    return ccCryptSectors(cryptorRef, kCCDecrypt, startSector, sectorSize, nSectors, dataIn, dataOut);
+}
+
 
 CCCryptorStatus CCDesIsWeakKey( void *key, size_t length)
 {
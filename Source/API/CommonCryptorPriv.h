@@ -40,14 +40,28 @@ extern "C" {
     
     /* Byte-Size Constants */
 #define CCMAXBUFFERSIZE 128             /* RC2/RC5 Max blocksize */
-#define DEFAULT_CRYPTOR_MALLOC 4096
+#define CC_CACHELINE_SIZE 64
+#define CC_CACHELINE_ROUNDUP(X) (((X) + CC_CACHELINE_SIZE - 1) & ~((size_t) CC_CACHELINE_SIZE - 1))
 #define CC_STREAMKEYSCHED  2048
 #define CC_MODEKEYSCHED  2048
 #define CC_MAXBLOCKSIZE  128
+#define CC_MAXPARALLELISM  64
+#define CC_PARALLEL_MINCHUNK (64 * 1024)
+    
+#define CC_MAXDEFERREDKEY   kCCKeySizeMaxRC2
+#define CC_MAXDEFERREDTWEAK kCCKeySizeAES256
     
 typedef struct _CCCryptor {
     uint8_t        buffptr[32];
+    /* Key material for expanding the unused direction of a block mode (see
+       ccExpandDirection()) or keying the chunk contexts of a parallel CTR run */
+    uint8_t         deferredKey[CC_MAXDEFERREDKEY];
+    uint8_t         deferredTweak[CC_MAXDEFERREDTWEAK];
+    uint8_t         deferredIV[kCCBlockSizeAES128];
+    size_t          deferredKeyLength;
+    void            *lazyCtx;   /* separately allocated context for that direction */
     uint32_t        bufferPos;
+    uint32_t        bufferStart;    /* buffptr is a ring - offset of the first held back byte */
     uint32_t        bytesProcessed;
     uint32_t        cipherBlocksize;
 
@@ -59,16 +73,46 @@ typedef struct _CCCryptor {
     cc2CCModeDescriptor *modeDesc;
     modeCtx         ctx[2];
     cc2CCPaddingDescriptor *padptr;
+    struct _CCKeySchedule *keySchedule;  /* set when created from a CCKeyScheduleRef */
+    uint32_t        parallelism;    /* CCCryptorSetParallelism(), 0 or 1 for serial */
+    uint64_t        streamPos;      /* bytes run through the mode since the IV was set */
 } CCCryptor;
     
 
+/*
+ * The CCCryptor and its mode contexts are laid out in a single block, each
+ * piece starting on a cache line.  When the caller's buffer is large enough
+ * (see CCCryptorGetContextSizeWithMode()) the block follows the compat wrapper
+ * in that buffer, otherwise it's a separate allocation recorded in cryptorMem.
+ */
+
 typedef struct _CCCompat {
     uint32_t			weMallocd;
     CCCryptor			*cryptor;
+    void				*cryptorMem;     /* separately allocated cryptor block or NULL */
+    size_t				cryptorMemSize;
 } CCCompatCryptor;
 
     
+/*
+ * A CCKeyScheduleRef holds a fully keyed cryptor block (zero IV) which is
+ * copied into every cryptor created from it.
+ */
+
+typedef struct _CCKeySchedule {
+    CCCryptor           *cryptor;
+    void                *cryptorMem;
+    size_t              cryptorMemSize;
+} CCKeySchedule;
+
 #define CCCRYPTOR_SIZE  sizeof(struct _CCCryptor)
+/*
+ * Not the size of a cryptor: the smallest (8 byte aligned) buffer
+ * CCCryptorCreateFromDataWithMode() takes, which holds only the compat
+ * wrapper.  Given that, the cryptor block always goes in cryptorMem.  The
+ * block's real size depends on the modes - CCCryptorGetContextSizeWithMode()
+ * reports the buffer that avoids the allocation.
+ */
 #define kCCContextSizeGENERIC (sizeof(CCCompatCryptor))
 
 
@@ -181,8 +181,11 @@ CCDHParametersCreateFromData(const void *p, size_t pLen, const void *g, size_t g
         return NULL;
     }
     
-    if(ccdh_init_gp(retval->gp._ncgp, n, pval, gval, (cc_size) l))
+    if(ccn_read_uint(n, pval, pLen, p) || ccn_read_uint(n, gval, gLen, g) ||
+       ccdh_init_gp(retval->gp._ncgp, n, pval, gval, (cc_size) l)) {
+        CCDHParametersRelease(retval);
         return NULL;
+    }
     return retval;
 
 }
@@ -197,7 +200,7 @@ CCDHParametersRelease(CCDHParameters parameters)
 
     CCDHParmSet CCDHParm = (CCDHParmSet) parameters;
     if(CCDHParm->malloced) 
-        CC_XFREE(CCDHParm->gp.gp, retval->malloced);
+        CC_XFREE(CCDHParm->gp.gp, CCDHParm->malloced);
     CCDHParm->malloced = 0;
     CCDHParm->gp.gp = NULL;
     CC_XFREE(CCDHParm, sizeof(CCDHParmSetstruct));
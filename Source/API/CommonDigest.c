@@ -287,7 +287,7 @@ CC_##_name_##_Update(CC_##_name_##_CTX *c, const void *data, CC_LONG len) \
 int \
 CC_##_name_##_Final(unsigned char *md, CC_##_name_##_CTX *c) \
 { \
-    if(((++CC_##_name_##_Ctr) % 50) == 0) CC_DEBUG_LOG(ASL_LEVEL_ERR, "Len = %lu\n", CC_##_name_##_Len); \
+    if(((++CC_##_name_##_Ctr) % 50) == 0) CC_DEBUG_LOG(ASL_LEVEL_ERR, "Len = %zu\n", CC_##_name_##_Len); \
     ccdigest_final(CCDigestGetDigestInfo(_constant_), (struct ccdigest_ctx *) c, md); \
 	return 1; \
 } \
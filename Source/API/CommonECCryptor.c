@@ -52,7 +52,7 @@ ccMallocECCryptor(size_t nbits, CCECKeyType keyType)
     size_t ctxSize = 0;
     
     
-    if(!ccec_keysize_is_supported(nbits)) return kCCParamError;
+    if(!ccec_keysize_is_supported(nbits)) return NULL;
     ccec_const_cp_t cp = ccec_get_cp(nbits);    
     size_t len = ccec_cp_prime_size(cp);
 
@@ -71,7 +71,6 @@ ccMallocECCryptor(size_t nbits, CCECKeyType keyType)
             ctxSize = ccec_full_ctx_size(len);
             break;
         default:
-            retval = kCCParamError;
             goto errOut;
     }
     
@@ -80,24 +79,20 @@ ccMallocECCryptor(size_t nbits, CCECKeyType keyType)
 
     return retval;
 errOut:
-    if(retval) {
-        CC_XFREE(retval, sizeof(CCECCryptor));
-    }
-    return retval;
+    CC_XFREE(retval, sizeof(CCECCryptor));
+    return NULL;
 }
 
 static void
 ccECCryptorClear(CCECCryptor *theKey)
 {
-    size_t nbits = theKey->keySize;
+    CCECCryptor *key = (CCECCryptor *) theKey;
     size_t ctxSize = 0;
     
-    if(!ccec_keysize_is_supported(nbits)) return ; //kCCParamError;
-    ccec_const_cp_t cp = ccec_get_cp(nbits);    
-    size_t len = ccec_cp_prime_size(cp);
-    
-    CCECCryptor *key = (CCECCryptor *) theKey;
     if(!key) return;
+    if(!ccec_keysize_is_supported(key->keySize)) return ; //kCCParamError;
+    ccec_const_cp_t cp = ccec_get_cp(key->keySize);    
+    size_t len = ccec_cp_prime_size(cp);
     
     switch(key->keyType) {
         case ccECKeyPublic:
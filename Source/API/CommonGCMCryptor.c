@@ -29,6 +29,29 @@
 #include "CommonCryptorPriv.h"
 #include <corecrypto/ccmode_factory.h>
 
+/*
+ * Everything goes through the mode object rather than the ccmode_gcm_*
+ * calls, so the ChaCha20-Poly1305 and GCM-SIV objects run here too.
+ */
+
+#define CC_GCM_MODE(cryptor) ((cryptor)->symMode[(cryptor)->op].gcm)
+#define CC_GCM_CTX(cryptor) ((cryptor)->ctx[(cryptor)->op].gcm)
+
+/* ChaCha20-Poly1305 and GCM-SIV take one 12 byte nonce, and run nothing without it */
+static bool ccAEADFixedNonce(CCCryptor *cryptor)
+{
+    return cryptor->mode == kCCModeChaCha20Poly1305 || cryptor->mode == kCCModeGCMSIV;
+}
+
+static bool ccAEADNonceMissing(CCCryptor *cryptor)
+{
+    switch(cryptor->mode) {
+        case kCCModeChaCha20Poly1305: return !ccchacha20poly1305_has_nonce(CC_GCM_CTX(cryptor));
+        case kCCModeGCMSIV: return !ccgcmsiv_has_nonce(CC_GCM_CTX(cryptor));
+        default: return false;
+    }
+}
+
 
 CCCryptorStatus
 CCCryptorGCMAddIV(CCCryptorRef cryptorRef,
@@ -40,7 +63,9 @@ CCCryptorGCMAddIV(CCCryptorRef cryptorRef,
     CC_DEBUG_LOG(ASL_LEVEL_ERR, "Entering\n");
 	if(compat_cryptor == NULL)  return kCCParamError;
     cryptor = compat_cryptor->cryptor;
-    ccmode_gcm_set_iv(cryptor->ctx[cryptor->op].gcm, ivLen, iv);
+    if(ccAEADFixedNonce(cryptor) &&
+       (iv == NULL || ivLen != 12 || !ccAEADNonceMissing(cryptor))) return kCCParamError;
+    CC_GCM_MODE(cryptor)->set_iv(CC_GCM_CTX(cryptor), ivLen, iv);
  	return kCCSuccess;
 }
 
@@ -55,8 +80,9 @@ CCCryptorGCMAddAAD(CCCryptorRef cryptorRef,
     CC_DEBUG_LOG(ASL_LEVEL_ERR, "Entering\n");
 	if(compat_cryptor == NULL)  return kCCParamError;
     cryptor = compat_cryptor->cryptor;
+    if(ccAEADNonceMissing(cryptor)) return kCCParamError;
     
-    ccmode_gcm_gmac(cryptor->ctx[cryptor->op].gcm, aDataLen, aData);
+    CC_GCM_MODE(cryptor)->gmac(CC_GCM_CTX(cryptor), aDataLen, aData);
  	return kCCSuccess;
 }
 
@@ -79,6 +105,67 @@ CCCryptorGCMaddAAD(CCCryptorRef cryptorRef,
 }
 
 
+#pragma mark Parallel Text
+
+/*
+ * GHASH is linear, so with CCCryptorSetParallelism() a long run of text
+ * is cut into chunks of whole blocks, each encrypted and hashed from zero
+ * on its own thread, and the mode folds the chunk hashes in after.  The
+ * tag comes out the same as a serial run's.
+ */
+
+typedef struct ccGCMParallelJob_t {
+    CCCryptor       *ref;
+    const uint8_t   *dataIn;
+    uint8_t         *dataOut;
+    size_t          nblocks;
+    size_t          chunkBlocks;
+    size_t          nchunks;
+    uint8_t         hashes[CC_MAXPARALLELISM][16];
+} ccGCMParallelJob;
+
+static void ccGCMParallelChunk(void *context, size_t chunk)
+{
+    ccGCMParallelJob *job = context;
+    CCCryptor *ref = job->ref;
+    size_t start = chunk * job->chunkBlocks;
+    size_t n = (chunk == job->nchunks - 1) ? job->nblocks - start: job->chunkBlocks;
+    
+    ref->modeDesc->mode_crypt_chunk(ref->symMode[ref->op], start, n, job->dataIn + start * 16,
+                                    job->dataOut + start * 16, job->hashes[chunk], ref->ctx[ref->op]);
+}
+
+/*
+ * Returns true if the run was done in parallel, false if it should be done
+ * serially.
+ */
+
+static bool ccGCMParallelCrypt(CCCryptor *ref, const void *dataIn, size_t dataInLength, void *dataOut)
+{
+    ccGCMParallelJob job;
+    const struct ccmode_gcm *mode = CC_GCM_MODE(ref);
+    size_t head;
+    
+    if(ref->parallelism < 2 || dataInLength < 2 * CC_PARALLEL_MINCHUNK || ref->mode != kCCModeGCM) return false;
+    if(!ref->modeDesc->mode_split_begin(ref->symMode[ref->op], &head, ref->ctx[ref->op])) return false;
+    if(head) mode->gcm(CC_GCM_CTX(ref), head, dataIn, dataOut);
+    
+    job.ref = ref;
+    job.dataIn = (const uint8_t *) dataIn + head;
+    job.dataOut = (uint8_t *) dataOut + head;
+    job.nblocks = (dataInLength - head) / 16;
+    job.nchunks = CC_XMIN(ref->parallelism, job.nblocks * 16 / CC_PARALLEL_MINCHUNK);
+    job.chunkBlocks = job.nblocks / job.nchunks;
+    dispatch_apply_f(job.nchunks, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), &job, ccGCMParallelChunk);
+    ref->modeDesc->mode_split_end(ref->symMode[ref->op], job.nblocks, job.nchunks, job.chunkBlocks,
+                                  (const uint8_t (*)[16]) job.hashes, ref->ctx[ref->op]);
+    
+    if((dataInLength - head) % 16)
+        mode->gcm(CC_GCM_CTX(ref), (dataInLength - head) % 16, job.dataIn + job.nblocks * 16, job.dataOut + job.nblocks * 16);
+    CC_XZEROMEM(job.hashes, sizeof(job.hashes));
+    return true;
+}
+
 
 CCCryptorStatus CCCryptorGCMEncrypt(
 	CCCryptorRef cryptorRef,
@@ -92,8 +179,11 @@ CCCryptorStatus CCCryptorGCMEncrypt(
 	if(compat_cryptor == NULL)  return kCCParamError;
     cryptor = compat_cryptor->cryptor;
     if(dataIn == NULL || dataOut == NULL) return kCCParamError;
+    if(ccAEADNonceMissing(cryptor)) return kCCParamError;
     
-    ccmode_gcm_encrypt(cryptor->ctx[cryptor->op].gcm, dataInLength, dataIn, dataOut);
+    if(cryptor->mode == kCCModeGCMSIV && !ccgcmsiv_can_crypt(CC_GCM_CTX(cryptor), dataOut)) return kCCParamError;
+    if(!ccGCMParallelCrypt(cryptor, dataIn, dataInLength, dataOut))
+        CC_GCM_MODE(cryptor)->gcm(CC_GCM_CTX(cryptor), dataInLength, dataIn, dataOut);
  	return kCCSuccess;
 }
 
@@ -111,8 +201,11 @@ CCCryptorStatus CCCryptorGCMDecrypt(
 	if(compat_cryptor == NULL)  return kCCParamError;
     cryptor = compat_cryptor->cryptor;
     if(dataIn == NULL || dataOut == NULL) return kCCParamError;
+    if(ccAEADNonceMissing(cryptor)) return kCCParamError;
 
-    ccmode_gcm_decrypt(cryptor->ctx[cryptor->op].gcm, dataInLength, dataIn, dataOut);
+    if(cryptor->mode == kCCModeGCMSIV && !ccgcmsiv_can_crypt(CC_GCM_CTX(cryptor), dataOut)) return kCCParamError;
+    if(!ccGCMParallelCrypt(cryptor, dataIn, dataInLength, dataOut))
+        CC_GCM_MODE(cryptor)->gcm(CC_GCM_CTX(cryptor), dataInLength, dataIn, dataOut);
  	return kCCSuccess;
 }
 
@@ -129,8 +222,11 @@ CCCryptorStatus CCCryptorGCMFinal(
 	if(compat_cryptor == NULL)  return kCCParamError;
     cryptor = compat_cryptor->cryptor;
 	if(tag == NULL || tagLength == NULL)  return kCCParamError;
+    if(ccAEADNonceMissing(cryptor)) return kCCParamError;
     
-    ccmode_gcm_finalize(cryptor->ctx[cryptor->op].gcm, tagLength, tag);
+    CC_GCM_MODE(cryptor)->finalize(CC_GCM_CTX(cryptor), *tagLength, (void *) tag);
+    if(cryptor->mode == kCCModeGCMSIV && cryptor->op == kCCDecrypt &&
+       !ccgcmsiv_tag_matches(CC_GCM_CTX(cryptor))) return kCCDecodeError;
  	return kCCSuccess;
 }
 
@@ -144,12 +240,37 @@ CCCryptorStatus CCCryptorGCMReset(
     CC_DEBUG_LOG(ASL_LEVEL_ERR, "Entering\n");
 	if(compat_cryptor == NULL)  return kCCParamError;
     cryptor = compat_cryptor->cryptor;
-    ccmode_gcm_reset(cryptor->ctx[cryptor->op].gcm);
+    CC_GCM_MODE(cryptor)->reset(CC_GCM_CTX(cryptor));
+ 	return kCCSuccess;
+}
+
+
+
+CCCryptorStatus CCCryptorGCMSIVSetTag(
+	CCCryptorRef cryptorRef,
+	const void *tag,
+	size_t tagLength)
+{
+	CCCompatCryptor *compat_cryptor = cryptorRef;
+    CCCryptor	*cryptor;
+    CC_DEBUG_LOG(ASL_LEVEL_ERR, "Entering\n");
+	if(compat_cryptor == NULL)  return kCCParamError;
+    cryptor = compat_cryptor->cryptor;
+    if(cryptor->mode != kCCModeGCMSIV || cryptor->op != kCCDecrypt) return kCCParamError;
+    if(tag == NULL || tagLength != CCGCMSIV_TAG_SIZE) return kCCParamError;
+    
+    ccgcmsiv_set_tag(CC_GCM_CTX(cryptor), tagLength, tag);
  	return kCCSuccess;
 }
 
 
 
+/*
+ * The cryptor goes in a kCCContextSizeGCM buffer on the stack - nothing is
+ * allocated unless some implementation's context outgrows it - and is
+ * released on every path out.
+ */
+
 CCCryptorStatus CCCryptorGCM(
 	CCOperation 	op,				/* kCCEncrypt, kCCDecrypt */
 	CCAlgorithm		alg,
@@ -165,36 +286,166 @@ CCCryptorStatus CCCryptorGCM(
 	const void 		*tag,
 	size_t 			*tagLength)
 {
+    uint64_t context[kCCContextSizeGCM / sizeof(uint64_t)];
+    uint32_t alignedKey[kCCKeySizeAES256 / sizeof(uint32_t)];
     CCCryptorRef cryptorRef;
     CCCryptorStatus retval;
     
     CC_DEBUG_LOG(ASL_LEVEL_ERR, "Entering Op: %d Cipher: %d\n", op, alg);
-
-    retval = CCCryptorCreateWithMode(op, kCCModeGCM, alg, 0, NULL, key, keyLength,
-                                         NULL, 0, 0, 0, &cryptorRef);
+    if(op != kCCEncrypt && op != kCCDecrypt) return kCCParamError;
+    
+    // An unaligned key would otherwise be copied to the heap.
+    if(key && keyLength <= sizeof(alignedKey)) {
+        CC_XMEMCPY(alignedKey, key, keyLength);
+        key = alignedKey;
+    }
+    retval = CCCryptorCreateFromDataWithMode(op, kCCModeGCM, alg, 0, NULL, key, keyLength,
+                                             NULL, 0, 0, 0, context, sizeof(context), &cryptorRef, NULL);
+    CC_XZEROMEM(alignedKey, sizeof(alignedKey));
     if(retval) return retval;
     
     // IV is optional
-    if(ivLen) {
-        retval = CCCryptorGCMAddIV(cryptorRef, iv, ivLen);
-        if(retval) return retval;
-    }
+    if(ivLen) retval = CCCryptorGCMAddIV(cryptorRef, iv, ivLen);
     
     // This must always be called - even with no aData.
-    retval = CCCryptorGCMaddAAD(cryptorRef, aData, aDataLen);
-    if(retval) return retval;
+    if(retval == kCCSuccess) retval = CCCryptorGCMaddAAD(cryptorRef, aData, aDataLen);
     
-    if(op == kCCEncrypt)
-        retval = CCCryptorGCMEncrypt(cryptorRef, dataIn, dataInLength, dataOut);
-    else if(op == kCCDecrypt)
-        retval = CCCryptorGCMDecrypt(cryptorRef, dataIn, dataInLength, dataOut);
-    else return kCCParamError;
-    if(retval) return retval;
-
-    retval = CCCryptorGCMFinal(cryptorRef, tag, tagLength);
+    if(retval == kCCSuccess) {
+        if(op == kCCEncrypt)
+            retval = CCCryptorGCMEncrypt(cryptorRef, dataIn, dataInLength, dataOut);
+        else
+            retval = CCCryptorGCMDecrypt(cryptorRef, dataIn, dataInLength, dataOut);
+    }
+    
+    if(retval == kCCSuccess) retval = CCCryptorGCMFinal(cryptorRef, tag, tagLength);
     CCCryptorRelease(cryptorRef);
     
     return retval;
 }
 
+/*
+ * The schedule's context is keyed - AES rounds and GHASH tables - and never
+ * written; each message runs on a copy of it on the stack.
+ */
 
+CCCryptorStatus CCCryptorGCMOneShotWithKey(
+	CCKeyScheduleRef keyRef,
+	CCOperation 	op,
+	const void 		*iv,
+	size_t 			ivLen,
+	const void 		*aData,
+	size_t 			aDataLen,
+	const void 		*dataIn,
+	size_t 			dataInLength,
+  	void 			*dataOut,
+	const void 		*tag,
+	size_t 			*tagLength)
+{
+    CCCryptor *schedule;
+    const struct ccmode_gcm *mode;
+    
+    CC_DEBUG_LOG(ASL_LEVEL_ERR, "Entering Op: %d\n", op);
+    if(keyRef == NULL || tag == NULL || tagLength == NULL) return kCCParamError;
+    if(op != kCCEncrypt && op != kCCDecrypt) return kCCParamError;
+    schedule = keyRef->cryptor;
+    if(schedule->mode != kCCModeGCM) return kCCParamError;
+    if(schedule->op != kCCBoth && schedule->op != op) return kCCParamError;
+    if(dataInLength && (dataIn == NULL || dataOut == NULL)) return kCCParamError;
+    
+    mode = schedule->symMode[op].gcm;
+    ccgcm_ctx_decl(mode->size, ctx);
+    CC_XMEMCPY(ctx, schedule->ctx[op].gcm, mode->size);
+    
+    if(ivLen) mode->set_iv(ctx, ivLen, iv);
+    mode->gmac(ctx, aDataLen, aData);
+    if(dataInLength) mode->gcm(ctx, dataInLength, dataIn, dataOut);
+    mode->finalize(ctx, *tagLength, (void *) tag);
+    CC_XZEROMEM(ctx, mode->size);
+    return kCCSuccess;
+}
+
+#pragma mark Batches
+
+#define CC_GCM_BATCH 32
+
+/*
+ * Entries go to the mode in runs of up to CC_GCM_BATCH valid ones, so the
+ * wide mode can interleave them; an entry that can't run gets its status
+ * and is left out.  Opening checks each tag in constant time, and wipes
+ * the plaintext of a message that fails.
+ */
+
+static CCCryptorStatus ccGCMBatch(CCKeyScheduleRef keyRef, CCOperation op, CCGCMBatchEntry *entries, size_t count)
+{
+    CCCryptorStatus retval = kCCSuccess;
+    ccgcm_batch_msg msgs[CC_GCM_BATCH];
+    CCGCMBatchEntry *run[CC_GCM_BATCH];
+    CCCryptor *schedule;
+    size_t i, j, n;
+    uint8_t diff;
+    
+    CC_DEBUG_LOG(ASL_LEVEL_ERR, "Entering Op: %d Count: %d\n", op, (int) count);
+    if(keyRef == NULL || (entries == NULL && count)) return kCCParamError;
+    schedule = keyRef->cryptor;
+    if(schedule->mode != kCCModeGCM) return kCCParamError;
+    if(schedule->op != kCCBoth && schedule->op != op) return kCCParamError;
+    
+    for(i = 0; i < count; ) {
+        for(n = 0; n < CC_GCM_BATCH && i < count; i++) {
+            CCGCMBatchEntry *entry = &entries[i];
+            
+            if(entry->tag == NULL || entry->tagLength == 0 || entry->tagLength > sizeof(msgs[0].tag) ||
+               (entry->ivLen && entry->iv == NULL) || (entry->aDataLen && entry->aData == NULL) ||
+               (entry->dataInLength && (entry->dataIn == NULL || entry->dataOut == NULL))) {
+                entry->status = kCCParamError;
+                continue;
+            }
+            msgs[n].iv = entry->iv;
+            msgs[n].ivLen = entry->ivLen;
+            msgs[n].aad = entry->aData;
+            msgs[n].aadLen = entry->aDataLen;
+            msgs[n].in = entry->dataIn;
+            msgs[n].len = entry->dataInLength;
+            msgs[n].out = entry->dataOut;
+            run[n++] = entry;
+        }
+        if(n == 0) continue;
+        schedule->modeDesc->mode_crypt_batch(schedule->symMode[op], n, msgs, schedule->ctx[op]);
+        
+        for(j = 0; j < n; j++) {
+            CCGCMBatchEntry *entry = run[j];
+            
+            entry->status = kCCSuccess;
+            if(op == kCCEncrypt) {
+                CC_XMEMCPY(entry->tag, msgs[j].tag, entry->tagLength);
+                continue;
+            }
+            diff = 0;
+            for(size_t t = 0; t < entry->tagLength; t++) diff |= msgs[j].tag[t] ^ ((const uint8_t *) entry->tag)[t];
+            if(diff) {
+                CC_XZEROMEM(entry->dataOut, entry->dataInLength);
+                entry->status = kCCDecodeError;
+            }
+        }
+        CC_XZEROMEM(msgs, sizeof(msgs));
+    }
+    
+    for(i = 0; i < count && retval == kCCSuccess; i++) retval = entries[i].status;
+    return retval;
+}
+
+CCCryptorStatus CCCryptorGCMSealBatch(
+	CCKeyScheduleRef keyRef,
+	CCGCMBatchEntry *entries,
+	size_t			count)
+{
+    return ccGCMBatch(keyRef, kCCEncrypt, entries, count);
+}
+
+CCCryptorStatus CCCryptorGCMOpenBatch(
+	CCKeyScheduleRef keyRef,
+	CCGCMBatchEntry *entries,
+	size_t			count)
+{
+    return ccGCMBatch(keyRef, kCCDecrypt, entries, count);
+}
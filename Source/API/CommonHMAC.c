@@ -206,7 +206,7 @@ CCHmacCreate(CCDigestAlg alg, const void *key, size_t keyLength)
 	CC_XZEROMEM(hmacCtx, sizeof(_NewHmacContext));
 	
     if((hmacCtx->di = CCDigestGetDigestInfo(alg)) == NULL) {
-        CC_DEBUG_LOG(CC_DEBUG, "CCHMac Unknown Digest %d\n");
+        CC_DEBUG_LOG(CC_DEBUG, "CCHMac Unknown Digest %d\n", alg);
         return NULL;
 	}
     
@@ -28,6 +28,7 @@
 #include "CommonDigestPriv.h"
 #include "CommonDigestSPI.h"
 #include "ccdebug.h"
+#include "ccMemory.h"
 
 
 int 
@@ -38,7 +39,7 @@ CCKeyDerivationPBKDF( CCPBKDFAlgorithm algorithm, const char *password, size_t p
 {
     const struct ccdigest_info *di;
 
-    CC_DEBUG_LOG(ASL_LEVEL_ERR, "PasswordLen %lu SaltLen %lU PRF %d Rounds %u DKLen %lu\n", passwordLen, saltLen, prf, rounds, derivedKeyLen);
+    CC_DEBUG_LOG(ASL_LEVEL_ERR, "PasswordLen %lu SaltLen %lu PRF %d Rounds %u DKLen %lu\n", passwordLen, saltLen, prf, rounds, derivedKeyLen);
     if(algorithm != kCCPBKDF2) return -1;
     switch(prf) {
         case kCCPRFHmacAlgSHA1: di = CCDigestGetDigestInfo(kCCDigestSHA1); break;
@@ -81,11 +82,12 @@ uint
 CCCalibratePBKDF(CCPBKDFAlgorithm algorithm, size_t passwordLen, size_t saltLen,
 				 CCPseudoRandomAlgorithm prf, size_t derivedKeyLen, uint32_t msec)
 {
-	char        *password;
-	uint8_t     *salt;
+	char        *password = NULL;
+	uint8_t     *salt = NULL;
 	uint64_t	startTime, endTime, elapsedTime;
-	uint8_t     *derivedKey;
+	uint8_t     *derivedKey = NULL;
 	int         i;
+	uint        retval;
     
     CC_DEBUG_LOG(ASL_LEVEL_ERR, "Entering\n");
 	if (derivedKeyLen == 0) return -1; // bad parameters
@@ -93,26 +95,32 @@ CCCalibratePBKDF(CCPBKDFAlgorithm algorithm, size_t passwordLen, size_t saltLen,
 	if (passwordLen == 0 ) passwordLen = 1;
 	if(algorithm != kCCPBKDF2) return -1;
     
-	if((password = malloc(passwordLen)) == NULL) return -1;
+	retval = -1;
+	if((password = CC_XMALLOC(passwordLen)) == NULL) goto errOut;
 	for(i=0; i<passwordLen; i++) password[i] = 'a';
-	if((salt = malloc(saltLen)) == NULL) return -1;
+	if((salt = CC_XMALLOC(saltLen)) == NULL) goto errOut;
 	for(i=0; i<saltLen; i++) salt[i] = i%256;
-	if((derivedKey = malloc(derivedKeyLen)) == NULL) return -1;
+	if((derivedKey = CC_XMALLOC(derivedKeyLen)) == NULL) goto errOut;
     
     for(elapsedTime = 0, i=0; i < 5 && elapsedTime == 0; i++) {
         startTime = timer();
-        if(CCKeyDerivationPBKDF(algorithm, password, passwordLen, salt, saltLen, prf, ROUNDMEASURE, derivedKey, derivedKeyLen)) return -2;
+        if(CCKeyDerivationPBKDF(algorithm, password, passwordLen, salt, saltLen, prf, ROUNDMEASURE, derivedKey, derivedKeyLen)) {
+            retval = -2;
+            goto errOut;
+        }
         endTime = timer();
         
         elapsedTime = endTime - startTime;
 	}
     
-    if(elapsedTime == 0) return 123456; // arbitrary, but something is seriously wrong
+    if(elapsedTime == 0) retval = 123456; // arbitrary, but something is seriously wrong
+    else retval = (msec * ROUNDMEASURE)/elapsedTime;
     
-	free(password);
-	free(salt);
-	free(derivedKey);
+errOut:
+	if(password) CC_XFREE(password, passwordLen);
+	if(salt) CC_XFREE(salt, saltLen);
+	if(derivedKey) CC_XFREE(derivedKey, derivedKeyLen);
     
-	return (msec * ROUNDMEASURE)/elapsedTime;
+	return retval;
 }
 
@@ -67,7 +67,6 @@ static CCRSACryptor *
 ccMallocRSACryptor(size_t nbits, CCRSAKeyType keyType)
 {
     CCRSACryptor *retval;
-    size_t ctxSize = 0;
     cc_size n = ccn_nof(nbits);
 
     if((retval = CC_XMALLOC(sizeof(CCRSACryptor))) == NULL) return NULL;
@@ -85,7 +84,6 @@ ccMallocRSACryptor(size_t nbits, CCRSAKeyType keyType)
             retval->ctxSize = ccrsa_full_ctx_size(ccn_sizeof(nbits));
             break;
         default:
-            retval = kCCParamError;
             goto errOut;
     }
     
@@ -94,22 +92,17 @@ ccMallocRSACryptor(size_t nbits, CCRSAKeyType keyType)
 
     return retval;
 errOut:
-    if(retval) {
-        CC_XFREE(retval, sizeof(CCRSACryptor));
-    }
-    return retval;
+    CC_XFREE(retval, sizeof(CCRSACryptor));
+    return NULL;
 }
 
 static void
 ccRSACryptorClear(CCRSACryptorRef theKey)
 {
-    size_t nbits;
-    size_t ctxSize = 0;
-    
     CCRSACryptor *key = (CCRSACryptor *) theKey;
     if(!key) return;
     
-    if(ctxSize && key->rsaKey.bytes) {
+    if(key->ctxSize && key->rsaKey.bytes) {
         CC_XZEROMEM(key->rsaKey.bytes, key->ctxSize);
         CC_XFREE(key->rsaKey.bytes, key->ctxSize);
     }
@@ -209,7 +209,7 @@ CCRNGCreate(uint32_t options, CCRandomRef *rngRef)
     struct ccdrbg_nistctr_custom custom_options;
 
     CC_DEBUG_LOG(ASL_LEVEL_ERR, "Entering\n");
-    ref = CC_XMALLOC(sizeof(ccInternalRandom));
+    ref = CC_XCALLOC(1, sizeof(ccInternalRandom));
     if(NULL == ref) return kCCMemoryFailure;
     
     ref->rngtype = rng_created;
@@ -219,7 +219,10 @@ CCRNGCreate(uint32_t options, CCRandomRef *rngRef)
     custom_options.strictFIPS = 1;
     custom_options.use_df = 1;
     
-    if(retval = ccInitDRBG(ref, &custom_options, options)) return retval;
+    if(retval = ccInitDRBG(ref, &custom_options, options)) {
+        CC_XFREE(ref, sizeof(ccInternalRandom));
+        return retval;
+    }
     *rngRef = ref;
 
     return kCCSuccess;    
@@ -231,6 +234,9 @@ CCRNGRelease(CCRandomRef rng)
     CC_DEBUG_LOG(ASL_LEVEL_ERR, "Entering\n");
     if(rng->rngtype == rng_created) {
         ccrng_CommonCrypto_done(rng->state.drbg);
+        CC_XFREE(rng->state.drbg, sizeof(struct ccrng_CommonCrypto_state));
+        CC_XFREE(rng->drbg_state, rng->info.drbg->size);
+        CC_XFREE(rng->info.drbg, sizeof(struct ccdrbg_info));
         CC_XFREE(rng, sizeof(ccInternalRandom));
     }
     return kCCSuccess;        
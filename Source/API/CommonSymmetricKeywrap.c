@@ -27,6 +27,7 @@
 #include "CommonCryptorPriv.h"
 #include <AssertMacros.h>
 #include "ccdebug.h"
+#include "ccMemory.h"
 
 
 static const uint8_t rfc3394_iv_data[] = { 0xA6, 0xA6, 0xA6, 0xA6, 0xA6, 0xA6,
@@ -88,7 +89,7 @@ CCSymmetricKeyWrap( CCWrappingAlgorithm algorithm,
 
     CC_DEBUG_LOG(ASL_LEVEL_ERR, "Entering\n");
     ccecb_ctx_decl(ccmode->size, ctx);
-	R = calloc(n, sizeof(uint64_t[2])); 
+	R = CC_XCALLOC(n, sizeof(uint64_t[2])); 
 	
     // don't wrap with something smaller
     // require_action(rawKeyLen <= kekLen, out, err = -1);
@@ -126,7 +127,7 @@ CCSymmetricKeyWrap( CCWrappingAlgorithm algorithm,
             R[i][j] = 0;
 
 out:
-	if (R) free(R);
+	if (R) CC_XFREE(R, n * sizeof(uint64_t[2]));
     return err;
 }
 
@@ -147,7 +148,7 @@ CCSymmetricKeyUnwrap( CCWrappingAlgorithm algorithm,
     CC_DEBUG_LOG(ASL_LEVEL_ERR, "Entering\n");
     ccecb_ctx_decl(ccmode->size, ctx);
 
-	R = calloc(n, sizeof(uint64_t[2])); 
+	R = CC_XCALLOC(n, sizeof(uint64_t[2])); 
 
     // kek multiple of 64 bits: 128, 192, 256
     require_action(kekLen == 16 || kekLen == 24 || kekLen == 32, out, err = -1);
@@ -184,7 +185,7 @@ CCSymmetricKeyUnwrap( CCWrappingAlgorithm algorithm,
             R[i][j] = 0;
 
 out:
-	if (R) free(R);
+	if (R) CC_XFREE(R, n * sizeof(uint64_t[2]));
     return err;
 }
 
@@ -0,0 +1,143 @@
+/*
+ * Copyright (c) 2013 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+#ifndef	_CC_COMMON_CRYPTO_ALLOCATOR_H_
+#define _CC_COMMON_CRYPTO_ALLOCATOR_H_
+
+#include <Availability.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <CommonCrypto/CommonCryptor.h>
+
+/*!
+    @header     CommonCryptoAllocator.h
+    @abstract   Lets an application supply the memory CommonCrypto keeps
+                its contexts in.
+
+    @discussion Cryptors, digest and HMAC contexts, RSA, EC and DH keys,
+                big numbers and RNG state are all allocated through one
+                allocator, malloc() and free() unless another is installed
+                with CCSetAllocator().  It can only be installed before
+                CommonCrypto allocates anything - in practice at startup -
+                so every block goes back to the allocator that handed it out.
+*/
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/*!
+    @enum       CCAllocatorOptions
+    @constant   kCCAllocatorZeroOnFree  Zero every block before it's freed,
+                                        not just the ones holding key material.
+*/
+enum {
+    kCCAllocatorZeroOnFree  = 0x0001,
+};
+typedef uint32_t CCAllocatorOptions;
+
+/*!
+    @typedef    CCAllocator
+    @field      context     Handed back to allocate and deallocate - an
+                            arena, say.  CCAllocatorSetThreadContext()
+                            overrides it for a thread.
+    @field      alignment   Every block has to be aligned to this many bytes,
+                            a power of two.  0 takes what malloc() gives.
+    @field      options     CCAllocatorOptions.
+    @field      allocate    Returns a block of size bytes aligned to alignment,
+                            or NULL.  NULL here and in deallocate uses malloc()
+                            (posix_memalign() for an alignment).
+    @field      deallocate  Releases a block.  size is the size it was
+                            allocated with.  context is the calling thread's,
+                            which needn't be the one the block came from.
+*/
+typedef struct CCAllocator {
+    void                *context;
+    size_t              alignment;
+    CCAllocatorOptions  options;
+    void                *(*allocate)(void *context, size_t size, size_t alignment);
+    void                (*deallocate)(void *context, void *block, size_t size);
+} CCAllocator;
+
+/*!
+    @function   CCSetAllocator
+    @abstract   Install the allocator for all of CommonCrypto's contexts.
+
+    @param      allocator   Copied.  allocate and deallocate have to be both
+                            set or both NULL.
+
+    @result     kCCSuccess, kCCParamError for a bad allocator, or
+                kCCUnimplemented if an allocator was already installed or
+                CommonCrypto has already allocated memory with the default.
+
+    @discussion Call it once, before anything else in CommonCrypto.
+*/
+CCCryptorStatus CCSetAllocator(
+	const CCAllocator	*allocator)
+__OSX_AVAILABLE_STARTING(__MAC_10_9, __IPHONE_7_0);
+
+/*!
+    @function   CCAllocatorSetThreadContext
+    @abstract   Use context rather than the allocator's own for allocations
+                made on the calling thread - a per-caller arena.
+
+    @param      context     NULL goes back to the allocator's context.
+*/
+void CCAllocatorSetThreadContext(
+	void				*context)
+__OSX_AVAILABLE_STARTING(__MAC_10_9, __IPHONE_7_0);
+
+/*!
+    @typedef    CCAllocatorStatistics
+    @field      allocations     Blocks allocated.
+    @field      deallocations   Blocks freed.
+    @field      bytesAllocated  Total size of the blocks allocated.
+    @field      bytesDeallocated Total size of the blocks freed, as
+                                passed to deallocate().
+*/
+typedef struct CCAllocatorStatistics {
+    uint64_t            allocations;
+    uint64_t            deallocations;
+    uint64_t            bytesAllocated;
+    uint64_t            bytesDeallocated;
+} CCAllocatorStatistics;
+
+/*!
+    @function   CCAllocatorCountThread
+    @abstract   Count the allocations CommonCrypto makes on the calling
+                thread into statistics - to see what an operation costs,
+                or that it leaks nothing.
+
+    @param      statistics  Added to, not cleared, until the thread calls
+                            again with NULL.  Blocks freed on another
+                            thread are counted there.
+*/
+void CCAllocatorCountThread(
+	CCAllocatorStatistics	*statistics)
+__OSX_AVAILABLE_STARTING(__MAC_10_9, __IPHONE_7_0);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif /* _CC_COMMON_CRYPTO_ALLOCATOR_H_ */
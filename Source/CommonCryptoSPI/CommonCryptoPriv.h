@@ -37,6 +37,7 @@
 #include <CommonCrypto/CommonHMacSPI.h>
 #include <CommonCrypto/CommonCMACSPI.h>
 #include <CommonCrypto/CommonRandomSPI.h>
+#include <CommonCrypto/CommonCryptoAllocator.h>
 #include <CommonCrypto/CommonSelfTest.h>
 
 // The following headers will be jettisoned once all internal projects
@@ -26,6 +26,7 @@
 
 #include <sys/types.h>
 #include <sys/param.h>
+#include <sys/uio.h>
 #include <stdint.h>
 
 #include <string.h>
@@ -36,6 +37,7 @@
 #include <stdlib.h>
 #endif /* KERNEL */
 #include <Availability.h>
+#include <CommonCrypto/CommonHMAC.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -64,11 +66,24 @@ enum {
 	kCCAlgorithmAES128WithHardware = 21
 };
 
+/*
+ 	Private Algorithms
+ */
+enum {
+	kCCAlgorithmChaCha20	= 7,
+};
+
+enum {
+	kCCKeySizeChaCha20		= 32,
+};
+
 /*
  	Private Modes
  */
 enum {
 	kCCModeGCM		= 11,
+	kCCModeChaCha20Poly1305	= 12,
+	kCCModeGCMSIV	= 13,
 };
 
 /*
@@ -116,6 +131,295 @@ CCCryptorStatus CCCryptorCreateFromDataWithMode(
 	size_t			*dataUsed)		/* optional, RETURNED */
 __OSX_AVAILABLE_STARTING(__MAC_10_7, __IPHONE_5_0);
 
+/*
+	Returns in contextSize the amount of caller-supplied memory 
+	CCCryptorCreateFromDataWithMode() needs to hold the entire cryptor -
+	wrapper, state and mode contexts - for the given op, mode and algorithm,
+	allowing for any alignment of that memory.  A buffer of at least this
+	size is never supplemented with a heap allocation.
+*/
+
+CCCryptorStatus CCCryptorGetContextSizeWithMode(
+	CCOperation 	op,				/* kCCEncrypt, kCCDecrypt, kCCBoth */
+	CCMode			mode,
+	CCAlgorithm		alg,
+	size_t			*contextSize)	/* RETURNED */
+__OSX_AVAILABLE_STARTING(__MAC_10_9, __IPHONE_7_0);
+
+/*
+	Enables recycling of released cryptors.  When depth is non-zero
+	CCCryptorRelease() keeps up to depth cryptors of each (algorithm, mode,
+	op) combination on a per-thread free list, and CCCryptorCreateWithMode()
+	and CCCryptorCreate() reuse them instead of allocating.  Key schedules
+	are zeroed before a cryptor is kept.  Cryptors created in caller-supplied
+	memory are never pooled.  A depth of 0 (the default) disables pooling.
+	The depth may be changed from any thread at any time; a thread's lists
+	are trimmed down to it as cryptors are released on that thread, and
+	freed when the thread exits.
+*/
+
+CCCryptorStatus CCCryptorSetPoolDepth(
+	uint32_t		depth)
+__OSX_AVAILABLE_STARTING(__MAC_10_9, __IPHONE_7_0);
+
+/*
+	Key Schedules
+
+	A CCKeyScheduleRef holds a key expanded once for an op, mode and
+	algorithm.  Any number of cryptors with different IVs can then be
+	created from it without running the key schedule again, and
+	CCCryptorReset() on those cryptors restores the schedule's contexts
+	rather than re-keying.  Only modes that keep the IV apart from the key
+	schedule are supported: kCCModeECB, kCCModeCBC, kCCModeXTS and kCCModeGCM.
+	The schedule must not be released while cryptors created from it are
+	still in use.  The raw key is kept only by a kCCEncrypt or kCCDecrypt
+	schedule for a block mode, so that its cryptors' block calls can expand
+	the other direction; created for kCCBoth, or for kCCModeGCM, a schedule
+	holds only the expanded key.  Cryptors never keep their own copy.
+*/
+
+typedef struct _CCKeySchedule *CCKeyScheduleRef;
+
+CCCryptorStatus CCKeyScheduleCreate(
+	CCOperation 	op,				/* kCCEncrypt, kCCDecrypt, kCCBoth */
+	CCMode			mode,
+	CCAlgorithm		alg,
+	const void 		*key,			/* raw key material */
+	size_t 			keyLength,	
+	const void 		*tweak,			/* raw tweak material */
+	size_t 			tweakLength,	
+	CCKeyScheduleRef *scheduleRef)	/* RETURNED */
+__OSX_AVAILABLE_STARTING(__MAC_10_9, __IPHONE_7_0);
+
+CCCryptorStatus CCKeyScheduleRelease(
+	CCKeyScheduleRef scheduleRef)
+__OSX_AVAILABLE_STARTING(__MAC_10_9, __IPHONE_7_0);
+
+CCCryptorStatus CCCryptorCreateWithKeySchedule(
+	CCKeyScheduleRef scheduleRef,
+	CCPadding		padding,
+	const void 		*iv,			/* optional initialization vector */
+	CCCryptorRef	*cryptorRef)	/* RETURNED */
+__OSX_AVAILABLE_STARTING(__MAC_10_9, __IPHONE_7_0);
+
+/*
+	Cloning
+
+	CCCryptorClone() creates a new cryptor in exactly the state of
+	cryptorRef: the expanded key, the current IV or counter, buffered
+	partial blocks and, for kCCModeGCM, the AAD and GHASH state.  The
+	key schedule is copied rather than recomputed, so a common prefix can
+	be processed once and then continued several ways.  The two cryptors
+	are independent afterwards and each must be released with
+	CCCryptorRelease().  A clone of a cryptor created from a
+	CCKeyScheduleRef uses the same schedule.  kCCModeGCMSIV cryptors can't
+	be cloned and return kCCUnimplemented.
+*/
+
+CCCryptorStatus CCCryptorClone(
+	CCCryptorRef	cryptorRef,
+	CCCryptorRef	*cloneRef)		/* RETURNED */
+__OSX_AVAILABLE_STARTING(__MAC_10_9, __IPHONE_7_0);
+
+/*
+	Seeking
+
+	CCCryptorSeek() moves a kCCModeCTR cryptor to byteOffset in the stream
+	that starts at the IV it was created with, so the next
+	CCCryptorUpdate() processes the byte at that offset.  The counter and
+	position within the keystream block are set directly; no keystream is
+	generated for the bytes skipped.  Offsets may go backwards as well as
+	forwards.  Other modes return kCCUnimplemented - OFB in particular
+	can't reach an offset without running the cipher up to it.
+
+	A seek may re-key the CTR context from the raw key, so the cryptor has
+	to have been created with one.  Key schedules don't keep it and don't
+	offer kCCModeCTR, so a cryptor from CCCryptorCreateWithKeySchedule()
+	returns kCCUnimplemented; a CTR cryptor without its key would return
+	kCCParamError.
+*/
+
+CCCryptorStatus CCCryptorSeek(
+	CCCryptorRef	cryptorRef,
+	uint64_t		byteOffset)
+__OSX_AVAILABLE_STARTING(__MAC_10_9, __IPHONE_7_0);
+
+/*
+	Scatter/gather update
+
+	CCCryptorUpdateV() behaves like CCCryptorUpdate() over the concatenation
+	of the dataIn fragments, writing the output across the dataOut fragments
+	in order.  Partial blocks are carried across fragment boundaries inside
+	the cryptor, so fragments need not be block multiples.  The mode is run
+	once per contiguous stretch of input and output.  dataOutMoved receives
+	the total number of bytes written.  As with CCCryptorUpdate(),
+	kCCBufferTooSmall leaves the cryptor in an undefined state.
+*/
+
+CCCryptorStatus CCCryptorUpdateV(
+	CCCryptorRef	cryptorRef,
+	const struct iovec *dataIn,
+	int				dataInCount,
+	const struct iovec *dataOut,
+	int				dataOutCount,
+	size_t			*dataOutMoved)	/* number of bytes written */
+__OSX_AVAILABLE_STARTING(__MAC_10_9, __IPHONE_7_0);
+
+/*
+	In-place update and final
+
+	CCCryptorUpdateInPlace() encrypts or decrypts the front of data in place
+	and never copies through the cryptor's internal buffer.  *dataMoved
+	receives the number of bytes processed; the rest of data - a partial
+	block, or the blocks the padding needs at final - is left untouched and
+	must lead the data passed to the next call.  Walking one buffer, the
+	caller advances data by *dataMoved and carries the remainder into the
+	next call's length.
+
+	CCCryptorFinalInPlace() processes the remaining dataLength bytes and the
+	padding in place.  dataAvailable is the space at data, which must cover
+	the padding block on encryption (CCCryptorGetOutputLength() with final
+	set gives the size).  Nothing is written if the space is short.
+	*dataMoved receives the number of bytes of output at data.  A whole
+	message can be passed to CCCryptorFinalInPlace() alone.
+
+	These can't be mixed with CCCryptorUpdate() on the same message:
+	kCCParamError is returned if CCCryptorUpdate() left bytes buffered.
+	Unpadded block modes return kCCAlignmentError if a partial block is
+	left at final.
+*/
+
+CCCryptorStatus CCCryptorUpdateInPlace(
+	CCCryptorRef	cryptorRef,
+	void			*data,			/* data in, processed data RETURNED here */
+	size_t			dataLength,
+	size_t			*dataMoved)		/* number of bytes processed */
+__OSX_AVAILABLE_STARTING(__MAC_10_9, __IPHONE_7_0);
+
+CCCryptorStatus CCCryptorFinalInPlace(
+	CCCryptorRef	cryptorRef,
+	void			*data,			/* data in, processed data RETURNED here */
+	size_t			dataLength,
+	size_t			dataAvailable,	/* space at data, including padding */
+	size_t			*dataMoved)		/* number of bytes written */
+__OSX_AVAILABLE_STARTING(__MAC_10_9, __IPHONE_7_0);
+
+/*
+	Parallel bulk processing
+
+	CCCryptorSetParallelism() lets a kCCModeECB or kCCModeCTR cryptor, or a
+	kCCModeCBC decryptor, split large inputs into up to nthreads chunks that
+	are processed concurrently.  For kCCModeXTS it applies to
+	CCCryptorXTSEncryptSectors() and CCCryptorXTSDecryptSectors(), and for
+	kCCModeGCM to CCCryptorGCMEncrypt() and CCCryptorGCMDecrypt(), where
+	the chunks are hashed separately and combined into the same tag; GCM
+	runs serially where the AES implementation can't split it.
+	Output is identical to serial processing.  Inputs shorter than two
+	chunks of 64KB are always processed serially.  0 or 1 turns it off.
+	Returns kCCUnimplemented for modes that can't be split.
+*/
+
+CCCryptorStatus CCCryptorSetParallelism(
+	CCCryptorRef	cryptorRef,
+	uint32_t		nthreads)
+__OSX_AVAILABLE_STARTING(__MAC_10_9, __IPHONE_7_0);
+
+
+/*
+	Batch one-shot
+
+	CCCryptBatch() is CCCrypt() over an array of independent messages that
+	share an operation, mode, algorithm and padding.  Runs of consecutive
+	entries with the same key share one key schedule, so callers with many
+	messages per key should keep them together.  CBC encryption with
+	ccNoPadding or ccPKCS7Padding runs several messages of a run side by
+	side through the cipher.  kCCModeXTS and kCCModeGCM aren't supported.
+
+	Each entry gets its own status and dataOutMoved, with the meaning they
+	have for CCCrypt(); the call returns kCCSuccess or the status of the
+	first entry that failed.  Entries with a NULL or empty key, or NULL
+	data with a non-zero length, get kCCParamError and are skipped, as
+	do AES entries whose key isn't 16, 24 or 32 bytes, with kCCKeySizeError.
+*/
+
+typedef struct CCCryptBatchEntry {
+	const void 		*key;
+	size_t 			keyLength;
+	const void 		*iv;			/* optional initialization vector */
+	const void 		*dataIn;
+	size_t 			dataInLength;
+	void 			*dataOut;
+	size_t 			dataOutAvailable;
+	size_t 			dataOutMoved;	/* RETURNED */
+	CCCryptorStatus	status;			/* RETURNED */
+} CCCryptBatchEntry;
+
+CCCryptorStatus CCCryptBatch(
+	CCOperation 	op,				/* kCCEncrypt, kCCDecrypt */
+	CCMode			mode,
+	CCAlgorithm		alg,
+	CCPadding		padding,
+	CCCryptBatchEntry *entries,
+	size_t			count)
+__OSX_AVAILABLE_STARTING(__MAC_10_9, __IPHONE_7_0);
+
+/*
+	AES-CBC with HMAC, encrypt-then-MAC
+
+	A CCCBCHmacRef runs AES-CBC and an HMAC over the ciphertext in one pass:
+	the data is taken in cache sized stretches, each one encrypted and then
+	MACed (or MACed and then decrypted) while it's still in cache, instead
+	of a CCCryptorUpdate() over the whole record followed by a CCHmacUpdate()
+	over it again.  Any CCHmacAlgorithm may be used; SHA-1 and SHA-256 are
+	what TLS and the at-rest formats use.  padding is ccNoPadding or
+	ccPKCS7Padding.
+
+	CCCBCHmacUpdate() works like CCCryptorUpdate().  On encryption
+	CCCBCHmacFinal() flushes the padding block and writes the first
+	tagLength bytes of the MAC to tag.  On decryption it checks tag against
+	the MAC before removing the padding and returns kCCDecodeError if they
+	differ.  Decrypting, CCCBCHmacUpdate() hands back plaintext before the
+	MAC has been checked: it is unauthenticated until CCCBCHmacFinal()
+	returns kCCSuccess, and must be thrown away if it doesn't.  tagLength
+	may truncate the MAC to no less than half its length and no less than
+	10 bytes; shorter tags return kCCParamError.
+*/
+
+typedef struct _CCCBCHmac *CCCBCHmacRef;
+
+CCCryptorStatus CCCBCHmacCreate(
+	CCOperation 	op,				/* kCCEncrypt, kCCDecrypt */
+	CCPadding		padding,
+	const void 		*key,			/* AES key */
+	size_t 			keyLength,
+	const void 		*iv,			/* optional initialization vector */
+	CCHmacAlgorithm	macAlgorithm,
+	const void		*macKey,
+	size_t			macKeyLength,
+	CCCBCHmacRef	*cbcHmacRef)	/* RETURNED */
+__OSX_AVAILABLE_STARTING(__MAC_10_9, __IPHONE_7_0);
+
+CCCryptorStatus CCCBCHmacUpdate(
+	CCCBCHmacRef	cbcHmacRef,
+	const void 		*dataIn,
+	size_t 			dataInLength,
+	void 			*dataOut,		/* data RETURNED here */
+	size_t 			dataOutAvailable,
+	size_t 			*dataOutMoved)
+__OSX_AVAILABLE_STARTING(__MAC_10_9, __IPHONE_7_0);
+
+CCCryptorStatus CCCBCHmacFinal(
+	CCCBCHmacRef	cbcHmacRef,
+	void 			*dataOut,
+	size_t 			dataOutAvailable,
+	size_t 			*dataOutMoved,
+	void			*tag,			/* RETURNED on encrypt, checked on decrypt */
+	size_t			tagLength)
+__OSX_AVAILABLE_STARTING(__MAC_10_9, __IPHONE_7_0);
+
+CCCryptorStatus CCCBCHmacRelease(
+	CCCBCHmacRef	cbcHmacRef)
+__OSX_AVAILABLE_STARTING(__MAC_10_9, __IPHONE_7_0);
 
 /*
 	Assuming we can use existing CCCryptorCreateFromData for all modes serviced by these:
@@ -147,6 +451,40 @@ CCCryptorStatus CCCryptorDecryptDataBlock(
 	void *dataOut)
 __OSX_AVAILABLE_STARTING(__MAC_10_7, __IPHONE_5_0);
 
+/*
+	XTS sector batches for block devices.
+	
+	Encrypt or decrypt nSectors consecutive sectors of sectorSize bytes
+	each, starting with sector number startSector.  Each sector is
+	tweaked with its own number, little-endian and zero extended to 128
+	bits, so the result is the same as one CCCryptorEncryptDataBlock()
+	or CCCryptorDecryptDataBlock() call per sector with that number as
+	the tweak.
+	
+	sectorSize has to be a multiple of the block size; kCCAlignmentError
+	is returned otherwise.  The cryptor has to be an XTS cryptor.
+	Sectors are independent, and with CCCryptorSetParallelism() a large
+	batch is spread over several threads.
+*/
+
+CCCryptorStatus CCCryptorXTSEncryptSectors(
+	CCCryptorRef cryptorRef,
+	uint64_t startSector,
+	size_t sectorSize,
+	size_t nSectors,
+	const void *dataIn,
+	void *dataOut)
+__OSX_AVAILABLE_STARTING(__MAC_10_9, __IPHONE_7_0);
+
+CCCryptorStatus CCCryptorXTSDecryptSectors(
+	CCCryptorRef cryptorRef,
+	uint64_t startSector,
+	size_t sectorSize,
+	size_t nSectors,
+	const void *dataIn,
+	void *dataOut)
+__OSX_AVAILABLE_STARTING(__MAC_10_9, __IPHONE_7_0);
+
 /*
 	Assuming we can use the existing CCCryptorRelease() interface for 
 	int mode_done(mode_context *ctx);
@@ -194,6 +532,25 @@ __OSX_AVAILABLE_STARTING(__MAC_10_7, __IPHONE_5_0);
     a CryptoRef.  Only kCCAlgorithmAES128 can be used with GCM and these
     functions.  IV Setting etc will be ignored from CCCryptorCreateWithMode().
     Use the CCCryptorGCMAddIV() routine below for IV setup.
+
+    The same functions drive the other AEAD modes:
+
+    kCCAlgorithmChaCha20 always runs as kCCModeChaCha20Poly1305 (RFC 7539),
+    whatever mode is asked for, so CCCryptorGCM() works with it too.  The key
+    is kCCKeySizeChaCha20 bytes, the IV 12 and the tag 16.
+
+    kCCModeGCMSIV is AES-GCM-SIV (RFC 8452) with a 16 or 32 byte key, a 12
+    byte IV and a 16 byte tag.  The tag is derived from the whole message and
+    then keys the encryption, so: encrypting, CCCryptorGCMEncrypt() output
+    has to go to one contiguous buffer and isn't ciphertext until
+    CCCryptorGCMFinal(); decrypting, the tag goes in with
+    CCCryptorGCMSIVSetTag() before any ciphertext, the output is contiguous
+    the same way and isn't plaintext until CCCryptorGCMFinal(), which
+    returns kCCDecodeError and zeroes the output if the tag doesn't match.
+
+    For both, the IV goes in whole with a single CCCryptorGCMAddIV(); any
+    other length, a second IV, or AAD, text or CCCryptorGCMFinal() before
+    the IV returns kCCParamError.
 */
 
 /*
@@ -280,9 +637,24 @@ __OSX_AVAILABLE_STARTING(__MAC_10_8, __IPHONE_5_0);
     message tag. The definition of the variables is the same as it is for all 
     the manual functions. If you are processing many packets under the same 
     key you shouldn’t use this function as it invokes the pre–computation 
-    with each call.
+    with each call - see CCCryptorGCMOneShotWithKey().
+
+    The cryptor lives in a kCCContextSizeGCM buffer on the stack, so the
+    call makes no heap allocation, and nothing is left behind whether it
+    succeeds or fails.
+*/
+
+/*
+	Caller memory of kCCContextSizeGCM bytes, any alignment, is enough for
+	CCCryptorCreateFromDataWithMode() to build an AES kCCModeGCM cryptor
+	for one direction without allocating.  CCCryptorGetContextSizeWithMode()
+	gives the exact figure for this implementation.
 */
 
+enum {
+    kCCContextSizeGCM = 4096
+};
+
 CCCryptorStatus CCCryptorGCM(
 	CCOperation 	op,				/* kCCEncrypt, kCCDecrypt */
 	CCAlgorithm		alg,
@@ -298,6 +670,80 @@ CCCryptorStatus CCCryptorGCM(
 	const void 		*tag,
 	size_t 			*tagLength)
 __OSX_AVAILABLE_STARTING(__MAC_10_8, __IPHONE_5_0);
+
+/*
+	CCCryptorGCM() for a key used over many messages.  keyRef comes from
+	CCKeyScheduleCreate() with kCCModeGCM and holds the expanded AES key
+	and GHASH tables, so each call only sets up the counter and runs the
+	message.  op must be one the schedule was created for (either, for
+	kCCBoth).  The schedule isn't modified, so any number of threads can
+	use it at once.
+*/
+
+CCCryptorStatus CCCryptorGCMOneShotWithKey(
+	CCKeyScheduleRef keyRef,
+	CCOperation 	op,				/* kCCEncrypt, kCCDecrypt */
+	const void 		*iv,
+	size_t 			ivLen,
+	const void 		*aData,
+	size_t 			aDataLen,
+	const void 		*dataIn,
+	size_t 			dataInLength,
+  	void 			*dataOut,
+	const void 		*tag,
+	size_t 			*tagLength)
+__OSX_AVAILABLE_STARTING(__MAC_10_9, __IPHONE_7_0);
+
+/*
+	CCCryptorGCMOneShotWithKey() over an array of independent messages -
+	QUIC packets, TLS records - under one key.  Messages are run side by
+	side, so the cipher stays busy across short ones instead of draining
+	at the end of each.  keyRef is as for CCCryptorGCMOneShotWithKey() and
+	has to have been created for the direction used (or kCCBoth).
+
+	Sealing, tag receives tagLength (at most 16) bytes.  Opening, tag is
+	the expected tag; a message whose tag doesn't match gets kCCDecodeError
+	and its dataOut is zeroed.  dataOut may be dataIn.  An entry with a
+	NULL pointer and a non-zero length for it gets kCCParamError and isn't
+	run.  Each entry gets its own status; the call returns kCCSuccess or the status of the first
+	entry that failed.
+*/
+
+typedef struct CCGCMBatchEntry {
+	const void 		*iv;
+	size_t 			ivLen;
+	const void 		*aData;
+	size_t 			aDataLen;
+	const void 		*dataIn;
+	size_t 			dataInLength;
+	void 			*dataOut;		/* dataInLength bytes */
+	void 			*tag;
+	size_t 			tagLength;
+	CCCryptorStatus	status;			/* RETURNED */
+} CCGCMBatchEntry;
+
+CCCryptorStatus CCCryptorGCMSealBatch(
+	CCKeyScheduleRef keyRef,
+	CCGCMBatchEntry *entries,
+	size_t			count)
+__OSX_AVAILABLE_STARTING(__MAC_10_9, __IPHONE_7_0);
+
+CCCryptorStatus CCCryptorGCMOpenBatch(
+	CCKeyScheduleRef keyRef,
+	CCGCMBatchEntry *entries,
+	size_t			count)
+__OSX_AVAILABLE_STARTING(__MAC_10_9, __IPHONE_7_0);
+
+/*
+	AES-GCM-SIV decryption: the expected tag, after the IV and before
+	CCCryptorGCMDecrypt().  kCCParamError for any other mode or direction.
+*/
+
+CCCryptorStatus CCCryptorGCMSIVSetTag(
+	CCCryptorRef cryptorRef,
+	const void *tag,
+	size_t tagLength)
+__OSX_AVAILABLE_STARTING(__MAC_10_9, __IPHONE_7_0);
     
 
 void CC_RC4_set_key(void *ctx, int len, const unsigned char *data)
@@ -0,0 +1,166 @@
+/*
+ * Copyright (c) 2013 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+/*
+ *  ccMemory.c
+ *  CommonCrypto
+ *
+ *  The allocator behind CC_XMALLOC() and friends.  It's settled by
+ *  CCSetAllocator() or by the first allocation, whichever comes first, and
+ *  never changes after that.
+ */
+
+#ifndef KERNEL
+
+#include "ccMemory.h"
+#include "ccdebug.h"
+#include "CommonCryptoAllocator.h"
+#include <pthread.h>
+#include <dispatch/dispatch.h>
+
+static const CCAllocator ccDefaultAllocator = { NULL, 0, 0, NULL, NULL };
+static CCAllocator ccInstalledAllocator;
+static uint32_t ccInstalling = 0;
+static const CCAllocator * volatile ccActiveAllocator = NULL;
+
+static pthread_key_t ccThreadContextKey;
+static pthread_key_t ccThreadStatisticsKey;
+static dispatch_once_t ccThreadContextInit;
+
+/* Zeroing through a volatile pointer so it isn't dropped as a dead store */
+static void *(* const volatile ccSecureMemset)(void *, int, size_t) = memset;
+
+static inline const CCAllocator *ccAllocator(void)
+{
+    const CCAllocator *allocator = ccActiveAllocator;
+
+    if(allocator == NULL) {
+        __sync_bool_compare_and_swap(&ccActiveAllocator, NULL, &ccDefaultAllocator);
+        allocator = ccActiveAllocator;
+    }
+    return allocator;
+}
+
+static inline void ccThreadContextKeyCreate(void)
+{
+    dispatch_once(&ccThreadContextInit, ^{
+        pthread_key_create(&ccThreadContextKey, NULL);
+        pthread_key_create(&ccThreadStatisticsKey, NULL);
+    });
+}
+
+static inline void *ccAllocatorContext(const CCAllocator *allocator)
+{
+    void *context;
+
+    ccThreadContextKeyCreate();
+    if((context = pthread_getspecific(ccThreadContextKey)) != NULL) return context;
+    return allocator->context;
+}
+
+/* Only threads that asked with CCAllocatorCountThread() are counted */
+static inline CCAllocatorStatistics *ccThreadStatistics(void)
+{
+    ccThreadContextKeyCreate();
+    return pthread_getspecific(ccThreadStatisticsKey);
+}
+
+void *ccMalloc(size_t size)
+{
+    const CCAllocator *allocator = ccAllocator();
+    CCAllocatorStatistics *statistics;
+    void *p;
+
+    if((statistics = ccThreadStatistics()) != NULL) {
+        statistics->allocations++;
+        statistics->bytesAllocated += size;
+    }
+    if(allocator->allocate) return allocator->allocate(ccAllocatorContext(allocator), size, allocator->alignment);
+    if(allocator->alignment == 0) return malloc(size);
+    return (posix_memalign(&p, allocator->alignment, size) == 0) ? p: NULL;
+}
+
+void *ccCalloc(size_t count, size_t size)
+{
+    void *p;
+
+    if(size && count > SIZE_MAX / size) return NULL;
+    if((p = ccMalloc(count * size)) != NULL) CC_XZEROMEM(p, count * size);
+    return p;
+}
+
+void *ccRealloc(void *p, size_t oldSize, size_t newSize)
+{
+    void *r;
+
+    if((r = ccMalloc(newSize)) == NULL) return NULL;
+    if(p) {
+        CC_XMEMCPY(r, p, CC_XMIN(oldSize, newSize));
+        ccFree(p, oldSize);
+    }
+    return r;
+}
+
+void ccFree(void *p, size_t size)
+{
+    const CCAllocator *allocator = ccAllocator();
+    CCAllocatorStatistics *statistics;
+
+    if(p == NULL) return;
+    if((statistics = ccThreadStatistics()) != NULL) {
+        statistics->deallocations++;
+        statistics->bytesDeallocated += size;
+    }
+    if(allocator->options & kCCAllocatorZeroOnFree) ccSecureMemset(p, 0, size);
+    if(allocator->deallocate) allocator->deallocate(ccAllocatorContext(allocator), p, size);
+    else free(p);
+}
+
+CCCryptorStatus CCSetAllocator(const CCAllocator *allocator)
+{
+    CC_DEBUG_LOG(ASL_LEVEL_ERR, "Entering\n");
+    if(allocator == NULL || (allocator->allocate == NULL) != (allocator->deallocate == NULL)) return kCCParamError;
+    if(allocator->alignment & (allocator->alignment - 1)) return kCCParamError;
+    if(allocator->allocate == NULL && allocator->alignment && allocator->alignment < sizeof(void *)) return kCCParamError;
+
+    if(ccActiveAllocator != NULL || !__sync_bool_compare_and_swap(&ccInstalling, 0, 1)) return kCCUnimplemented;
+    ccInstalledAllocator = *allocator;
+    if(!__sync_bool_compare_and_swap(&ccActiveAllocator, NULL, &ccInstalledAllocator)) return kCCUnimplemented;
+    return kCCSuccess;
+}
+
+void CCAllocatorSetThreadContext(void *context)
+{
+    CC_DEBUG_LOG(ASL_LEVEL_ERR, "Entering\n");
+    ccThreadContextKeyCreate();
+    pthread_setspecific(ccThreadContextKey, context);
+}
+
+void CCAllocatorCountThread(CCAllocatorStatistics *statistics)
+{
+    CC_DEBUG_LOG(ASL_LEVEL_ERR, "Entering\n");
+    ccThreadContextKeyCreate();
+    pthread_setspecific(ccThreadStatisticsKey, statistics);
+}
+
+#endif /* KERNEL */
@@ -35,11 +35,22 @@
 #else /* KERNEL */
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 
-#define CC_XMALLOC(s)  malloc(s)
-#define CC_XCALLOC(c, s) calloc((c), (s))
-#define CC_XREALLOC(p, s) realloc((p), (s))
-#define CC_XFREE(p, s)    free(p)
+/*
+ * Everything comes from the allocator installed with CCSetAllocator(),
+ * malloc() unless one was.  Frees take the size the block was allocated
+ * with.
+ */
+void *ccMalloc(size_t size);
+void *ccCalloc(size_t count, size_t size);
+void *ccRealloc(void *p, size_t oldSize, size_t newSize);
+void ccFree(void *p, size_t size);
+
+#define CC_XMALLOC(s)  ccMalloc(s)
+#define CC_XCALLOC(c, s) ccCalloc((c), (s))
+#define CC_XREALLOC(p, o, s) ccRealloc((p), (o), (s))
+#define CC_XFREE(p, s)    ccFree((p), (s))
 #define CC_XMEMCPY(s1, s2, n) memcpy((s1), (s2), (n))
 #define CC_XMEMCMP(s1, s2, n) memcmp((s1), (s2), (n))
 #define CC_XMEMSET(s1, s2, n) memset((s1), (s2), (n))
@@ -45,10 +45,52 @@ static uint32_t	 std_options = 0;
 static aslclient aslhandle = NULL;
 static aslmsg msgptr = NULL;
 
+#define LINESIZE 256
+
+typedef struct ccdebug_record {
+    int         level;
+    const char  *funcname;
+    char        message[LINESIZE];
+} ccdebug_record;
+
+int ccdebug_level = CC_TRACE_UNINITIALIZED;
+
+static uint32_t ccdebug_sample = 1;
+static uint32_t ccdebug_count = 0;
+static ccdebug_record *ccdebug_ring = NULL;
+static uint32_t ccdebug_ringsize = 0;
+static uint32_t ccdebug_ringnext = 0;
+
+static int
+ccdebug_env(const char *name, int defvalue) {
+    char *value = getenv(name);
+    
+    if(value == NULL || *value == 0) return defvalue;
+    return atoi(value);
+}
+
+/* Only the environment - most processes never trace and never need ASL */
 static void
 ccdebug_init() {
     static dispatch_once_t init;
     dispatch_once(&init, ^{
+        int ringsize, sample;
+        
+        if((sample = ccdebug_env("CC_TRACE_SAMPLE", 1)) > 1) ccdebug_sample = sample;
+        if((ringsize = ccdebug_env("CC_TRACE_RING", 0)) > 0 &&
+           (ccdebug_ring = calloc(ringsize, sizeof(ccdebug_record))) != NULL) {
+            ccdebug_ringsize = ringsize;
+            atexit(ccdebug_flush);
+        }
+        // Publish the level last - until then every message comes through here.
+        ccdebug_level = ccdebug_env("CC_TRACE_LEVEL", -1);
+    });
+}
+
+static void
+ccdebug_open() {
+    static dispatch_once_t opened;
+    dispatch_once(&opened, ^{
         char *ccEnvStdErr = getenv("CC_STDERR");
         
         if(ccEnvStdErr != NULL && strncmp(ccEnvStdErr, "yes", 3) == 0) std_options |= ASL_OPT_STDERR;
@@ -57,19 +99,52 @@ ccdebug_init() {
         asl_set(msgptr, ASL_KEY_FACILITY, "com.apple.platformsec");
     });
 }
-	
-#define LINESIZE 256
+
+/*
+ * Write out what's in the ring, oldest first.  Records being written while
+ * this runs may come out torn; it's meant for exit and the debugger.
+ */
 
 void
-ccdebug_imp(int level, char *funcname, char *format, ...) {
+ccdebug_flush(void) {
+    uint32_t next, i;
+    
+    ccdebug_init();
+    if(ccdebug_ring == NULL) return;
+    next = __sync_fetch_and_add(&ccdebug_ringnext, 0);
+    if(next == 0) return;
+    ccdebug_open();
+    i = (next > ccdebug_ringsize) ? next - ccdebug_ringsize: 0;
+    for(; i < next; i++) {
+        ccdebug_record *rec = &ccdebug_ring[i % ccdebug_ringsize];
+        asl_log(aslhandle, msgptr, rec->level, std_log_prefix, rec->funcname, rec->message);
+    }
+}
+
+void
+ccdebug_imp(int level, const char *funcname, const char *format, ...) {
 	va_list argp;
 	char fmtbuffer[LINESIZE];
+    int force = level & CC_TRACE_FORCE;
 
 	ccdebug_init();
+    level &= ~CC_TRACE_FORCE;
+    if(!force) {
+        if(level > ccdebug_level) return;
+        if(ccdebug_sample > 1 && (__sync_fetch_and_add(&ccdebug_count, 1) % ccdebug_sample) != 0) return;
+    }
 	
 	va_start(argp, format);
-	snprintf(fmtbuffer, LINESIZE, std_log_prefix, funcname, format);
-	asl_vlog(aslhandle, msgptr, level, fmtbuffer, argp);
+    if(!force && ccdebug_ring) {
+        ccdebug_record *rec = &ccdebug_ring[__sync_fetch_and_add(&ccdebug_ringnext, 1) % ccdebug_ringsize];
+        
+        rec->level = level;
+        rec->funcname = funcname;
+        vsnprintf(rec->message, LINESIZE, format, argp);
+    } else {
+        ccdebug_open();
+        snprintf(fmtbuffer, LINESIZE, std_log_prefix, funcname, format);
+        asl_vlog(aslhandle, msgptr, level, fmtbuffer, argp);
+    }
 	va_end(argp);
 }
-
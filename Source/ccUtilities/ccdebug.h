@@ -71,16 +71,40 @@
 #define CC_DEBUG_BUG			ASL_LEVEL_ERR
 #define CC_DEBUG			ASL_LEVEL_ERR
 
-void ccdebug_imp(int level, char *funcname, char *format, ...);
+/*
+ * Tracing.  A CC_DEBUG_LOG() costs one compare against ccdebug_level, which
+ * is off (-1) unless the environment turns it on:
+ *
+ *	CC_TRACE_LEVEL	trace messages at this ASL level or more severe
+ *	CC_TRACE_SAMPLE	keep 1 in N of the traced messages
+ *	CC_TRACE_RING	keep the last N messages in memory rather than logging
+ *			each one; they go to ASL from ccdebug_flush() and at exit
+ *	CC_STDERR	"yes" copies ASL output to stderr
+ *
+ * ccdebug_level starts above every level so the first message reads these;
+ * ASL is only opened once a message gets past them.  Files built with
+ * DIAGNOSTIC log every message synchronously, as before.
+ */
+
+#define CC_TRACE_UNINITIALIZED	0x7fffffff
+#define CC_TRACE_FORCE			0x100
+
+extern int ccdebug_level;
+
+void ccdebug_imp(int level, const char *funcname, const char *format, ...) __attribute__((format(printf, 3, 4)));
+void ccdebug_flush(void);
 
 #ifdef DIAGNOSTIC
 
-#define CC_DEBUG_LOG(lvl,...) ccdebug_imp(lvl, __FUNCTION__, __VA_ARGS__)
+#define CC_DEBUG_LOG(lvl,...) ccdebug_imp((lvl) | CC_TRACE_FORCE, __FUNCTION__, __VA_ARGS__)
 
 #else
 
-#define CC_DEBUG_LOG(lvl,...) {}
-#endif /* DEBUG */
+#define CC_DEBUG_LOG(lvl,...) do {                                      \
+    if(__builtin_expect((lvl) <= ccdebug_level, 0))                     \
+        ccdebug_imp(lvl, __FUNCTION__, __VA_ARGS__);                    \
+} while(0)
+#endif /* DIAGNOSTIC */
 
 #endif /* KERNEL */
 
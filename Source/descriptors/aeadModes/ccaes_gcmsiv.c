@@ -0,0 +1,507 @@
+/*
+ * Copyright (c) 2013 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+/*
+ *  ccaes_gcmsiv.c
+ *  CommonCrypto
+ *
+ *  POLYVAL runs on PCLMULQDQ four blocks per reduction where the CPU has it,
+ *  otherwise on a constant time 64 bit carryless multiply built from integer
+ *  multiplies with holes in the operands.
+ */
+
+#include "ccaes_gcmsiv.h"
+#include <string.h>
+#include <dispatch/dispatch.h>
+
+#if defined (__x86_64__) || defined(__i386__)		// x86_64 or i386 architectures
+#include <cpuid.h>
+#include <immintrin.h>
+#define CCGCMSIV_X86 1
+#define CCGCMSIV_PCLMUL __attribute__((target("pclmul,sse2")))
+#endif
+
+#define CCGCMSIV_BLOCK      16
+#define CCGCMSIV_CTR_BATCH  8       /* counter blocks per ECB call */
+
+/* x^-128 reduction constant: x^63 + x^62 + x^57 */
+#define CCGCMSIV_POLY       0xC200000000000000ULL
+
+enum {
+    ccgcmsiv_state_iv = 0,
+    ccgcmsiv_state_aad,
+    ccgcmsiv_state_text,
+    ccgcmsiv_state_done,
+};
+
+typedef struct ccgcmsiv_ctx_t {
+    const struct ccmode_gcmsiv *siv;
+    uint32_t    keyLength;
+    uint32_t    state;
+    uint8_t     nonce[CCGCMSIV_NONCE_SIZE];
+    uint32_t    nonceLength;
+    uint64_t    h[4][2];                /* H, H^2, H^3, H^4 in the POLYVAL field */
+    uint64_t    s[2];
+    uint8_t     buffer[CCGCMSIV_BLOCK];
+    uint32_t    bufferPos;
+    uint64_t    aadLength;
+    uint64_t    textLength;
+    uint8_t     tag[CCGCMSIV_TAG_SIZE];
+    uint8_t     expectedTag[CCGCMSIV_TAG_SIZE];
+    bool        haveTag;
+    bool        tagMatches;
+    bool        broken;                 /* non-contiguous output */
+    uint8_t     *pending;               /* the text so far, waiting for finalize */
+    size_t      pendingLength;
+    uint8_t     counter[CCGCMSIV_BLOCK];
+    uint8_t     keystream[CCGCMSIV_CTR_BATCH * CCGCMSIV_BLOCK];
+    uint32_t    keystreamPos;
+} ccgcmsiv_ctx;
+
+/* The master key schedule and the per-nonce encryption key schedule follow the header */
+#define CCGCMSIV_ROUND(n) (((n) + 15) & ~(size_t) 15)
+#define CCGCMSIV_KEY_ECB(c) ((ccecb_ctx *) ((uint8_t *) (c) + CCGCMSIV_ROUND(sizeof(ccgcmsiv_ctx))))
+#define CCGCMSIV_ENC_ECB(c) ((ccecb_ctx *) ((uint8_t *) CCGCMSIV_KEY_ECB(c) + CCGCMSIV_ROUND((c)->siv->ecb->size)))
+
+typedef void (*ccpolyval_blocks_f)(uint64_t s[2], const uint64_t h[4][2], const uint8_t *in, size_t nblocks);
+typedef void (*ccpolyval_mul_f)(uint64_t r[2], const uint64_t a[2], const uint64_t b[2]);
+
+static ccpolyval_blocks_f ccpolyval_blocks;
+static ccpolyval_mul_f ccpolyval_mul;
+
+static inline uint64_t ccgcmsiv_load64(const uint8_t *p)
+{
+    uint64_t v = 0;
+    for(int i = 7; i >= 0; i--) v = (v << 8) | p[i];
+    return v;
+}
+
+static inline void ccgcmsiv_store64(uint8_t *p, uint64_t v)
+{
+    for(int i = 0; i < 8; i++, v >>= 8) p[i] = (uint8_t) v;
+}
+
+#pragma mark POLYVAL
+
+/* Low 64 bits of the carryless product; the holes keep the integer carries out of the way */
+static inline uint64_t ccpolyval_bmul64(uint64_t x, uint64_t y)
+{
+    const uint64_t m0 = 0x1111111111111111ULL, m1 = 0x2222222222222222ULL;
+    const uint64_t m2 = 0x4444444444444444ULL, m3 = 0x8888888888888888ULL;
+    uint64_t x0 = x & m0, x1 = x & m1, x2 = x & m2, x3 = x & m3;
+    uint64_t y0 = y & m0, y1 = y & m1, y2 = y & m2, y3 = y & m3;
+    uint64_t z0 = (x0 * y0) ^ (x1 * y3) ^ (x2 * y2) ^ (x3 * y1);
+    uint64_t z1 = (x0 * y1) ^ (x1 * y0) ^ (x2 * y3) ^ (x3 * y2);
+    uint64_t z2 = (x0 * y2) ^ (x1 * y1) ^ (x2 * y0) ^ (x3 * y3);
+    uint64_t z3 = (x0 * y3) ^ (x1 * y2) ^ (x2 * y1) ^ (x3 * y0);
+    
+    return (z0 & m0) | (z1 & m1) | (z2 & m2) | (z3 & m3);
+}
+
+static inline uint64_t ccpolyval_rev64(uint64_t x)
+{
+    x = ((x & 0x5555555555555555ULL) << 1) | ((x >> 1) & 0x5555555555555555ULL);
+    x = ((x & 0x3333333333333333ULL) << 2) | ((x >> 2) & 0x3333333333333333ULL);
+    x = ((x & 0x0F0F0F0F0F0F0F0FULL) << 4) | ((x >> 4) & 0x0F0F0F0F0F0F0F0FULL);
+    x = ((x & 0x00FF00FF00FF00FFULL) << 8) | ((x >> 8) & 0x00FF00FF00FF00FFULL);
+    x = ((x & 0x0000FFFF0000FFFFULL) << 16) | ((x >> 16) & 0x0000FFFF0000FFFFULL);
+    return (x << 32) | (x >> 32);
+}
+
+static inline void ccpolyval_clmul64(uint64_t x, uint64_t y, uint64_t *lo, uint64_t *hi)
+{
+    *lo = ccpolyval_bmul64(x, y);
+    *hi = ccpolyval_rev64(ccpolyval_bmul64(ccpolyval_rev64(x), ccpolyval_rev64(y))) >> 1;
+}
+
+/*
+ * t * x^-128 mod x^128 + x^127 + x^126 + x^121 + 1, folding out the low
+ * word twice: adding t0 * P clears t0 since P is 1 mod x^64.
+ */
+
+static inline void ccpolyval_reduce(uint64_t r[2], uint64_t t0, uint64_t t1, uint64_t t2, uint64_t t3)
+{
+    uint64_t lo, hi;
+    
+    ccpolyval_clmul64(t0, CCGCMSIV_POLY, &lo, &hi);
+    t1 ^= lo; t2 ^= hi ^ t0;
+    ccpolyval_clmul64(t1, CCGCMSIV_POLY, &lo, &hi);
+    t2 ^= lo; t3 ^= hi ^ t1;
+    r[0] = t2; r[1] = t3;
+}
+
+static void ccpolyval_mul_portable(uint64_t r[2], const uint64_t a[2], const uint64_t b[2])
+{
+    uint64_t l0, l1, h0, h1, m0, m1, m2, m3;
+    
+    ccpolyval_clmul64(a[0], b[0], &l0, &l1);
+    ccpolyval_clmul64(a[1], b[1], &h0, &h1);
+    ccpolyval_clmul64(a[0], b[1], &m0, &m1);
+    ccpolyval_clmul64(a[1], b[0], &m2, &m3);
+    ccpolyval_reduce(r, l0, l1 ^ m0 ^ m2, h0 ^ m1 ^ m3, h1);
+}
+
+static void ccpolyval_blocks_portable(uint64_t s[2], const uint64_t h[4][2], const uint8_t *in, size_t nblocks)
+{
+    for(; nblocks; nblocks--, in += CCGCMSIV_BLOCK) {
+        s[0] ^= ccgcmsiv_load64(in);
+        s[1] ^= ccgcmsiv_load64(in + 8);
+        ccpolyval_mul_portable(s, s, h[0]);
+    }
+}
+
+#if CCGCMSIV_X86
+
+CCGCMSIV_PCLMUL static inline void ccpolyval_clmul128(__m128i a, __m128i b, __m128i *lo, __m128i *mid, __m128i *hi)
+{
+    *lo = _mm_xor_si128(*lo, _mm_clmulepi64_si128(a, b, 0x00));
+    *hi = _mm_xor_si128(*hi, _mm_clmulepi64_si128(a, b, 0x11));
+    *mid = _mm_xor_si128(*mid, _mm_xor_si128(_mm_clmulepi64_si128(a, b, 0x01), _mm_clmulepi64_si128(a, b, 0x10)));
+}
+
+/* The same two folds as ccpolyval_reduce, with the word shifts as a half swap */
+CCGCMSIV_PCLMUL static inline __m128i ccpolyval_reduce_pclmul(__m128i lo, __m128i mid, __m128i hi)
+{
+    const __m128i poly = _mm_set_epi64x(0, (long long) CCGCMSIV_POLY);
+    
+    lo = _mm_xor_si128(lo, _mm_slli_si128(mid, 8));
+    hi = _mm_xor_si128(hi, _mm_srli_si128(mid, 8));
+    lo = _mm_xor_si128(_mm_shuffle_epi32(lo, 0x4e), _mm_clmulepi64_si128(lo, poly, 0x00));
+    lo = _mm_xor_si128(_mm_shuffle_epi32(lo, 0x4e), _mm_clmulepi64_si128(lo, poly, 0x00));
+    return _mm_xor_si128(lo, hi);
+}
+
+CCGCMSIV_PCLMUL static void ccpolyval_mul_pclmul(uint64_t r[2], const uint64_t a[2], const uint64_t b[2])
+{
+    __m128i lo = _mm_setzero_si128(), mid = _mm_setzero_si128(), hi = _mm_setzero_si128();
+    
+    ccpolyval_clmul128(_mm_loadu_si128((const __m128i *) a), _mm_loadu_si128((const __m128i *) b), &lo, &mid, &hi);
+    _mm_storeu_si128((__m128i *) r, ccpolyval_reduce_pclmul(lo, mid, hi));
+}
+
+/* Four blocks against H^4..H, one reduction */
+CCGCMSIV_PCLMUL static void ccpolyval_blocks_pclmul(uint64_t s[2], const uint64_t h[4][2], const uint8_t *in, size_t nblocks)
+{
+    const __m128i h1 = _mm_loadu_si128((const __m128i *) h[0]), h2 = _mm_loadu_si128((const __m128i *) h[1]);
+    const __m128i h3 = _mm_loadu_si128((const __m128i *) h[2]), h4 = _mm_loadu_si128((const __m128i *) h[3]);
+    __m128i acc = _mm_loadu_si128((const __m128i *) s), lo, mid, hi;
+    
+    for(; nblocks >= 4; nblocks -= 4, in += 4 * CCGCMSIV_BLOCK) {
+        lo = mid = hi = _mm_setzero_si128();
+        ccpolyval_clmul128(_mm_xor_si128(acc, _mm_loadu_si128((const __m128i *) in)), h4, &lo, &mid, &hi);
+        ccpolyval_clmul128(_mm_loadu_si128((const __m128i *) (in + 16)), h3, &lo, &mid, &hi);
+        ccpolyval_clmul128(_mm_loadu_si128((const __m128i *) (in + 32)), h2, &lo, &mid, &hi);
+        ccpolyval_clmul128(_mm_loadu_si128((const __m128i *) (in + 48)), h1, &lo, &mid, &hi);
+        acc = ccpolyval_reduce_pclmul(lo, mid, hi);
+    }
+    for(; nblocks; nblocks--, in += CCGCMSIV_BLOCK) {
+        lo = mid = hi = _mm_setzero_si128();
+        ccpolyval_clmul128(_mm_xor_si128(acc, _mm_loadu_si128((const __m128i *) in)), h1, &lo, &mid, &hi);
+        acc = ccpolyval_reduce_pclmul(lo, mid, hi);
+    }
+    _mm_storeu_si128((__m128i *) s, acc);
+}
+
+#endif
+
+static void ccpolyval_select(void)
+{
+    static dispatch_once_t init;
+    
+    dispatch_once(&init, ^{
+        ccpolyval_blocks = ccpolyval_blocks_portable;
+        ccpolyval_mul = ccpolyval_mul_portable;
+#if CCGCMSIV_X86
+        unsigned int eax, ebx, ecx, edx;
+        
+        if(__get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_PCLMUL) && (edx & bit_SSE2)) {
+            ccpolyval_blocks = ccpolyval_blocks_pclmul;
+            ccpolyval_mul = ccpolyval_mul_pclmul;
+        }
+#endif
+    });
+}
+
+static void ccpolyval_update(ccgcmsiv_ctx *c, const uint8_t *in, size_t n)
+{
+    size_t want;
+    
+    if(c->bufferPos) {
+        want = CCGCMSIV_BLOCK - c->bufferPos;
+        if(want > n) want = n;
+        memcpy(c->buffer + c->bufferPos, in, want);
+        c->bufferPos += want; in += want; n -= want;
+        if(c->bufferPos < CCGCMSIV_BLOCK) return;
+        ccpolyval_blocks(c->s, (const uint64_t (*)[2]) c->h, c->buffer, 1);
+        c->bufferPos = 0;
+    }
+    if(n >= CCGCMSIV_BLOCK) {
+        ccpolyval_blocks(c->s, (const uint64_t (*)[2]) c->h, in, n / CCGCMSIV_BLOCK);
+        in += n & ~(size_t) 15; n &= 15;
+    }
+    if(n) {
+        memcpy(c->buffer, in, n);
+        c->bufferPos = (uint32_t) n;
+    }
+}
+
+static void ccpolyval_pad(ccgcmsiv_ctx *c)
+{
+    if(c->bufferPos == 0) return;
+    memset(c->buffer + c->bufferPos, 0, CCGCMSIV_BLOCK - c->bufferPos);
+    ccpolyval_blocks(c->s, (const uint64_t (*)[2]) c->h, c->buffer, 1);
+    c->bufferPos = 0;
+}
+
+#pragma mark CTR
+
+/* Counter blocks are the tag with the top bit set, counting in the low 32 bits, little endian */
+static void ccgcmsiv_ctr(ccgcmsiv_ctx *c, size_t n, const uint8_t *in, uint8_t *out)
+{
+    const struct ccmode_ecb *ecb = c->siv->ecb;
+    uint8_t counters[CCGCMSIV_CTR_BATCH * CCGCMSIV_BLOCK];
+    uint32_t ctr;
+    size_t i;
+    
+    while(n) {
+        if(c->keystreamPos == sizeof(c->keystream)) {
+            ctr = (uint32_t) c->counter[0] | ((uint32_t) c->counter[1] << 8) | ((uint32_t) c->counter[2] << 16) | ((uint32_t) c->counter[3] << 24);
+            for(i = 0; i < CCGCMSIV_CTR_BATCH; i++, ctr++) {
+                uint8_t *cb = counters + CCGCMSIV_BLOCK * i;
+                
+                memcpy(cb, c->counter, CCGCMSIV_BLOCK);
+                cb[0] = (uint8_t) ctr; cb[1] = (uint8_t) (ctr >> 8); cb[2] = (uint8_t) (ctr >> 16); cb[3] = (uint8_t) (ctr >> 24);
+            }
+            c->counter[0] = (uint8_t) ctr; c->counter[1] = (uint8_t) (ctr >> 8); c->counter[2] = (uint8_t) (ctr >> 16); c->counter[3] = (uint8_t) (ctr >> 24);
+            ecb->ecb(CCGCMSIV_ENC_ECB(c), CCGCMSIV_CTR_BATCH, counters, c->keystream);
+            c->keystreamPos = 0;
+        }
+        for(; n && c->keystreamPos < sizeof(c->keystream); n--) *out++ = *in++ ^ c->keystream[c->keystreamPos++];
+    }
+    memset(counters, 0, sizeof(counters));
+}
+
+#pragma mark Modes
+
+/* The nonce is complete: derive the POLYVAL and encryption keys from it */
+static void ccgcmsiv_start(ccgcmsiv_ctx *c)
+{
+    const struct ccmode_ecb *ecb = c->siv->ecb;
+    uint8_t in[6 * CCGCMSIV_BLOCK], out[6 * CCGCMSIV_BLOCK], keys[48];
+    uint32_t i, nkeys = (c->keyLength == 32) ? 6: 4;
+    
+    memset(in, 0, sizeof(in));
+    for(i = 0; i < nkeys; i++) {
+        in[CCGCMSIV_BLOCK * i] = (uint8_t) i;
+        memcpy(in + CCGCMSIV_BLOCK * i + 4, c->nonce, CCGCMSIV_NONCE_SIZE);
+    }
+    ecb->ecb(CCGCMSIV_KEY_ECB(c), nkeys, in, out);
+    for(i = 0; i < nkeys; i++) memcpy(keys + 8 * i, out + CCGCMSIV_BLOCK * i, 8);
+    
+    c->h[0][0] = ccgcmsiv_load64(keys);
+    c->h[0][1] = ccgcmsiv_load64(keys + 8);
+    for(i = 1; i < 4; i++) ccpolyval_mul(c->h[i], c->h[i - 1], c->h[0]);
+    ecb->init(ecb, CCGCMSIV_ENC_ECB(c), c->keyLength, keys + 16);
+    
+    c->s[0] = c->s[1] = 0;
+    c->bufferPos = 0;
+    c->aadLength = c->textLength = 0;
+    c->state = ccgcmsiv_state_aad;
+    if(c->siv->decrypt && c->haveTag) {
+        memcpy(c->counter, c->expectedTag, CCGCMSIV_BLOCK);
+        c->counter[15] |= 0x80;
+    }
+    c->keystreamPos = sizeof(c->keystream);
+    memset(in, 0, sizeof(in));
+    memset(out, 0, sizeof(out));
+    memset(keys, 0, sizeof(keys));
+}
+
+static void ccgcmsiv_reset(ccgcm_ctx *ctx)
+{
+    ccgcmsiv_ctx *c = (ccgcmsiv_ctx *) ctx;
+    
+    c->state = ccgcmsiv_state_iv;
+    c->nonceLength = 0;
+    memset(c->h, 0, sizeof(c->h));
+    memset(c->s, 0, sizeof(c->s));
+    memset(c->keystream, 0, sizeof(c->keystream));
+    c->keystreamPos = sizeof(c->keystream);
+    c->bufferPos = 0;
+    c->haveTag = c->tagMatches = c->broken = false;
+    c->pending = NULL;
+    c->pendingLength = 0;
+}
+
+static void ccgcmsiv_init(const struct ccmode_gcm *mode, ccgcm_ctx *ctx, unsigned long key_len, const void *key)
+{
+    ccgcmsiv_ctx *c = (ccgcmsiv_ctx *) ctx;
+    
+    ccpolyval_select();
+    c->siv = (const struct ccmode_gcmsiv *) mode;
+    c->keyLength = (uint32_t) key_len;
+    c->siv->ecb->init(c->siv->ecb, CCGCMSIV_KEY_ECB(c), key_len, key);
+    ccgcmsiv_reset(ctx);
+}
+
+static void ccgcmsiv_set_iv(ccgcm_ctx *ctx, size_t iv_size, const void *iv)
+{
+    ccgcmsiv_ctx *c = (ccgcmsiv_ctx *) ctx;
+    
+    /* RFC 8452 nonces are 12 bytes, given once */
+    if(c->state != ccgcmsiv_state_iv || c->nonceLength || iv_size != CCGCMSIV_NONCE_SIZE) return;
+    memcpy(c->nonce, iv, iv_size);
+    c->nonceLength = (uint32_t) iv_size;
+}
+
+static void ccgcmsiv_aad(ccgcm_ctx *ctx, unsigned long nbytes, const void *in)
+{
+    ccgcmsiv_ctx *c = (ccgcmsiv_ctx *) ctx;
+    
+    if(c->state == ccgcmsiv_state_iv && c->nonceLength) ccgcmsiv_start(c);
+    if(c->state != ccgcmsiv_state_aad) return;
+    ccpolyval_update(c, in, nbytes);
+    c->aadLength += nbytes;
+}
+
+static void ccgcmsiv_crypt(ccgcm_ctx *ctx, unsigned long nbytes, const void *in, void *out)
+{
+    ccgcmsiv_ctx *c = (ccgcmsiv_ctx *) ctx;
+    
+    if(c->state == ccgcmsiv_state_iv && c->nonceLength) ccgcmsiv_start(c);
+    if(c->state == ccgcmsiv_state_aad) {
+        ccpolyval_pad(c);
+        c->state = ccgcmsiv_state_text;
+    }
+    if(c->state != ccgcmsiv_state_text || !ccgcmsiv_can_crypt(ctx, out)) {
+        c->broken = true;
+        return;
+    }
+    c->textLength += nbytes;
+    /* Decrypting, nothing is released until finalize has checked the tag */
+    if(!c->siv->decrypt) ccpolyval_update(c, in, nbytes);
+    if(out != in) memmove(out, in, nbytes);
+    if(c->pending == NULL) c->pending = out;
+    c->pendingLength += nbytes;
+}
+
+static void ccgcmsiv_finalize(ccgcm_ctx *ctx, size_t tag_size, void *tag)
+{
+    ccgcmsiv_ctx *c = (ccgcmsiv_ctx *) ctx;
+    uint8_t s[CCGCMSIV_BLOCK];
+    uint8_t diff = 0;
+    int i;
+    
+    if(c->state == ccgcmsiv_state_iv && c->nonceLength) ccgcmsiv_start(c);
+    if(c->state == ccgcmsiv_state_iv) {
+        /* No nonce, no tag */
+        c->tagMatches = false;
+        memset(tag, 0, tag_size);
+        return;
+    }
+    if(c->state != ccgcmsiv_state_done) {
+        if(c->siv->decrypt && c->pending) {
+            ccgcmsiv_ctr(c, c->pendingLength, c->pending, c->pending);
+            ccpolyval_update(c, c->pending, c->pendingLength);
+        }
+        ccpolyval_pad(c);
+        ccgcmsiv_store64(s, c->aadLength * 8);
+        ccgcmsiv_store64(s + 8, c->textLength * 8);
+        ccpolyval_update(c, s, sizeof(s));
+        ccgcmsiv_store64(s, c->s[0]);
+        ccgcmsiv_store64(s + 8, c->s[1]);
+        for(i = 0; i < CCGCMSIV_NONCE_SIZE; i++) s[i] ^= c->nonce[i];
+        s[15] &= 0x7f;
+        c->siv->ecb->ecb(CCGCMSIV_ENC_ECB(c), 1, s, c->tag);
+        if(c->siv->decrypt) {
+            for(i = 0; i < CCGCMSIV_TAG_SIZE; i++) diff |= c->tag[i] ^ c->expectedTag[i];
+            c->tagMatches = c->haveTag && !c->broken && diff == 0;
+            if(!c->tagMatches && c->pending) memset(c->pending, 0, c->pendingLength);
+        } else if(c->pending) {
+            memcpy(c->counter, c->tag, CCGCMSIV_BLOCK);
+            c->counter[15] |= 0x80;
+            ccgcmsiv_ctr(c, c->pendingLength, c->pending, c->pending);
+        }
+        c->pending = NULL;
+        c->state = ccgcmsiv_state_done;
+        memset(s, 0, sizeof(s));
+    }
+    memcpy(tag, c->tag, (tag_size < sizeof(c->tag)) ? tag_size: sizeof(c->tag));
+}
+
+void ccgcmsiv_set_tag(ccgcm_ctx *ctx, size_t tag_size, const void *tag)
+{
+    ccgcmsiv_ctx *c = (ccgcmsiv_ctx *) ctx;
+    
+    if(!c->siv->decrypt || tag_size != CCGCMSIV_TAG_SIZE || c->state == ccgcmsiv_state_text || c->state == ccgcmsiv_state_done) return;
+    memcpy(c->expectedTag, tag, CCGCMSIV_TAG_SIZE);
+    c->haveTag = true;
+    /* set after the nonce went in: the counter starts from it now */
+    if(c->state == ccgcmsiv_state_aad) {
+        memcpy(c->counter, c->expectedTag, CCGCMSIV_BLOCK);
+        c->counter[15] |= 0x80;
+    }
+}
+
+bool ccgcmsiv_can_crypt(const ccgcm_ctx *ctx, const void *out)
+{
+    const ccgcmsiv_ctx *c = (const ccgcmsiv_ctx *) ctx;
+    
+    if(c->broken) return false;
+    if(c->siv->decrypt && !c->haveTag) return false;
+    return c->pending == NULL || c->pending + c->pendingLength == (const uint8_t *) out;
+}
+
+bool ccgcmsiv_has_nonce(const ccgcm_ctx *ctx)
+{
+    return ((const ccgcmsiv_ctx *) ctx)->nonceLength == CCGCMSIV_NONCE_SIZE;
+}
+
+bool ccgcmsiv_tag_matches(const ccgcm_ctx *ctx)
+{
+    return ((const ccgcmsiv_ctx *) ctx)->tagMatches;
+}
+
+static void ccmode_factory_gcmsiv(struct ccmode_gcmsiv *siv, const struct ccmode_ecb *ecb, bool decrypt)
+{
+    siv->gcm.size = CCGCMSIV_ROUND(sizeof(ccgcmsiv_ctx)) + 2 * CCGCMSIV_ROUND(ecb->size);
+    siv->gcm.block_size = 1;
+    siv->gcm.init = ccgcmsiv_init;
+    siv->gcm.set_iv = ccgcmsiv_set_iv;
+    siv->gcm.gmac = ccgcmsiv_aad;
+    siv->gcm.gcm = ccgcmsiv_crypt;
+    siv->gcm.finalize = ccgcmsiv_finalize;
+    siv->gcm.reset = ccgcmsiv_reset;
+    siv->ecb = ecb;
+    siv->decrypt = decrypt;
+}
+
+void ccmode_factory_gcmsiv_encrypt(struct ccmode_gcmsiv *siv, const struct ccmode_ecb *ecb)
+{
+    ccmode_factory_gcmsiv(siv, ecb, false);
+}
+
+void ccmode_factory_gcmsiv_decrypt(struct ccmode_gcmsiv *siv, const struct ccmode_ecb *ecb)
+{
+    ccmode_factory_gcmsiv(siv, ecb, true);
+}
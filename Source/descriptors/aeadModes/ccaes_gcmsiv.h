@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2013 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+/*
+ *  ccaes_gcmsiv.h
+ *  CommonCrypto
+ *
+ *  AES-GCM-SIV (RFC 8452) behind the corecrypto GCM mode interface, built
+ *  from an AES ECB object the way the corecrypto factories build theirs.
+ *  Keys are 16 or 32 bytes, the nonce exactly 12 (set once, and nothing
+ *  runs until it is) and the tag 16.
+ *
+ *  The tag is the IV of the CTR pass, so neither direction fully streams:
+ *  encrypt hashes the plaintext as it comes, copies it to the output and
+ *  encrypts that in place at finalize, so the output across calls has to be
+ *  one contiguous buffer.  Decrypt needs the tag before the ciphertext and
+ *  works the same way: the ciphertext is only copied until finalize, which
+ *  decrypts it in place and checks the tag, and wipes it if that fails.
+ *  Nothing from an unauthenticated message is ever released.
+ */
+
+#ifndef _CCAES_GCMSIV_H_
+#define _CCAES_GCMSIV_H_
+
+#include <stdbool.h>
+#include <corecrypto/ccmode.h>
+
+#define CCGCMSIV_NONCE_SIZE 12
+#define CCGCMSIV_TAG_SIZE   16
+
+struct ccmode_gcmsiv {
+    struct ccmode_gcm gcm;              /* must be first - this is what the mode descriptor sees */
+    const struct ccmode_ecb *ecb;
+    bool decrypt;
+};
+
+void ccmode_factory_gcmsiv_encrypt(struct ccmode_gcmsiv *siv, const struct ccmode_ecb *ecb);
+void ccmode_factory_gcmsiv_decrypt(struct ccmode_gcmsiv *siv, const struct ccmode_ecb *ecb);
+
+/* Decrypt only: the expected tag, before any ciphertext */
+void ccgcmsiv_set_tag(ccgcm_ctx *ctx, size_t tag_size, const void *tag);
+
+/* false if the next crypt call into out can't be done (see above) */
+bool ccgcmsiv_can_crypt(const ccgcm_ctx *ctx, const void *out);
+
+/* Whether the 12 byte nonce has been set */
+bool ccgcmsiv_has_nonce(const ccgcm_ctx *ctx);
+
+/* Decrypt only, after finalize: whether the computed tag matched the one set */
+bool ccgcmsiv_tag_matches(const ccgcm_ctx *ctx);
+
+#endif /* _CCAES_GCMSIV_H_ */
@@ -0,0 +1,582 @@
+/*
+ * Copyright (c) 2013 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+/*
+ *  ccchacha20poly1305.c
+ *  CommonCrypto
+ *
+ *  ChaCha20 runs 4 blocks at a time on SSE2 and NEON and 8 on AVX2, one
+ *  32 bit word of every block per vector lane; Poly1305 is the 26 bit limb
+ *  version, which needs nothing wider than 32x32->64 multiplies.
+ */
+
+#include "ccchacha20poly1305.h"
+#include <string.h>
+#include <stdbool.h>
+#include <dispatch/dispatch.h>
+
+#if defined (__x86_64__) || defined(__i386__)		// x86_64 or i386 architectures
+#include <cpuid.h>
+#include <immintrin.h>
+#define CCCHACHA_X86 1
+#define CCCHACHA_SSE2   __attribute__((target("sse2")))
+#define CCCHACHA_AVX2   __attribute__((target("avx2")))
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define CCCHACHA_NEON 1
+#endif
+
+#define CCCHACHA_BLOCK  64
+#define CCCHACHA_STRIDE 4096    /* cipher and MAC alternate over this much */
+
+enum {
+    ccchachapoly_state_iv = 0,
+    ccchachapoly_state_aad,
+    ccchachapoly_state_text,
+    ccchachapoly_state_done,
+};
+
+typedef struct ccchachapoly_ctx_t {
+    uint32_t    key[8];
+    uint32_t    nonce[3];
+    uint32_t    counter;
+    uint8_t     iv[CCCHACHA20_NONCE_SIZE];
+    uint32_t    ivLength;
+    uint32_t    state;
+    uint32_t    decrypt;
+    uint8_t     keystream[CCCHACHA_BLOCK];
+    uint32_t    keystreamPos;
+    /* Poly1305 */
+    uint32_t    r[5];
+    uint32_t    h[5];
+    uint32_t    pad[4];
+    uint8_t     buffer[16];
+    uint32_t    bufferPos;
+    uint64_t    aadLength;
+    uint64_t    textLength;
+    uint8_t     tag[CCPOLY1305_TAG_SIZE];
+} ccchachapoly_ctx;
+
+/* Runs nblocks of keystream over in and advances the block counter in input[12] */
+typedef void (*ccchacha_blocks_f)(uint32_t input[16], size_t nblocks, const uint8_t *in, uint8_t *out);
+
+static ccchacha_blocks_f ccchacha_blocks;
+
+static inline uint32_t ccchacha_load32(const uint8_t *p)
+{
+    return (uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static inline void ccchacha_store32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t) v; p[1] = (uint8_t) (v >> 8); p[2] = (uint8_t) (v >> 16); p[3] = (uint8_t) (v >> 24);
+}
+
+static inline void ccchacha_store64(uint8_t *p, uint64_t v)
+{
+    ccchacha_store32(p, (uint32_t) v);
+    ccchacha_store32(p + 4, (uint32_t) (v >> 32));
+}
+
+#pragma mark ChaCha20
+
+#define CCCHACHA_ROTL(v, n) (((v) << (n)) | ((v) >> (32 - (n))))
+
+#define CCCHACHA_QR(a, b, c, d) \
+    a += b; d ^= a; d = CCCHACHA_ROTL(d, 16); \
+    c += d; b ^= c; b = CCCHACHA_ROTL(b, 12); \
+    a += b; d ^= a; d = CCCHACHA_ROTL(d, 8);  \
+    c += d; b ^= c; b = CCCHACHA_ROTL(b, 7);
+
+/* The column and diagonal rounds over 16 words of any type QR takes */
+#define CCCHACHA_DOUBLEROUNDS(QR, x) \
+    for(int _r = 0; _r < 10; _r++) { \
+        QR(x[0], x[4], x[8],  x[12]) QR(x[1], x[5], x[9],  x[13]) \
+        QR(x[2], x[6], x[10], x[14]) QR(x[3], x[7], x[11], x[15]) \
+        QR(x[0], x[5], x[10], x[15]) QR(x[1], x[6], x[11], x[12]) \
+        QR(x[2], x[7], x[8],  x[13]) QR(x[3], x[4], x[9],  x[14]) \
+    }
+
+static void ccchacha_input(const ccchachapoly_ctx *c, uint32_t input[16])
+{
+    input[0] = 0x61707865; input[1] = 0x3320646e; input[2] = 0x79622d32; input[3] = 0x6b206574;
+    memcpy(input + 4, c->key, sizeof(c->key));
+    input[12] = c->counter;
+    memcpy(input + 13, c->nonce, sizeof(c->nonce));
+}
+
+static void ccchacha_blocks_portable(uint32_t input[16], size_t nblocks, const uint8_t *in, uint8_t *out)
+{
+    uint32_t x[16];
+    int i;
+    
+    for(; nblocks; nblocks--, in += CCCHACHA_BLOCK, out += CCCHACHA_BLOCK) {
+        memcpy(x, input, sizeof(x));
+        CCCHACHA_DOUBLEROUNDS(CCCHACHA_QR, x)
+        for(i = 0; i < 16; i++) ccchacha_store32(out + 4 * i, ccchacha_load32(in + 4 * i) ^ (x[i] + input[i]));
+        input[12]++;
+    }
+    memset(x, 0, sizeof(x));
+}
+
+#if CCCHACHA_X86
+
+#define CCCHACHA_ROTL128(v, n) _mm_or_si128(_mm_slli_epi32(v, n), _mm_srli_epi32(v, 32 - (n)))
+
+#define CCCHACHA_QR128(a, b, c, d) \
+    a = _mm_add_epi32(a, b); d = _mm_xor_si128(d, a); d = CCCHACHA_ROTL128(d, 16); \
+    c = _mm_add_epi32(c, d); b = _mm_xor_si128(b, c); b = CCCHACHA_ROTL128(b, 12); \
+    a = _mm_add_epi32(a, b); d = _mm_xor_si128(d, a); d = CCCHACHA_ROTL128(d, 8);  \
+    c = _mm_add_epi32(c, d); b = _mm_xor_si128(b, c); b = CCCHACHA_ROTL128(b, 7);
+
+CCCHACHA_SSE2 static void ccchacha_blocks_sse2(uint32_t input[16], size_t nblocks, const uint8_t *in, uint8_t *out)
+{
+    __m128i s[16], x[16], t0, t1, t2, t3, b[4];
+    int i, j, g;
+    
+    for(; nblocks >= 4; nblocks -= 4, in += 4 * CCCHACHA_BLOCK, out += 4 * CCCHACHA_BLOCK) {
+        for(i = 0; i < 16; i++) x[i] = s[i] = _mm_set1_epi32((int) input[i]);
+        x[12] = s[12] = _mm_add_epi32(s[12], _mm_set_epi32(3, 2, 1, 0));
+        CCCHACHA_DOUBLEROUNDS(CCCHACHA_QR128, x)
+        /* Lane j holds block j - transpose each group of four words back into the blocks */
+        for(g = 0; g < 4; g++) {
+            t0 = _mm_unpacklo_epi32(_mm_add_epi32(x[4 * g], s[4 * g]), _mm_add_epi32(x[4 * g + 1], s[4 * g + 1]));
+            t1 = _mm_unpacklo_epi32(_mm_add_epi32(x[4 * g + 2], s[4 * g + 2]), _mm_add_epi32(x[4 * g + 3], s[4 * g + 3]));
+            t2 = _mm_unpackhi_epi32(_mm_add_epi32(x[4 * g], s[4 * g]), _mm_add_epi32(x[4 * g + 1], s[4 * g + 1]));
+            t3 = _mm_unpackhi_epi32(_mm_add_epi32(x[4 * g + 2], s[4 * g + 2]), _mm_add_epi32(x[4 * g + 3], s[4 * g + 3]));
+            b[0] = _mm_unpacklo_epi64(t0, t1);
+            b[1] = _mm_unpackhi_epi64(t0, t1);
+            b[2] = _mm_unpacklo_epi64(t2, t3);
+            b[3] = _mm_unpackhi_epi64(t2, t3);
+            for(j = 0; j < 4; j++) {
+                const uint8_t *ip = in + CCCHACHA_BLOCK * j + 16 * g;
+                _mm_storeu_si128((__m128i *) (out + CCCHACHA_BLOCK * j + 16 * g), _mm_xor_si128(_mm_loadu_si128((const __m128i *) ip), b[j]));
+            }
+        }
+        input[12] += 4;
+    }
+    if(nblocks) ccchacha_blocks_portable(input, nblocks, in, out);
+}
+
+#define CCCHACHA_ROTL256(v, n) _mm256_or_si256(_mm256_slli_epi32(v, n), _mm256_srli_epi32(v, 32 - (n)))
+
+/* 16 and 8 bit rotates are byte shuffles */
+#define CCCHACHA_QR256(a, b, c, d) \
+    a = _mm256_add_epi32(a, b); d = _mm256_shuffle_epi8(_mm256_xor_si256(d, a), rot16); \
+    c = _mm256_add_epi32(c, d); b = _mm256_xor_si256(b, c); b = CCCHACHA_ROTL256(b, 12); \
+    a = _mm256_add_epi32(a, b); d = _mm256_shuffle_epi8(_mm256_xor_si256(d, a), rot8); \
+    c = _mm256_add_epi32(c, d); b = _mm256_xor_si256(b, c); b = CCCHACHA_ROTL256(b, 7);
+
+CCCHACHA_AVX2 static void ccchacha_blocks_avx2(uint32_t input[16], size_t nblocks, const uint8_t *in, uint8_t *out)
+{
+    const __m256i rot16 = _mm256_setr_epi8(2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13,
+                                           2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13);
+    const __m256i rot8 = _mm256_setr_epi8(3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14,
+                                          3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14);
+    __m256i s[16], x[16], w[4], t0, t1, t2, t3, b;
+    int i, j, g;
+    
+    for(; nblocks >= 8; nblocks -= 8, in += 8 * CCCHACHA_BLOCK, out += 8 * CCCHACHA_BLOCK) {
+        for(i = 0; i < 16; i++) x[i] = s[i] = _mm256_set1_epi32((int) input[i]);
+        x[12] = s[12] = _mm256_add_epi32(s[12], _mm256_set_epi32(7, 6, 5, 4, 3, 2, 1, 0));
+        CCCHACHA_DOUBLEROUNDS(CCCHACHA_QR256, x)
+        /* The unpacks work within 128 bit halves: low half ends up block j, high half block j + 4 */
+        for(g = 0; g < 4; g++) {
+            for(i = 0; i < 4; i++) w[i] = _mm256_add_epi32(x[4 * g + i], s[4 * g + i]);
+            t0 = _mm256_unpacklo_epi32(w[0], w[1]);
+            t1 = _mm256_unpacklo_epi32(w[2], w[3]);
+            t2 = _mm256_unpackhi_epi32(w[0], w[1]);
+            t3 = _mm256_unpackhi_epi32(w[2], w[3]);
+            for(j = 0; j < 4; j++) {
+                const uint8_t *ip = in + CCCHACHA_BLOCK * j + 16 * g;
+                uint8_t *op = out + CCCHACHA_BLOCK * j + 16 * g;
+                
+                switch(j) {
+                    case 0: b = _mm256_unpacklo_epi64(t0, t1); break;
+                    case 1: b = _mm256_unpackhi_epi64(t0, t1); break;
+                    case 2: b = _mm256_unpacklo_epi64(t2, t3); break;
+                    default: b = _mm256_unpackhi_epi64(t2, t3); break;
+                }
+                _mm_storeu_si128((__m128i *) op, _mm_xor_si128(_mm_loadu_si128((const __m128i *) ip), _mm256_castsi256_si128(b)));
+                _mm_storeu_si128((__m128i *) (op + 4 * CCCHACHA_BLOCK),
+                                 _mm_xor_si128(_mm_loadu_si128((const __m128i *) (ip + 4 * CCCHACHA_BLOCK)), _mm256_extracti128_si256(b, 1)));
+            }
+        }
+        input[12] += 8;
+    }
+    if(nblocks) ccchacha_blocks_sse2(input, nblocks, in, out);
+}
+
+#elif CCCHACHA_NEON
+
+#define CCCHACHA_ROTLNEON(v, n) vsriq_n_u32(vshlq_n_u32(v, n), v, 32 - (n))
+
+#define CCCHACHA_QRNEON(a, b, c, d) \
+    a = vaddq_u32(a, b); d = veorq_u32(d, a); d = vreinterpretq_u32_u16(vrev32q_u16(vreinterpretq_u16_u32(d))); \
+    c = vaddq_u32(c, d); b = veorq_u32(b, c); b = CCCHACHA_ROTLNEON(b, 12); \
+    a = vaddq_u32(a, b); d = veorq_u32(d, a); d = CCCHACHA_ROTLNEON(d, 8); \
+    c = vaddq_u32(c, d); b = veorq_u32(b, c); b = CCCHACHA_ROTLNEON(b, 7);
+
+static void ccchacha_blocks_neon(uint32_t input[16], size_t nblocks, const uint8_t *in, uint8_t *out)
+{
+    static const uint32_t lanes[4] = { 0, 1, 2, 3 };
+    uint32x4_t s[16], x[16], w[4], b[4];
+    uint32x4x2_t t01, t23;
+    int i, j, g;
+    
+    for(; nblocks >= 4; nblocks -= 4, in += 4 * CCCHACHA_BLOCK, out += 4 * CCCHACHA_BLOCK) {
+        for(i = 0; i < 16; i++) x[i] = s[i] = vdupq_n_u32(input[i]);
+        x[12] = s[12] = vaddq_u32(s[12], vld1q_u32(lanes));
+        CCCHACHA_DOUBLEROUNDS(CCCHACHA_QRNEON, x)
+        for(g = 0; g < 4; g++) {
+            for(i = 0; i < 4; i++) w[i] = vaddq_u32(x[4 * g + i], s[4 * g + i]);
+            t01 = vtrnq_u32(w[0], w[1]);
+            t23 = vtrnq_u32(w[2], w[3]);
+            b[0] = vcombine_u32(vget_low_u32(t01.val[0]), vget_low_u32(t23.val[0]));
+            b[1] = vcombine_u32(vget_low_u32(t01.val[1]), vget_low_u32(t23.val[1]));
+            b[2] = vcombine_u32(vget_high_u32(t01.val[0]), vget_high_u32(t23.val[0]));
+            b[3] = vcombine_u32(vget_high_u32(t01.val[1]), vget_high_u32(t23.val[1]));
+            for(j = 0; j < 4; j++) {
+                const uint8_t *ip = in + CCCHACHA_BLOCK * j + 16 * g;
+                vst1q_u8(out + CCCHACHA_BLOCK * j + 16 * g, veorq_u8(vld1q_u8(ip), vreinterpretq_u8_u32(b[j])));
+            }
+        }
+        input[12] += 4;
+    }
+    if(nblocks) ccchacha_blocks_portable(input, nblocks, in, out);
+}
+
+#endif
+
+static void ccchacha_select(void)
+{
+    static dispatch_once_t init;
+    
+    dispatch_once(&init, ^{
+        ccchacha_blocks = ccchacha_blocks_portable;
+#if CCCHACHA_X86
+        unsigned int eax, ebx, ecx, edx;
+        
+        if(__get_cpuid(1, &eax, &ebx, &ecx, &edx) && (edx & bit_SSE2)) {
+            ccchacha_blocks = ccchacha_blocks_sse2;
+            if((ecx & bit_OSXSAVE) && __get_cpuid_max(0, NULL) >= 7) {
+                uint32_t xcr0, xcr0hi;
+                
+                __asm__ volatile("xgetbv" : "=a"(xcr0), "=d"(xcr0hi) : "c"(0));
+                __cpuid_count(7, 0, eax, ebx, ecx, edx);
+                if((ebx & bit_AVX2) && (xcr0 & 0x6) == 0x6) ccchacha_blocks = ccchacha_blocks_avx2;
+            }
+        }
+#elif CCCHACHA_NEON
+        ccchacha_blocks = ccchacha_blocks_neon;
+#endif
+    });
+}
+
+/* XOR n bytes of keystream, carrying a part used block across calls */
+static void ccchacha_crypt(ccchachapoly_ctx *c, size_t n, const uint8_t *in, uint8_t *out)
+{
+    uint32_t input[16];
+    size_t nblocks;
+    
+    for(; n && c->keystreamPos < CCCHACHA_BLOCK; n--) *out++ = *in++ ^ c->keystream[c->keystreamPos++];
+    if(n == 0) return;
+    ccchacha_input(c, input);
+    if((nblocks = n / CCCHACHA_BLOCK) != 0) {
+        ccchacha_blocks(input, nblocks, in, out);
+        in += CCCHACHA_BLOCK * nblocks; out += CCCHACHA_BLOCK * nblocks; n -= CCCHACHA_BLOCK * nblocks;
+    }
+    if(n) {
+        memset(c->keystream, 0, sizeof(c->keystream));
+        ccchacha_blocks(input, 1, c->keystream, c->keystream);
+        for(c->keystreamPos = 0; n; n--) *out++ = *in++ ^ c->keystream[c->keystreamPos++];
+    }
+    c->counter = input[12];
+    memset(input, 0, sizeof(input));
+}
+
+#pragma mark Poly1305
+
+static void ccpoly_init(ccchachapoly_ctx *c, const uint8_t key[32])
+{
+    c->r[0] = (ccchacha_load32(key +  0)     ) & 0x3ffffff;
+    c->r[1] = (ccchacha_load32(key +  3) >> 2) & 0x3ffff03;
+    c->r[2] = (ccchacha_load32(key +  6) >> 4) & 0x3ffc0ff;
+    c->r[3] = (ccchacha_load32(key +  9) >> 6) & 0x3f03fff;
+    c->r[4] = (ccchacha_load32(key + 12) >> 8) & 0x00fffff;
+    for(int i = 0; i < 4; i++) c->pad[i] = ccchacha_load32(key + 16 + 4 * i);
+    memset(c->h, 0, sizeof(c->h));
+    c->bufferPos = 0;
+}
+
+static void ccpoly_blocks(ccchachapoly_ctx *c, const uint8_t *m, size_t nbytes, uint32_t hibit)
+{
+    const uint32_t r0 = c->r[0], r1 = c->r[1], r2 = c->r[2], r3 = c->r[3], r4 = c->r[4];
+    const uint32_t s1 = r1 * 5, s2 = r2 * 5, s3 = r3 * 5, s4 = r4 * 5;
+    uint32_t h0 = c->h[0], h1 = c->h[1], h2 = c->h[2], h3 = c->h[3], h4 = c->h[4];
+    uint64_t d0, d1, d2, d3, d4;
+    uint32_t carry;
+    
+    for(; nbytes >= 16; nbytes -= 16, m += 16) {
+        h0 += (ccchacha_load32(m +  0)     ) & 0x3ffffff;
+        h1 += (ccchacha_load32(m +  3) >> 2) & 0x3ffffff;
+        h2 += (ccchacha_load32(m +  6) >> 4) & 0x3ffffff;
+        h3 += (ccchacha_load32(m +  9) >> 6) & 0x3ffffff;
+        h4 += (ccchacha_load32(m + 12) >> 8) | hibit;
+        
+        d0 = (uint64_t) h0 * r0 + (uint64_t) h1 * s4 + (uint64_t) h2 * s3 + (uint64_t) h3 * s2 + (uint64_t) h4 * s1;
+        d1 = (uint64_t) h0 * r1 + (uint64_t) h1 * r0 + (uint64_t) h2 * s4 + (uint64_t) h3 * s3 + (uint64_t) h4 * s2;
+        d2 = (uint64_t) h0 * r2 + (uint64_t) h1 * r1 + (uint64_t) h2 * r0 + (uint64_t) h3 * s4 + (uint64_t) h4 * s3;
+        d3 = (uint64_t) h0 * r3 + (uint64_t) h1 * r2 + (uint64_t) h2 * r1 + (uint64_t) h3 * r0 + (uint64_t) h4 * s4;
+        d4 = (uint64_t) h0 * r4 + (uint64_t) h1 * r3 + (uint64_t) h2 * r2 + (uint64_t) h3 * r1 + (uint64_t) h4 * r0;
+        
+        carry = (uint32_t) (d0 >> 26); h0 = (uint32_t) d0 & 0x3ffffff;
+        d1 += carry; carry = (uint32_t) (d1 >> 26); h1 = (uint32_t) d1 & 0x3ffffff;
+        d2 += carry; carry = (uint32_t) (d2 >> 26); h2 = (uint32_t) d2 & 0x3ffffff;
+        d3 += carry; carry = (uint32_t) (d3 >> 26); h3 = (uint32_t) d3 & 0x3ffffff;
+        d4 += carry; carry = (uint32_t) (d4 >> 26); h4 = (uint32_t) d4 & 0x3ffffff;
+        h0 += carry * 5; carry = h0 >> 26; h0 &= 0x3ffffff;
+        h1 += carry;
+    }
+    c->h[0] = h0; c->h[1] = h1; c->h[2] = h2; c->h[3] = h3; c->h[4] = h4;
+}
+
+static void ccpoly_update(ccchachapoly_ctx *c, const uint8_t *m, size_t n)
+{
+    size_t want;
+    
+    if(c->bufferPos) {
+        want = 16 - c->bufferPos;
+        if(want > n) want = n;
+        memcpy(c->buffer + c->bufferPos, m, want);
+        c->bufferPos += want; m += want; n -= want;
+        if(c->bufferPos < 16) return;
+        ccpoly_blocks(c, c->buffer, 16, 1 << 24);
+        c->bufferPos = 0;
+    }
+    if(n >= 16) {
+        ccpoly_blocks(c, m, n & ~(size_t) 15, 1 << 24);
+        m += n & ~(size_t) 15; n &= 15;
+    }
+    if(n) {
+        memcpy(c->buffer, m, n);
+        c->bufferPos = (uint32_t) n;
+    }
+}
+
+/* The AEAD construction zero pads the AAD and the text to whole blocks */
+static void ccpoly_pad(ccchachapoly_ctx *c)
+{
+    if(c->bufferPos == 0) return;
+    memset(c->buffer + c->bufferPos, 0, 16 - c->bufferPos);
+    ccpoly_blocks(c, c->buffer, 16, 1 << 24);
+    c->bufferPos = 0;
+}
+
+static void ccpoly_finish(ccchachapoly_ctx *c, uint8_t mac[16])
+{
+    uint32_t h0 = c->h[0], h1 = c->h[1], h2 = c->h[2], h3 = c->h[3], h4 = c->h[4];
+    uint32_t g0, g1, g2, g3, g4, carry, mask;
+    uint64_t f;
+    
+    carry = h1 >> 26; h1 &= 0x3ffffff;
+    h2 += carry; carry = h2 >> 26; h2 &= 0x3ffffff;
+    h3 += carry; carry = h3 >> 26; h3 &= 0x3ffffff;
+    h4 += carry; carry = h4 >> 26; h4 &= 0x3ffffff;
+    h0 += carry * 5; carry = h0 >> 26; h0 &= 0x3ffffff;
+    h1 += carry;
+    
+    /* h - p, kept if it didn't go negative */
+    g0 = h0 + 5; carry = g0 >> 26; g0 &= 0x3ffffff;
+    g1 = h1 + carry; carry = g1 >> 26; g1 &= 0x3ffffff;
+    g2 = h2 + carry; carry = g2 >> 26; g2 &= 0x3ffffff;
+    g3 = h3 + carry; carry = g3 >> 26; g3 &= 0x3ffffff;
+    g4 = h4 + carry - (1 << 26);
+    mask = (g4 >> 31) - 1;
+    h0 = (h0 & ~mask) | (g0 & mask);
+    h1 = (h1 & ~mask) | (g1 & mask);
+    h2 = (h2 & ~mask) | (g2 & mask);
+    h3 = (h3 & ~mask) | (g3 & mask);
+    h4 = (h4 & ~mask) | (g4 & mask);
+    
+    h0 = h0 | (h1 << 26);
+    h1 = (h1 >> 6) | (h2 << 20);
+    h2 = (h2 >> 12) | (h3 << 14);
+    h3 = (h3 >> 18) | (h4 << 8);
+    
+    f = (uint64_t) h0 + c->pad[0];             ccchacha_store32(mac, (uint32_t) f);
+    f = (uint64_t) h1 + c->pad[1] + (f >> 32); ccchacha_store32(mac + 4, (uint32_t) f);
+    f = (uint64_t) h2 + c->pad[2] + (f >> 32); ccchacha_store32(mac + 8, (uint32_t) f);
+    f = (uint64_t) h3 + c->pad[3] + (f >> 32); ccchacha_store32(mac + 12, (uint32_t) f);
+}
+
+#pragma mark Modes
+
+static struct ccmode_gcm ccchachapoly_encrypt;
+static struct ccmode_gcm ccchachapoly_decrypt;
+
+/* The IV is in: key Poly1305 from block 0, the message starts at block 1 */
+static void ccchachapoly_start(ccchachapoly_ctx *c)
+{
+    uint8_t polyKey[CCCHACHA_BLOCK];
+    uint32_t input[16];
+    
+    for(int i = 0; i < 3; i++) c->nonce[i] = ccchacha_load32(c->iv + 4 * i);
+    c->counter = 0;
+    ccchacha_input(c, input);
+    memset(polyKey, 0, sizeof(polyKey));
+    ccchacha_blocks_portable(input, 1, polyKey, polyKey);
+    ccpoly_init(c, polyKey);
+    c->counter = 1;
+    c->keystreamPos = CCCHACHA_BLOCK;
+    c->aadLength = c->textLength = 0;
+    c->state = ccchachapoly_state_aad;
+    memset(polyKey, 0, sizeof(polyKey));
+    memset(input, 0, sizeof(input));
+}
+
+static void ccchachapoly_reset(ccgcm_ctx *ctx)
+{
+    ccchachapoly_ctx *c = (ccchachapoly_ctx *) ctx;
+    
+    c->ivLength = 0;
+    c->state = ccchachapoly_state_iv;
+    c->keystreamPos = CCCHACHA_BLOCK;
+    memset(c->keystream, 0, sizeof(c->keystream));
+    memset(c->h, 0, sizeof(c->h));
+    memset(c->r, 0, sizeof(c->r));
+    memset(c->pad, 0, sizeof(c->pad));
+    c->bufferPos = 0;
+}
+
+static void ccchachapoly_init(const struct ccmode_gcm *mode, ccgcm_ctx *ctx, unsigned long key_len, const void *key)
+{
+    ccchachapoly_ctx *c = (ccchachapoly_ctx *) ctx;
+    
+    ccchacha_select();
+    for(int i = 0; i < 8; i++) c->key[i] = ccchacha_load32((const uint8_t *) key + 4 * i);
+    c->decrypt = (mode == &ccchachapoly_decrypt);
+    ccchachapoly_reset(ctx);
+}
+
+static void ccchachapoly_set_iv(ccgcm_ctx *ctx, size_t iv_size, const void *iv)
+{
+    ccchachapoly_ctx *c = (ccchachapoly_ctx *) ctx;
+    
+    /* RFC 8439 nonces are 12 bytes, given once */
+    if(c->state != ccchachapoly_state_iv || c->ivLength || iv_size != CCCHACHA20_NONCE_SIZE) return;
+    memcpy(c->iv, iv, iv_size);
+    c->ivLength = (uint32_t) iv_size;
+}
+
+bool ccchacha20poly1305_has_nonce(const ccgcm_ctx *ctx)
+{
+    return ((const ccchachapoly_ctx *) ctx)->ivLength == CCCHACHA20_NONCE_SIZE;
+}
+
+static void ccchachapoly_aad(ccgcm_ctx *ctx, unsigned long nbytes, const void *in)
+{
+    ccchachapoly_ctx *c = (ccchachapoly_ctx *) ctx;
+    
+    if(c->state == ccchachapoly_state_iv && c->ivLength) ccchachapoly_start(c);
+    if(c->state != ccchachapoly_state_aad) return;
+    ccpoly_update(c, in, nbytes);
+    c->aadLength += nbytes;
+}
+
+static void ccchachapoly_crypt(ccgcm_ctx *ctx, unsigned long nbytes, const void *in, void *out)
+{
+    ccchachapoly_ctx *c = (ccchachapoly_ctx *) ctx;
+    const uint8_t *ip = in;
+    uint8_t *op = out;
+    size_t n;
+    
+    if(c->state == ccchachapoly_state_iv && c->ivLength) ccchachapoly_start(c);
+    if(c->state == ccchachapoly_state_aad) {
+        ccpoly_pad(c);
+        c->state = ccchachapoly_state_text;
+    }
+    if(c->state != ccchachapoly_state_text) return;
+    c->textLength += nbytes;
+    /* The MAC is over the ciphertext - before decrypting, after encrypting */
+    for(; nbytes; nbytes -= n, ip += n, op += n) {
+        n = (nbytes < CCCHACHA_STRIDE) ? nbytes: CCCHACHA_STRIDE;
+        if(c->decrypt) ccpoly_update(c, ip, n);
+        ccchacha_crypt(c, n, ip, op);
+        if(!c->decrypt) ccpoly_update(c, op, n);
+    }
+}
+
+static void ccchachapoly_finalize(ccgcm_ctx *ctx, size_t tag_size, void *tag)
+{
+    ccchachapoly_ctx *c = (ccchachapoly_ctx *) ctx;
+    uint8_t lengths[16];
+    
+    if(c->state == ccchachapoly_state_iv && c->ivLength) ccchachapoly_start(c);
+    if(c->state == ccchachapoly_state_iv) {
+        /* No nonce, no tag */
+        memset(tag, 0, tag_size);
+        return;
+    }
+    if(c->state != ccchachapoly_state_done) {
+        ccpoly_pad(c);
+        ccchacha_store64(lengths, c->aadLength);
+        ccchacha_store64(lengths + 8, c->textLength);
+        ccpoly_update(c, lengths, sizeof(lengths));
+        ccpoly_finish(c, c->tag);
+        c->state = ccchachapoly_state_done;
+    }
+    memcpy(tag, c->tag, (tag_size < sizeof(c->tag)) ? tag_size: sizeof(c->tag));
+}
+
+static struct ccmode_gcm ccchachapoly_encrypt = {
+    .size = sizeof(ccchachapoly_ctx),
+    .block_size = 1,
+    .init = ccchachapoly_init,
+    .set_iv = ccchachapoly_set_iv,
+    .gmac = ccchachapoly_aad,
+    .gcm = ccchachapoly_crypt,
+    .finalize = ccchachapoly_finalize,
+    .reset = ccchachapoly_reset,
+};
+
+static struct ccmode_gcm ccchachapoly_decrypt = {
+    .size = sizeof(ccchachapoly_ctx),
+    .block_size = 1,
+    .init = ccchachapoly_init,
+    .set_iv = ccchachapoly_set_iv,
+    .gmac = ccchachapoly_aad,
+    .gcm = ccchachapoly_crypt,
+    .finalize = ccchachapoly_finalize,
+    .reset = ccchachapoly_reset,
+};
+
+struct ccmode_gcm *ccchacha20poly1305_encrypt_mode(void)
+{
+    return &ccchachapoly_encrypt;
+}
+
+struct ccmode_gcm *ccchacha20poly1305_decrypt_mode(void)
+{
+    return &ccchachapoly_decrypt;
+}
@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2013 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+/*
+ *  ccchacha20poly1305.h
+ *  CommonCrypto
+ *
+ *  ChaCha20-Poly1305 (RFC 7539) behind the corecrypto GCM mode interface,
+ *  so it runs through the ccgcm_mode descriptor and the CCCryptorGCM calls.
+ *  The nonce is 12 bytes, set once; nothing runs until it is.  Tags are
+ *  16 bytes.
+ */
+
+#ifndef _CCCHACHA20POLY1305_H_
+#define _CCCHACHA20POLY1305_H_
+
+#include <stdbool.h>
+#include <corecrypto/ccmode.h>
+
+#define CCCHACHA20_KEY_SIZE     32
+#define CCCHACHA20_NONCE_SIZE   12
+#define CCPOLY1305_TAG_SIZE     16
+
+struct ccmode_gcm *ccchacha20poly1305_encrypt_mode(void);
+struct ccmode_gcm *ccchacha20poly1305_decrypt_mode(void);
+
+/* Whether the 12 byte nonce has been set */
+bool ccchacha20poly1305_has_nonce(const ccgcm_ctx *ctx);
+
+#endif /* _CCCHACHA20POLY1305_H_ */
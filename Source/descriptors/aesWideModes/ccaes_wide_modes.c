@@ -0,0 +1,1323 @@
+/*
+ * Copyright (c) 2013 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+/*
+ *  ccaes_wide_modes.c
+ *  CommonCrypto
+ *
+ *  Wide AES-CTR and AES-XTS.  CTR counter blocks and XTS tweaks are
+ *  independent, so 8 or 16 blocks go through the rounds together and the
+ *  AES unit's pipeline stays full.  GCM does the same for its counter
+ *  blocks and hides GHASH's multiplies in the gaps between AES rounds.
+ */
+
+#include "ccaes_wide_modes.h"
+
+#if defined (__x86_64__) || defined(__i386__)		// x86_64 or i386 architectures
+
+#include <assert.h>
+#include <string.h>
+#include <stdbool.h>
+#include <cpuid.h>
+#include <immintrin.h>
+#include <dispatch/dispatch.h>
+
+#ifndef CC_WIDE_VAES
+#if (defined(__clang__) && __clang_major__ >= 7) || (!defined(__clang__) && defined(__GNUC__) && __GNUC__ >= 8)
+#define CC_WIDE_VAES 1
+#else
+#define CC_WIDE_VAES 0
+#endif
+#endif
+
+#define CCWIDE_AESNI    __attribute__((target("aes,ssse3")))
+#define CCWIDE_VAES256  __attribute__((target("aes,avx2,vaes")))
+#define CCWIDE_VAES512  __attribute__((target("aes,avx512f,avx512bw,vaes")))
+
+#define CCWIDE_MAXROUNDS 14
+#define CCWIDE_LANES 8
+
+typedef struct ccwide_ctr_ctx_t {
+    uint8_t rk[CCWIDE_MAXROUNDS + 1][16];
+    uint32_t rounds;
+    uint32_t padOffset;
+    uint8_t ctr[16];
+    uint8_t pad[16];
+} ccwide_ctr_ctx;
+
+typedef struct ccwide_xts_ctx_t {
+    uint8_t rk[CCWIDE_MAXROUNDS + 1][16];    /* data key, encrypt or decrypt schedule */
+    uint8_t tk[CCWIDE_MAXROUNDS + 1][16];    /* tweak key */
+    uint32_t rounds;
+    uint32_t tweakRounds;
+    uint32_t decrypt;
+} ccwide_xts_ctx;
+
+/* The current tweak has to come first - xts() hands back a pointer to it */
+typedef struct ccwide_xts_tweak_t {
+    uint8_t t[16];
+    uint64_t blocks;
+} ccwide_xts_tweak;
+
+typedef void (*ccwide_ctr_blocks_f)(const uint8_t (*rk)[16], uint32_t rounds, uint8_t *ctr, size_t nblocks, const uint8_t *in, uint8_t *out);
+typedef void (*ccwide_xts_blocks_f)(const uint8_t (*rk)[16], uint32_t rounds, bool decrypt, uint8_t *tweak, size_t nblocks, const uint8_t *in, uint8_t *out);
+
+static ccwide_ctr_blocks_f ccwide_ctr_blocks;
+static ccwide_xts_blocks_f ccwide_xts_blocks;
+
+#pragma mark Key Schedule
+
+/*
+ * SubWord() from aeskeygenassist, whose first dword is SubWord() of its
+ * second; the byte order doesn't matter to it.  No table, so no lookups
+ * that depend on the key.
+ */
+
+CCWIDE_AESNI static inline uint32_t ccwide_subword(uint32_t w)
+{
+    return (uint32_t) _mm_cvtsi128_si32(_mm_aeskeygenassist_si128(_mm_set_epi32(0, 0, (int) w, 0), 0));
+}
+
+#define CCWIDE_KEYLENGTH_OK(len)    ((len) == 16 || (len) == 24 || (len) == 32)
+
+/*
+ * FIPS-197 key expansion; returns the number of rounds.  Callers only
+ * pass AES key lengths; anything else leaves rk alone and returns 0.
+ */
+
+CCWIDE_AESNI static uint32_t ccwide_expand_key(const uint8_t *key, unsigned long keyLength, uint8_t (*rk)[16])
+{
+    uint32_t w[4 * (CCWIDE_MAXROUNDS + 1)];
+    uint32_t nk = (uint32_t) keyLength / 4, rounds = nk + 6, rcon = 1, i, t;
+
+    if(!CCWIDE_KEYLENGTH_OK(keyLength)) return 0;
+    for(i = 0; i < nk; i++)
+        w[i] = ((uint32_t) key[4*i] << 24) | ((uint32_t) key[4*i+1] << 16) | ((uint32_t) key[4*i+2] << 8) | key[4*i+3];
+    for(i = nk; i < 4 * (rounds + 1); i++) {
+        t = w[i - 1];
+        if(i % nk == 0) {
+            t = ccwide_subword((t << 8) | (t >> 24)) ^ (rcon << 24);
+            rcon = (rcon << 1) ^ ((rcon & 0x80) ? 0x1b: 0);
+        } else if(nk > 6 && i % nk == 4) {
+            t = ccwide_subword(t);
+        }
+        w[i] = w[i - nk] ^ t;
+    }
+    for(i = 0; i < 4 * (rounds + 1); i++) {
+        rk[i / 4][4 * (i % 4)] = w[i] >> 24;
+        rk[i / 4][4 * (i % 4) + 1] = w[i] >> 16;
+        rk[i / 4][4 * (i % 4) + 2] = w[i] >> 8;
+        rk[i / 4][4 * (i % 4) + 3] = w[i];
+    }
+    memset(w, 0, sizeof(w));
+    return rounds;
+}
+
+/* Equivalent inverse cipher schedule for aesdec */
+CCWIDE_AESNI static void ccwide_decrypt_key(uint8_t (*rk)[16], uint32_t rounds)
+{
+    __m128i ek[CCWIDE_MAXROUNDS + 1];
+    uint32_t r;
+
+    for(r = 0; r <= rounds; r++) ek[r] = _mm_loadu_si128((const __m128i *) rk[r]);
+    _mm_storeu_si128((__m128i *) rk[0], ek[rounds]);
+    for(r = 1; r < rounds; r++) _mm_storeu_si128((__m128i *) rk[r], _mm_aesimc_si128(ek[rounds - r]));
+    _mm_storeu_si128((__m128i *) rk[rounds], ek[0]);
+}
+
+#pragma mark AES-NI
+
+/*
+ * The lane loops below have to be unrolled for the blocks to stay in
+ * registers - without that they go through memory between rounds.
+ */
+
+#if defined(__clang__)
+#define CCWIDE_UNROLL _Pragma("unroll")
+#else
+#define CCWIDE_UNROLL _Pragma("GCC unroll 16")
+#endif
+
+
+CCWIDE_AESNI static inline void ccwide_load_keys(const uint8_t (*rk)[16], uint32_t rounds, __m128i *k)
+{
+    uint32_t r;
+
+    for(r = 0; r <= rounds; r++) k[r] = _mm_loadu_si128((const __m128i *) rk[r]);
+}
+
+CCWIDE_AESNI static inline __m128i ccwide_encrypt1(__m128i b, const __m128i *k, uint32_t rounds)
+{
+    uint32_t r;
+
+    b = _mm_xor_si128(b, k[0]);
+    for(r = 1; r < rounds; r++) b = _mm_aesenc_si128(b, k[r]);
+    return _mm_aesenclast_si128(b, k[rounds]);
+}
+
+CCWIDE_AESNI static inline __m128i ccwide_decrypt1(__m128i b, const __m128i *k, uint32_t rounds)
+{
+    uint32_t r;
+
+    b = _mm_xor_si128(b, k[0]);
+    for(r = 1; r < rounds; r++) b = _mm_aesdec_si128(b, k[r]);
+    return _mm_aesdeclast_si128(b, k[rounds]);
+}
+
+static inline uint64_t ccwide_load_be64(const uint8_t *p)
+{
+    return ((uint64_t) p[0] << 56) | ((uint64_t) p[1] << 48) | ((uint64_t) p[2] << 40) | ((uint64_t) p[3] << 32) |
+           ((uint64_t) p[4] << 24) | ((uint64_t) p[5] << 16) | ((uint64_t) p[6] << 8) | p[7];
+}
+
+static inline void ccwide_store_be64(uint8_t *p, uint64_t v)
+{
+    int i;
+
+    for(i = 7; i >= 0; i--, v >>= 8) p[i] = (uint8_t) v;
+}
+
+/*
+ * The whole 128 bit counter block is incremented big-endian.  It's kept
+ * little-endian in registers and byte swapped into each block; a batch that
+ * would carry out of the low 64 bits takes the scalar path instead.
+ */
+
+CCWIDE_AESNI static void ccwide_ctr_aesni(const uint8_t (*rk)[16], uint32_t rounds, uint8_t *ctr, size_t nblocks, const uint8_t *in, uint8_t *out)
+{
+    const __m128i bswap = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    const __m128i one = _mm_set_epi64x(0, 1);
+    __m128i k[CCWIDE_MAXROUNDS + 1], b[CCWIDE_LANES], c;
+    uint64_t hi = ccwide_load_be64(ctr), lo = ccwide_load_be64(ctr + 8);
+    uint32_t r;
+    int i;
+
+    ccwide_load_keys(rk, rounds, k);
+    for(; nblocks >= CCWIDE_LANES && lo <= UINT64_MAX - CCWIDE_LANES; nblocks -= CCWIDE_LANES, in += 16 * CCWIDE_LANES, out += 16 * CCWIDE_LANES) {
+        c = _mm_set_epi64x((long long) hi, (long long) lo);
+        CCWIDE_UNROLL
+        for(i = 0; i < CCWIDE_LANES; i++) {
+            b[i] = _mm_xor_si128(_mm_shuffle_epi8(c, bswap), k[0]);
+            c = _mm_add_epi64(c, one);
+        }
+        lo += CCWIDE_LANES;
+        for(r = 1; r < rounds; r++) {
+            CCWIDE_UNROLL
+            for(i = 0; i < CCWIDE_LANES; i++) b[i] = _mm_aesenc_si128(b[i], k[r]);
+        }
+        CCWIDE_UNROLL
+        for(i = 0; i < CCWIDE_LANES; i++) {
+            b[i] = _mm_aesenclast_si128(b[i], k[rounds]);
+            _mm_storeu_si128((__m128i *) (out + 16 * i), _mm_xor_si128(b[i], _mm_loadu_si128((const __m128i *) (in + 16 * i))));
+        }
+    }
+    for(; nblocks; nblocks--, in += 16, out += 16) {
+        b[0] = _mm_set_epi64x((long long) __builtin_bswap64(lo), (long long) __builtin_bswap64(hi));
+        if(++lo == 0) ++hi;
+        b[0] = ccwide_encrypt1(b[0], k, rounds);
+        _mm_storeu_si128((__m128i *) out, _mm_xor_si128(b[0], _mm_loadu_si128((const __m128i *) in)));
+        /* Back to the wide path once past the carry */
+        if(nblocks > CCWIDE_LANES && lo == 0) {
+            ccwide_store_be64(ctr, hi);
+            ccwide_store_be64(ctr + 8, lo);
+            ccwide_ctr_aesni(rk, rounds, ctr, nblocks - 1, in + 16, out + 16);
+            return;
+        }
+    }
+    ccwide_store_be64(ctr, hi);
+    ccwide_store_be64(ctr + 8, lo);
+}
+
+/* Multiply the tweak by alpha in GF(2^128), little-endian as XTS has it */
+static inline void ccwide_tweak_next(uint64_t *lo, uint64_t *hi)
+{
+    uint64_t carry = *hi >> 63;
+
+    *hi = (*hi << 1) | (*lo >> 63);
+    *lo = (*lo << 1) ^ (carry * 0x87);
+}
+
+static inline void ccwide_tweak_load(const uint8_t *tweak, uint64_t *lo, uint64_t *hi)
+{
+    memcpy(lo, tweak, 8);
+    memcpy(hi, tweak + 8, 8);
+}
+
+static inline void ccwide_tweak_store(uint8_t *tweak, uint64_t lo, uint64_t hi)
+{
+    memcpy(tweak, &lo, 8);
+    memcpy(tweak + 8, &hi, 8);
+}
+
+CCWIDE_AESNI static void ccwide_xts_aesni(const uint8_t (*rk)[16], uint32_t rounds, bool decrypt, uint8_t *tweak, size_t nblocks, const uint8_t *in, uint8_t *out)
+{
+    __m128i k[CCWIDE_MAXROUNDS + 1], b[CCWIDE_LANES], t[CCWIDE_LANES];
+    uint64_t lo, hi;
+    uint32_t r;
+    int i;
+
+    ccwide_load_keys(rk, rounds, k);
+    ccwide_tweak_load(tweak, &lo, &hi);
+    for(; nblocks >= CCWIDE_LANES; nblocks -= CCWIDE_LANES, in += 16 * CCWIDE_LANES, out += 16 * CCWIDE_LANES) {
+        CCWIDE_UNROLL
+        for(i = 0; i < CCWIDE_LANES; i++) {
+            t[i] = _mm_set_epi64x((long long) hi, (long long) lo);
+            ccwide_tweak_next(&lo, &hi);
+            b[i] = _mm_xor_si128(_mm_xor_si128(_mm_loadu_si128((const __m128i *) (in + 16 * i)), t[i]), k[0]);
+        }
+        if(decrypt) {
+            for(r = 1; r < rounds; r++) {
+                CCWIDE_UNROLL
+                for(i = 0; i < CCWIDE_LANES; i++) b[i] = _mm_aesdec_si128(b[i], k[r]);
+            }
+            CCWIDE_UNROLL
+            for(i = 0; i < CCWIDE_LANES; i++) b[i] = _mm_aesdeclast_si128(b[i], k[rounds]);
+        } else {
+            for(r = 1; r < rounds; r++) {
+                CCWIDE_UNROLL
+                for(i = 0; i < CCWIDE_LANES; i++) b[i] = _mm_aesenc_si128(b[i], k[r]);
+            }
+            CCWIDE_UNROLL
+            for(i = 0; i < CCWIDE_LANES; i++) b[i] = _mm_aesenclast_si128(b[i], k[rounds]);
+        }
+        CCWIDE_UNROLL
+        for(i = 0; i < CCWIDE_LANES; i++) _mm_storeu_si128((__m128i *) (out + 16 * i), _mm_xor_si128(b[i], t[i]));
+    }
+    for(; nblocks; nblocks--, in += 16, out += 16) {
+        t[0] = _mm_set_epi64x((long long) hi, (long long) lo);
+        ccwide_tweak_next(&lo, &hi);
+        b[0] = _mm_xor_si128(_mm_loadu_si128((const __m128i *) in), t[0]);
+        b[0] = (decrypt) ? ccwide_decrypt1(b[0], k, rounds): ccwide_encrypt1(b[0], k, rounds);
+        _mm_storeu_si128((__m128i *) out, _mm_xor_si128(b[0], t[0]));
+    }
+    ccwide_tweak_store(tweak, lo, hi);
+}
+
+#if CC_WIDE_VAES
+#pragma mark VAES
+
+/*
+ * 16 blocks per iteration: 8 ymm registers of 2 blocks, or 4 zmm registers
+ * of 4.  Whatever is left after the last full iteration - and a batch the
+ * counter would carry in - goes through the AES-NI path.
+ */
+
+#define CCWIDE_VBLOCKS 16
+
+CCWIDE_VAES256 static void ccwide_ctr_vaes256(const uint8_t (*rk)[16], uint32_t rounds, uint8_t *ctr, size_t nblocks, const uint8_t *in, uint8_t *out)
+{
+    const __m256i bswap = _mm256_broadcastsi128_si256(_mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15));
+    const __m256i two = _mm256_set_epi64x(0, 2, 0, 2);
+    __m256i k[CCWIDE_MAXROUNDS + 1], b[CCWIDE_VBLOCKS / 2], c;
+    uint64_t hi, lo;
+    uint32_t r;
+    int i;
+
+    for(r = 0; r <= rounds; r++) k[r] = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) rk[r]));
+    for(; nblocks >= CCWIDE_VBLOCKS; nblocks -= CCWIDE_VBLOCKS, in += 16 * CCWIDE_VBLOCKS, out += 16 * CCWIDE_VBLOCKS) {
+        hi = ccwide_load_be64(ctr);
+        lo = ccwide_load_be64(ctr + 8);
+        if(lo > UINT64_MAX - CCWIDE_VBLOCKS) {
+            ccwide_ctr_aesni(rk, rounds, ctr, CCWIDE_VBLOCKS, in, out);
+            continue;
+        }
+        c = _mm256_set_epi64x((long long) hi, (long long) (lo + 1), (long long) hi, (long long) lo);
+        CCWIDE_UNROLL
+        for(i = 0; i < CCWIDE_VBLOCKS / 2; i++) {
+            b[i] = _mm256_xor_si256(_mm256_shuffle_epi8(c, bswap), k[0]);
+            c = _mm256_add_epi64(c, two);
+        }
+        ccwide_store_be64(ctr + 8, lo + CCWIDE_VBLOCKS);
+        for(r = 1; r < rounds; r++) {
+            CCWIDE_UNROLL
+            for(i = 0; i < CCWIDE_VBLOCKS / 2; i++) b[i] = _mm256_aesenc_epi128(b[i], k[r]);
+        }
+        CCWIDE_UNROLL
+        for(i = 0; i < CCWIDE_VBLOCKS / 2; i++) {
+            b[i] = _mm256_aesenclast_epi128(b[i], k[rounds]);
+            _mm256_storeu_si256((__m256i *) (out + 32 * i), _mm256_xor_si256(b[i], _mm256_loadu_si256((const __m256i *) (in + 32 * i))));
+        }
+    }
+    if(nblocks) ccwide_ctr_aesni(rk, rounds, ctr, nblocks, in, out);
+}
+
+CCWIDE_VAES512 static void ccwide_ctr_vaes512(const uint8_t (*rk)[16], uint32_t rounds, uint8_t *ctr, size_t nblocks, const uint8_t *in, uint8_t *out)
+{
+    const __m512i bswap = _mm512_broadcast_i32x4(_mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15));
+    const __m512i four = _mm512_set_epi64(0, 4, 0, 4, 0, 4, 0, 4);
+    __m512i k[CCWIDE_MAXROUNDS + 1], b[CCWIDE_VBLOCKS / 4], c;
+    uint64_t hi, lo;
+    uint32_t r;
+    int i;
+
+    for(r = 0; r <= rounds; r++) k[r] = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i *) rk[r]));
+    for(; nblocks >= CCWIDE_VBLOCKS; nblocks -= CCWIDE_VBLOCKS, in += 16 * CCWIDE_VBLOCKS, out += 16 * CCWIDE_VBLOCKS) {
+        hi = ccwide_load_be64(ctr);
+        lo = ccwide_load_be64(ctr + 8);
+        if(lo > UINT64_MAX - CCWIDE_VBLOCKS) {
+            ccwide_ctr_aesni(rk, rounds, ctr, CCWIDE_VBLOCKS, in, out);
+            continue;
+        }
+        c = _mm512_set_epi64((long long) hi, (long long) (lo + 3), (long long) hi, (long long) (lo + 2),
+                             (long long) hi, (long long) (lo + 1), (long long) hi, (long long) lo);
+        CCWIDE_UNROLL
+        for(i = 0; i < CCWIDE_VBLOCKS / 4; i++) {
+            b[i] = _mm512_xor_si512(_mm512_shuffle_epi8(c, bswap), k[0]);
+            c = _mm512_add_epi64(c, four);
+        }
+        ccwide_store_be64(ctr + 8, lo + CCWIDE_VBLOCKS);
+        for(r = 1; r < rounds; r++) {
+            CCWIDE_UNROLL
+            for(i = 0; i < CCWIDE_VBLOCKS / 4; i++) b[i] = _mm512_aesenc_epi128(b[i], k[r]);
+        }
+        CCWIDE_UNROLL
+        for(i = 0; i < CCWIDE_VBLOCKS / 4; i++) {
+            b[i] = _mm512_aesenclast_epi128(b[i], k[rounds]);
+            _mm512_storeu_si512((void *) (out + 64 * i), _mm512_xor_si512(b[i], _mm512_loadu_si512((const void *) (in + 64 * i))));
+        }
+    }
+    if(nblocks) ccwide_ctr_aesni(rk, rounds, ctr, nblocks, in, out);
+}
+
+CCWIDE_VAES256 static void ccwide_xts_vaes256(const uint8_t (*rk)[16], uint32_t rounds, bool decrypt, uint8_t *tweak, size_t nblocks, const uint8_t *in, uint8_t *out)
+{
+    __m256i k[CCWIDE_MAXROUNDS + 1], b[CCWIDE_VBLOCKS / 2], t[CCWIDE_VBLOCKS / 2];
+    uint64_t lo, hi, lo0, hi0;
+    uint32_t r;
+    int i;
+
+    for(r = 0; r <= rounds; r++) k[r] = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) rk[r]));
+    ccwide_tweak_load(tweak, &lo, &hi);
+    for(; nblocks >= CCWIDE_VBLOCKS; nblocks -= CCWIDE_VBLOCKS, in += 16 * CCWIDE_VBLOCKS, out += 16 * CCWIDE_VBLOCKS) {
+        CCWIDE_UNROLL
+        for(i = 0; i < CCWIDE_VBLOCKS / 2; i++) {
+            lo0 = lo; hi0 = hi;
+            ccwide_tweak_next(&lo, &hi);
+            t[i] = _mm256_set_epi64x((long long) hi, (long long) lo, (long long) hi0, (long long) lo0);
+            ccwide_tweak_next(&lo, &hi);
+            b[i] = _mm256_xor_si256(_mm256_xor_si256(_mm256_loadu_si256((const __m256i *) (in + 32 * i)), t[i]), k[0]);
+        }
+        if(decrypt) {
+            for(r = 1; r < rounds; r++) {
+                CCWIDE_UNROLL
+                for(i = 0; i < CCWIDE_VBLOCKS / 2; i++) b[i] = _mm256_aesdec_epi128(b[i], k[r]);
+            }
+            CCWIDE_UNROLL
+            for(i = 0; i < CCWIDE_VBLOCKS / 2; i++) b[i] = _mm256_aesdeclast_epi128(b[i], k[rounds]);
+        } else {
+            for(r = 1; r < rounds; r++) {
+                CCWIDE_UNROLL
+                for(i = 0; i < CCWIDE_VBLOCKS / 2; i++) b[i] = _mm256_aesenc_epi128(b[i], k[r]);
+            }
+            CCWIDE_UNROLL
+            for(i = 0; i < CCWIDE_VBLOCKS / 2; i++) b[i] = _mm256_aesenclast_epi128(b[i], k[rounds]);
+        }
+        CCWIDE_UNROLL
+        for(i = 0; i < CCWIDE_VBLOCKS / 2; i++) _mm256_storeu_si256((__m256i *) (out + 32 * i), _mm256_xor_si256(b[i], t[i]));
+    }
+    ccwide_tweak_store(tweak, lo, hi);
+    if(nblocks) ccwide_xts_aesni(rk, rounds, decrypt, tweak, nblocks, in, out);
+}
+
+CCWIDE_VAES512 static void ccwide_xts_vaes512(const uint8_t (*rk)[16], uint32_t rounds, bool decrypt, uint8_t *tweak, size_t nblocks, const uint8_t *in, uint8_t *out)
+{
+    __m512i k[CCWIDE_MAXROUNDS + 1], b[CCWIDE_VBLOCKS / 4], t[CCWIDE_VBLOCKS / 4];
+    uint64_t lo, hi, tl[4], th[4];
+    uint32_t r;
+    int i, j;
+
+    for(r = 0; r <= rounds; r++) k[r] = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i *) rk[r]));
+    ccwide_tweak_load(tweak, &lo, &hi);
+    for(; nblocks >= CCWIDE_VBLOCKS; nblocks -= CCWIDE_VBLOCKS, in += 16 * CCWIDE_VBLOCKS, out += 16 * CCWIDE_VBLOCKS) {
+        CCWIDE_UNROLL
+        for(i = 0; i < CCWIDE_VBLOCKS / 4; i++) {
+            CCWIDE_UNROLL
+            for(j = 0; j < 4; j++) {
+                tl[j] = lo; th[j] = hi;
+                ccwide_tweak_next(&lo, &hi);
+            }
+            t[i] = _mm512_set_epi64((long long) th[3], (long long) tl[3], (long long) th[2], (long long) tl[2],
+                                    (long long) th[1], (long long) tl[1], (long long) th[0], (long long) tl[0]);
+            b[i] = _mm512_xor_si512(_mm512_xor_si512(_mm512_loadu_si512((const void *) (in + 64 * i)), t[i]), k[0]);
+        }
+        if(decrypt) {
+            for(r = 1; r < rounds; r++) {
+                CCWIDE_UNROLL
+                for(i = 0; i < CCWIDE_VBLOCKS / 4; i++) b[i] = _mm512_aesdec_epi128(b[i], k[r]);
+            }
+            CCWIDE_UNROLL
+            for(i = 0; i < CCWIDE_VBLOCKS / 4; i++) b[i] = _mm512_aesdeclast_epi128(b[i], k[rounds]);
+        } else {
+            for(r = 1; r < rounds; r++) {
+                CCWIDE_UNROLL
+                for(i = 0; i < CCWIDE_VBLOCKS / 4; i++) b[i] = _mm512_aesenc_epi128(b[i], k[r]);
+            }
+            CCWIDE_UNROLL
+            for(i = 0; i < CCWIDE_VBLOCKS / 4; i++) b[i] = _mm512_aesenclast_epi128(b[i], k[rounds]);
+        }
+        CCWIDE_UNROLL
+        for(i = 0; i < CCWIDE_VBLOCKS / 4; i++) _mm512_storeu_si512((void *) (out + 64 * i), _mm512_xor_si512(b[i], t[i]));
+    }
+    ccwide_tweak_store(tweak, lo, hi);
+    if(nblocks) ccwide_xts_aesni(rk, rounds, decrypt, tweak, nblocks, in, out);
+}
+
+#endif /* CC_WIDE_VAES */
+
+#pragma mark Modes
+
+static void ccwide_ctr_init(const struct ccmode_ctr *mode, ccctr_ctx *ctx, unsigned long key_len, const void *key, const void *iv)
+{
+    ccwide_ctr_ctx *c = (ccwide_ctr_ctx *) ctx;
+
+    assert(CCWIDE_KEYLENGTH_OK(key_len));
+    c->rounds = ccwide_expand_key(key, key_len, c->rk);
+    memcpy(c->ctr, iv, sizeof(c->ctr));
+    c->padOffset = sizeof(c->pad);
+}
+
+static void ccwide_ctr_crypt(ccctr_ctx *ctx, unsigned long nbytes, const void *in, void *out)
+{
+    ccwide_ctr_ctx *c = (ccwide_ctr_ctx *) ctx;
+    const uint8_t *ip = in;
+    uint8_t *op = out;
+    size_t nblocks;
+
+    /* Finish the keystream block a previous call left part used */
+    for(; nbytes && c->padOffset < sizeof(c->pad); nbytes--) *op++ = *ip++ ^ c->pad[c->padOffset++];
+    if((nblocks = nbytes / 16) != 0) {
+        ccwide_ctr_blocks((const uint8_t (*)[16]) c->rk, c->rounds, c->ctr, nblocks, ip, op);
+        ip += 16 * nblocks; op += 16 * nblocks; nbytes -= 16 * nblocks;
+    }
+    if(nbytes) {
+        memset(c->pad, 0, sizeof(c->pad));
+        ccwide_ctr_blocks((const uint8_t (*)[16]) c->rk, c->rounds, c->ctr, 1, c->pad, c->pad);
+        for(c->padOffset = 0; nbytes; nbytes--) *op++ = *ip++ ^ c->pad[c->padOffset++];
+    }
+}
+
+static struct ccmode_ctr ccwide_ctr_mode = {
+    .size = sizeof(ccwide_ctr_ctx),
+    .block_size = 1,
+    .init = ccwide_ctr_init,
+    .ctr = ccwide_ctr_crypt,
+};
+
+static struct ccmode_xts ccwide_xts_encrypt;
+static struct ccmode_xts ccwide_xts_decrypt;
+
+CCWIDE_AESNI static void ccwide_xts_init(const struct ccmode_xts *mode, ccxts_ctx *ctx, unsigned long key_len, const void *key, const void *tweak_key)
+{
+    ccwide_xts_ctx *c = (ccwide_xts_ctx *) ctx;
+
+    assert(CCWIDE_KEYLENGTH_OK(key_len));
+    c->decrypt = (mode == &ccwide_xts_decrypt);
+    c->rounds = ccwide_expand_key(key, key_len, c->rk);
+    if(c->decrypt) ccwide_decrypt_key(c->rk, c->rounds);
+    c->tweakRounds = ccwide_expand_key(tweak_key, key_len, c->tk);
+}
+
+CCWIDE_AESNI static void ccwide_xts_set_tweak(const ccxts_ctx *ctx, ccxts_tweak *tweak, const void *iv)
+{
+    const ccwide_xts_ctx *c = (const ccwide_xts_ctx *) ctx;
+    ccwide_xts_tweak *t = (ccwide_xts_tweak *) tweak;
+    __m128i k[CCWIDE_MAXROUNDS + 1];
+
+    ccwide_load_keys((const uint8_t (*)[16]) c->tk, c->tweakRounds, k);
+    _mm_storeu_si128((__m128i *) t->t, ccwide_encrypt1(_mm_loadu_si128((const __m128i *) iv), k, c->tweakRounds));
+    t->blocks = 0;
+}
+
+static void *ccwide_xts_crypt(const ccxts_ctx *ctx, ccxts_tweak *tweak, unsigned long nblocks, const void *in, void *out)
+{
+    const ccwide_xts_ctx *c = (const ccwide_xts_ctx *) ctx;
+    ccwide_xts_tweak *t = (ccwide_xts_tweak *) tweak;
+
+    if(nblocks) {
+        ccwide_xts_blocks((const uint8_t (*)[16]) c->rk, c->rounds, c->decrypt, t->t, nblocks, in, out);
+        t->blocks += nblocks;
+    }
+    return t->t;
+}
+
+static struct ccmode_xts ccwide_xts_encrypt = {
+    .size = sizeof(ccwide_xts_ctx),
+    .tweak_size = sizeof(ccwide_xts_tweak),
+    .block_size = 16,
+    .init = ccwide_xts_init,
+    .set_tweak = ccwide_xts_set_tweak,
+    .xts = ccwide_xts_crypt,
+};
+
+static struct ccmode_xts ccwide_xts_decrypt = {
+    .size = sizeof(ccwide_xts_ctx),
+    .tweak_size = sizeof(ccwide_xts_tweak),
+    .block_size = 16,
+    .init = ccwide_xts_init,
+    .set_tweak = ccwide_xts_set_tweak,
+    .xts = ccwide_xts_crypt,
+};
+
+#pragma mark Sector Batches
+
+/*
+ * Each sector's tweak is its number encrypted under the tweak key.  The
+ * encryptions don't depend on one another, so eight sectors' tweaks go
+ * through the rounds together before the sectors themselves.
+ */
+
+CCWIDE_AESNI static void ccwide_sector_tweaks(const ccwide_xts_ctx *c, uint64_t sector, size_t n, uint8_t (*tweaks)[16])
+{
+    __m128i k[CCWIDE_MAXROUNDS + 1], b[CCWIDE_LANES];
+    uint32_t r;
+    size_t i;
+
+    ccwide_load_keys((const uint8_t (*)[16]) c->tk, c->tweakRounds, k);
+    CCWIDE_UNROLL
+    for(i = 0; i < CCWIDE_LANES; i++) b[i] = _mm_xor_si128(_mm_set_epi64x(0, (long long) (sector + i)), k[0]);
+    for(r = 1; r < c->tweakRounds; r++) {
+        CCWIDE_UNROLL
+        for(i = 0; i < CCWIDE_LANES; i++) b[i] = _mm_aesenc_si128(b[i], k[r]);
+    }
+    for(i = 0; i < n; i++) _mm_storeu_si128((__m128i *) tweaks[i], _mm_aesenclast_si128(b[i], k[c->tweakRounds]));
+}
+
+bool ccaes_wide_xts_crypt_sectors(const struct ccmode_xts *mode, const ccxts_ctx *ctx, uint64_t sector, size_t sectorBlocks,
+                                  size_t nSectors, const void *in, void *out)
+{
+    const ccwide_xts_ctx *c = (const ccwide_xts_ctx *) ctx;
+    uint8_t tweaks[CCWIDE_LANES][16];
+    const uint8_t *ip = in;
+    uint8_t *op = out;
+    size_t n, i;
+
+    if(mode != &ccwide_xts_encrypt && mode != &ccwide_xts_decrypt) return false;
+    for(; nSectors; nSectors -= n, sector += n) {
+        n = (nSectors < CCWIDE_LANES) ? nSectors: CCWIDE_LANES;
+        ccwide_sector_tweaks(c, sector, n, tweaks);
+        for(i = 0; i < n; i++, ip += 16 * sectorBlocks, op += 16 * sectorBlocks)
+            ccwide_xts_blocks((const uint8_t (*)[16]) c->rk, c->rounds, c->decrypt, tweaks[i], sectorBlocks, ip, op);
+    }
+    memset(tweaks, 0, sizeof(tweaks));
+    return true;
+}
+
+bool ccaes_wide_ctr_seek(const struct ccmode_ctr *mode, ccctr_ctx *ctx, const void *counter, size_t skip)
+{
+    ccwide_ctr_ctx *c = (ccwide_ctr_ctx *) ctx;
+
+    if(mode != &ccwide_ctr_mode) return false;
+    memcpy(c->ctr, counter, sizeof(c->ctr));
+    c->padOffset = sizeof(c->pad);
+    if(skip) {
+        memset(c->pad, 0, sizeof(c->pad));
+        ccwide_ctr_blocks((const uint8_t (*)[16]) c->rk, c->rounds, c->ctr, 1, c->pad, c->pad);
+        c->padOffset = (uint32_t) skip;
+    }
+    return true;
+}
+
+#pragma mark GCM
+
+/*
+ * GHASH runs on byte reflected blocks, as in Intel's carry-less multiply
+ * paper: four PCLMULQDQs give the 256 bit product, which is shifted left
+ * a bit and reduced.  Products are linear, so eight of them - each block
+ * times the power of H that brings it level with the last - are summed
+ * before a single reduction.  The AES rounds for one batch of counters and
+ * the multiplies for a batch of ciphertext are issued together so the two
+ * units overlap: decryption hashes the batch it's decrypting, encryption
+ * the batch before.
+ */
+
+#define CCWIDE_GCM      __attribute__((target("aes,pclmul,ssse3")))
+
+enum {
+    ccwide_gcm_state_iv = 0,
+    ccwide_gcm_state_aad,
+    ccwide_gcm_state_text,
+    ccwide_gcm_state_done,
+};
+
+typedef struct ccwide_gcm_ctx_t {
+    uint8_t rk[CCWIDE_MAXROUNDS + 1][16];
+    uint32_t rounds;
+    uint32_t decrypt;
+    uint8_t h[CCWIDE_LANES][16];    /* H, H^2 .. H^8, byte reflected */
+    uint8_t x[16];                  /* GHASH accumulator, byte reflected */
+    uint8_t j0[16];                 /* pre-counter block */
+    uint8_t ctr[16];                /* next counter block, byte reflected */
+    uint8_t buf[16];                /* IV, AAD or ciphertext short of a block */
+    uint8_t pad[16];                /* keystream for the text block in buf */
+    uint32_t bufPos;
+    uint32_t state;
+    uint64_t ivLength;
+    uint64_t aadLength;
+    uint64_t textLength;
+    uint8_t tag[16];
+} ccwide_gcm_ctx;
+
+static bool ccwide_gcm_available;
+
+CCWIDE_GCM static inline __m128i ccwide_bswap128(__m128i b)
+{
+    return _mm_shuffle_epi8(b, _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15));
+}
+
+/* Accumulate the unreduced product of a and b */
+CCWIDE_GCM static inline void ccwide_clmul_acc(__m128i a, __m128i b, __m128i *lo, __m128i *mid, __m128i *hi)
+{
+    *lo = _mm_xor_si128(*lo, _mm_clmulepi64_si128(a, b, 0x00));
+    *hi = _mm_xor_si128(*hi, _mm_clmulepi64_si128(a, b, 0x11));
+    *mid = _mm_xor_si128(*mid, _mm_xor_si128(_mm_clmulepi64_si128(a, b, 0x10), _mm_clmulepi64_si128(a, b, 0x01)));
+}
+
+CCWIDE_GCM static inline __m128i ccwide_gf_reduce(__m128i lo, __m128i mid, __m128i hi)
+{
+    __m128i t7, t8, t9, t2, t4, t5;
+
+    lo = _mm_xor_si128(lo, _mm_slli_si128(mid, 8));
+    hi = _mm_xor_si128(hi, _mm_srli_si128(mid, 8));
+
+    /* Shift the 256 bit product left one bit */
+    t7 = _mm_srli_epi32(lo, 31);
+    t8 = _mm_srli_epi32(hi, 31);
+    lo = _mm_slli_epi32(lo, 1);
+    hi = _mm_slli_epi32(hi, 1);
+    t9 = _mm_srli_si128(t7, 12);
+    t8 = _mm_slli_si128(t8, 4);
+    t7 = _mm_slli_si128(t7, 4);
+    lo = _mm_or_si128(lo, t7);
+    hi = _mm_or_si128(_mm_or_si128(hi, t8), t9);
+
+    /* Reduce modulo x^128 + x^7 + x^2 + x + 1 */
+    t7 = _mm_xor_si128(_mm_xor_si128(_mm_slli_epi32(lo, 31), _mm_slli_epi32(lo, 30)), _mm_slli_epi32(lo, 25));
+    t8 = _mm_srli_si128(t7, 4);
+    lo = _mm_xor_si128(lo, _mm_slli_si128(t7, 12));
+    t2 = _mm_srli_epi32(lo, 1);
+    t4 = _mm_srli_epi32(lo, 2);
+    t5 = _mm_srli_epi32(lo, 7);
+    t2 = _mm_xor_si128(_mm_xor_si128(_mm_xor_si128(t2, t4), t5), t8);
+    return _mm_xor_si128(hi, _mm_xor_si128(lo, t2));
+}
+
+CCWIDE_GCM static inline __m128i ccwide_gf_mul(__m128i a, __m128i b)
+{
+    __m128i lo = _mm_setzero_si128(), mid = _mm_setzero_si128(), hi = _mm_setzero_si128();
+
+    ccwide_clmul_acc(a, b, &lo, &mid, &hi);
+    return ccwide_gf_reduce(lo, mid, hi);
+}
+
+/* Hash up to CCWIDE_LANES blocks with one reduction */
+CCWIDE_GCM static __m128i ccwide_ghash_run(const uint8_t (*h)[16], __m128i x, const uint8_t *in, size_t n)
+{
+    __m128i lo = _mm_setzero_si128(), mid = _mm_setzero_si128(), hi = _mm_setzero_si128(), b;
+    size_t i;
+
+    for(i = 0; i < n; i++) {
+        b = ccwide_bswap128(_mm_loadu_si128((const __m128i *) (in + 16 * i)));
+        if(i == 0) b = _mm_xor_si128(b, x);
+        ccwide_clmul_acc(b, _mm_loadu_si128((const __m128i *) h[n - 1 - i]), &lo, &mid, &hi);
+    }
+    return ccwide_gf_reduce(lo, mid, hi);
+}
+
+CCWIDE_GCM static void ccwide_ghash(ccwide_gcm_ctx *c, const uint8_t *in, size_t nblocks)
+{
+    __m128i x = _mm_loadu_si128((const __m128i *) c->x);
+    size_t n;
+
+    for(; nblocks; nblocks -= n, in += 16 * n) {
+        n = (nblocks < CCWIDE_LANES) ? nblocks: CCWIDE_LANES;
+        x = ccwide_ghash_run((const uint8_t (*)[16]) c->h, x, in, n);
+    }
+    _mm_storeu_si128((__m128i *) c->x, x);
+}
+
+/*
+ * Whole blocks of text.  The counter is kept byte reflected so that GCM's
+ * 32 bit increment is an add to the low lane.
+ */
+
+CCWIDE_GCM static void ccwide_gcm_blocks(ccwide_gcm_ctx *c, size_t nblocks, const uint8_t *in, uint8_t *out)
+{
+    const __m128i one = _mm_set_epi32(0, 0, 0, 1);
+    __m128i k[CCWIDE_MAXROUNDS + 1], hp[CCWIDE_LANES], b[CCWIDE_LANES], g[CCWIDE_LANES];
+    __m128i x = _mm_loadu_si128((const __m128i *) c->x), ctr = _mm_loadu_si128((const __m128i *) c->ctr);
+    __m128i lo, mid, hi;
+    const uint8_t *hashIn = NULL;     /* ciphertext batch to hash alongside this one */
+    uint32_t rounds = c->rounds, r;
+    size_t n;
+    int i;
+
+    ccwide_load_keys((const uint8_t (*)[16]) c->rk, rounds, k);
+    for(i = 0; i < CCWIDE_LANES; i++) hp[i] = _mm_loadu_si128((const __m128i *) c->h[i]);
+
+    for(; nblocks >= CCWIDE_LANES; nblocks -= CCWIDE_LANES, in += 16 * CCWIDE_LANES, out += 16 * CCWIDE_LANES) {
+        if(c->decrypt) hashIn = in;
+        CCWIDE_UNROLL
+        for(i = 0; i < CCWIDE_LANES; i++) {
+            b[i] = _mm_xor_si128(ccwide_bswap128(ctr), k[0]);
+            ctr = _mm_add_epi32(ctr, one);
+        }
+        if(hashIn) {
+            CCWIDE_UNROLL
+            for(i = 0; i < CCWIDE_LANES; i++) g[i] = ccwide_bswap128(_mm_loadu_si128((const __m128i *) (hashIn + 16 * i)));
+            g[0] = _mm_xor_si128(g[0], x);
+            lo = mid = hi = _mm_setzero_si128();
+            /* One multiply per round for the first eight rounds */
+            for(r = 1; r <= CCWIDE_LANES; r++) {
+                CCWIDE_UNROLL
+                for(i = 0; i < CCWIDE_LANES; i++) b[i] = _mm_aesenc_si128(b[i], k[r]);
+                ccwide_clmul_acc(g[r - 1], hp[CCWIDE_LANES - r], &lo, &mid, &hi);
+            }
+            x = ccwide_gf_reduce(lo, mid, hi);
+        } else {
+            r = 1;
+        }
+        for(; r < rounds; r++) {
+            CCWIDE_UNROLL
+            for(i = 0; i < CCWIDE_LANES; i++) b[i] = _mm_aesenc_si128(b[i], k[r]);
+        }
+        CCWIDE_UNROLL
+        for(i = 0; i < CCWIDE_LANES; i++) {
+            b[i] = _mm_aesenclast_si128(b[i], k[rounds]);
+            _mm_storeu_si128((__m128i *) (out + 16 * i), _mm_xor_si128(b[i], _mm_loadu_si128((const __m128i *) (in + 16 * i))));
+        }
+        if(!c->decrypt) hashIn = out;
+        else hashIn = NULL;
+    }
+    /* The last encrypted batch hasn't been hashed */
+    if(hashIn) x = ccwide_ghash_run((const uint8_t (*)[16]) c->h, x, hashIn, CCWIDE_LANES);
+
+    if((n = nblocks) != 0) {
+        if(c->decrypt) x = ccwide_ghash_run((const uint8_t (*)[16]) c->h, x, in, n);
+        for(i = 0; i < (int) n; i++) {
+            b[0] = ccwide_encrypt1(ccwide_bswap128(ctr), k, rounds);
+            ctr = _mm_add_epi32(ctr, one);
+            _mm_storeu_si128((__m128i *) (out + 16 * i), _mm_xor_si128(b[0], _mm_loadu_si128((const __m128i *) (in + 16 * i))));
+        }
+        if(!c->decrypt) x = ccwide_ghash_run((const uint8_t (*)[16]) c->h, x, out, n);
+    }
+    _mm_storeu_si128((__m128i *) c->x, x);
+    _mm_storeu_si128((__m128i *) c->ctr, ctr);
+}
+
+/* One block of keystream for a partial block of text */
+CCWIDE_GCM static void ccwide_gcm_pad(ccwide_gcm_ctx *c)
+{
+    __m128i k[CCWIDE_MAXROUNDS + 1], ctr = _mm_loadu_si128((const __m128i *) c->ctr);
+
+    ccwide_load_keys((const uint8_t (*)[16]) c->rk, c->rounds, k);
+    _mm_storeu_si128((__m128i *) c->pad, ccwide_encrypt1(ccwide_bswap128(ctr), k, c->rounds));
+    _mm_storeu_si128((__m128i *) c->ctr, _mm_add_epi32(ctr, _mm_set_epi32(0, 0, 0, 1)));
+}
+
+/* Hash what's in buf, zero padded */
+static void ccwide_gcm_flush(ccwide_gcm_ctx *c)
+{
+    if(c->bufPos == 0) return;
+    memset(c->buf + c->bufPos, 0, sizeof(c->buf) - c->bufPos);
+    ccwide_ghash(c, c->buf, 1);
+    c->bufPos = 0;
+}
+
+static void ccwide_gcm_lengths(ccwide_gcm_ctx *c, uint64_t a, uint64_t b)
+{
+    uint8_t lengths[16];
+
+    ccwide_store_be64(lengths, a * 8);
+    ccwide_store_be64(lengths + 8, b * 8);
+    ccwide_ghash(c, lengths, 1);
+}
+
+/* The IV is complete: derive the pre-counter block and start the AAD */
+CCWIDE_GCM static void ccwide_gcm_start(ccwide_gcm_ctx *c)
+{
+    __m128i j0;
+
+    if(c->ivLength == 12) {
+        memcpy(c->j0, c->buf, 12);
+        memset(c->j0 + 12, 0, 3);
+        c->j0[15] = 1;
+    } else {
+        ccwide_gcm_flush(c);
+        ccwide_gcm_lengths(c, 0, c->ivLength);
+        _mm_storeu_si128((__m128i *) c->j0, ccwide_bswap128(_mm_loadu_si128((const __m128i *) c->x)));
+    }
+    j0 = ccwide_bswap128(_mm_loadu_si128((const __m128i *) c->j0));
+    _mm_storeu_si128((__m128i *) c->ctr, _mm_add_epi32(j0, _mm_set_epi32(0, 0, 0, 1)));
+    memset(c->x, 0, sizeof(c->x));
+    c->bufPos = 0;
+    c->aadLength = c->textLength = 0;
+    c->state = ccwide_gcm_state_aad;
+}
+
+static void ccwide_gcm_reset(ccgcm_ctx *ctx)
+{
+    ccwide_gcm_ctx *c = (ccwide_gcm_ctx *) ctx;
+
+    memset(c->x, 0, sizeof(c->x));
+    memset(c->buf, 0, sizeof(c->buf));
+    memset(c->pad, 0, sizeof(c->pad));
+    c->bufPos = 0;
+    c->ivLength = 0;
+    c->state = ccwide_gcm_state_iv;
+}
+
+static struct ccmode_gcm ccwide_gcm_encrypt;
+static struct ccmode_gcm ccwide_gcm_decrypt;
+
+CCWIDE_GCM static void ccwide_gcm_init(const struct ccmode_gcm *mode, ccgcm_ctx *ctx, unsigned long key_len, const void *key)
+{
+    ccwide_gcm_ctx *c = (ccwide_gcm_ctx *) ctx;
+    __m128i k[CCWIDE_MAXROUNDS + 1], h, hn;
+    int i;
+
+    assert(CCWIDE_KEYLENGTH_OK(key_len));
+    c->rounds = ccwide_expand_key(key, key_len, c->rk);
+    c->decrypt = (mode == &ccwide_gcm_decrypt);
+    ccwide_load_keys((const uint8_t (*)[16]) c->rk, c->rounds, k);
+    h = hn = ccwide_bswap128(ccwide_encrypt1(_mm_setzero_si128(), k, c->rounds));
+    for(i = 0; i < CCWIDE_LANES; i++) {
+        _mm_storeu_si128((__m128i *) c->h[i], hn);
+        hn = ccwide_gf_mul(hn, h);
+    }
+    ccwide_gcm_reset(ctx);
+}
+
+static void ccwide_gcm_set_iv(ccgcm_ctx *ctx, size_t iv_size, const void *iv)
+{
+    ccwide_gcm_ctx *c = (ccwide_gcm_ctx *) ctx;
+    const uint8_t *ip = iv;
+    size_t n;
+
+    if(c->state != ccwide_gcm_state_iv) return;
+    c->ivLength += iv_size;
+    /* Blocks are hashed lazily - a 12 byte IV isn't hashed at all */
+    for(; iv_size; iv_size -= n, ip += n) {
+        if(c->bufPos == sizeof(c->buf)) {
+            ccwide_ghash(c, c->buf, 1);
+            c->bufPos = 0;
+        }
+        n = sizeof(c->buf) - c->bufPos;
+        if(n > iv_size) n = iv_size;
+        memcpy(c->buf + c->bufPos, ip, n);
+        c->bufPos += (uint32_t) n;
+    }
+}
+
+static void ccwide_gcm_aad(ccgcm_ctx *ctx, unsigned long nbytes, const void *in)
+{
+    ccwide_gcm_ctx *c = (ccwide_gcm_ctx *) ctx;
+    const uint8_t *ip = in;
+    size_t n;
+
+    if(c->state == ccwide_gcm_state_iv) ccwide_gcm_start(c);
+    if(c->state != ccwide_gcm_state_aad) return;
+    c->aadLength += nbytes;
+    if(c->bufPos) {
+        n = sizeof(c->buf) - c->bufPos;
+        if(n > nbytes) n = nbytes;
+        memcpy(c->buf + c->bufPos, ip, n);
+        c->bufPos += (uint32_t) n;
+        ip += n; nbytes -= n;
+        if(c->bufPos == sizeof(c->buf)) ccwide_gcm_flush(c);
+    }
+    if(nbytes >= 16) {
+        ccwide_ghash(c, ip, nbytes / 16);
+        ip += nbytes & ~(size_t) 15;
+        nbytes &= 15;
+    }
+    if(nbytes) {
+        memcpy(c->buf, ip, nbytes);
+        c->bufPos = (uint32_t) nbytes;
+    }
+}
+
+static void ccwide_gcm_crypt(ccgcm_ctx *ctx, unsigned long nbytes, const void *in, void *out)
+{
+    ccwide_gcm_ctx *c = (ccwide_gcm_ctx *) ctx;
+    const uint8_t *ip = in;
+    uint8_t *op = out;
+
+    if(c->state == ccwide_gcm_state_iv) ccwide_gcm_start(c);
+    if(c->state == ccwide_gcm_state_aad) {
+        ccwide_gcm_flush(c);
+        c->state = ccwide_gcm_state_text;
+    }
+    if(c->state != ccwide_gcm_state_text) return;
+    c->textLength += nbytes;
+
+    /* Finish the block a previous call left part done; buf collects its ciphertext */
+    for(; nbytes && c->bufPos; nbytes--) {
+        c->buf[c->bufPos] = (c->decrypt) ? *ip: (uint8_t) (*ip ^ c->pad[c->bufPos]);
+        *op++ = *ip++ ^ c->pad[c->bufPos];
+        if(++c->bufPos == sizeof(c->buf)) ccwide_gcm_flush(c);
+    }
+    if(nbytes >= 16) {
+        ccwide_gcm_blocks(c, nbytes / 16, ip, op);
+        ip += nbytes & ~(size_t) 15;
+        op += nbytes & ~(size_t) 15;
+        nbytes &= 15;
+    }
+    if(nbytes) {
+        ccwide_gcm_pad(c);
+        for(; nbytes; nbytes--) {
+            c->buf[c->bufPos] = (c->decrypt) ? *ip: (uint8_t) (*ip ^ c->pad[c->bufPos]);
+            *op++ = *ip++ ^ c->pad[c->bufPos];
+            c->bufPos++;
+        }
+    }
+}
+
+CCWIDE_GCM static void ccwide_gcm_finalize(ccgcm_ctx *ctx, size_t tag_size, void *tag)
+{
+    ccwide_gcm_ctx *c = (ccwide_gcm_ctx *) ctx;
+    __m128i k[CCWIDE_MAXROUNDS + 1], s;
+
+    if(c->state == ccwide_gcm_state_iv) ccwide_gcm_start(c);
+    if(c->state != ccwide_gcm_state_done) {
+        ccwide_gcm_flush(c);
+        ccwide_gcm_lengths(c, c->aadLength, c->textLength);
+        ccwide_load_keys((const uint8_t (*)[16]) c->rk, c->rounds, k);
+        s = ccwide_encrypt1(_mm_loadu_si128((const __m128i *) c->j0), k, c->rounds);
+        _mm_storeu_si128((__m128i *) c->tag, _mm_xor_si128(s, ccwide_bswap128(_mm_loadu_si128((const __m128i *) c->x))));
+        memset(c->pad, 0, sizeof(c->pad));
+        c->state = ccwide_gcm_state_done;
+    }
+    memcpy(tag, c->tag, (tag_size < sizeof(c->tag)) ? tag_size: sizeof(c->tag));
+}
+
+static struct ccmode_gcm ccwide_gcm_encrypt = {
+    .size = sizeof(ccwide_gcm_ctx),
+    .block_size = 1,
+    .init = ccwide_gcm_init,
+    .set_iv = ccwide_gcm_set_iv,
+    .gmac = ccwide_gcm_aad,
+    .gcm = ccwide_gcm_crypt,
+    .finalize = ccwide_gcm_finalize,
+    .reset = ccwide_gcm_reset,
+};
+
+static struct ccmode_gcm ccwide_gcm_decrypt = {
+    .size = sizeof(ccwide_gcm_ctx),
+    .block_size = 1,
+    .init = ccwide_gcm_init,
+    .set_iv = ccwide_gcm_set_iv,
+    .gmac = ccwide_gcm_aad,
+    .gcm = ccwide_gcm_crypt,
+    .finalize = ccwide_gcm_finalize,
+    .reset = ccwide_gcm_reset,
+};
+
+#pragma mark GCM Chunks
+
+/*
+ * GHASH is linear: text hashed in chunks, each from zero, gives the same
+ * result once every chunk's hash is multiplied by H to the number of
+ * blocks after it and the lot added to the hash so far times H to the
+ * total.  So the chunks of a long run can go to different threads.
+ */
+
+/* H^n, n at least 1 */
+CCWIDE_GCM static __m128i ccwide_gf_pow(__m128i h, size_t n)
+{
+    __m128i r = h;
+    int bit = (int) (sizeof(n) * 8) - 1;
+
+    while(!((n >> bit) & 1)) bit--;
+    for(bit--; bit >= 0; bit--) {
+        r = ccwide_gf_mul(r, r);
+        if((n >> bit) & 1) r = ccwide_gf_mul(r, h);
+    }
+    return r;
+}
+
+bool ccaes_wide_gcm_split_begin(const struct ccmode_gcm *mode, ccgcm_ctx *ctx, size_t *head)
+{
+    ccwide_gcm_ctx *c = (ccwide_gcm_ctx *) ctx;
+
+    if(mode != &ccwide_gcm_encrypt && mode != &ccwide_gcm_decrypt) return false;
+    if(c->state == ccwide_gcm_state_done) return false;
+    /* Finishes the IV and AAD */
+    ccwide_gcm_crypt(ctx, 0, NULL, NULL);
+    *head = (sizeof(c->buf) - c->bufPos) % sizeof(c->buf);
+    return true;
+}
+
+CCWIDE_GCM void ccaes_wide_gcm_chunk(const ccgcm_ctx *ctx, size_t blockOffset, size_t nblocks, const void *in, void *out, void *hash)
+{
+    ccwide_gcm_ctx c;
+    __m128i ctr;
+
+    memcpy(&c, ctx, sizeof(c));
+    memset(c.x, 0, sizeof(c.x));
+    /* inc32 wraps the low word, as a 32 bit add does */
+    ctr = _mm_add_epi32(_mm_loadu_si128((const __m128i *) c.ctr), _mm_set_epi32(0, 0, 0, (int) blockOffset));
+    _mm_storeu_si128((__m128i *) c.ctr, ctr);
+    ccwide_gcm_blocks(&c, nblocks, in, out);
+    memcpy(hash, c.x, sizeof(c.x));
+    memset(&c, 0, sizeof(c));
+}
+
+CCWIDE_GCM void ccaes_wide_gcm_split_end(ccgcm_ctx *ctx, size_t nblocks, size_t nchunks, size_t chunkBlocks, const uint8_t (*hashes)[16])
+{
+    ccwide_gcm_ctx *c = (ccwide_gcm_ctx *) ctx;
+    __m128i h = _mm_loadu_si128((const __m128i *) c->h[0]), y = _mm_setzero_si128(), hk, x;
+    size_t after = 0, k;
+
+    if(nblocks == 0) return;
+    for(k = nchunks; k-- > 0; ) {
+        hk = _mm_loadu_si128((const __m128i *) hashes[k]);
+        y = _mm_xor_si128(y, (after) ? ccwide_gf_mul(hk, ccwide_gf_pow(h, after)): hk);
+        after += (k == nchunks - 1) ? nblocks - k * chunkBlocks: chunkBlocks;
+    }
+    x = ccwide_gf_mul(_mm_loadu_si128((const __m128i *) c->x), ccwide_gf_pow(h, nblocks));
+    _mm_storeu_si128((__m128i *) c->x, _mm_xor_si128(x, y));
+    _mm_storeu_si128((__m128i *) c->ctr, _mm_add_epi32(_mm_loadu_si128((const __m128i *) c->ctr), _mm_set_epi32(0, 0, 0, (int) nblocks)));
+    c->textLength += nblocks * 16;
+}
+
+#pragma mark GCM Batches
+
+/*
+ * A short message - a packet, a record - is mostly overhead and tail: the
+ * mask block E(J0), the blocks after its last full batch and a partial
+ * block, each waiting out the whole AES latency on its own.  A batch keys
+ * once and keeps only J0, the counter and the GHASH accumulator for each
+ * of up to 8 messages.  The masks and tails of all of them are pooled, so
+ * their counter blocks fill 8 lanes whichever message they belong to.
+ * Each message's AAD, tail and lengths are still hashed with one reduction
+ * per 8 blocks.
+ */
+
+typedef struct ccwide_lane_set {
+    __m128i b[CCWIDE_LANES];
+    const uint8_t *in[CCWIDE_LANES];
+    uint8_t *out[CCWIDE_LANES];
+    int n;
+} ccwide_lane_set;
+
+CCWIDE_GCM static void ccwide_lanes_run(ccwide_lane_set *l, const __m128i *k, uint32_t rounds)
+{
+    uint32_t r;
+    int i;
+
+    for(r = 1; r < rounds; r++)
+        for(i = 0; i < l->n; i++) l->b[i] = _mm_aesenc_si128(l->b[i], k[r]);
+    for(i = 0; i < l->n; i++)
+        _mm_storeu_si128((__m128i *) l->out[i], _mm_xor_si128(_mm_aesenclast_si128(l->b[i], k[rounds]), _mm_loadu_si128((const __m128i *) l->in[i])));
+    l->n = 0;
+}
+
+/* Queue E(ctr) ^ in -> out, running the lanes once all 8 are taken */
+CCWIDE_GCM static inline void ccwide_lanes_add(ccwide_lane_set *l, const __m128i *k, uint32_t rounds, __m128i ctr, const uint8_t *in, uint8_t *out)
+{
+    l->b[l->n] = _mm_xor_si128(ccwide_bswap128(ctr), k[0]);
+    l->in[l->n] = in;
+    l->out[l->n] = out;
+    if(++l->n == CCWIDE_LANES) ccwide_lanes_run(l, k, rounds);
+}
+
+/* GHASH len bytes, the last block zero padded */
+CCWIDE_GCM static __m128i ccwide_ghash_bytes(const uint8_t (*h)[16], __m128i x, const uint8_t *in, size_t len)
+{
+    uint8_t last[16];
+    size_t n;
+
+    for(; len >= 16; len -= 16 * n, in += 16 * n) {
+        n = len / 16;
+        if(n > CCWIDE_LANES) n = CCWIDE_LANES;
+        x = ccwide_ghash_run(h, x, in, n);
+    }
+    if(len) {
+        memset(last, 0, sizeof(last));
+        memcpy(last, in, len);
+        x = ccwide_ghash_run(h, x, last, 1);
+    }
+    return x;
+}
+
+CCWIDE_GCM static void ccwide_gcm_batch_group(ccwide_gcm_ctx *c, const __m128i *k, int nmsgs, ccgcm_batch_msg *m)
+{
+    const __m128i one = _mm_set_epi32(0, 0, 0, 1);
+    const uint8_t (*h)[16] = (const uint8_t (*)[16]) c->h;
+    static const uint8_t zero[16];
+    uint8_t mask[CCWIDE_LANES][16], partIn[CCWIDE_LANES][16], partOut[CCWIDE_LANES][16], lengths[16];
+    __m128i x[CCWIDE_LANES], ctr[CCWIDE_LANES];
+    size_t bulk[CCWIDE_LANES], tail;
+    ccwide_lane_set lanes;
+    uint32_t rounds = c->rounds;
+    int j;
+
+    lanes.n = 0;
+    for(j = 0; j < nmsgs; j++) {
+        const uint8_t *in = m[j].in;
+        uint8_t *out = m[j].out;
+
+        /* J0 - only an IV other than 12 bytes needs hashing */
+        if(m[j].ivLen == 12) {
+            memcpy(c->j0, m[j].iv, 12);
+            memset(c->j0 + 12, 0, 3);
+            c->j0[15] = 1;
+        } else {
+            ccwide_gcm_reset((ccgcm_ctx *) c);
+            ccwide_gcm_set_iv((ccgcm_ctx *) c, m[j].ivLen, m[j].iv);
+            ccwide_gcm_start(c);
+        }
+        ctr[j] = ccwide_bswap128(_mm_loadu_si128((const __m128i *) c->j0));
+        ccwide_lanes_add(&lanes, k, rounds, ctr[j], zero, mask[j]);
+        ctr[j] = _mm_add_epi32(ctr[j], one);
+        x[j] = ccwide_ghash_bytes(h, _mm_setzero_si128(), m[j].aad, m[j].aadLen);
+
+        /* Whole 8 block batches go through the stitched kernel */
+        if((bulk[j] = m[j].len / 16 / CCWIDE_LANES * CCWIDE_LANES * 16) != 0) {
+            _mm_storeu_si128((__m128i *) c->x, x[j]);
+            _mm_storeu_si128((__m128i *) c->ctr, ctr[j]);
+            ccwide_gcm_blocks(c, bulk[j] / 16, in, out);
+            x[j] = _mm_loadu_si128((const __m128i *) c->x);
+            ctr[j] = _mm_loadu_si128((const __m128i *) c->ctr);
+        }
+
+        /* Decrypting, the tail is hashed before any output can overwrite it */
+        tail = m[j].len - bulk[j];
+        if(c->decrypt) x[j] = ccwide_ghash_bytes(h, x[j], in + bulk[j], tail);
+        for(in += bulk[j], out += bulk[j]; tail >= 16; tail -= 16, in += 16, out += 16) {
+            ccwide_lanes_add(&lanes, k, rounds, ctr[j], in, out);
+            ctr[j] = _mm_add_epi32(ctr[j], one);
+        }
+        if(tail) {
+            memcpy(partIn[j], in, tail);
+            ccwide_lanes_add(&lanes, k, rounds, ctr[j], partIn[j], partOut[j]);
+        }
+    }
+    if(lanes.n) ccwide_lanes_run(&lanes, k, rounds);
+
+    for(j = 0; j < nmsgs; j++) {
+        uint8_t *out = (uint8_t *) m[j].out + bulk[j];
+
+        tail = m[j].len - bulk[j];
+        if(tail & 15) memcpy(out + (tail & ~(size_t) 15), partOut[j], tail & 15);
+        if(!c->decrypt) x[j] = ccwide_ghash_bytes(h, x[j], out, tail);
+        ccwide_store_be64(lengths, (uint64_t) m[j].aadLen * 8);
+        ccwide_store_be64(lengths + 8, (uint64_t) m[j].len * 8);
+        x[j] = ccwide_ghash_run(h, x[j], lengths, 1);
+        _mm_storeu_si128((__m128i *) m[j].tag, _mm_xor_si128(_mm_loadu_si128((const __m128i *) mask[j]), ccwide_bswap128(x[j])));
+    }
+    memset(mask, 0, sizeof(mask));
+    memset(partIn, 0, sizeof(partIn));
+    memset(partOut, 0, sizeof(partOut));
+}
+
+bool ccaes_wide_gcm_crypt_batch(const struct ccmode_gcm *mode, const ccgcm_ctx *ctx, size_t n, ccgcm_batch_msg *msgs)
+{
+    __m128i k[CCWIDE_MAXROUNDS + 1];
+    ccwide_gcm_ctx c;
+    int group;
+
+    if(mode != &ccwide_gcm_encrypt && mode != &ccwide_gcm_decrypt) return false;
+    /* One copy of the key for the batch: the bulk runs and odd IVs work in it */
+    memcpy(&c, ctx, sizeof(c));
+    ccwide_load_keys((const uint8_t (*)[16]) c.rk, c.rounds, k);
+    for(; n; n -= group, msgs += group) {
+        group = (n < CCWIDE_LANES) ? (int) n: CCWIDE_LANES;
+        ccwide_gcm_batch_group(&c, k, group, msgs);
+    }
+    memset(&c, 0, sizeof(c));
+    memset(k, 0, sizeof(k));
+    return true;
+}
+
+#pragma mark Selection
+
+#if CC_WIDE_VAES
+/* The OS has to save the wide register state, not just the CPU support it */
+static inline uint64_t ccwide_xgetbv(void)
+{
+    uint32_t eax, edx;
+
+    __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return ((uint64_t) edx << 32) | eax;
+}
+#endif
+
+static bool ccwide_select(void)
+{
+    static dispatch_once_t init;
+    static bool available;
+
+    dispatch_once(&init, ^{
+        unsigned int eax, ebx, ecx, edx;
+
+        if(__get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_AES) && (ecx & bit_SSSE3)) {
+            ccwide_ctr_blocks = ccwide_ctr_aesni;
+            ccwide_xts_blocks = ccwide_xts_aesni;
+            ccwide_gcm_available = (ecx & bit_PCLMUL) != 0;
+            available = true;
+#if CC_WIDE_VAES
+            if((ecx & bit_OSXSAVE) && __get_cpuid_max(0, NULL) >= 7) {
+                uint64_t xcr0 = ccwide_xgetbv();
+
+                __cpuid_count(7, 0, eax, ebx, ecx, edx);
+                if((ecx & bit_VAES) && (ebx & bit_AVX512F) && (ebx & bit_AVX512BW) && (xcr0 & 0xe6) == 0xe6) {
+                    ccwide_ctr_blocks = ccwide_ctr_vaes512;
+                    ccwide_xts_blocks = ccwide_xts_vaes512;
+                } else if((ecx & bit_VAES) && (ebx & bit_AVX2) && (xcr0 & 0x6) == 0x6) {
+                    ccwide_ctr_blocks = ccwide_ctr_vaes256;
+                    ccwide_xts_blocks = ccwide_xts_vaes256;
+                }
+            }
+#endif
+        }
+    });
+    return available;
+}
+
+struct ccmode_ctr *ccaes_wide_ctr_crypt_mode(void)
+{
+    return (ccwide_select()) ? &ccwide_ctr_mode: NULL;
+}
+
+struct ccmode_xts *ccaes_wide_xts_encrypt_mode(void)
+{
+    return (ccwide_select()) ? &ccwide_xts_encrypt: NULL;
+}
+
+struct ccmode_xts *ccaes_wide_xts_decrypt_mode(void)
+{
+    return (ccwide_select()) ? &ccwide_xts_decrypt: NULL;
+}
+
+struct ccmode_gcm *ccaes_wide_gcm_encrypt_mode(void)
+{
+    return (ccwide_select() && ccwide_gcm_available) ? &ccwide_gcm_encrypt: NULL;
+}
+
+struct ccmode_gcm *ccaes_wide_gcm_decrypt_mode(void)
+{
+    return (ccwide_select() && ccwide_gcm_available) ? &ccwide_gcm_decrypt: NULL;
+}
+
+#endif /* x86 */
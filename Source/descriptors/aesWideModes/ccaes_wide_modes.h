@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) 2013 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+/*
+ *  ccaes_wide_modes.h
+ *  CommonCrypto
+ *
+ *  AES-CTR and AES-XTS modes that keep 8 or 16 blocks in flight - VAES on
+ *  512 or 256 bit lanes where the CPU has it, AES-NI 8 blocks wide
+ *  otherwise - and an AES-GCM that runs its CTR and GHASH in one pass.
+ *  They carry their own key schedule, so they plug in as corecrypto mode
+ *  objects.
+ */
+
+#ifndef _CCAES_WIDE_MODES_H_
+#define _CCAES_WIDE_MODES_H_
+
+#include <corecrypto/ccmode.h>
+#include <stdbool.h>
+
+/* One message of a GCM batch: all of it is run and the full tag returned */
+typedef struct ccgcm_batch_msg {
+    const void  *iv;
+    size_t      ivLen;
+    const void  *aad;
+    size_t      aadLen;
+    const void  *in;
+    size_t      len;
+    void        *out;
+    uint8_t     tag[16];    /* RETURNED */
+} ccgcm_batch_msg;
+
+#if defined (__x86_64__) || defined(__i386__)		// x86_64 or i386 architectures
+
+/* NULL if the CPU has no AES-NI */
+struct ccmode_ctr *ccaes_wide_ctr_crypt_mode(void);
+struct ccmode_xts *ccaes_wide_xts_encrypt_mode(void);
+struct ccmode_xts *ccaes_wide_xts_decrypt_mode(void);
+
+/* NULL if the CPU has no AES-NI or no PCLMULQDQ */
+struct ccmode_gcm *ccaes_wide_gcm_encrypt_mode(void);
+struct ccmode_gcm *ccaes_wide_gcm_decrypt_mode(void);
+
+/*
+ * Run nSectors consecutive sectors of sectorBlocks blocks each, tweaked
+ * with their sector numbers (little-endian) starting at sector.  Returns
+ * false, having done nothing, if mode isn't one of the wide XTS modes.
+ */
+bool ccaes_wide_xts_crypt_sectors(const struct ccmode_xts *mode, const ccxts_ctx *ctx, uint64_t sector, size_t sectorBlocks,
+                                  size_t nSectors, const void *in, void *out);
+
+/*
+ * Point ctx at counter block counter with its first skip keystream bytes
+ * used, without touching the key schedule.  Returns false, having done
+ * nothing, if mode isn't the wide CTR mode.
+ */
+bool ccaes_wide_ctr_seek(const struct ccmode_ctr *mode, ccctr_ctx *ctx, const void *counter, size_t skip);
+
+/*
+ * Run n messages under the key in ctx, which is left as it is - up to 8 at
+ * once, a block from each going through the cipher together.  Returns
+ * false, having done nothing, if mode isn't one of the wide GCM modes.
+ */
+bool ccaes_wide_gcm_crypt_batch(const struct ccmode_gcm *mode, const ccgcm_ctx *ctx, size_t n, ccgcm_batch_msg *msgs);
+
+/*
+ * A long run of GCM text split into chunks for separate threads.
+ * ccaes_wide_gcm_split_begin() finishes the IV and AAD and sets *head to
+ * the bytes to run normally before the next block boundary; it returns
+ * false if mode isn't one of the wide GCM modes or the tag's been taken.
+ * Each ccaes_wide_gcm_chunk() then runs nblocks blocks starting
+ * blockOffset blocks past that boundary, leaving ctx as it is, and
+ * returns the chunk's GHASH.  ccaes_wide_gcm_split_end() adds all nblocks
+ * to ctx given the hashes, in order, of nchunks chunks of chunkBlocks
+ * blocks - the last one taking what's left.
+ */
+bool ccaes_wide_gcm_split_begin(const struct ccmode_gcm *mode, ccgcm_ctx *ctx, size_t *head);
+void ccaes_wide_gcm_chunk(const ccgcm_ctx *ctx, size_t blockOffset, size_t nblocks, const void *in, void *out, void *hash);
+void ccaes_wide_gcm_split_end(ccgcm_ctx *ctx, size_t nblocks, size_t nchunks, size_t chunkBlocks, const uint8_t (*hashes)[16]);
+
+#endif /* x86 */
+#endif /* _CCAES_WIDE_MODES_H_ */
@@ -23,7 +23,19 @@
 
 #include "corecryptoSymmetricBridge.h"
 #include "ccMemory.h"
+#include "ccdebug.h"
+#include "CommonCryptor.h"
 #include <corecrypto/ccrc4.h>
+#include <corecrypto/ccmode_factory.h>
+#include "aesWideModes/ccaes_wide_modes.h"
+#include <dispatch/dispatch.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__i386__) || defined(__x86_64__)
+#include <cpuid.h>
+#elif defined(__arm__)
+#include <sys/sysctl.h>
+#endif
 
 static void *noMode(void) { return NULL; }
 
@@ -104,6 +116,196 @@ modeList ccmodeList[7][2] = {
 };
 
 
+#pragma mark CPU Dispatch
+
+/*
+ * Per-tier AES mode lists.  The portable tier and the modes corecrypto only
+ * ships generic versions of are built with the mode factories over the
+ * tier's ECB, so every mode of a tier runs on the same block function.
+ * The table is filled once per cipher/direction by getCipherMode().
+ */
+
+#define CC_MODE_GETTER(_name_, _type_, _obj_) \
+static struct _type_ *_name_(void) { return (struct _type_ *) (_obj_); }
+
+#define CC_FACTORY_MODE(_name_, _type_, _factory_, ...) \
+static struct _type_ _name_##_obj; \
+static __attribute__((unused)) struct _type_ *_name_(void) { _factory_(&_name_##_obj, __VA_ARGS__); return &_name_##_obj; }
+
+#define CC_FACTORY_MODES(_tier_, _ecbEncrypt_, _ecbDecrypt_) \
+CC_FACTORY_MODE(_tier_##_cbc_encrypt_mode, ccmode_cbc, ccmode_factory_cbc_encrypt, _ecbEncrypt_) \
+CC_FACTORY_MODE(_tier_##_cbc_decrypt_mode, ccmode_cbc, ccmode_factory_cbc_decrypt, _ecbDecrypt_) \
+CC_FACTORY_MODE(_tier_##_cfb_encrypt_mode, ccmode_cfb, ccmode_factory_cfb_encrypt, _ecbEncrypt_) \
+CC_FACTORY_MODE(_tier_##_cfb_decrypt_mode, ccmode_cfb, ccmode_factory_cfb_decrypt, _ecbEncrypt_) \
+CC_FACTORY_MODE(_tier_##_cfb8_encrypt_mode, ccmode_cfb8, ccmode_factory_cfb8_encrypt, _ecbEncrypt_) \
+CC_FACTORY_MODE(_tier_##_cfb8_decrypt_mode, ccmode_cfb8, ccmode_factory_cfb8_decrypt, _ecbEncrypt_) \
+CC_FACTORY_MODE(_tier_##_ctr_encrypt_mode, ccmode_ctr, ccmode_factory_ctr_crypt, _ecbEncrypt_) \
+CC_FACTORY_MODE(_tier_##_ctr_decrypt_mode, ccmode_ctr, ccmode_factory_ctr_crypt, _ecbEncrypt_) \
+CC_FACTORY_MODE(_tier_##_ofb_encrypt_mode, ccmode_ofb, ccmode_factory_ofb_crypt, _ecbEncrypt_) \
+CC_FACTORY_MODE(_tier_##_ofb_decrypt_mode, ccmode_ofb, ccmode_factory_ofb_crypt, _ecbEncrypt_) \
+CC_FACTORY_MODE(_tier_##_xts_encrypt_mode, ccmode_xts, ccmode_factory_xts_encrypt, _ecbEncrypt_, _ecbEncrypt_) \
+CC_FACTORY_MODE(_tier_##_xts_decrypt_mode, ccmode_xts, ccmode_factory_xts_decrypt, _ecbDecrypt_, _ecbEncrypt_) \
+CC_FACTORY_MODE(_tier_##_gcm_encrypt_mode, ccmode_gcm, ccmode_factory_gcm_encrypt, _ecbEncrypt_) \
+CC_FACTORY_MODE(_tier_##_gcm_decrypt_mode, ccmode_gcm, ccmode_factory_gcm_decrypt, _ecbEncrypt_)
+
+#define CC_TIER_LIST(_tier_) { \
+    { _tier_##_ecb_encrypt_mode, _tier_##_cbc_encrypt_mode, _tier_##_cfb_encrypt_mode, _tier_##_cfb8_encrypt_mode, _tier_##_ctr_encrypt_mode, _tier_##_ofb_encrypt_mode, _tier_##_xts_encrypt_mode, _tier_##_gcm_encrypt_mode }, \
+    { _tier_##_ecb_decrypt_mode, _tier_##_cbc_decrypt_mode, _tier_##_cfb_decrypt_mode, _tier_##_cfb8_decrypt_mode, _tier_##_ctr_decrypt_mode, _tier_##_ofb_decrypt_mode, _tier_##_xts_decrypt_mode, _tier_##_gcm_decrypt_mode } \
+}
+
+CC_MODE_GETTER(ccaes_portable_ecb_encrypt_mode, ccmode_ecb, &ccaes_ltc_ecb_encrypt_mode)
+CC_MODE_GETTER(ccaes_portable_ecb_decrypt_mode, ccmode_ecb, &ccaes_ltc_ecb_decrypt_mode)
+CC_FACTORY_MODES(ccaes_portable, &ccaes_ltc_ecb_encrypt_mode, &ccaes_ltc_ecb_decrypt_mode)
+
+#if CCAES_INTEL
+CC_MODE_GETTER(ccaes_vector_ecb_encrypt_mode, ccmode_ecb, &ccaes_intel_ecb_encrypt_opt_mode)
+CC_MODE_GETTER(ccaes_vector_ecb_decrypt_mode, ccmode_ecb, &ccaes_intel_ecb_decrypt_opt_mode)
+CC_MODE_GETTER(ccaes_vector_cbc_kernel_encrypt_mode, ccmode_cbc, &ccaes_intel_cbc_encrypt_opt_mode)
+CC_MODE_GETTER(ccaes_vector_cbc_kernel_decrypt_mode, ccmode_cbc, &ccaes_intel_cbc_decrypt_opt_mode)
+CC_MODE_GETTER(ccaes_vector_xts_kernel_encrypt_mode, ccmode_xts, &ccaes_intel_xts_encrypt_opt_mode)
+CC_MODE_GETTER(ccaes_vector_xts_kernel_decrypt_mode, ccmode_xts, &ccaes_intel_xts_decrypt_opt_mode)
+CC_FACTORY_MODES(ccaes_vector, &ccaes_intel_ecb_encrypt_opt_mode, &ccaes_intel_ecb_decrypt_opt_mode)
+
+CC_MODE_GETTER(ccaes_aesni_ecb_encrypt_mode, ccmode_ecb, &ccaes_intel_ecb_encrypt_aesni_mode)
+CC_MODE_GETTER(ccaes_aesni_ecb_decrypt_mode, ccmode_ecb, &ccaes_intel_ecb_decrypt_aesni_mode)
+CC_MODE_GETTER(ccaes_aesni_cbc_kernel_encrypt_mode, ccmode_cbc, &ccaes_intel_cbc_encrypt_aesni_mode)
+CC_MODE_GETTER(ccaes_aesni_cbc_kernel_decrypt_mode, ccmode_cbc, &ccaes_intel_cbc_decrypt_aesni_mode)
+CC_MODE_GETTER(ccaes_aesni_xts_kernel_encrypt_mode, ccmode_xts, &ccaes_intel_xts_encrypt_aesni_mode)
+CC_MODE_GETTER(ccaes_aesni_xts_kernel_decrypt_mode, ccmode_xts, &ccaes_intel_xts_decrypt_aesni_mode)
+CC_FACTORY_MODES(ccaes_aesni, &ccaes_intel_ecb_encrypt_aesni_mode, &ccaes_intel_ecb_decrypt_aesni_mode)
+
+/* The wide kernels keep 8-16 blocks in flight; they're NULL without AES-NI */
+static struct ccmode_ctr *ccaes_wide_ctr_mode(void)
+{
+    struct ccmode_ctr *wide = ccaes_wide_ctr_crypt_mode();
+    return (wide) ? wide: ccaes_aesni_ctr_encrypt_mode();
+}
+
+static struct ccmode_xts *ccaes_wide_xts_encrypt_or_kernel_mode(void)
+{
+    struct ccmode_xts *wide = ccaes_wide_xts_encrypt_mode();
+    return (wide) ? wide: ccaes_aesni_xts_kernel_encrypt_mode();
+}
+
+static struct ccmode_xts *ccaes_wide_xts_decrypt_or_kernel_mode(void)
+{
+    struct ccmode_xts *wide = ccaes_wide_xts_decrypt_mode();
+    return (wide) ? wide: ccaes_aesni_xts_kernel_decrypt_mode();
+}
+
+/* GCM with the CTR and GHASH passes stitched together; NULL without PCLMULQDQ */
+static struct ccmode_gcm *ccaes_wide_gcm_encrypt_or_default_mode(void)
+{
+    struct ccmode_gcm *wide = ccaes_wide_gcm_encrypt_mode();
+    return (wide) ? wide: ccaes_gcm_encrypt_mode();
+}
+
+static struct ccmode_gcm *ccaes_wide_gcm_decrypt_or_default_mode(void)
+{
+    struct ccmode_gcm *wide = ccaes_wide_gcm_decrypt_mode();
+    return (wide) ? wide: ccaes_gcm_decrypt_mode();
+}
+#elif CCAES_ARM
+CC_MODE_GETTER(ccaes_vector_ecb_encrypt_mode, ccmode_ecb, &ccaes_arm_ecb_encrypt_mode)
+CC_MODE_GETTER(ccaes_vector_ecb_decrypt_mode, ccmode_ecb, &ccaes_arm_ecb_decrypt_mode)
+CC_FACTORY_MODES(ccaes_vector, &ccaes_arm_ecb_encrypt_mode, &ccaes_arm_ecb_decrypt_mode)
+#endif
+
+static modeList ccaesTierList[CC_CPU_TIERS][2] = {
+    CC_TIER_LIST(ccaes_portable),
+#if CCAES_INTEL
+    /* corecrypto's own CBC and XTS kernels beat the factory versions; CTR and XTS go wide with AES-NI */
+    {
+        { ccaes_vector_ecb_encrypt_mode, ccaes_vector_cbc_kernel_encrypt_mode, ccaes_vector_cfb_encrypt_mode, ccaes_vector_cfb8_encrypt_mode, ccaes_vector_ctr_encrypt_mode, ccaes_vector_ofb_encrypt_mode, ccaes_vector_xts_kernel_encrypt_mode, ccaes_vector_gcm_encrypt_mode },
+        { ccaes_vector_ecb_decrypt_mode, ccaes_vector_cbc_kernel_decrypt_mode, ccaes_vector_cfb_decrypt_mode, ccaes_vector_cfb8_decrypt_mode, ccaes_vector_ctr_decrypt_mode, ccaes_vector_ofb_decrypt_mode, ccaes_vector_xts_kernel_decrypt_mode, ccaes_vector_gcm_decrypt_mode }
+    },
+    {
+        { ccaes_aesni_ecb_encrypt_mode, ccaes_aesni_cbc_kernel_encrypt_mode, ccaes_aesni_cfb_encrypt_mode, ccaes_aesni_cfb8_encrypt_mode, ccaes_wide_ctr_mode, ccaes_aesni_ofb_encrypt_mode, ccaes_wide_xts_encrypt_or_kernel_mode, ccaes_wide_gcm_encrypt_or_default_mode },
+        { ccaes_aesni_ecb_decrypt_mode, ccaes_aesni_cbc_kernel_decrypt_mode, ccaes_aesni_cfb_decrypt_mode, ccaes_aesni_cfb8_decrypt_mode, ccaes_wide_ctr_mode, ccaes_aesni_ofb_decrypt_mode, ccaes_wide_xts_decrypt_or_kernel_mode, ccaes_wide_gcm_decrypt_or_default_mode }
+    },
+#elif CCAES_ARM
+    CC_TIER_LIST(ccaes_vector),
+    /* corecrypto's defaults use the crypto extensions where the core has them */
+    {
+        { ccaes_ecb_encrypt_mode, ccaes_cbc_encrypt_mode, ccaes_cfb_encrypt_mode, ccaes_cfb8_encrypt_mode, ccaes_ctr_crypt_mode, ccaes_ofb_crypt_mode, ccaes_vector_xts_encrypt_mode, ccaes_gcm_encrypt_mode },
+        { ccaes_ecb_decrypt_mode, ccaes_cbc_decrypt_mode, ccaes_cfb_decrypt_mode, ccaes_cfb8_decrypt_mode, ccaes_ctr_crypt_mode, ccaes_ofb_crypt_mode, ccaes_vector_xts_decrypt_mode, ccaes_gcm_decrypt_mode }
+    },
+#endif
+};
+
+#if CCAES_INTEL
+#define CC_CPU_TIER_MAX ccCPUTierAES
+#elif CCAES_ARM
+#define CC_CPU_TIER_MAX ccCPUTierAES
+#else
+#define CC_CPU_TIER_MAX ccCPUTierPortable
+#endif
+
+static int ccCPUDetectTier(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+    unsigned int eax, ebx, ecx, edx;
+    
+    if(__get_cpuid(1, &eax, &ebx, &ecx, &edx) == 0) return ccCPUTierPortable;
+    if((ecx & bit_AES) && (ecx & bit_PCLMUL)) return ccCPUTierAES;
+    if(ecx & bit_SSSE3) return ccCPUTierVector;
+    return ccCPUTierPortable;
+#elif defined(__arm64__) || defined(__aarch64__)
+    return ccCPUTierAES;
+#elif defined(__arm__)
+    int neon = 0;
+    size_t len = sizeof(neon);
+    
+    if(sysctlbyname("hw.optional.neon", &neon, &len, NULL, 0) == 0 && neon) return ccCPUTierVector;
+    return ccCPUTierPortable;
+#else
+    return ccCPUTierPortable;
+#endif
+}
+
+static int ccCPUTierSelected;
+
+int ccCPUTier(void)
+{
+    static dispatch_once_t init;
+    
+    dispatch_once(&init, ^{
+        const char *forced = getenv("CC_CPU_TIER");
+        int tier = ccCPUDetectTier();
+        
+        if(forced) {
+            if(strcmp(forced, "portable") == 0) tier = ccCPUTierPortable;
+            else if(strcmp(forced, "vector") == 0 && tier >= ccCPUTierVector) tier = ccCPUTierVector;
+            else if(strcmp(forced, "aes") == 0 && tier >= ccCPUTierAES) tier = ccCPUTierAES;
+        }
+        if(tier > CC_CPU_TIER_MAX) tier = CC_CPU_TIER_MAX;
+        ccCPUTierSelected = tier;
+        CC_DEBUG_LOG(ASL_LEVEL_INFO, "AES implementation tier %d\n", tier);
+    });
+    return ccCPUTierSelected;
+}
+
+const modeList *ccmodeListSelect(uint32_t cipher, int direction)
+{
+    if(cipher == kCCAlgorithmAES128) return &ccaesTierList[ccCPUTier()][direction];
+    return &ccmodeList[cipher][direction];
+}
+
+struct ccmode_gcm *ccaes_gcmsiv_mode(int direction)
+{
+    static struct ccmode_gcmsiv siv[2];
+    static dispatch_once_t init;
+    
+    dispatch_once(&init, ^{
+        const struct ccmode_ecb *ecb = ccmodeListSelect(kCCAlgorithmAES128, kCCEncrypt)->ecb();
+        
+        ccmode_factory_gcmsiv_encrypt(&siv[kCCEncrypt], ecb);
+        ccmode_factory_gcmsiv_decrypt(&siv[kCCDecrypt], ecb);
+    });
+    return &siv[direction].gcm;
+}
+
+
 // Thunks
 //ECB
 
@@ -151,6 +353,20 @@ static void cccbc_mode_crypt(corecryptoMode modeObj, const void *in, void *out,
     modeObj.cbc->cbc(&ctx.cbc->cbc, ctx.cbc->iv, len / cccbc_mode_get_block_size(modeObj), in, out);
 }
 
+/*
+ * Runs the mode from the given IV, leaving the one in the context alone.  The
+ * key schedule is only read, so chunks of a CBC decryption can run this
+ * concurrently on one context.
+ */
+
+static void cccbc_mode_crypt_from_iv(corecryptoMode modeObj, const void *in, void *out, size_t len, const void *iv, modeCtx ctx)
+{
+    cccbc_iv_decl(cccbc_mode_get_block_size(modeObj), tmpiv);
+    CC_XMEMCPY(tmpiv, iv, cccbc_mode_get_block_size(modeObj));
+    modeObj.cbc->cbc(&ctx.cbc->cbc, tmpiv, len / cccbc_mode_get_block_size(modeObj), in, out);
+    CC_XZEROMEM(tmpiv, cccbc_mode_get_block_size(modeObj));
+}
+
 static int cccbc_getiv(corecryptoMode modeObj, void *iv, uint32_t *len, modeCtx ctx)
 {
     if(*len < cccbc_mode_get_block_size(modeObj)) {
@@ -178,6 +394,7 @@ cc2CCModeDescriptor cccbc_mode = {
     .mode_decrypt = cccbc_mode_crypt,
     .mode_encrypt_tweaked = NULL,
     .mode_decrypt_tweaked = NULL,
+    .mode_crypt_from_iv = cccbc_mode_crypt_from_iv,
     .mode_done = NULL,
     .mode_setiv = cccbc_setiv,
     .mode_getiv = cccbc_getiv
@@ -258,6 +475,27 @@ static void ccctr_mode_crypt(corecryptoMode modeObj, const void *in, void *out,
     modeObj.ctr->ctr(ctx.ctr, len / ccctr_mode_get_block_size(modeObj), in, out);
 }
 
+/*
+ * corecrypto's CTR contexts can't be given a new counter, so they're set up
+ * again at the counter block and run over the bytes of it already used.
+ * The wide AES mode takes the counter directly.
+ */
+
+static void ccctr_mode_seek(corecryptoMode modeObj, const void *key, size_t keylen, const void *counter, size_t skip, modeCtx ctx)
+{
+    uint8_t scratch[kCCBlockSizeAES128];   /* skip is less than a cipher block */
+
+#if defined (__x86_64__) || defined(__i386__)
+    if(ccaes_wide_ctr_seek(modeObj.ctr, ctx.ctr, counter, skip)) return;
+#endif
+    modeObj.ctr->init(modeObj.ctr, ctx.ctr, keylen, key, counter);
+    if(skip) {
+        CC_XZEROMEM(scratch, skip);
+        modeObj.ctr->ctr(ctx.ctr, skip / ccctr_mode_get_block_size(modeObj), scratch, scratch);
+        CC_XZEROMEM(scratch, skip);
+    }
+}
+
 cc2CCModeDescriptor ccctr_mode = {
     .mode_get_ctx_size = ccctr_mode_get_ctx_size,
     .mode_get_block_size = ccctr_mode_get_block_size,
@@ -266,6 +504,7 @@ cc2CCModeDescriptor ccctr_mode = {
     .mode_decrypt = ccctr_mode_crypt,
     .mode_encrypt_tweaked = NULL,
     .mode_decrypt_tweaked = NULL,
+    .mode_seek = ccctr_mode_seek,
     .mode_done = NULL,
     .mode_setiv = NULL,
     .mode_getiv = NULL
@@ -301,9 +540,9 @@ cc2CCModeDescriptor ccofb_mode = {
 };
 
 // XTS
-/* For now we always schedule both encrypt and decrypt contexts for AES-XTS.  Original CommonCrypto support
- * allowed a "both" (kCCEncrypt and kCCDecrypt) capability used for AES-XTS block I/O.  The initialization 
- * and correct mode objext and context passing are done at the CommonCryptor layer.
+/* Original CommonCrypto support allowed a "both" (kCCEncrypt and kCCDecrypt) capability used for AES-XTS
+ * block I/O.  The CommonCryptor layer schedules the direction asked for and expands the other one the first
+ * time a block I/O call needs it; the initialization and correct mode object and context passing are done there.
  */
 
 
@@ -359,6 +598,31 @@ static void ccxts_mode_decrypt_tweak(corecryptoMode modeObj, const void *in, voi
     ccpad_xts_decrypt(modeObj.xts, ctx.xts, tweak, len, in, out);
 }
 
+/*
+ * Whole sectors, so no ciphertext stealing and no pad routines.  The wide
+ * AES modes build eight sectors' tweaks at a time.
+ */
+
+static void ccxts_mode_crypt_sectors(corecryptoMode modeObj, uint64_t sector, size_t sectorSize, size_t nSectors,
+                                     const void *in, void *out, modeCtx ctx)
+{
+    size_t nblocks = sectorSize / ccxts_mode_get_block_size(modeObj);
+    const uint8_t *ip = in;
+    uint8_t *op = out;
+    uint8_t sectorTweak[16];
+    int i;
+    
+#if defined (__x86_64__) || defined(__i386__)
+    if(ccaes_wide_xts_crypt_sectors(modeObj.xts, ctx.xts, sector, nblocks, nSectors, in, out)) return;
+#endif
+    ccxts_tweak_decl(ccxts_context_size(modeObj.xts), tweak);
+    CC_XZEROMEM(sectorTweak, sizeof(sectorTweak));
+    for(; nSectors; nSectors--, sector++, ip += sectorSize, op += sectorSize) {
+        for(i = 0; i < 8; i++) sectorTweak[i] = (uint8_t) (sector >> (8 * i));
+        modeObj.xts->set_tweak(ctx.xts, tweak, sectorTweak);
+        modeObj.xts->xts(ctx.xts, tweak, nblocks, ip, op);
+    }
+}
 
 cc2CCModeDescriptor ccxts_mode = {
     .mode_get_ctx_size = ccxts_mode_get_ctx_size,
@@ -368,6 +632,7 @@ cc2CCModeDescriptor ccxts_mode = {
     .mode_decrypt = NULL,
     .mode_encrypt_tweaked = ccxts_mode_encrypt_tweak,
     .mode_decrypt_tweaked = ccxts_mode_decrypt_tweak,
+    .mode_crypt_sectors = ccxts_mode_crypt_sectors,
     .mode_done = NULL,
     .mode_setiv = NULL,
     .mode_getiv = NULL
@@ -395,6 +660,46 @@ static int ccgcm_setiv(corecryptoMode modeObj, const void *iv, uint32_t len, mod
     return 0;
 }
 
+static void ccgcm_mode_crypt_batch(corecryptoMode modeObj, size_t n, ccgcm_batch_msg *msgs, modeCtx ctx)
+{
+#if defined (__x86_64__) || defined(__i386__)
+    if(ccaes_wide_gcm_crypt_batch(modeObj.gcm, ctx.gcm, n, msgs)) return;
+#endif
+    ccgcm_ctx_decl(modeObj.gcm->size, msgCtx);
+    for(; n; n--, msgs++) {
+        CC_XMEMCPY(msgCtx, ctx.gcm, modeObj.gcm->size);
+        if(msgs->ivLen) modeObj.gcm->set_iv(msgCtx, msgs->ivLen, msgs->iv);
+        modeObj.gcm->gmac(msgCtx, msgs->aadLen, msgs->aad);
+        if(msgs->len) modeObj.gcm->gcm(msgCtx, msgs->len, msgs->in, msgs->out);
+        modeObj.gcm->finalize(msgCtx, sizeof(msgs->tag), msgs->tag);
+    }
+    CC_XZEROMEM(msgCtx, modeObj.gcm->size);
+}
+
+/* Chunks of a long run can go to separate threads; only the wide mode can split */
+
+static bool ccgcm_mode_split_begin(corecryptoMode modeObj, size_t *head, modeCtx ctx)
+{
+#if defined (__x86_64__) || defined(__i386__)
+    return ccaes_wide_gcm_split_begin(modeObj.gcm, ctx.gcm, head);
+#else
+    return false;
+#endif
+}
+
+static void ccgcm_mode_crypt_chunk(corecryptoMode modeObj, size_t blockOffset, size_t nblocks, const void *in, void *out, void *hash, modeCtx ctx)
+{
+#if defined (__x86_64__) || defined(__i386__)
+    ccaes_wide_gcm_chunk(ctx.gcm, blockOffset, nblocks, in, out, hash);
+#endif
+}
+
+static void ccgcm_mode_split_end(corecryptoMode modeObj, size_t nblocks, size_t nchunks, size_t chunkBlocks, const uint8_t (*hashes)[16], modeCtx ctx)
+{
+#if defined (__x86_64__) || defined(__i386__)
+    ccaes_wide_gcm_split_end(ctx.gcm, nblocks, nchunks, chunkBlocks, hashes);
+#endif
+}
 
 cc2CCModeDescriptor ccgcm_mode = {
     .mode_get_ctx_size = ccgcm_mode_get_ctx_size,
@@ -404,6 +709,10 @@ cc2CCModeDescriptor ccgcm_mode = {
     .mode_decrypt = ccgcm_mode_crypt,
     .mode_encrypt_tweaked = NULL,
     .mode_decrypt_tweaked = NULL,
+    .mode_crypt_batch = ccgcm_mode_crypt_batch,
+    .mode_split_begin = ccgcm_mode_split_begin,
+    .mode_crypt_chunk = ccgcm_mode_crypt_chunk,
+    .mode_split_end = ccgcm_mode_split_end,
     .mode_done = NULL,
     .mode_setiv = ccgcm_setiv,
     .mode_getiv = NULL
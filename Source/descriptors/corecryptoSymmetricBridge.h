@@ -33,6 +33,9 @@
 #include <corecrypto/ccrc2.h>
 #include <corecrypto/ccblowfish.h>
 #include <corecrypto/ccpad.h>
+#include "aeadModes/ccchacha20poly1305.h"
+#include "aeadModes/ccaes_gcmsiv.h"
+#include "aesWideModes/ccaes_wide_modes.h"
 
 typedef union {
     struct ccmode_ecb *ecb;
@@ -69,6 +72,25 @@ typedef struct modes_t {
 
 modeList ccmodeList[7][2];
 
+/*
+ * AES implementation tiers, best first.  The tier is picked from the CPU at
+ * first use; CC_CPU_TIER=portable|vector|aes in the environment forces one
+ * (falling back to what the CPU and this build actually have).
+ */
+
+enum {
+    ccCPUTierPortable   = 0,    /* plain C */
+    ccCPUTierVector     = 1,    /* SSE / NEON table based */
+    ccCPUTierAES        = 2,    /* AES-NI / ARMv8 crypto extensions */
+};
+#define CC_CPU_TIERS 3
+
+int ccCPUTier(void);
+const modeList *ccmodeListSelect(uint32_t cipher, int direction);
+
+/* AES-GCM-SIV over the selected tier's AES; the cipher tables only go as far as GCM */
+struct ccmode_gcm *ccaes_gcmsiv_mode(int direction);
+
 typedef struct cbc_with_iv_t {
     uint8_t iv[16];
     cccbc_ctx cbc;
@@ -143,6 +165,64 @@ typedef void (*ccmode_encrypt_tweaked_p)(corecryptoMode modeObj, const void *pt,
  */
 typedef void (*ccmode_decrypt_tweaked_p)(corecryptoMode modeObj, const void *ct, size_t len,
                                       void *pt, const void *tweak, modeCtx ctx);
+/** Run the mode over whole blocks from the given IV, leaving the one in the
+ context alone (CBC decryption currently, for parallel chunks)
+ @param in		The input
+ @param out		[out] The output
+ @param len		the length of data (in == out) octets
+ @param iv		The IV to start from
+ @param ctx		The mode context, only read
+ */
+typedef void (*ccmode_crypt_from_iv_p)(corecryptoMode modeObj, const void *in, void *out, size_t len,
+                                       const void *iv, modeCtx ctx);
+/** Encrypt or decrypt a run of consecutive sectors (XTS mode currently)
+ @param sector		The number of the first sector - each sector's tweak
+ is its number, little-endian
+ @param sectorSize	The length of each sector, a multiple of the block
+ size (octets)
+ @param nSectors	The number of sectors
+ @param in		The input
+ @param out		[out] The output
+ @param ctx		The mode context
+ */
+typedef void (*ccmode_crypt_sectors_p)(corecryptoMode modeObj, uint64_t sector, size_t sectorSize, size_t nSectors,
+                                       const void *in, void *out, modeCtx ctx);
+/** Reposition a stream mode (CTR mode currently) without generating the
+ keystream ahead of the new position
+ @param key		The raw key the context was set up with
+ @param keylen		The length of the key
+ @param counter		The counter block covering the new position
+ @param skip		The number of keystream bytes of that block already used
+ @param ctx		The mode context
+ */
+typedef void (*ccmode_seek_p)(corecryptoMode modeObj, const void *key, size_t keylen, const void *counter, size_t skip, modeCtx ctx);
+/** Run a batch of independent messages (GCM mode currently)
+ @param n		The number of messages
+ @param msgs		The messages, each given its tag
+ @param ctx		The keyed mode context, left as it is
+ */
+typedef void (*ccmode_crypt_batch_p)(corecryptoMode modeObj, size_t n, ccgcm_batch_msg *msgs, modeCtx ctx);
+/** Ready an authenticated stream (GCM mode currently) to be run in chunks
+ @param head		[out] The bytes to run normally before the chunks
+ @param ctx		The mode context
+ @return false if the mode can't be split
+ */
+typedef bool (*ccmode_split_begin_p)(corecryptoMode modeObj, size_t *head, modeCtx ctx);
+/** Run one chunk of whole blocks, leaving the context as it is
+ @param blockOffset	The chunk's first block, counted from the split
+ @param nblocks		The number of blocks
+ @param hash		[out] The chunk's hash, 16 bytes
+ @param ctx		The mode context
+ */
+typedef void (*ccmode_crypt_chunk_p)(corecryptoMode modeObj, size_t blockOffset, size_t nblocks, const void *in, void *out, void *hash, modeCtx ctx);
+/** Add the chunks to the context
+ @param nblocks		The blocks in all the chunks
+ @param nchunks		The number of chunks
+ @param chunkBlocks	The blocks in each chunk but the last
+ @param hashes		The chunks' hashes, in order
+ @param ctx		The mode context
+ */
+typedef void (*ccmode_split_end_p)(corecryptoMode modeObj, size_t nblocks, size_t nchunks, size_t chunkBlocks, const uint8_t (*hashes)[16], modeCtx ctx);
 /** Terminate the mode
  @param ctx		[out] The mode context
  */
@@ -181,6 +261,13 @@ typedef struct cc2CCModeDescriptor_t {
 	ccmode_decrypt_p        mode_decrypt;
 	ccmode_encrypt_tweaked_p mode_encrypt_tweaked;
 	ccmode_decrypt_tweaked_p mode_decrypt_tweaked;
+	ccmode_crypt_sectors_p  mode_crypt_sectors;
+	ccmode_crypt_from_iv_p  mode_crypt_from_iv;
+	ccmode_seek_p           mode_seek;
+	ccmode_crypt_batch_p    mode_crypt_batch;
+	ccmode_split_begin_p    mode_split_begin;
+	ccmode_crypt_chunk_p    mode_crypt_chunk;
+	ccmode_split_end_p      mode_split_end;
 	ccmode_done_p           mode_done;
 	ccmode_setiv_p          mode_setiv;
 	ccmode_getiv_p          mode_getiv;